@@ -13,7 +13,12 @@
 
 #include "EventManager.hpp"
 
-#include <string.h> // strtok
+#include "Analytics/Analytics.hpp"
+
+#include "API/EventStream.hpp"
+
+#include <string.h> // strtok, strstr
+#include <stdlib.h> // strtoull
 
 #ifndef PLATFORM_WINDOWS
 #include <sys/socket.h>
@@ -24,6 +29,14 @@
 /*
 	tavo-serverio-ip:portas/arm?camid=[cameraID]
 	tavo-serverio-ip:portas/arm?siteid=[siteID]
+	tavo-serverio-ip:portas/analytics/stats
+	tavo-serverio-ip:portas/events
+	tavo-serverio-ip:portas/events?camid=[cameraID]
+	tavo-serverio-ip:portas/log/level
+	tavo-serverio-ip:portas/log/level?channel=[channel]&level=[level]
+	tavo-serverio-ip:portas/trace
+	tavo-serverio-ip:portas/metrics
+	tavo-serverio-ip:portas/latency
 */
 
 APIServer::APIServer(Main& rApp)
@@ -101,6 +114,8 @@ void APIServer::Update()
 	// Should be enough for reading a single HTTP header. 
 	static char readBuffer[1024];
 
+	const char* pLastEventIdHeader = "Last-Event-ID:";
+
 	for (size_t i = 0; i < numClients; ++i)
 	{
 		auto& rSocketId = mClientSockets.at(i);
@@ -109,15 +124,52 @@ void APIServer::Update()
 		if (rSocketId == INVALID_SOCKET)
 			continue;
 
-		
+		// Response is written without blocking, the client is released once it's sent. (See "SendResponse")
+		if (mClientIsResponding.at(i))
+		{
+			if (!FlushClient(static_cast<APIClientId>(i), currentTP))
+				continue;
+
+			if (mClientSendBuffers.at(i).empty())
+				ReleaseClient(static_cast<APIClientId>(i));
+			else if (std::chrono::duration_cast<std::chrono::seconds>(currentTP - mClientTimePoints.at(i)).count() > ClientTimeout)
+			{
+				LOG_WARNING(Log::Channel::API, "Client (id: %zu) is not reading the response, disconnecting. (Unsent: %zu bytes)", i, mClientSendBuffers.at(i).size());
+				ReleaseClient(static_cast<APIClientId>(i));
+			}
+
+			continue;
+		}
+
+		// Subscribers don't send anything after the request, the read only tells if the connection was closed.
+		if (mClientIsSubscribed.at(i))
+		{
+			const auto bytesReaded = recv(rSocketId, readBuffer, sizeof(readBuffer), 0);
+
+			if (bytesReaded == 0 || (bytesReaded == SOCKET_ERROR && Socket::GetErrorCode() != EAGAIN && Socket::GetErrorCode() != EWOULDBLOCK))
+			{
+				LOG_MESSAGE(Log::Channel::API, "Event stream subscriber (id: %zu) disconnected.", i);
+				ReleaseClient(static_cast<APIClientId>(i));
+			}
+
+			continue;
+		}
 
 		//=============================================
 		// Handle reads.
 		{
-			auto bytesReaded = recv(rSocketId, readBuffer, sizeof(readBuffer), 0/*MSG_PEEK*/);
+			auto bytesReaded = recv(rSocketId, readBuffer, sizeof(readBuffer) - 1, 0/*MSG_PEEK*/);
 
 			if (bytesReaded > 0)
 			{
+				readBuffer[bytesReaded] = '\0';
+
+				// Reconnected event stream subscriber. (Before the "strtok" splits the header)
+				U64 lastEventId = 0;
+
+				if (const char* pLastEventId = strstr(readBuffer, pLastEventIdHeader))
+					lastEventId = strtoull(pLastEventId + strlen(pLastEventIdHeader), nullptr, 10);
+
 //				{
 //					std::fstream file("APIrequest.raw", std::ios::out | std::fstream::binary);
 //					file.write(readBuffer, bytesReaded);
@@ -151,7 +203,7 @@ void APIServer::Update()
 						if (pos != String::npos)
 							cgi = cgi.substr(0, pos + 1);
 
-						HandleCGI(static_cast<APIClientId>(i), cgi);
+						HandleCGI(static_cast<APIClientId>(i), cgi, lastEventId);
 						break;
 					}
 				}
@@ -162,6 +214,10 @@ void APIServer::Update()
 			}
 		}
 
+		// Client became the subscriber, is being responded (or was closed) by its request.
+		if (rSocketId == INVALID_SOCKET || mClientIsSubscribed.at(i) || mClientIsResponding.at(i))
+			continue;
+
 		//=============================================
 		// Handle timeouts.
 		const auto& clientTP = mClientTimePoints.at(i);
@@ -172,12 +228,12 @@ void APIServer::Update()
 		{
 			LOG_WARNING(Log::Channel::API, "Client timeout. (size: %d)", numClients);
 
-			Socket::Close(rSocketId);
-
 			// Allow slot to be re-used.
-			mClientReleasedIds.push_back(static_cast<APIClientId>(i));
+			ReleaseClient(static_cast<APIClientId>(i));
 		}
 	}
+
+	HandleSubscribers(currentTP);
 }
 
 void APIServer::HandleNewConnection()
@@ -206,9 +262,15 @@ void APIServer::HandleNewConnection()
 // SAMPLE: 
 // "/arm?camid=4"
 // "/arm?camid=4&camid=7&siteid=12" (Support for multiple cameras and sites)
-void APIServer::HandleCGI(APIClientId clientId, const String& rCGI)
+void APIServer::HandleCGI(APIClientId clientId, const String& rCGI, U64 lastEventId)
 {
-	if (rCGI.find("/arm?") != String::npos)
+	if (rCGI.compare(0, 7, "/events") == 0)
+	{
+		// Connection is kept open.
+		if (HandleCGI_Subscribe(clientId, rCGI, lastEventId))
+			return;
+	}
+	else if (rCGI.find("/arm?") != String::npos)
 	{
 		HandleCGI_ArmState(rCGI.substr(5), true); // Get rid of "/arm?".
 	}
@@ -216,12 +278,35 @@ void APIServer::HandleCGI(APIClientId clientId, const String& rCGI)
 	{
 		HandleCGI_ArmState(rCGI.substr(8), false); // Get rid of "/arm?".
 	}
+	else if (rCGI.find("/analytics/stats") != String::npos)
+	{
+		HandleCGI_AnalyticsStats(clientId);
+	}
+	else if (rCGI.compare(0, 10, "/log/level") == 0)
+	{
+		HandleCGI_LogLevel(clientId, rCGI);
+	}
+	else if (rCGI.compare(0, 6, "/trace") == 0)
+	{
+		HandleCGI_Trace(clientId);
+	}
+	else if (rCGI.compare(0, 8, "/metrics") == 0)
+	{
+		SendResponse(clientId, "text/plain; version=0.0.4", gMetrics.Format());
+	}
+	else if (rCGI.compare(0, 8, "/latency") == 0)
+	{
+		// Footage pipeline stages, from the STOR until the user notification. (See "FootageLatency")
+		SendResponse(clientId, "application/json", gFootageLatency.FormatJSON());
+	}
 	else
 	{
 		LOG_WARNING(Log::Channel::API, "Received the unknown CGI request: \"%s\"!", rCGI.c_str());
 	}
 
-	Socket::Close(mClientSockets.at(clientId));
+	// NOTE: Response that is still being sent releases the client later. (See "Update")
+	if (mClientSockets.at(clientId) != INVALID_SOCKET && mClientSendBuffers.at(clientId).empty())
+		ReleaseClient(clientId);
 }
 
 void APIServer::HandleCGI_ArmState(const String& rCGI, bool isArmed)
@@ -285,6 +370,268 @@ void APIServer::HandleCGI_ArmState(const String& rCGI, bool isArmed)
 	}
 }
 
+// Analytics scheduler per-camera queue-wait histograms. (See "Analytics::GetSchedulerStats")
+void APIServer::HandleCGI_AnalyticsStats(APIClientId clientId)
+{
+	if (!mMain.AnalyticsPtr)
+	{
+		LOG_WARNING(Log::Channel::API, "Analytics stats requested, but Analytics is not running!");
+		return;
+	}
+
+	SendResponse(clientId, "application/json", mMain.AnalyticsPtr->GetSchedulerStats());
+}
+
+// Changes the log levels, responds with the current ones.
+// SAMPLE: "/log/level", "/log/level?level=info", "/log/level?channel=ftp&level=debug"
+void APIServer::HandleCGI_LogLevel(APIClientId clientId, const String& rCGI)
+{
+	String channelName;
+	String levelName;
+
+	const auto pos = rCGI.find('?');
+
+	if (pos != String::npos)
+	{
+		// NOTE: CGI ends with the space.
+		std::stringstream ss(rCGI.substr(pos + 1, rCGI.find(' ', pos) - pos - 1));
+		std::string token;
+
+		while (std::getline(ss, token, '&'))
+		{
+			if (token.compare(0, 8, "channel=") == 0)
+				channelName = token.substr(8);
+			else if (token.compare(0, 6, "level=") == 0)
+				levelName = token.substr(6);
+		}
+	}
+
+	if (!levelName.empty())
+	{
+		Log::Level level;
+		Log::Channel channel;
+
+		if (!Log::ParseLevel(levelName, level))
+		{
+			LOG_ERROR(Log::Channel::API, "Invalid log level: \"%s\"", levelName.c_str());
+		}
+		else if (channelName.empty())
+		{
+			LOG_MESSAGE(Log::Channel::API, "Log level of all the channels: %s", levelName.c_str());
+
+			gpLog->SetLevel(level);
+		}
+		else if (!Log::ParseChannel(channelName, channel))
+		{
+			LOG_ERROR(Log::Channel::API, "Invalid log channel: \"%s\"", channelName.c_str());
+		}
+		else
+		{
+			LOG_MESSAGE(Log::Channel::API, "Log level of the \"%s\" channel: %s", channelName.c_str(), levelName.c_str());
+
+			gpLog->SetLevel(channel, level);
+		}
+	}
+
+	// SAMPLE: {"main":"info","db":"info","api":"info","ftp":"debug",...}
+	std::ostringstream ss;
+
+	ss << '{';
+
+	for (size_t i = 0; i < Log::NumChannels; ++i)
+	{
+		const auto channel = static_cast<Log::Channel> (i);
+
+		if (i != 0)
+			ss << ',';
+
+		ss << '"' << Log::GetChannelName(channel) << "\":\"" << Log::GetLevelName(gpLog->GetLevel(channel)) << '"';
+	}
+
+	ss << '}';
+
+	SendResponse(clientId, "application/json", ss.str());
+}
+
+// Flight recorder dump, as it is. (See "Tools/TraceDecoder")
+void APIServer::HandleCGI_Trace(APIClientId clientId)
+{
+	if (!mMain.FlightRecorderPtr)
+	{
+		LOG_WARNING(Log::Channel::API, "Flight recorder dump requested, but it's not recording!");
+		return;
+	}
+
+	String dump;
+
+	mMain.FlightRecorderPtr->Dump(dump);
+
+	LOG_MESSAGE(Log::Channel::API, "Flight recorder dump. (%zu bytes)", dump.size());
+
+	SendResponse(clientId, "application/octet-stream", dump);
+}
+
+// Server-Sent Events stream of the "EventStream" records. Only the new records are sent,
+// unless the reconnected client tells the last one it got. ("Last-Event-ID" header)
+// SAMPLE: "/events", "/events?camid=4"
+bool APIServer::HandleCGI_Subscribe(APIClientId clientId, const String& rCGI, U64 lastEventId)
+{
+	if (!mMain.EventStreamPtr)
+	{
+		LOG_WARNING(Log::Channel::API, "Event stream requested, but it's not running!");
+		return false;
+	}
+
+	if (mNumSubscribers >= MaxSubscribers)
+	{
+		LOG_WARNING(Log::Channel::API, "Event stream has too many subscribers! (%u)", mNumSubscribers);
+		return false;
+	}
+
+	U32 cameraId = 0;
+
+	const auto pos = rCGI.find("camid=");
+
+	if (pos != String::npos && !Utils::StringTo(rCGI.c_str() + pos + 6, cameraId))
+	{
+		LOG_ERROR(Log::Channel::API, "Failed to get the camera id: %s", rCGI.c_str());
+		return false;
+	}
+
+	LOG_MESSAGE(Log::Channel::API, "Event stream subscriber (id: %u, camera: %u, last event id: %" PRIu64 ")", clientId, cameraId, lastEventId);
+
+	mClientIsSubscribed.at(clientId) = true;
+	mClientCameraFilters.at(clientId) = cameraId;
+	// NOTE: Ids start from 1 again after the restart, the client's id is not valid then.
+	const U64 lastRecordId = mMain.EventStreamPtr->GetLastId();
+
+	mClientLastRecordIds.at(clientId) = (lastEventId != 0 && lastEventId <= lastRecordId) ? lastEventId : lastRecordId;
+
+	// "retry" - reconnect delay of the browser's "EventSource", in milliseconds.
+	mClientSendBuffers.at(clientId) =
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Type: text/event-stream\r\n"
+		"Cache-Control: no-cache\r\n"
+		"Connection: keep-alive\r\n"
+		"Access-Control-Allow-Origin: *\r\n"
+		"\r\n"
+		"retry: 3000\n\n";
+
+	mNumSubscribers++;
+
+	FlushClient(clientId, std::chrono::steady_clock::now());
+
+	return true;
+}
+
+// New records are appended to every subscriber's send buffer, the buffers are written without blocking.
+void APIServer::HandleSubscribers(const TimePoint& rCurrentTP)
+{
+	if (mNumSubscribers == 0)
+		return;
+
+	U64 minLastId = U64_MAX;
+
+	for (size_t i = 0; i < mClientSockets.size(); ++i)
+	{
+		if (mClientIsSubscribed.at(i))
+			minLastId = std::min(minLastId, mClientLastRecordIds.at(i));
+	}
+
+	Vector<EventStream::RecordPtr> records;
+
+	mMain.EventStreamPtr->GetRecords(minLastId, records);
+
+	for (size_t i = 0; i < mClientSockets.size(); ++i)
+	{
+		if (!mClientIsSubscribed.at(i))
+			continue;
+
+		auto& rBuffer = mClientSendBuffers.at(i);
+		auto& rLastId = mClientLastRecordIds.at(i);
+
+		const U32 cameraId = mClientCameraFilters.at(i);
+
+		for (const auto& rRecordPtr : records)
+		{
+			if (rRecordPtr->id <= rLastId)
+				continue;
+
+			if (cameraId == 0 || rRecordPtr->cameraId == 0 || rRecordPtr->cameraId == cameraId)
+				rBuffer += rRecordPtr->text;
+
+			rLastId = rRecordPtr->id;
+		}
+
+		if (rBuffer.empty() && std::chrono::duration_cast<std::chrono::seconds>(rCurrentTP - mClientTimePoints.at(i)).count() >= SubscriberHeartbeatSec)
+			rBuffer = ": ping\n\n";
+
+		if (!FlushClient(static_cast<APIClientId>(i), rCurrentTP))
+			continue;
+
+		if (rBuffer.size() > MaxSubscriberBuffer)
+		{
+			LOG_WARNING(Log::Channel::API, "Event stream subscriber (id: %zu) is too slow, disconnecting. (Unsent: %zu bytes)", i, rBuffer.size());
+			ReleaseClient(static_cast<APIClientId>(i));
+		}
+	}
+}
+
+// Writes the send buffer (of the subscriber or the response) without blocking. Returns false if the client was released.
+bool APIServer::FlushClient(APIClientId clientId, const TimePoint& rCurrentTP)
+{
+	auto& rBuffer = mClientSendBuffers.at(clientId);
+
+	if (rBuffer.empty())
+		return true;
+
+	// MSG_NOSIGNAL - Requests not to send SIGPIPE on errors on stream oriented sockets when the other end breaks the connection.
+	const ssize_t bytesSent = send(mClientSockets.at(clientId), rBuffer.data(), rBuffer.size(), MSG_NOSIGNAL);
+
+	if (bytesSent == SOCKET_ERROR)
+	{
+		const int errorCode = Socket::GetErrorCode();
+
+		if (errorCode == EAGAIN || errorCode == EWOULDBLOCK)
+			return true;
+
+		LOG_MESSAGE(Log::Channel::API, "Client (id: %u) disconnected. (Error: %s, Code: %d)", clientId, Socket::GetErrorString(errorCode), errorCode);
+		ReleaseClient(clientId);
+		return false;
+	}
+
+	rBuffer.erase(0, static_cast<size_t> (bytesSent));
+
+	mClientTimePoints.at(clientId) = rCurrentTP;
+
+	return true;
+}
+
+// Response is queued, what doesn't fit into the socket's buffer right away is sent by the "Update".
+// (Responses might be large, i.e. the "/trace" dump, the client that doesn't read must not block the main loop)
+void APIServer::SendResponse(APIClientId clientId, const char* pContentType, const String& rContent)
+{
+	std::ostringstream ss;
+
+	ss	<< "HTTP/1.1 200 OK\r\n"
+		<< "Content-Type: "		<< pContentType << "\r\n"
+		<< "Content-Length: "	<< rContent.size() << "\r\n"
+		<< "Connection: close\r\n"
+		<< "\r\n";
+
+	auto& rBuffer = mClientSendBuffers.at(clientId);
+
+	rBuffer = ss.str();
+	rBuffer += rContent;
+
+	const auto currentTP = std::chrono::steady_clock::now();
+
+	mClientIsResponding.at(clientId) = true;
+	mClientTimePoints.at(clientId) = currentTP;
+
+	FlushClient(clientId, currentTP);
+}
+
 void APIServer::HandleCameraArmState(U32 cameraId, bool isArmed)
 {
 	String hashKey;
@@ -328,6 +675,11 @@ APIClientId APIServer::AddClient(SocketId socketId)
 
 			mClientSockets.resize(newSize);
 			mClientTimePoints.resize(newSize);
+			mClientIsSubscribed.resize(newSize);
+			mClientCameraFilters.resize(newSize);
+			mClientLastRecordIds.resize(newSize);
+			mClientSendBuffers.resize(newSize);
+			mClientIsResponding.resize(newSize);
 		}
 	}
 	else
@@ -338,10 +690,29 @@ APIClientId APIServer::AddClient(SocketId socketId)
 
 	mClientSockets.at(id) = socketId;
 	mClientTimePoints.at(id) = std::chrono::steady_clock::now();
+	mClientIsSubscribed.at(id) = false;
+	mClientSendBuffers.at(id).clear();
+	mClientIsResponding.at(id) = false;
 
 	return id;
 }
 
+void APIServer::ReleaseClient(APIClientId clientId)
+{
+	Socket::Close(mClientSockets.at(clientId));
+
+	if (mClientIsSubscribed.at(clientId))
+	{
+		mClientIsSubscribed.at(clientId) = false;
+		mNumSubscribers--;
+	}
+
+	mClientSendBuffers.at(clientId).clear();
+	mClientIsResponding.at(clientId) = false;
+
+	mClientReleasedIds.push_back(clientId);
+}
+
 bool APIServer::GetDatabaseFTPCamerasArmStatesBySite(U32 siteId, Vector<U32>& rList)
 {
 	using namespace Database::Table;
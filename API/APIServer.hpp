@@ -21,10 +21,20 @@ private:
 //	void HandleRead();
 //	void HandleTimeouts();
 
-	void HandleCGI(APIClientId clientId, const String& rCGI);
+	void HandleCGI(APIClientId clientId, const String& rCGI, U64 lastEventId);
 	void HandleCGI_ArmState(const String& rCGI, bool isArmed);
+	void HandleCGI_AnalyticsStats(APIClientId clientId);
+	void HandleCGI_LogLevel(APIClientId clientId, const String& rCGI);
+	void HandleCGI_Trace(APIClientId clientId);
+	bool HandleCGI_Subscribe(APIClientId clientId, const String& rCGI, U64 lastEventId);
+
+	void HandleSubscribers(const TimePoint& rCurrentTP);
+	bool FlushClient(APIClientId clientId, const TimePoint& rCurrentTP);
+
+	void SendResponse(APIClientId clientId, const char* pContentType, const String& rContent);
 
 	APIClientId AddClient(SocketId socketId);
+	void ReleaseClient(APIClientId clientId);
 
 	void HandleCameraArmState(U32 cameraId, bool isArmed);
 
@@ -37,6 +47,11 @@ private:
 
 	static constexpr U32 ClientTimeout = 10; // In seconds.
 
+	// Event stream subscribers. (See "EventStream")
+	static constexpr U32 MaxSubscribers = 64;
+	static constexpr U32 SubscriberHeartbeatSec = 15;				// Comment line, so the dead connections are noticed.
+	static constexpr size_t MaxSubscriberBuffer = 1 << 20;		// Unsent data of the slow subscriber, it's dropped after that.
+
 	Main&		mMain;
 
 	SocketId	mServerSocket = INVALID_SOCKET;
@@ -46,5 +61,16 @@ private:
 	Vector<APIClientId>	mClientReleasedIds;
 
 	Vector<SocketId>	mClientSockets;
-	Vector<TimePoint>	mClientTimePoints;
+	Vector<TimePoint>	mClientTimePoints; // Subscribers and the responses: last write.
+
+	// Event stream subscribers.
+	Vector<bool>		mClientIsSubscribed;
+	Vector<U32>			mClientCameraFilters; // 0 - all cameras.
+	Vector<U64>			mClientLastRecordIds;
+	Vector<String>		mClientSendBuffers; // Subscribers and the responses.
+
+	// Response is being sent, the client is released once it's done. (See "SendResponse")
+	Vector<bool>		mClientIsResponding;
+
+	U32					mNumSubscribers = 0;
 };
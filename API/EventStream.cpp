@@ -0,0 +1,189 @@
+#include "PCH.hpp"
+
+#include "Main.hpp"
+#include "Utils.hpp"
+
+#include "Database/Database.hpp"
+
+#include "API/EventStream.hpp"
+
+// Sample:
+// "id: 17\nevent: detection\ndata: {"eventId":12,"eventFootageId":345,...}\n\n"
+
+static String EscapeJSON(const String& rText)
+{
+	String result;
+	result.reserve(rText.size());
+
+	for (const char c : rText)
+	{
+		switch (c)
+		{
+			case '"':	result += "\\\"";	break;
+			case '\\':	result += "\\\\";	break;
+			case '\n':	result += "\\n";	break;
+			case '\r':	result += "\\r";	break;
+			case '\t':	result += "\\t";	break;
+
+			default:
+				if (static_cast<U8> (c) < 0x20)
+				{
+					char code[8];
+					snprintf(code, sizeof(code), "\\u%04x", static_cast<U8> (c));
+					result += code;
+				}
+				else
+					result += c;
+				break;
+		}
+	}
+
+	return result;
+}
+
+EventStream::EventStream(U32 historySize)
+	: mHistorySize(historySize ? historySize : 1)
+{ }
+
+void EventStream::PublishEventStart(EventId eventId, U32 cameraId)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mEventCameras[eventId] = cameraId;
+	}
+
+	std::ostringstream ss;
+
+	ss	<< "{\"eventId\":"	<< eventId
+		<< ",\"cameraId\":"	<< cameraId
+		<< ",\"time\":\""	<< Utils::StringFromLocaltime(true, true, true) << "\"}";
+
+	Publish("event_start", cameraId, ss.str());
+}
+
+void EventStream::PublishEventEnd(EventId eventId)
+{
+	U32 cameraId = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		auto it = mEventCameras.find(eventId);
+
+		if (it != mEventCameras.end())
+		{
+			cameraId = it->second;
+			mEventCameras.erase(it);
+		}
+	}
+
+	std::ostringstream ss;
+
+	ss	<< "{\"eventId\":"	<< eventId
+		<< ",\"cameraId\":"	<< cameraId
+		<< ",\"time\":\""	<< Utils::StringFromLocaltime(true, true, true) << "\"}";
+
+	Publish("event_end", cameraId, ss.str());
+}
+
+void EventStream::PublishFootage(EventId eventId, EventFootageId eventFootageId, const String& rName, const String& rTimestampStr, U16 timestampMs)
+{
+	const U32 cameraId = GetEventCameraId(eventId);
+
+	std::ostringstream ss;
+
+	ss	<< "{\"eventId\":"			<< eventId
+		<< ",\"eventFootageId\":"	<< eventFootageId
+		<< ",\"cameraId\":"			<< cameraId
+		<< ",\"name\":\""			<< EscapeJSON(rName)
+		<< "\",\"timestamp\":\""	<< EscapeJSON(rTimestampStr)
+		<< "\",\"ms\":"				<< timestampMs << '}';
+
+	Publish("footage", cameraId, ss.str());
+}
+
+void EventStream::PublishDetections(EventId eventId, EventFootageId eventFootageId, U32 cameraId, bool isNotified, const Vector<Analytics::Detection>& rDetections)
+{
+	std::ostringstream ss;
+
+	ss	<< "{\"eventId\":"			<< eventId
+		<< ",\"eventFootageId\":"	<< eventFootageId
+		<< ",\"cameraId\":"			<< cameraId
+		<< ",\"isNotified\":"		<< (isNotified ? "true" : "false")
+		<< ",\"objects\":[";
+
+	for (size_t i = 0; i < rDetections.size(); ++i)
+	{
+		const auto& rDetection = rDetections[i];
+
+		if (i != 0)
+			ss << ',';
+
+		ss	<< "{\"name\":\""			<< EscapeJSON(rDetection.name)
+			<< "\",\"probability\":"	<< rDetection.probability
+			<< ",\"x\":"				<< rDetection.x
+			<< ",\"y\":"				<< rDetection.y
+			<< ",\"width\":"			<< rDetection.width
+			<< ",\"height\":"			<< rDetection.height << '}';
+	}
+
+	ss << "]}";
+
+	Publish("detection", cameraId, ss.str());
+}
+
+void EventStream::Publish(const char* pType, U32 cameraId, const String& rJSON)
+{
+	auto recordPtr = std::make_shared<Record>();
+
+	recordPtr->cameraId = cameraId;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	recordPtr->id = ++mLastId;
+
+	{
+		std::ostringstream ss;
+
+		ss	<< "id: "		<< recordPtr->id
+			<< "\nevent: "	<< pType
+			<< "\ndata: "	<< rJSON << "\n\n";
+
+		recordPtr->text = ss.str();
+	}
+
+	mRecords.emplace_back(std::move(recordPtr));
+
+	if (mRecords.size() > mHistorySize)
+		mRecords.pop_front();
+}
+
+void EventStream::GetRecords(U64 lastId, Vector<RecordPtr>& rRecords) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	if (mRecords.empty() || mRecords.back()->id <= lastId)
+		return;
+
+	// Ids are consecutive, so the first wanted record is found right away.
+	const U64 firstId = mRecords.front()->id;
+	const size_t first = (lastId >= firstId) ? static_cast<size_t> (lastId - firstId + 1) : 0;
+
+	rRecords.insert(rRecords.end(), mRecords.begin() + first, mRecords.end());
+}
+
+U64 EventStream::GetLastId() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	return mLastId;
+}
+
+U32 EventStream::GetEventCameraId(EventId eventId) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto it = mEventCameras.find(eventId);
+
+	return (it != mEventCameras.end()) ? it->second : 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Analytics/Analytics.hpp"
+
+// Event start/end, footage and detection records pushed to the API subscribers as they are produced. (See "APIServer", "/events")
+// Records are kept in memory (the last "historySize" of them), so the reconnected subscriber gets the ones it missed. ("Last-Event-ID")
+// THREAD: Publish - any thread. (Detections are published by the pool workers)
+class EventStream
+{
+public:
+	// Complete Server-Sent Events message.
+	struct Record
+	{
+		U64		id = 0;
+		U32		cameraId = 0; // 0 - not known.
+		String	text;
+	};
+
+	using RecordPtr = std::shared_ptr<const Record>;
+
+	explicit EventStream(U32 historySize);
+
+	void PublishEventStart(EventId eventId, U32 cameraId);
+	void PublishEventEnd(EventId eventId);
+	void PublishFootage(EventId eventId, EventFootageId eventFootageId, const String& rName, const String& rTimestampStr, U16 timestampMs);
+	void PublishDetections(EventId eventId, EventFootageId eventFootageId, U32 cameraId, bool isNotified, const Vector<Analytics::Detection>& rDetections);
+
+	// Records published after the "lastId". (All the kept ones, if the "lastId" is too old)
+	void GetRecords(U64 lastId, Vector<RecordPtr>& rRecords) const;
+
+	U64 GetLastId() const;
+
+private:
+
+	void Publish(const char* pType, U32 cameraId, const String& rJSON);
+
+	U32 GetEventCameraId(EventId eventId) const;
+
+	const U32 mHistorySize;
+
+	mutable std::mutex	mMutex;
+
+	std::deque<RecordPtr>	mRecords;
+	U64						mLastId = 0;
+
+	// Footage and the event end records don't know the camera. (Filled by the event start)
+	UnorderedMap<EventId, U32> mEventCameras;
+};
@@ -0,0 +1,216 @@
+#include "PCH.hpp"
+
+#include "AVIDemuxer.hpp"
+
+#include <string.h> // memcpy
+
+/*
+	RIFF file is a tree of chunks: id (4 bytes), data size (4 bytes, little endian), data (padded to the even size).
+	"RIFF" and "LIST" chunks hold the other chunks, their data starts with the list type.
+
+	RIFF "AVI "
+		LIST "hdrl"
+			"avih"				Main header. (Microseconds per frame, ...)
+			LIST "strl"			One per stream.
+				"strh"			Stream header. (Type: "vids", "auds", ...)
+				"strf"
+		LIST "movi"
+			"00dc"				Frames, the first two characters are the stream number.
+			"01wb"				("dc" - compressed video, "db" - uncompressed video, "wb" - audio)
+			LIST "rec "			(Optional grouping of the frames)
+		"idx1"					Index, not needed when the file is read sequentially.
+	RIFF "AVIX"					(OpenDML) More "movi" data.
+
+	Lists are not tracked, every list is entered and its chunks are handled as if they were top level ones.
+*/
+
+static constexpr U32 MakeFourCC(char a, char b, char c, char d)
+{
+	return static_cast<U32> (static_cast<U8> (a)) | (static_cast<U32> (static_cast<U8> (b)) << 8) | (static_cast<U32> (static_cast<U8> (c)) << 16) | (static_cast<U32> (static_cast<U8> (d)) << 24);
+}
+
+static constexpr U32 RIFF = MakeFourCC('R', 'I', 'F', 'F');
+static constexpr U32 LIST = MakeFourCC('L', 'I', 'S', 'T');
+static constexpr U32 AVI  = MakeFourCC('A', 'V', 'I', ' ');
+static constexpr U32 AVIH = MakeFourCC('a', 'v', 'i', 'h');
+static constexpr U32 STRH = MakeFourCC('s', 't', 'r', 'h');
+static constexpr U32 VIDS = MakeFourCC('v', 'i', 'd', 's');
+
+// Larger chunks are skipped. (Same limit as the analytics messages)
+static constexpr U32 MaxFrameSize = 16 << 20;
+
+// "avih" is 56 bytes, "strh" 56 (or 64). Larger ones are skipped, the size comes from the upload.
+static constexpr U32 MaxHeaderSize = 1024;
+
+static U32 ReadU32(const char* p)
+{
+	U32 value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+AVIDemuxer::AVIDemuxer(U32 frameStep, const FrameHandler& rHandler)
+	: mFrameStep(frameStep ? frameStep : 1)
+	, mHandler(rHandler)
+{ }
+
+bool AVIDemuxer::Feed(const char* pData, size_t size)
+{
+	while (size > 0 && mState != State::Invalid)
+	{
+		size_t n = 0;
+
+		switch (mState)
+		{
+			case State::Header:
+			{
+				// Chunk id and size, the list type follows for the lists.
+				size_t headerSize = 8;
+
+				if (mHeaderSize >= 4)
+				{
+					const U32 id = ReadU32(mHeader);
+
+					if (id == RIFF || id == LIST)
+						headerSize = 12;
+				}
+
+				n = std::min(headerSize - mHeaderSize, size);
+
+				memcpy(mHeader + mHeaderSize, pData, n);
+				mHeaderSize += n;
+
+				if (mHeaderSize == 8 && (ReadU32(mHeader) == RIFF || ReadU32(mHeader) == LIST))
+					break;
+
+				if (mHeaderSize == headerSize)
+					HandleHeader();
+
+				break;
+			}
+
+			case State::Collect:
+			{
+				n = std::min(static_cast<size_t> (mChunkSize) - mChunk.size(), size);
+
+				mChunk.insert(mChunk.end(), pData, pData + n);
+
+				if (mChunk.size() == mChunkSize)
+				{
+					HandleChunk();
+
+					// Padding byte.
+					mRemaining = mChunkSize & 1;
+					mState = (mRemaining != 0) ? State::Skip : State::Header;
+				}
+
+				break;
+			}
+
+			case State::Skip:
+			{
+				n = std::min(mRemaining, size);
+
+				mRemaining -= n;
+
+				if (mRemaining == 0)
+					mState = State::Header;
+
+				break;
+			}
+
+			case State::Invalid:
+				break;
+		}
+
+		pData += n;
+		size -= n;
+	}
+
+	return mState != State::Invalid;
+}
+
+void AVIDemuxer::HandleHeader()
+{
+	const U32 id = ReadU32(mHeader);
+	const U32 size = ReadU32(mHeader + 4);
+
+	mHeaderSize = 0;
+
+	if (mIsFirst)
+	{
+		mIsFirst = false;
+
+		if (id != RIFF || ReadU32(mHeader + 8) != AVI)
+			mState = State::Invalid;
+
+		return;
+	}
+
+	// Lists are entered, the next header is their first chunk.
+	if (id == RIFF || id == LIST)
+		return;
+
+	mChunkId = id;
+	mChunkSize = size;
+
+	bool isWanted = (id == AVIH || id == STRH) && size <= MaxHeaderSize;
+
+	// Skipped stream header still has its stream number.
+	if (id == STRH && !isWanted)
+		mNumStreams++;
+
+	if (IsVideoChunk(id))
+	{
+		// NOTE: Empty chunks are the dropped frames, they still take their time slot.
+		isWanted = (mNumFrames % mFrameStep == 0) && size > 0 && size <= MaxFrameSize;
+
+		mNumFrames++;
+	}
+
+	if (isWanted && size > 0)
+	{
+		mChunk.clear();
+		mChunk.reserve(size);
+
+		mState = State::Collect;
+		return;
+	}
+
+	mRemaining = static_cast<size_t> (size) + (size & 1);
+	mState = (mRemaining != 0) ? State::Skip : State::Header;
+}
+
+void AVIDemuxer::HandleChunk()
+{
+	if (mChunkId == AVIH)
+	{
+		if (mChunk.size() >= 4)
+			mMicroSecPerFrame = ReadU32(mChunk.data());
+	}
+	else if (mChunkId == STRH)
+	{
+		if (mChunk.size() >= 4 && ReadU32(mChunk.data()) == VIDS && mVideoStream == U32_MAX)
+			mVideoStream = mNumStreams;
+
+		mNumStreams++;
+	}
+	else
+		mHandler(mNumFrames - 1, mChunk.data(), mChunk.size());
+}
+
+// "##dc" or "##db", where "##" is the video stream number. (The first stream, if the headers are missing)
+bool AVIDemuxer::IsVideoChunk(U32 chunkId) const
+{
+	const char c0 = static_cast<char> (chunkId);
+	const char c1 = static_cast<char> (chunkId >> 8);
+	const char c2 = static_cast<char> (chunkId >> 16);
+	const char c3 = static_cast<char> (chunkId >> 24);
+
+	if (c0 < '0' || c0 > '9' || c1 < '0' || c1 > '9' || c2 != 'd' || (c3 != 'c' && c3 != 'b'))
+		return false;
+
+	const U32 stream = static_cast<U32> ((c0 - '0') * 10 + (c1 - '0'));
+
+	return stream == ((mVideoStream != U32_MAX) ? mVideoStream : 0);
+}
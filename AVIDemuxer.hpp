@@ -0,0 +1,61 @@
+#pragma once
+
+#include <functional>
+
+// Streaming RIFF/AVI demuxer for the Motion JPEG clips.
+// File is fed in any sized parts (as it's downloaded), only the selected video frame is buffered at the time.
+// Every MJPEG frame is a keyframe, so the frames are selected by their number: 0, N, 2N, ...
+// NOTE: "RIFF AVIX" extensions (OpenDML, clips larger than 1 GB) are read the same way.
+class AVIDemuxer
+{
+public:
+	// Data is valid only during the call.
+	using FrameHandler = std::function<void(U32 frameIndex, const char* pData, size_t size)>;
+
+	AVIDemuxer(U32 frameStep, const FrameHandler& rHandler);
+
+	// Returns false once the data turns out to be not an AVI (or is corrupted), the rest of it is ignored.
+	bool Feed(const char* pData, size_t size);
+
+	bool IsValid() const { return mState != State::Invalid; }
+
+	U32 GetNumFrames() const { return mNumFrames; }
+
+	// From the main AVI header. (0 - not known yet)
+	U32 GetMicroSecPerFrame() const { return mMicroSecPerFrame; }
+
+private:
+
+	enum class State : uint8_t
+	{
+		Header,		// Chunk id and size. (And the list type of the "RIFF" and "LIST")
+		Collect,	// Chunk data is buffered.
+		Skip,		// Chunk data (and the padding byte) is skipped.
+		Invalid
+	};
+
+	void HandleHeader();
+	void HandleChunk();
+
+	bool IsVideoChunk(U32 chunkId) const;
+
+	const U32			mFrameStep;
+	const FrameHandler	mHandler;
+
+	State	mState = State::Header;
+
+	char	mHeader[12];
+	size_t	mHeaderSize = 0;
+	bool	mIsFirst = true; // File must start with the "RIFF AVI ".
+
+	U32		mChunkId = 0;
+	U32		mChunkSize = 0;
+	size_t	mRemaining = 0; // Of the chunk data (collected or skipped), including the padding.
+
+	Vector<char> mChunk;
+
+	U32		mNumStreams = 0;		// "strh" headers seen.
+	U32		mVideoStream = U32_MAX;	// Index of the first video stream.
+	U32		mNumFrames = 0;
+	U32		mMicroSecPerFrame = 0;
+};
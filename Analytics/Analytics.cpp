@@ -13,13 +13,22 @@
 
 #include "CGI/CGIManager.hpp"
 
+#include "API/EventStream.hpp"
+
 #include "ThreadPool.hpp"
 
 #include "TinyXML2/tinyxml2.h"
 
+#include <string.h>	// memcpy
+#include <math.h>	// lround
+#include <tuple>
+
 #ifndef PLATFORM_WINDOWS
+#include <unistd.h>		// close
 #include <sys/socket.h>
-#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/types.h>	// getpid
 #include <netinet/in.h> // sockaddr_in
 #include <arpa/inet.h>	// inet_pton
 #endif
@@ -32,20 +41,153 @@
 
 	Worker thread'as nuskaito faila is HDD ir nusiuncia ji i pacia Analytics programa.
 	
-	Vienas prisijungimas atspindi viena event sessija. 
-	Event sessijai pasibaigus - atsijungiam nuo Analytics sistemos.
+	Prisijungimai prie Analytics sistemos laikomi "pool'e" (prisijungta ir serverio hello gautas is anksto),
+	todel pirmas event'o kadras issiunciamas iskarto. Pool'o prisijungimas paskiriamas vienam event'ui,
+	tik tada issiunciamas handshake (su event'o alarmId). Rezultatai susiejami su kadru per "fileId".
+
+	Analytics thread'as nebemiega fiksuota laika: laukiam "epoll_wait" kol atsiras socket'u aktyvumas
+	arba kol kitas thread'as "pazadins" per "eventfd" (nauji event'ai, naujas footage, baigtas siuntimas).
 */
 
-Analytics::Analytics(Main& rApp, const Database::Info& rDBInfo, const String& rServerAddress, U16 serverPort, U16 connectTimeoutSec)
+// Epoll "data" value used to identify the wake event. (Analytics session ids are used for the sockets)
+constexpr U64 WakeEventTag = U64_MAX;
+
+constexpr int MaxEpollEvents = 64;
+
+// Maximum time to stay in "epoll_wait" without any activity. (Used for the connect timeouts)
+constexpr int EpollTimeoutMs = 500;
+
+// Delay before the pool tries to connect to the failed backend again. (Doubled after each failure)
+constexpr U16 MinRetryDelaySec = 1;
+constexpr U16 MaxRetryDelaySec = 60;
+
+// How many times the footage is sent again after the connection failed (before getting any results).
+constexpr U8 MaxFootageAttempts = 3;
+
+constexpr int StatsIntervalSec = 60;
+
+// Analytics protocol.
+constexpr size_t HelloSize = 6;				// Client id (4 bytes) and the protocol version (2 bytes)
+constexpr size_t MessageHeaderSize = 6;		// Mark (1 byte), type (1 byte) and the whole message size (4 bytes)
+constexpr size_t MaxMessageSize = 16 << 20;	// Anything larger is treated as a corrupted stream.
+
+// Results are XML, unless both sides support the binary results. (Negotiated by the handshake, see "HandleMessages")
+constexpr U16 XMLProtocolVersion = 5;
+constexpr U16 BinaryProtocolVersion = 6;
+
+constexpr U8 MessageTypeBinaryResults = 4;
+
+// Tells the server to read the frames from the shared memory ring. (See "SharedMemoryRing")
+constexpr U8 MessageTypeShmAttach = 5;
+
+#pragma pack(push, 1)
+struct ShmAttach
+{
+	// Header.
+	U8	mark = 7;
+	U8	type = MessageTypeShmAttach;
+	U32 size = 0;
+
+	U32 numSlots = 0;
+	U32 slotSize = 0;
+	char name[64]{};
+};
+
+// Binary results message: header, "BinaryResults" and "numObjects" of the "BinaryObject".
+struct BinaryResults
+{
+	U32 fileId = 0;
+	U16 numObjects = 0;
+	U16 flags = 0; // Reserved.
+};
+
+struct BinaryObject
+{
+	U16 classId = 0;	// Index of the "Settings::classNames".
+	U8	probability = 0;// Percent.
+	U8	reserved = 0;
+	U16 x = 0;
+	U16 y = 0;
+	U16 width = 0;
+	U16 height = 0;
+};
+#pragma pack(pop)
+
+// Results are matched to the in-flight footage before the XML is parsed. (See "Frame::fileId")
+// "<Root incompleteResult="0" count="1" fileId="3295">"
+static bool GetResultFileId(const char* pXML, size_t size, U32& rFileId)
+{
+	static const char Attribute[] = "fileId=\"";
+
+	const char* pEnd = pXML + size;
+	const char* p = std::search(pXML, pEnd, Attribute, Attribute + sizeof(Attribute) - 1);
+
+	if (p == pEnd)
+		return false;
+
+	p += sizeof(Attribute) - 1;
+
+	if (p == pEnd || *p < '0' || *p > '9')
+		return false;
+
+	U32 fileId = 0;
+
+	for (; p != pEnd && *p >= '0' && *p <= '9'; ++p)
+		fileId = fileId * 10 + static_cast<U32> (*p - '0');
+
+	rFileId = fileId;
+
+	return true;
+}
+
+Analytics::Analytics(Main& rApp, const Database::Info& rDBInfo, const Settings& rSettings)
 	: mMain(rApp)
-	, mConnectTimeoutSec(connectTimeoutSec)
-	, mServerPort(serverPort)
 	, mDBInfo(rDBInfo)
-	, mServerAddress(rServerAddress)
+	, mSettings(rSettings)
 {
-	mThreadPtr = std::make_unique<std::thread>(&Analytics::ThreadProc, this);
+	if (mSettings.backends.empty())
+		throw Exception("Analytics has no servers configured!");
 
-	mReadBuffer.reserve(4096);
+	{
+		const auto numBackends = mSettings.backends.size();
+
+		mBackendRetryTPs.resize(numBackends);
+		mBackendRetryDelaySec.resize(numBackends, MinRetryDelaySec);
+		mBackendIsUp.resize(numBackends, true);
+		mBackendInFlight.resize(numBackends, 0);
+		mBackendLatencyMs.resize(numBackends, 0);
+		mBackendNumResults.resize(numBackends, 0);
+		mBackendNumFailures.resize(numBackends, 0);
+	}
+
+	mEpollId = epoll_create1(EPOLL_CLOEXEC);
+
+	if (mEpollId == -1)
+	{
+		int errorCode = Socket::GetErrorCode();
+		throw ExceptionVA("Analytics failed for \"epoll_create1\"! (Error: %s, Code: %d)", Socket::GetErrorString(errorCode), errorCode);
+	}
+
+	mWakeEventId = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (mWakeEventId == -1)
+	{
+		int errorCode = Socket::GetErrorCode();
+		throw ExceptionVA("Analytics failed for \"eventfd\"! (Error: %s, Code: %d)", Socket::GetErrorString(errorCode), errorCode);
+	}
+
+	{
+		epoll_event event{};
+
+		event.events = EPOLLIN;
+		event.data.u64 = WakeEventTag;
+
+		if (epoll_ctl(mEpollId, EPOLL_CTL_ADD, mWakeEventId, &event) == -1)
+		{
+			int errorCode = Socket::GetErrorCode();
+			throw ExceptionVA("Analytics failed to register the wake event! (Error: %s, Code: %d)", Socket::GetErrorString(errorCode), errorCode);
+		}
+	}
 
 	{
 		std::ostringstream ss;
@@ -87,6 +229,8 @@ Analytics::Analytics(Main& rApp, const Database::Info& rDBInfo, const String& rS
 
 		mSQLQuery.analyticsUpdateStats = ss.str();
 	}
+
+	mThreadPtr = std::make_unique<std::thread>(&Analytics::ThreadProc, this);
 }
 
 Analytics::~Analytics()
@@ -94,14 +238,121 @@ Analytics::~Analytics()
 	LOG_MESSAGE(Log::Channel::Analytics, "Analytics system is stopping.");
 
 	mIsStopRequested = true;
+
+	WakeUp();
+
 	mThreadPtr->join();
 
+	// Result tasks drop the rest of their results once the stop is requested, wait for the ones being written.
+	while (mNumResultTasks != 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+	// NOTE: Sockets of the running send tasks are shut down, so the tasks don't block in "Socket::Send".
+	for (AnalyticsSessionId id = 0; id < static_cast<AnalyticsSessionId> (mAnalyticsSockets.size()); ++id)
+		ReleaseConnection(id);
+
+	// IMPORTANT:
+	// Send tasks (queued ones as well, the pool outlives us) use this object and wake us up, wait for all of them.
+	while (mNumSendTasks != 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+	for (AnalyticsSessionId id = 0; id < static_cast<AnalyticsSessionId> (mAnalyticsSockets.size()); ++id)
+	{
+		if (mAnalyticsStatus.at(id) == SatusFlags::Failed)
+			Socket::Close(mAnalyticsSockets.at(id));
+	}
+
+	close(mWakeEventId);
+	close(mEpollId);
+
 	LOG_MESSAGE(Log::Channel::Analytics, "Analytics system is stopped.");
 }
 
+// THREAD: Main thread.
+// Session will be started by the Analytics thread. (See "HandleQueuedEvents")
 void Analytics::AddEvent(EventId eventId, U32 cameraId, U8 personThreshold, const String& rFootagePath)
 {
-	LOG_MESSAGE(Log::Channel::Analytics, "Analytics starts new session. (EventId: %" PRIu64 ", CameraId: %u, PersonThreshold: %u, Path: '%s')", eventId, cameraId, personThreshold, rFootagePath.c_str());
+	mEventMutex.lock();
+	mEventQueue.emplace_back(eventId, cameraId, personThreshold, rFootagePath, false);
+	mEventMutex.unlock();
+
+	WakeUp();
+}
+
+// THREAD: Main thread.
+void Analytics::EndEvent(EventId eventId)
+{
+	mEventMutex.lock();
+	mEventQueue.emplace_back(eventId, 0, 0, String(), true);
+	mEventMutex.unlock();
+
+	WakeUp();
+}
+
+// Add's information about the event's footage that should be shaduled for processing as soon as possible.
+// Analytics manager works on a separate thread.
+// All the queued footage will be handled by the "HandleQueuedFootageList".
+void Analytics::AddFootage(EventId eventId, EventFootageId eventFootageId, const String& rName, const JPEG::Signature& rSignature, U64 contentHash)
+{
+	mFootageMutex.lock();
+	mFootageQueue.emplace_back(eventId, eventFootageId, rName, std::chrono::steady_clock::now(), rSignature, contentHash);
+	mFootageMutex.unlock();
+
+	WakeUp();
+}
+
+void Analytics::WakeUp()
+{
+	// NOTE:
+	// Counter is accumulated until the Analytics thread reads it, so multiple wake ups result in a single "epoll_wait" return.
+	eventfd_write(mWakeEventId, 1);
+}
+
+void Analytics::StartSession(const EventInfo& rInfo)
+{
+	const auto eventId = rInfo.eventId;
+
+	LOG_MESSAGE(Log::Channel::Analytics, "Analytics starts new session. (EventId: %" PRIu64 ", CameraId: %u, PersonThreshold: %u, Path: '%s')", eventId, rInfo.cameraId, rInfo.personThreshold, rInfo.footagePath.c_str());
+
+	// NOTE:
+	// No connection is made here, event's footage is sent using the already connected pool connections.
+	auto& rSession = mEventMap[eventId];
+
+	rSession.cameraId = rInfo.cameraId;
+	rSession.personThreshold = rInfo.personThreshold;
+	rSession.footagePath = rInfo.footagePath;
+
+	std::lock_guard<std::mutex> lock(mCameraStatsMutex);
+
+	rSession.pCameraStats = &mCameraStats[rInfo.cameraId];
+}
+
+void Analytics::EndSession(EventId eventId)
+{
+	auto it = mEventMap.find(eventId);
+	if (it == mEventMap.end())
+	{
+		LOG_ERROR(Log::Channel::Analytics, "Analytics session can't end! (Event id: %" PRIu64 " not found)", eventId);
+		return;
+	}
+
+	auto& rSession = it->second;
+
+	const auto queueSize = rSession.footageQueue.size();
+
+	// If analytics session was not marked as "DONE" and there are still some queued frames - defer the closure.
+	// (So even though EVENT session might be closed, the defered ANALYTICS session might still wait for some frames to be analized)
+	if (!rSession.isDone && queueSize > 0)
+		LOG_MESSAGE(Log::Channel::Analytics, "Analytics session (Event id: %" PRIu64 ") still contains %u queued frames...", eventId, queueSize);
+
+	// Session is released by the "HandleQueuedFootageMap".
+	rSession.isEnded = true;
+}
+
+// Starts a new pool connection. (Handshake is made once it's leased to an event, see "LeaseConnection")
+void Analytics::StartConnection(U16 backendIndex)
+{
+	const auto& rBackend = mSettings.backends.at(backendIndex);
 
 	SocketId socketId = INVALID_SOCKET;
 
@@ -110,16 +361,17 @@ void Analytics::AddEvent(EventId eventId, U32 cameraId, U8 personThreshold, cons
 		socketId = Socket::Create();
 
 		Socket::SetNonBlocking(socketId);
+		Socket::SetKeepAlive(socketId);
 
 		sockaddr_in addr{};
 
 		addr.sin_family = AF_INET;
-		addr.sin_port = htons(mServerPort);
+		addr.sin_port = htons(rBackend.port);
 
-		if (inet_pton(addr.sin_family, mServerAddress.c_str(), &addr.sin_addr) <= 0)
-			throw ExceptionVA("Invalid address: %s:%d", mServerAddress.c_str(), mServerPort);
+		if (inet_pton(addr.sin_family, rBackend.address.c_str(), &addr.sin_addr) <= 0)
+			throw ExceptionVA("Invalid address: %s:%d", rBackend.address.c_str(), rBackend.port);
 
-		LOG_MESSAGE(Log::Channel::Analytics, "Connecting to the Analytics: %s:%d", mServerAddress.c_str(), mServerPort);
+		LOG_MESSAGE(Log::Channel::Analytics, "Connecting to the Analytics: %s:%d", rBackend.address.c_str(), rBackend.port);
 
 		// NOTE:
 		// "O_NONBLOCK is set for the file descriptor for the socket and the connection cannot be immediately established; 
@@ -139,6 +391,8 @@ void Analytics::AddEvent(EventId eventId, U32 cameraId, U8 personThreshold, cons
 	{
 		LOG_ERROR(Log::Channel::Analytics, e.GetText());
 		Socket::Close(socketId);
+
+		HandleBackendFailure(backendIndex, std::chrono::steady_clock::now());
 		return;
 	}
 
@@ -153,13 +407,16 @@ void Analytics::AddEvent(EventId eventId, U32 cameraId, U8 personThreshold, cons
 			const std::size_t newSize = id + 1;
 
 			mAnalyticsSockets.resize(newSize);
-			mAnalyticsCameraIds.resize(newSize);
-			mAnalyticsThresholds.resize(newSize);
+			mAnalyticsBackends.resize(newSize);
 			mAnalyticsEvents.resize(newSize);
-			mAnalyticsEventPaths.resize(newSize);
 			mAnalyticsStatus.resize(newSize);
 			mAnalyticsTimePoints.resize(newSize);
 			mAnalyticsUniqueId.resize(newSize);
+			mAnalyticsInFlight.resize(newSize);
+			mAnalyticsSendStates.resize(newSize);
+			mAnalyticsReadBuffers.resize(newSize);
+			mAnalyticsProtocolVersion.resize(newSize);
+			mAnalyticsRings.resize(newSize);
 		}
 	}
 	else
@@ -169,533 +426,1953 @@ void Analytics::AddEvent(EventId eventId, U32 cameraId, U8 personThreshold, cons
 	}
 
 	mAnalyticsSockets.at(id) = socketId;
-	mAnalyticsCameraIds.at(id) = cameraId;
-	mAnalyticsThresholds.at(id) = personThreshold;
-	mAnalyticsEvents.at(id) = eventId;
-	mAnalyticsEventPaths.at(id) = rFootagePath;
+	mAnalyticsBackends.at(id) = backendIndex;
+	mAnalyticsEvents.at(id) = 0;
 	mAnalyticsStatus.at(id) = SatusFlags::Connecting;
 	mAnalyticsTimePoints.at(id) = std::chrono::steady_clock::now();
+	mAnalyticsInFlight.at(id).clear();
+	mAnalyticsReadBuffers.at(id).Clear();
+	mAnalyticsProtocolVersion.at(id) = XMLProtocolVersion;
+	mAnalyticsRings.at(id).reset();
+
+	if (!mAnalyticsSendStates.at(id))
+		mAnalyticsSendStates.at(id) = std::make_shared<SendState>();
+
+	// Connect completion is reported as "writable" socket (or as an error).
+	{
+		epoll_event event{};
 
-	// Make sure eventMap element is created for the appropriate eventId.
-//	mEventMap[eventId].isDone = false;
-	mEventMap[eventId].sessionId = id;
+		event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+		event.data.u64 = id;
+
+		if (epoll_ctl(mEpollId, EPOLL_CTL_ADD, socketId, &event) == -1)
+		{
+			int errorCode = Socket::GetErrorCode();
+			LOG_ERROR(Log::Channel::Analytics, "Analytics failed for \"epoll_ctl\"! (Error: %s, Code: %d, Id: %u)", Socket::GetErrorString(errorCode), errorCode, id);
+			ReleaseConnection(id);
+			return;
+		}
+	}
 }
 
-void Analytics::EndEvent(EventId eventId)
+void Analytics::ReleaseConnection(AnalyticsSessionId id)
 {
-#if 1
-	auto it = mEventMap.find(eventId);
-	if (it == mEventMap.end())
-	{
-		LOG_ERROR(Log::Channel::Analytics, "Analytics session can't end! (Event id: %" PRIu64 " not found)", eventId);
+	if (mAnalyticsStatus.at(id) == SatusFlags::Free)
 		return;
-	}
 
-	auto& rSession = it->second;
+	// Frames still waiting for the results on this connection will never get them, so they are sent again. (Failover)
+	// NOTE: Reverse order, so the frames are put back to the event's queue in the same order they were sent.
+	auto& rInFlight = mAnalyticsInFlight.at(id);
 
-	const auto queueSize = rSession.footageQueue.size();
-	
-	// If analytics session was not marked as "DONE" and there are still some queued frames - defer the closure.
-	// (So even though EVENT session might be closed, the defered ANALYTICS session might still wait for some frames to be analized)
-	if (!rSession.isDone && queueSize > 0)
+	for (auto it = rInFlight.rbegin(); it != rInFlight.rend(); ++it)
 	{
-		LOG_MESSAGE(Log::Channel::Analytics, "Analytics session (id: %u, Event id: %" PRIu64 ") still contains %u queued frames...", rSession.sessionId, eventId, queueSize);
-
-		// TODO: HANDLE THE SITUATION.
+		ReleaseFootage(id, *it);
+		RequeueFootage(*it);
 	}
-	else
-	{
-		LOG_MESSAGE(Log::Channel::Analytics, "Analytics session (id: %u, Event id: %" PRIu64 ") ended.", rSession.sessionId, eventId);
-
-		ReleaseSession(rSession.sessionId);
 
-		mEventMap.erase(it);
-	}
-#else
+	rInFlight.clear();
 
-	LOG_MESSAGE(Log::Channel::Analytics, "Analytics session ended. Event id: %" PRIu64, eventId);
+	// NOTE: Ring is removed once the send task (if any) releases it as well.
+	mAnalyticsRings.at(id).reset();
 
-	const auto numSessions = static_cast<AnalyticsSessionId> (mAnalyticsEvents.size());
+	auto& rSendState = *mAnalyticsSendStates.at(id);
 
-	for (AnalyticsSessionId i = 0; i < numSessions; ++i)
+	// IMPORTANT:
+	// Socket id can't be closed (and re-used by the OS) while the send task is still writing to it.
+	// Shut it down for now, it's closed by the "HandlePool" once the task finishes.
+	if (!rSendState.isSendAllowed)
 	{
-		if (mAnalyticsEvents.at(i) == eventId)
+		if (mAnalyticsStatus.at(id) != SatusFlags::Failed)
 		{
-			ReleaseSession(i);
-			break;
+			epoll_ctl(mEpollId, EPOLL_CTL_DEL, mAnalyticsSockets.at(id), nullptr);
+			shutdown(mAnalyticsSockets.at(id), SHUT_RDWR);
+
+			mAnalyticsStatus.at(id) = SatusFlags::Failed;
 		}
+		return;
 	}
 
-	mEventMap.erase(eventId);
-#endif
-}
-
-// Add's information about the event's footage that should be shaduled for processing as soon as possible.
-// Analytics manager works on a separate thread.
-// All the queued footage will be handled by the "HandleQueuedFootageList".
-void Analytics::AddFootage(EventId eventId, EventFootageId eventFootageId, const String& rName)
-{
-	mFootageMutex.lock();
-	mFootageQueue.emplace_back(eventId, eventFootageId, rName);
-	mFootageMutex.unlock();
-}
+	rSendState.failedIds.clear();
+	rSendState.unsentIds.clear();
 
-void Analytics::ReleaseSession(AnalyticsSessionId id)
-{
+	// NOTE: Closing the socket removes it from the epoll set as well.
 	Socket::Close(mAnalyticsSockets.at(id));
 
 	mAnalyticsReleasedIds.emplace_back(id);
-	mAnalyticsEvents.at(id) = 0;
 	mAnalyticsStatus.at(id) = SatusFlags::Free;
-
-//	mAnalyticsSessions.at(id).reset();
 }
 
-bool Analytics::HandleConnect(AnalyticsSessionId id, const TimePoint& rCurrentTP)
+// Returns the connection leased to the event, if it can take more frames.
+// Event without a connection leases the pooled one of the backend with the least outstanding frames.
+// (Or "InvalidAnalyticsSessionId" if the event's connection is busy or the pool is empty)
+// NOTE: One connection per event, its frames are pipelined using the in-flight window.
+AnalyticsSessionId Analytics::GetAvailableConnection(EventId eventId)
 {
-	const auto socketId = mAnalyticsSockets.at(id);
-
-	fd_set fdSet;
-	FD_ZERO(&fdSet);
-	FD_SET(socketId, &fdSet);
+	const auto numSessions = static_cast<AnalyticsSessionId> (mAnalyticsSockets.size());
 
-	timeval	timeout = { 0, 0 }; // Don't block.
-
-	// TODO: http://beesbuzz.biz/code/5739-The-problem-with-select-vs-poll
-	// NOTE: 
-	// Using "send check". If we can "send" - we're connected.
-	int result = select(socketId + 1, 0, &fdSet, 0, &timeout);
-	if (result > 0)
-	{
-		const auto eventId = mAnalyticsEvents.at(id);
-		LOG_MESSAGE(Log::Channel::Analytics, "Analytics session (id: %u) connected with ANL server. (EventId: %" PRIu64 ")", id, eventId);
-		mAnalyticsStatus.at(id) = SatusFlags::Connected;
-		mAnalyticsTimePoints.at(id) = rCurrentTP;
-		return true;
-	}
-	else if (result < 0)
-	{
-		// TODO: Proper cleanup?
-		int errorCode = Socket::GetErrorCode();
-		LOG_ERROR(Log::Channel::Analytics, "Analytics socket failed for \"select\"! (Error code: %d)", errorCode);
-		ReleaseSession(id);
-	}
-	else
+	for (AnalyticsSessionId id = 0; id < numSessions; ++id)
 	{
-		// Check for socket connect time-out.
-		auto seconds = std::chrono::duration_cast<std::chrono::seconds>(rCurrentTP - mAnalyticsTimePoints.at(id)).count();
-
-		if (seconds > mConnectTimeoutSec)
-		{
-			const auto eventId = mAnalyticsEvents.at(id);
-			LOG_ERROR(Log::Channel::Analytics, "Analytics socket failed to connect to: %s:%d (Timeout %d sec, EventId: %" PRIu64 ")", mServerAddress.c_str(), mServerPort, mConnectTimeoutSec, eventId);
-			ReleaseSession(id);
-		}
-	}
-
-	return false;
-}
-
-void Analytics::HandleRead(AnalyticsSessionId id)
-{
-	const auto socketId = mAnalyticsSockets.at(id);
+		if (mAnalyticsStatus.at(id) != SatusFlags::Ready || mAnalyticsEvents.at(id) != eventId)
+			continue;
 
-	static char readBuffer[1024];
+		// 2019-06-06 FIX:
+		// Only one send task per-socket.
+		if (!mAnalyticsSendStates.at(id)->isSendAllowed)
+			return InvalidAnalyticsSessionId;
 
-	// Check if "handshake" was made.
+		if (mAnalyticsInFlight.at(id).size() >= mSettings.inFlightWindow)
+			return InvalidAnalyticsSessionId;
 
-	// If so, try and read any available response data.
+		return id;
+	}
 
-	// Socket is connected, but actual analytics session was not yet initialized.
-	// So try and read the initial data thad is sent to us by the Analytics server.
-	if (mAnalyticsStatus.at(id) == SatusFlags::Connected)
+	for (;;)
 	{
-		auto bytesAvailable = recv(socketId, readBuffer, sizeof(readBuffer), MSG_PEEK);
+		AnalyticsSessionId bestId = InvalidAnalyticsSessionId;
 
-		if (bytesAvailable < 6)
-			return;
+		for (AnalyticsSessionId id = 0; id < numSessions; ++id)
+		{
+			if (mAnalyticsStatus.at(id) != SatusFlags::Handshake)
+				continue;
 
-		const U32 clientId = *reinterpret_cast<const U32*>(readBuffer);
-		const U16 protocolVersion = *reinterpret_cast<const U16*>(readBuffer + 4);
+			if (bestId == InvalidAnalyticsSessionId)
+			{
+				bestId = id;
+				continue;
+			}
 
-		LOG_DEBUG(Log::Channel::Analytics, "Analytics new session HANDSHAKE. (Id: %u, Client id: %u, protocol-version: %u)", id, clientId, protocolVersion);
+			const auto backendIndex = mAnalyticsBackends.at(id);
+			const auto bestBackendIndex = mAnalyticsBackends.at(bestId);
 
-		recv(socketId, readBuffer, sizeof(readBuffer), 0);
+			// Least outstanding frames on the backend, then the faster backend.
+			const auto key = std::make_tuple(mBackendInFlight.at(backendIndex), mBackendLatencyMs.at(backendIndex));
+			const auto bestKey = std::make_tuple(mBackendInFlight.at(bestBackendIndex), mBackendLatencyMs.at(bestBackendIndex));
 
-		mAnalyticsStatus.at(id)   = SatusFlags::Handshake;
-		mAnalyticsUniqueId.at(id) = clientId;
-	}
-	else if (mAnalyticsStatus.at(id) == SatusFlags::Ready)
-	{
-#if PLATFORM_WINDOWS
-		u_long bytesAvailable = 0;
-		if (ioctlsocket(socketId, FIONREAD, &bytesAvailable) == SOCKET_ERROR)
-#else
-		size_t bytesAvailable = 0;
-		if (ioctl(socketId, FIONREAD, (u_long*)&bytesAvailable) == SOCKET_ERROR)
-#endif
-		{
-			LOG_ERROR(Log::Channel::Analytics, "Failed for \"ioctl\"!");
+			if (key < bestKey)
+				bestId = id;
 		}
 
-//		printf("bytesAvailable[Event:%" PRIu64 "]: %d\n", mAnalyticsEvents.at(id), bytesAvailable);
-
-		constexpr auto HeaderSize = 6;
-/*
-#pragma pack(push, 1)
-		struct Header
-		{
-			quint8  mark;
-			quint8	type;	// enum MessageType
-			quint32	size;
-		};
-#pragma pack(pop)
-*/
+		// Pool might still be connecting.
+		if (bestId == InvalidAnalyticsSessionId)
+			return InvalidAnalyticsSessionId;
 
-		// Check if we have enough bytes to read at least the header.
-		if (bytesAvailable < HeaderSize)
-			return;
+		// Failed connection is released, the next one is tried.
+		if (LeaseConnection(bestId, eventId))
+			return bestId;
+	}
+}
 
-		recv(socketId, readBuffer, sizeof(readBuffer), MSG_PEEK);
+// Leased connection is released once its event no longer needs it and nothing is in-flight. (See "HandlePool")
+// (Back-filled frames of the ended event lease a new connection)
+bool Analytics::IsLeaseEnded(AnalyticsSessionId id) const
+{
+	if (mAnalyticsStatus.at(id) != SatusFlags::Ready)
+		return false;
 
-//		auto messageType = *reinterpret_cast<const uint8_t*>(&readBuffer[1]); // Skip the "mark" (1 byte)
-		auto messageSize = *reinterpret_cast<const U32*>(&readBuffer[2]);
+	if (!mAnalyticsInFlight.at(id).empty() || !mAnalyticsSendStates.at(id)->isSendAllowed)
+		return false;
 
-		// Check if we have enough bytes to read the whole response.
-		if (bytesAvailable < messageSize)
-			return;
+	auto it = mEventMap.find(mAnalyticsEvents.at(id));
 
-		// If we're here, we can expect that the whole response data is available to be read.
+	return it == mEventMap.end() || it->second.isDone;
+}
 
-		// Prepare the "ReadBuffer". 
-		// (Note, the capacity is never reduced when resizing to smaller size)
-		mReadBuffer.resize(messageSize);
+void Analytics::HandleSocketEvent(AnalyticsSessionId id, U32 events)
+{
+	// Connection might be released while handling the previous events of the same "epoll_wait" call.
+	if (mAnalyticsStatus.at(id) == SatusFlags::Free || mAnalyticsStatus.at(id) == SatusFlags::Failed)
+		return;
 
-		if (!Socket::Read(socketId, mReadBuffer.data(), mReadBuffer.size()))
-		{
-			LOG_ERROR(Log::Channel::Analytics, "Failed while reading respnse for event id: %" PRIu64, mAnalyticsEvents.at(id));
+	if (mAnalyticsStatus.at(id) == SatusFlags::Connecting)
+	{
+		if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
 			return;
-		}
-
-		// TODO: 
-		// Remove eventId? Leave just String..?
-		const auto cameraId = mAnalyticsCameraIds.at(id);
-		const EventId eventId = mAnalyticsEvents.at(id);
 
-		mResultQueue.push({ id, cameraId, eventId, 0, String(mReadBuffer.data() + HeaderSize + 4, mReadBuffer.size() - (HeaderSize + 4))});
+		if (!HandleConnect(id))
+			return; // If session is not connected, there is no point of continuing.
+	}
 
-#if 0
-		static int resultCounter;
-		std::fstream file;
-		file.open("XML_" + std::to_string(resultCounter++) + ".xml", std::ios::out | std::fstream::binary);
+	// NOTE:
+	// Read before handling the hang-up, so that the last results sent by the Analytics server are not lost.
+	if (events & EPOLLIN)
+	{
+		if (!HandleRead(id))
+			return;
+	}
 
-		if (!file.is_open())
-			LOG_ERROR(Log::Channel::Analytics, "Failed to write Analytics file: %s", strerror(Socket::GetErrorCode()));
+	if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+	{
+		LOG_ERROR(Log::Channel::Analytics, "Analytics connection (id: %u, backend: #%u) was disconnected by the ANL server.", id, mAnalyticsBackends.at(id));
+		ReleaseConnection(id);
 
-		file.write(mReadBuffer.data() + HeaderSize + 4, mReadBuffer.size() - (HeaderSize + 4));
-#endif
+		HandleBackendFailure(mAnalyticsBackends.at(id), std::chrono::steady_clock::now());
+		return;
 	}
 }
 
-void Analytics::HandleSend(AnalyticsSessionId id)
+bool Analytics::HandleConnect(AnalyticsSessionId id)
 {
-	if (mAnalyticsStatus.at(id) == SatusFlags::Handshake)
-	{
-#pragma pack(push, 1)
-		struct Handshake
-		{
-			U32 clientId = 0;
-			U16 type = 0;			// TODO: Enumeration: Default, person, car, plant, etc.
-			U16 quality = 0;		// STREAM_QUALITY_LOW = 0, STREAM_QUALITY_MED,  STREAM_QUALITY_HIGH
-			U32 streamTypeA = 1;	// STREAM_TYPE_UNKNOWN = 0, STREAM_TYPE_JPEG = 1, STREAM_TYPE_VIDEO = 2,
+	const auto socketId = mAnalyticsSockets.at(id);
+	const auto backendIndex = mAnalyticsBackends.at(id);
+	const auto& rBackend = mSettings.backends.at(backendIndex);
 
-			// Header.
-			uint8_t mark = 7;
-			uint8_t messageType = 1; // NET_MSG_TYPE_HELLO
-			U32 size = 0;
+	// NOTE:
+	// Socket becomes "writable" when the asynchronous connect completes, "SO_ERROR" tells if it succeeded.
+	int errorCode = 0;
+	socklen_t errorCodeSize = sizeof(errorCode);
 
-			U16 protocolVersion = 0;
-			int64_t	alarmId = 0;
-			uint8_t threshold = 20; // Default.
-			uint8_t streamTypeB = 1; // STREAM_TYPE_JPEG = 1
+	if (getsockopt(socketId, SOL_SOCKET, SO_ERROR, &errorCode, &errorCodeSize) == SOCKET_ERROR)
+		errorCode = Socket::GetErrorCode();
 
-			U16 nameLength = 16;
-			char name[16]{ "Test\0" };
+	if (errorCode != 0)
+	{
+		LOG_ERROR(Log::Channel::Analytics, "Analytics socket failed to connect to: %s:%d (Error: %s, Code: %d, Id: %u)", rBackend.address.c_str(), rBackend.port, Socket::GetErrorString(errorCode), errorCode, id);
+		ReleaseConnection(id);
 
-			uint8_t findLicensePlates = 0;
-		} handshake;
-#pragma pack(pop)
+		HandleBackendFailure(backendIndex, std::chrono::steady_clock::now());
+		return false;
+	}
 
-		handshake.clientId = mAnalyticsUniqueId.at(id);
+	LOG_MESSAGE(Log::Channel::Analytics, "Analytics connection (id: %u) connected with ANL server: %s:%d", id, rBackend.address.c_str(), rBackend.port);
 
-		handshake.size = 37;
-		handshake.protocolVersion = 5;
-		handshake.alarmId = mAnalyticsEvents.at(id);
+	mAnalyticsStatus.at(id) = SatusFlags::Connected;
+	mAnalyticsTimePoints.at(id) = std::chrono::steady_clock::now();
 
-		try
-		{
-			Socket::Send(mAnalyticsSockets.at(id), (char*)&handshake, sizeof(Handshake));
-		}
-		catch (const Exception& e)
-		{
-			LOG_ERROR(Log::Channel::Analytics, "Analytics::HandleSend[HANDSHAKE]: %s\n", e.GetText());
-			ReleaseSession(id);
-			return;
-		}
+	// Stop listening for "writable", otherwise "epoll_wait" would return instantly.
+	epoll_event event{};
 
-		mAnalyticsStatus.at(id) = SatusFlags::Ready;
-	}
-/*
-	else if (mAnalyticsStatus.at(id) == SatusFlags::Ready)
+	event.events = EPOLLIN | EPOLLRDHUP;
+	event.data.u64 = id;
+
+	if (epoll_ctl(mEpollId, EPOLL_CTL_MOD, socketId, &event) == -1)
 	{
-		// TODO
+		errorCode = Socket::GetErrorCode();
+		LOG_ERROR(Log::Channel::Analytics, "Analytics failed for \"epoll_ctl\"! (Error: %s, Code: %d, Id: %u)", Socket::GetErrorString(errorCode), errorCode, id);
+		ReleaseConnection(id);
+		return false;
 	}
-*/
+
+	return true;
 }
 
-void Analytics::ThreadProc()
+void Analytics::HandleTimeouts(const TimePoint& rCurrentTP)
 {
-	LOG_MESSAGE(Log::Channel::Analytics, "Analytics thread started.");
-	LOG_MESSAGE(Log::Channel::Analytics, "Analytics server: %s:%d", mServerAddress.c_str(), mServerPort);
+	const auto numSessions = static_cast<AnalyticsSessionId> (mAnalyticsSockets.size());
 
-	try
+	for (AnalyticsSessionId id = 0; id < numSessions; ++id)
 	{
-		LOG_MESSAGE(Log::Channel::Analytics, "Connecting to the Database (%s:%d)", mDBInfo.hostname.c_str(), mDBInfo.port);
+		const auto status = mAnalyticsStatus.at(id);
+		const auto backendIndex = mAnalyticsBackends.at(id);
 
-		Database::Connection database;
-
-		if (!database.Connect(mDBInfo, 7, 3))
-			return;
+		auto seconds = std::chrono::duration_cast<std::chrono::seconds>(rCurrentTP - mAnalyticsTimePoints.at(id)).count();
 
-		while (!mIsStopRequested)
+		if (status == SatusFlags::Connecting)
 		{
-			const auto currentTP = std::chrono::steady_clock::now();
-			const auto numSessions = static_cast<AnalyticsSessionId> (mAnalyticsSockets.size());
-
-			for (AnalyticsSessionId id = 0; id < numSessions; ++id)
+			// Check for socket connect time-out.
+			if (seconds > mSettings.connectTimeoutSec)
 			{
-				if (mAnalyticsStatus.at(id) == SatusFlags::Free)
-					continue;
-
-				if (mAnalyticsStatus.at(id) == SatusFlags::Connecting)
-				{
-					if (!HandleConnect(id, currentTP))
-						continue; // If session is not connected, there is no point of continuing.
-				}
+				const auto& rBackend = mSettings.backends.at(backendIndex);
 
-				HandleRead(id);
+				LOG_ERROR(Log::Channel::Analytics, "Analytics socket failed to connect to: %s:%d (Timeout %d sec, Id: %u)", rBackend.address.c_str(), rBackend.port, mSettings.connectTimeoutSec, id);
+				ReleaseConnection(id);
 
-				HandleSend(id);
+				HandleBackendFailure(backendIndex, rCurrentTP);
 			}
+		}
+		else if (status == SatusFlags::Connected)
+		{
+			// Analytics server is taking too long to launch it's child.
+			if (seconds > mSettings.connectTimeoutSec)
+			{
+				LOG_ERROR(Log::Channel::Analytics, "Analytics connection (id: %u) handshake timeout. (%d sec)", id, mSettings.connectTimeoutSec);
+				ReleaseConnection(id);
+
+				HandleBackendFailure(backendIndex, rCurrentTP);
+			}
+		}
+		else if (status == SatusFlags::Handshake)
+		{
+			if (mSettings.poolMaxAgeSec > 0 && seconds > mSettings.poolMaxAgeSec)
+			{
+				LOG_MESSAGE(Log::Channel::Analytics, "Analytics connection (id: %u) is recycled. (Age: %d sec)", id, static_cast<int> (seconds));
+				ReleaseConnection(id);
+			}
+		}
+		else if (status == SatusFlags::Ready)
+		{
+			auto& rInFlight = mAnalyticsInFlight.at(id);
+
+			// Health check:
+			// Footage that never got any results means the connection (or the server's child) is stuck, so it's recycled.
+			if (!rInFlight.empty() && mSettings.resultTimeoutSec > 0)
+			{
+				auto resultSeconds = std::chrono::duration_cast<std::chrono::seconds>(rCurrentTP - rInFlight.front().sentTP).count();
+
+				if (resultSeconds >= mSettings.resultTimeoutSec)
+				{
+					LOG_WARNING(Log::Channel::Analytics, "Analytics results timeout. (%u sec, Id: %u, EventId: %" PRIu64 ", EventFootageId: %" PRIu64 ")", mSettings.resultTimeoutSec, id, rInFlight.front().eventId, rInFlight.front().eventFootageId);
+					ReleaseConnection(id);
+
+					HandleBackendFailure(backendIndex, rCurrentTP);
+				}
+			}
+		}
+	}
+}
+
+// Keeps the pool of every backend filled with the connected (or connecting) analytics sessions.
+// Leased connections are not counted, they are released once their event is over.
+void Analytics::HandlePool(const TimePoint& rCurrentTP)
+{
+	const auto numBackends = static_cast<U16> (mSettings.backends.size());
+
+	Vector<U32> numConnections(numBackends, 0);
+	Vector<U32> numPooled(numBackends, 0);
+
+	const auto numSessions = static_cast<AnalyticsSessionId> (mAnalyticsSockets.size());
+
+	for (AnalyticsSessionId id = 0; id < numSessions; ++id)
+	{
+		const auto status = mAnalyticsStatus.at(id);
+
+		if (status == SatusFlags::Free)
+			continue;
+
+		// Waiting for the send task to finish. (See "ReleaseConnection")
+		if (status == SatusFlags::Failed)
+		{
+			ReleaseConnection(id);
+			continue;
+		}
+
+		HandleFailedFootage(id);
+
+		if (IsLeaseEnded(id))
+		{
+			LOG_DEBUG(Log::Channel::Analytics, "Analytics connection (id: %u) lease ended. (EventId: %" PRIu64 ")", id, mAnalyticsEvents.at(id));
+			ReleaseConnection(id);
+			continue;
+		}
+
+		numConnections.at(mAnalyticsBackends.at(id))++;
+
+		if (status != SatusFlags::Ready)
+			numPooled.at(mAnalyticsBackends.at(id))++;
+	}
+
+	for (U16 backendIndex = 0; backendIndex < numBackends; ++backendIndex)
+	{
+		// Failed backend is retried later. (Its frames are dispatched to the other backends meanwhile)
+		if (rCurrentTP < mBackendRetryTPs.at(backendIndex))
+			continue;
+
+		for (auto n = numPooled.at(backendIndex); n < mSettings.poolSize; ++n)
+			StartConnection(backendIndex);
+	}
+
+	if (rCurrentTP >= mStatsTP)
+	{
+		mStatsTP = rCurrentTP + std::chrono::seconds(StatsIntervalSec);
+
+		LogBackendStats(numConnections);
+		LogSchedulerStats();
+	}
+}
+
+void Analytics::HandleBackendFailure(U16 backendIndex, const TimePoint& rCurrentTP)
+{
+	auto& rRetryDelaySec = mBackendRetryDelaySec.at(backendIndex);
+
+	mBackendNumFailures.at(backendIndex)++;
+	mBackendRetryTPs.at(backendIndex) = rCurrentTP + std::chrono::seconds(rRetryDelaySec);
+
+	if (mBackendIsUp.at(backendIndex))
+	{
+		const auto& rBackend = mSettings.backends.at(backendIndex);
+
+		LOG_WARNING(Log::Channel::Analytics, "Analytics backend #%u (%s:%d) is DOWN.", backendIndex, rBackend.address.c_str(), rBackend.port);
+
+		mBackendIsUp.at(backendIndex) = false;
+	}
+
+	rRetryDelaySec = std::min<U16>(rRetryDelaySec * 2, MaxRetryDelaySec);
+}
+
+void Analytics::HandleBackendReady(U16 backendIndex)
+{
+	mBackendRetryDelaySec.at(backendIndex) = MinRetryDelaySec;
+
+	if (!mBackendIsUp.at(backendIndex))
+	{
+		const auto& rBackend = mSettings.backends.at(backendIndex);
+
+		LOG_MESSAGE(Log::Channel::Analytics, "Analytics backend #%u (%s:%d) is UP.", backendIndex, rBackend.address.c_str(), rBackend.port);
+
+		mBackendIsUp.at(backendIndex) = true;
+	}
+}
+
+void Analytics::LogBackendStats(const Vector<U32>& rNumConnections) const
+{
+	for (U16 backendIndex = 0; backendIndex < static_cast<U16> (mSettings.backends.size()); ++backendIndex)
+	{
+		const auto& rBackend = mSettings.backends.at(backendIndex);
+
+		LOG_MESSAGE(Log::Channel::Analytics, "Analytics backend #%u (%s:%d) %s: connections: %u, in-flight: %u, latency: %u ms, results: %" PRIu64 ", failures: %" PRIu64,
+			backendIndex, rBackend.address.c_str(), rBackend.port, mBackendIsUp.at(backendIndex) ? "UP" : "DOWN",
+			rNumConnections.at(backendIndex), mBackendInFlight.at(backendIndex), mBackendLatencyMs.at(backendIndex),
+			mBackendNumResults.at(backendIndex), mBackendNumFailures.at(backendIndex));
+	}
+}
+
+// Reads all the available data and handles all the complete messages.
+// Returns false if the connection was released. (Protocol error)
+bool Analytics::HandleRead(AnalyticsSessionId id)
+{
+	const auto socketId = mAnalyticsSockets.at(id);
+
+	auto& rBuffer = mAnalyticsReadBuffers.at(id);
+
+	// NOTE:
+	// Short read means the socket is drained, so usually a single "recv" is made per readiness event.
+	for (;;)
+	{
+		size_t freeSize = 0;
+		char* pFree = rBuffer.GetWriteArea(freeSize);
+
+		const ssize_t bytesReceived = recv(socketId, pFree, freeSize, 0);
+
+		if (bytesReceived > 0)
+		{
+			rBuffer.Commit(static_cast<size_t> (bytesReceived));
+
+			if (static_cast<size_t> (bytesReceived) < freeSize)
+				break;
+
+			continue;
+		}
+
+		if (bytesReceived == 0)
+			break; // Closed by the ANL server. (Reported as the hang-up, see "HandleSocketEvent")
+
+		const int errorCode = Socket::GetErrorCode();
+
+		if (errorCode == EINTR)
+			continue;
+
+		if (errorCode != EAGAIN && errorCode != EWOULDBLOCK)
+			LOG_ERROR(Log::Channel::Analytics, "Analytics failed for \"recv\"! (Error: %s, Code: %d, Id: %u)", Socket::GetErrorString(errorCode), errorCode, id);
+
+		break;
+	}
+
+	return HandleMessages(id);
+}
+
+// Handles the complete messages received so far, the partial one is left in the buffer.
+// Returns false if the connection was released. (Protocol error)
+bool Analytics::HandleMessages(AnalyticsSessionId id)
+{
+	auto& rBuffer = mAnalyticsReadBuffers.at(id);
+
+	for (;;)
+	{
+		// Socket is connected, but actual analytics session was not yet initialized.
+		// So try and read the initial data thad is sent to us by the Analytics server.
+		if (mAnalyticsStatus.at(id) == SatusFlags::Connected)
+		{
+			if (rBuffer.GetSize() < HelloSize)
+				return true;
+
+			U32 clientId = 0;
+			U16 protocolVersion = 0;
+
+			rBuffer.Peek(0, &clientId, sizeof(clientId));
+			rBuffer.Peek(4, &protocolVersion, sizeof(protocolVersion));
+			rBuffer.Consume(HelloSize);
+
+			LOG_DEBUG(Log::Channel::Analytics, "Analytics new session HANDSHAKE. (Id: %u, Client id: %u, protocol-version: %u)", id, clientId, protocolVersion);
+
+			mAnalyticsStatus.at(id)   = SatusFlags::Handshake;
+			mAnalyticsUniqueId.at(id) = clientId;
+
+			// Older servers only send the XML results.
+			mAnalyticsProtocolVersion.at(id) = (mSettings.isBinaryResults && protocolVersion >= BinaryProtocolVersion) ? BinaryProtocolVersion : XMLProtocolVersion;
+
+			LOG_MESSAGE(Log::Channel::Analytics, "Analytics connection (id: %u) is pooled. (%s results)", id, (mAnalyticsProtocolVersion.at(id) == BinaryProtocolVersion) ? "binary" : "XML");
+
+			HandleBackendReady(mAnalyticsBackends.at(id));
+		}
+		else if (mAnalyticsStatus.at(id) == SatusFlags::Ready)
+		{
+/*
+#pragma pack(push, 1)
+			struct Header
+			{
+				quint8  mark;
+				quint8	type;	// enum MessageType
+				quint32	size;	// Whole message, including the header.
+			};
+#pragma pack(pop)
+*/
+			// Check if we have enough bytes to read at least the header.
+			if (rBuffer.GetSize() < MessageHeaderSize)
+				return true;
+
+			U32 messageSize = 0;
+			rBuffer.Peek(2, &messageSize, sizeof(messageSize)); // Skip the "mark" and "type" (2 bytes)
+
+			if (messageSize < MessageHeaderSize + 4 || messageSize > MaxMessageSize)
+			{
+				LOG_ERROR(Log::Channel::Analytics, "Analytics message has invalid size: %u (Id: %u)", messageSize, id);
+
+				ReleaseConnection(id);
+				HandleBackendFailure(mAnalyticsBackends.at(id), std::chrono::steady_clock::now());
+				return false;
+			}
+
+			// Check if we have the whole message. (Buffer is grown, so the rest of it can be received at once)
+			if (rBuffer.GetSize() < messageSize)
+			{
+				rBuffer.Reserve(messageSize);
+				return true;
+			}
+
+			const char* pMessage = rBuffer.GetContiguous(messageSize);
+
+			if (static_cast<U8> (pMessage[1]) == MessageTypeBinaryResults)
+				HandleBinaryResult(id, pMessage + MessageHeaderSize, messageSize - MessageHeaderSize);
+			else
+				HandleXMLResult(id, pMessage + MessageHeaderSize + 4, messageSize - (MessageHeaderSize + 4));
+
+			rBuffer.Consume(messageSize);
+		}
+		else
+		{
+			// Handshake is not sent yet, the rest is handled once it's leased. (See "LeaseConnection")
+			return true;
+		}
+	}
+}
+
+void Analytics::HandleXMLResult(AnalyticsSessionId id, const char* pXML, size_t xmlSize)
+{
+	U32 fileId = 0;
+
+	if (!GetResultFileId(pXML, xmlSize, fileId))
+	{
+		LOG_ERROR(Log::Channel::Analytics, "Analytics result without the \"fileId\"! (Id: %u)", id);
+		return;
+	}
+
+	HandleResult(id, fileId, false, pXML, xmlSize);
+}
+
+void Analytics::HandleBinaryResult(AnalyticsSessionId id, const char* pData, size_t size)
+{
+	BinaryResults results;
+
+	if (size >= sizeof(BinaryResults))
+		memcpy(&results, pData, sizeof(BinaryResults));
+
+	if (size < sizeof(BinaryResults) || size != sizeof(BinaryResults) + results.numObjects * sizeof(BinaryObject))
+	{
+		LOG_ERROR(Log::Channel::Analytics, "Analytics binary result has invalid size: %zu (Id: %u)", size, id);
+		return;
+	}
+
+	HandleResult(id, results.fileId, true, pData, size);
+}
+
+// Results are parsed by the pool workers. (See "ProcessResults")
+void Analytics::HandleResult(AnalyticsSessionId id, U32 fileId, bool isBinary, const char* pData, size_t size)
+{
+	// Frames are pipelined, so the result is matched to the in-flight footage before it's queued.
+	InFlight frame;
+
+	if (!CompleteFootage(id, fileId, frame))
+	{
+		// Already timed-out or failed.
+		LOG_WARNING(Log::Channel::Analytics, "Analytics result for unknown footage. (Id: %u, fileId: %u)", id, fileId);
+		return;
+	}
+
+	// Backend latency. (Exponential moving average, 1/8 weight for the new sample)
+	{
+		const auto backendIndex = mAnalyticsBackends.at(id);
+		const auto latencyMs = static_cast<U32> (std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - frame.sentTP).count());
+
+		auto& rLatencyMs = mBackendLatencyMs.at(backendIndex);
+
+		rLatencyMs = (mBackendNumResults.at(backendIndex) == 0) ? latencyMs : (rLatencyMs * 7 + latencyMs) / 8;
+
+		mBackendNumResults.at(backendIndex)++;
+
+		TRACE_EVENT(AnalyticsResult, frame.eventFootageId, frame.eventId, latencyMs);
+
+		Metrics::Add(gMetrics.analyticsResults);
+		Metrics::Add(gMetrics.analyticsLatencyMs, latencyMs);
+	}
+
+	gFootageLatency.Mark(frame.eventFootageId, FootageLatency::Stage::Result);
+
+	QueueResult(ResultsInfo(id, frame.cameraId, frame.personThreshold, frame.isBackfill, frame.eventId, frame.eventFootageId, frame.geometry, frame.queuedTP, frame.contentHash, isBinary, String(pData, size)));
+
+#if 0
+	static int resultCounter;
+	std::fstream file;
+	file.open("XML_" + std::to_string(resultCounter++) + ".xml", std::ios::out | std::fstream::binary);
+
+	if (!file.is_open())
+		LOG_ERROR(Log::Channel::Analytics, "Failed to write Analytics file: %s", strerror(Socket::GetErrorCode()));
+
+	file.write(pData, size);
+#endif
+}
+
+// Pooled connection is leased to the event, the handshake tells the server the event's alarm id.
+// Returns false if the connection was released.
+bool Analytics::LeaseConnection(AnalyticsSessionId id, EventId eventId)
+{
+#pragma pack(push, 1)
+	struct Handshake
+	{
+		U32 clientId = 0;
+		U16 type = 0;			// TODO: Enumeration: Default, person, car, plant, etc.
+		U16 quality = 0;		// STREAM_QUALITY_LOW = 0, STREAM_QUALITY_MED,  STREAM_QUALITY_HIGH
+		U32 streamTypeA = 1;	// STREAM_TYPE_UNKNOWN = 0, STREAM_TYPE_JPEG = 1, STREAM_TYPE_VIDEO = 2,
+
+		// Header.
+		uint8_t mark = 7;
+		uint8_t messageType = 1; // NET_MSG_TYPE_HELLO
+		U32 size = 0;
+
+		U16 protocolVersion = 0;
+		int64_t	alarmId = 0;
+		uint8_t threshold = 20; // Default.
+		uint8_t streamTypeB = 1; // STREAM_TYPE_JPEG = 1
+
+		U16 nameLength = 16;
+		char name[16]{ "Test\0" };
+
+		uint8_t findLicensePlates = 0;
+	} handshake;
+#pragma pack(pop)
+
+	handshake.clientId = mAnalyticsUniqueId.at(id);
+
+	handshake.size = 37;
+	handshake.protocolVersion = mAnalyticsProtocolVersion.at(id);
+	handshake.alarmId = static_cast<int64_t> (eventId);
+
+	try
+	{
+		Socket::Send(mAnalyticsSockets.at(id), (char*)&handshake, sizeof(Handshake));
+
+		if (mSettings.backends.at(mAnalyticsBackends.at(id)).isSharedMemory)
+			CreateRing(id);
+	}
+	catch (const Exception& e)
+	{
+		LOG_ERROR(Log::Channel::Analytics, "Analytics::LeaseConnection[HANDSHAKE]: %s\n", e.GetText());
+		ReleaseConnection(id);
+
+		HandleBackendFailure(mAnalyticsBackends.at(id), std::chrono::steady_clock::now());
+		return false;
+	}
+
+	LOG_DEBUG(Log::Channel::Analytics, "Analytics connection (id: %u) is leased. (EventId: %" PRIu64 "%s)", id, eventId, mAnalyticsRings.at(id) ? ", shared memory frames" : "");
+
+	mAnalyticsEvents.at(id) = eventId;
+	mAnalyticsStatus.at(id) = SatusFlags::Ready;
+	mAnalyticsTimePoints.at(id) = std::chrono::steady_clock::now();
+
+	// Anything received before the handshake was sent.
+	return HandleMessages(id);
+}
+
+// Frames of the connection are sent using the new shared memory ring, the server is told to attach to it.
+// If the ring can't be created the frames are sent using the socket. (Throws "Exception" if the socket fails)
+void Analytics::CreateRing(AnalyticsSessionId id)
+{
+	auto ringPtr = std::make_shared<SharedMemoryRing>();
+
+	char name[sizeof(ShmAttach::name)];
+	snprintf(name, sizeof(name), "/viquant-%d-%u", static_cast<int> (getpid()), mRingCounter++);
+
+	try
+	{
+		ringPtr->Create(name, mSettings.shmNumSlots, mSettings.shmSlotSize);
+	}
+	catch (const Exception& e)
+	{
+		LOG_WARNING(Log::Channel::Analytics, "Analytics connection (id: %u) frames are sent using the socket. (%s)", id, e.GetText());
+		return;
+	}
+
+	ShmAttach attach;
+
+	attach.size = static_cast<U32> (sizeof(ShmAttach));
+	attach.numSlots = ringPtr->GetNumSlots();
+	attach.slotSize = ringPtr->GetSlotCapacity();
+	memcpy(attach.name, name, sizeof(name));
+
+	Socket::Send(mAnalyticsSockets.at(id), (char*)&attach, sizeof(ShmAttach));
+
+	mAnalyticsRings.at(id) = std::move(ringPtr);
+}
+
+void Analytics::ThreadProc()
+{
+	LOG_MESSAGE(Log::Channel::Analytics, "Analytics thread started.");
+
+	if (gpFlightRecorder)
+		gpFlightRecorder->SetThreadName("Analytics");
+
+	for (auto& rBackend : mSettings.backends)
+		LOG_MESSAGE(Log::Channel::Analytics, "Analytics server: %s:%d", rBackend.address.c_str(), rBackend.port);
+
+	LOG_MESSAGE(Log::Channel::Analytics, "Analytics pool size: %u (per server), max age: %u sec", mSettings.poolSize, mSettings.poolMaxAgeSec);
+	LOG_MESSAGE(Log::Channel::Analytics, "Analytics in-flight window: %u, batch size: %u", mSettings.inFlightWindow, mSettings.batchSize);
+
+	try
+	{
+		LOG_MESSAGE(Log::Channel::Analytics, "Connecting to the Database (%s:%d)", mDBInfo.hostname.c_str(), mDBInfo.port);
+
+		// Results are written by the pool workers, the first connection is made right away. (Problems are reported at the start)
+		auto databasePtr = TakeResultConnection();
+
+		if (!databasePtr)
+			return;
+
+		ReleaseResultConnection(std::move(databasePtr));
+
+		// Pool is connected before the first event arrives.
+		HandlePool(std::chrono::steady_clock::now());
+
+		epoll_event events[MaxEpollEvents];
+
+		while (!mIsStopRequested)
+		{
+			const int numEvents = epoll_wait(mEpollId, events, MaxEpollEvents, EpollTimeoutMs);
+
+			if (numEvents == -1 && Socket::GetErrorCode() != EINTR)
+			{
+				int errorCode = Socket::GetErrorCode();
+				throw ExceptionVA("Failed for \"epoll_wait\"! (Error: %s, Code: %d)", Socket::GetErrorString(errorCode), errorCode);
+			}
+
+			for (int i = 0; i < numEvents; ++i)
+			{
+				if (events[i].data.u64 == WakeEventTag)
+				{
+					eventfd_t value;
+					eventfd_read(mWakeEventId, &value);
+					continue;
+				}
+
+				HandleSocketEvent(static_cast<AnalyticsSessionId> (events[i].data.u64), events[i].events);
+			}
+
+			const auto currentTP = std::chrono::steady_clock::now();
+
+			HandleTimeouts(currentTP);
+
+			HandlePool(currentTP);
+
+			HandleQueuedEvents();
+
+			HandleResultStrands();
 
-			WriteQueuedResults(database);
-
 			HandleQueuedFootageList();
 
-			HandleQueuedFootageMap();
+			HandleQueuedFootageMap();
+
+			UpdateMetrics();
+		}
+	}
+	catch (const Exception& e)
+	{
+		LOG_ERROR(Log::Channel::Analytics, "Analytics: %s\n", e.GetText());
+	}
+
+	LOG_MESSAGE(Log::Channel::Analytics, "Analytics thread stopped.");
+}
+
+void Analytics::UpdateMetrics()
+{
+	U64 numInFlight = 0;
+	U64 numQueued = 0;
+
+	for (const auto n : mBackendInFlight)
+		numInFlight += n;
+
+	for (const auto& r : mEventMap)
+		numQueued += r.second.footageQueue.size();
+
+	Metrics::Set(gMetrics.analyticsInFlight, numInFlight);
+	Metrics::Set(gMetrics.analyticsQueueDepth, numQueued);
+	Metrics::Set(gMetrics.analyticsBackfillDepth, mBackfillQueue.size());
+}
+
+#pragma pack(push, 1)
+struct Frame
+{
+	// Header.
+	uint8_t mark = 7;
+	uint8_t type = 2; // NET_MSG_TYPE_FRAME
+	U32 size = 0;
+
+	U32 fileId = 777;
+	U32 payloadSize = 0;
+
+	// ... Toliau seka payloadas/image'as.
+};
+#pragma pack(pop)
+
+// Reads the footage files and writes them to the analytics socket as consecutive "frame" messages.
+// (All the frames are prepared into a single buffer, so the batch is handed to the socket at once)
+// With the shared memory ring the files are read straight into its slots instead, only the frames that don't fit are sent using the socket.
+void Analytics::SendFootageTask(Analytics* pAnalytics, SocketId socketId, Vector<Session::Footage> footageList, std::shared_ptr<SendState> sendStatePtr, std::shared_ptr<SharedMemoryRing> ringPtr)
+{
+	Vector<char> sendBuffer;
+	Vector<EventFootageId> sendIds;
+
+	Vector<char> output;
+
+	for (auto& rFootage : footageList)
+	{
+		// Stopping, the rest is not sent. (See "~Analytics")
+		if (pAnalytics->mIsStopRequested)
+			break;
+
+		const String& rFileName = rFootage.fileName;
+
+		try
+		{
+			std::ifstream fileStream(rFileName, std::ios::in | std::ifstream::binary);
+
+			if (!fileStream.is_open())
+				throw ExceptionVA("Failed to open: \"%s\".", rFileName.c_str());
+
+			// Determine the file size.
+			fileStream.seekg(0, std::ios_base::end);
+
+			auto length = fileStream.tellg();
+
+			if (length <= 0)
+				throw ExceptionVA("No data for: \"%s\".", rFileName.c_str());
+
+			fileStream.seekg(0, std::ios_base::beg);
+
+			// IMPORTANT:
+			// fileId is 32 bits, eventFootageId is 64 bits of size.
+			// Results are matched back to the in-flight footage using this value.
+			const U32 fileId = static_cast<U32> (rFootage.eventFootageId);
+
+			if (ringPtr)
+			{
+				char* pSlot = (static_cast<size_t> (length) <= ringPtr->GetSlotCapacity()) ? ringPtr->AcquireSlot() : nullptr;
+
+				if (pSlot != nullptr)
+				{
+					fileStream.read(pSlot, length);
+
+					if (!fileStream)
+						throw ExceptionVA("Failed to read: \"%s\".", rFileName.c_str());
+
+					size_t size = static_cast<size_t> (length);
+
+					if (pAnalytics->PreprocessFootage(rFootage, pSlot, size, output))
+					{
+						// NOTE: Preprocessed frame could be larger (different Huffman tables), then the original is sent as it is.
+						if (output.size() <= ringPtr->GetSlotCapacity())
+						{
+							memcpy(pSlot, output.data(), output.size());
+							size = output.size();
+						}
+						else
+							pAnalytics->TakeFrameGeometry(rFootage.eventFootageId);
+					}
+
+					ringPtr->Publish(fileId, static_cast<U32> (size));
+
+					TRACE_EVENT(AnalyticsSend, rFootage.eventFootageId, 0, size);
+
+					pAnalytics->mNumRingFrames++;
+					continue;
+				}
+
+				pAnalytics->mNumRingFallbacks++;
+			}
+
+			// Frame header followed by the payload (file content).
+			const auto offset = sendBuffer.size();
+			const auto payloadOffset = offset + sizeof(Frame);
+
+			sendBuffer.resize(payloadOffset + static_cast<size_t> (length));
+
+			fileStream.read(&sendBuffer[payloadOffset], length);
+
+			if (!fileStream)
+			{
+				sendBuffer.resize(offset);
+				throw ExceptionVA("Failed to read: \"%s\".", rFileName.c_str());
+			}
+
+			// NOTE: Might replace the payload, so the header is filled in afterwards.
+			if (pAnalytics->PreprocessFootage(rFootage, &sendBuffer[payloadOffset], static_cast<size_t> (length), output))
+			{
+				sendBuffer.resize(payloadOffset);
+				sendBuffer.insert(sendBuffer.end(), output.begin(), output.end());
+			}
+
+			Frame frame;
+
+			frame.payloadSize = static_cast<U32>(sendBuffer.size() - payloadOffset);
+			frame.size = static_cast<U32>(sizeof(Frame)) + frame.payloadSize;
+
+			// TODO:
+			// "fileId" buvo skirtas video failams, atspingi video faile esancio kadru numeri.
+			// Bet kol kas video failu nepalaikome, o mums reikia perduoti "eventFootageId"
+			frame.fileId = fileId;
+
+			memcpy(&sendBuffer[offset], &frame, sizeof(Frame));
+
+			sendIds.push_back(rFootage.eventFootageId);
+		}
+		catch (const Exception& e)
+		{
+			LOG_ERROR(Log::Channel::Analytics, "Analytics::SendFootageTask: %s", e.GetText());
+
+			sendStatePtr->failedIds.push_back(rFootage.eventFootageId);
+		}
+	}
+
+	if (!sendBuffer.empty())
+	{
+		try
+		{
+			Socket::Send(socketId, sendBuffer.data(), sendBuffer.size());
+
+			for (const auto eventFootageId : sendIds)
+				TRACE_EVENT(AnalyticsSend, eventFootageId, 0, sendBuffer.size());
+		}
+		catch (const Exception& e)
+		{
+			LOG_ERROR(Log::Channel::Analytics, "Analytics::SendFootageTask: %s", e.GetText());
+
+			sendStatePtr->unsentIds.insert(sendStatePtr->unsentIds.end(), sendIds.begin(), sendIds.end());
+		}
+	}
+
+	sendStatePtr->isSendAllowed = true;
+
+	// Next queued footage can be sent right away.
+	pAnalytics->WakeUp();
+
+	// NOTE: Last, the "Analytics" might be destroyed right after.
+	pAnalytics->mNumSendTasks--;
+}
+
+// Crops the frame to the camera's region of interest and downscales it. (Originals on the disk are not touched)
+// Returns false if the original frame should be sent, otherwise the preprocessed JPEG is in the "rOutput".
+bool Analytics::PreprocessFootage(const Session::Footage& rFootage, const char* pData, size_t size, Vector<char>& rOutput)
+{
+	const auto it = mSettings.cameraRegions.find(rFootage.cameraId);
+
+	if (mSettings.maxFrameWidth == 0 && it == mSettings.cameraRegions.end())
+		return false;
+
+	const JPEG::Region region = (it != mSettings.cameraRegions.end()) ? it->second : JPEG::Region();
+
+	const auto startTP = std::chrono::steady_clock::now();
+
+	JPEG::Geometry geometry;
+
+	rOutput.clear();
+
+	// Not a baseline JPEG (or nothing to do), the original is sent.
+	if (!JPEG::Preprocess(pData, size, region, mSettings.maxFrameWidth, rOutput, geometry))
+		return false;
+
+	{
+		std::lock_guard<std::mutex> lock(mFrameGeometryMutex);
+		mFrameGeometry[rFootage.eventFootageId] = geometry;
+	}
+
+	mNumPreprocessed++;
+	mPreprocessBytesIn += size;
+	mPreprocessBytesOut += rOutput.size();
+	mPreprocessUs += static_cast<U64> (std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTP).count());
+
+	return true;
+}
+
+// Returns (and forgets) the placement of the preprocessed frame, the default one if the frame was sent as it is.
+JPEG::Geometry Analytics::TakeFrameGeometry(EventFootageId eventFootageId)
+{
+	JPEG::Geometry geometry;
+
+	if (mSettings.maxFrameWidth == 0 && mSettings.cameraRegions.empty())
+		return geometry;
+
+	std::lock_guard<std::mutex> lock(mFrameGeometryMutex);
+
+	auto it = mFrameGeometry.find(eventFootageId);
+	if (it != mFrameGeometry.end())
+	{
+		geometry = it->second;
+		mFrameGeometry.erase(it);
+	}
+
+	return geometry;
+}
+
+// Starts and ends the analytics sessions requested by the "AddEvent" and "EndEvent".
+void Analytics::HandleQueuedEvents()
+{
+	mEventMutex.lock();
+
+	if (mEventQueue.empty())
+	{
+		mEventMutex.unlock();
+		return;
+	}
+
+	Vector<EventInfo> localQueue;
+	localQueue.swap(mEventQueue);
+
+	mEventMutex.unlock();
+
+	for (auto& r : localQueue)
+	{
+		if (r.isEnd)
+			EndSession(r.eventId);
+		else
+			StartSession(r);
+	}
+}
+
+// Checks if there is any queued footage that needs to be mapped to the event queue.
+void Analytics::HandleQueuedFootageList()
+{
+	std::lock_guard<std::mutex> lock(mFootageMutex);
+
+	if (mFootageQueue.empty())
+		return;
+
+	for (auto& r : mFootageQueue)
+	{
+		auto it = mEventMap.find(r.eventId);
+		if (it == mEventMap.end())
+		{
+			// Probably "Analytics::EndEvent" was called while still having some queued footage...
+			// TODO: I should still analize all the queued footage...!
+			LOG_ERROR(Log::Channel::Analytics, "Analytics event map is missing event id: %" PRIu64 ", can't process event footage id: %" PRIu64, r.eventId, r.eventFootageId);
+			gFootageLatency.Finish(r.eventFootageId);
+			continue;
+		}
+
+		auto& rSession = it->second;
+
+		// If "person" was detected with the appropriate threshold,
+		// We will stop sending all other event associated footage to the analytics server.
+		if (rSession.isDone)
+		{
+			gFootageLatency.Finish(r.eventFootageId);
+			continue;
+		}
+
+		if (IsCachedFootage(r.eventId, rSession, r.eventFootageId, r.queuedTP, r.contentHash))
+			continue;
+
+		// NOTE: The footage is still stored (and listed), it just gets no analytics results.
+		if (IsDuplicateFootage(rSession, r.signature))
+		{
+			gFootageLatency.Finish(r.eventFootageId);
+			continue;
+		}
+
+		rSession.footageQueue.push_back({ r.eventFootageId, r.name, 0, r.queuedTP, rSession.numQueued++, 0, r.contentHash });
+	}
+
+	mFootageQueue.clear();
+}
+
+// Cameras resend the same buffered frames (after a reconnect or for a new event), byte-identical frames are not analyzed again.
+// Results of the identical frame are queued as if they were received, so the frame gets its detections and the notification.
+bool Analytics::IsCachedFootage(EventId eventId, const Session& rSession, EventFootageId eventFootageId, const TimePoint& rQueuedTP, U64 contentHash)
+{
+	if (contentHash == 0)
+		return false;
+
+	std::shared_ptr<const Vector<Detection>> detectionsPtr;
+
+	if (!FindCachedResult(rSession.cameraId, contentHash, detectionsPtr))
+		return false;
+
+	mNumCacheHits++;
+
+	gFootageLatency.Mark(eventFootageId, FootageLatency::Stage::Result);
+
+	ResultsInfo result(InvalidAnalyticsSessionId, rSession.cameraId, rSession.personThreshold, false, eventId, eventFootageId, JPEG::Geometry(), rQueuedTP, 0, false, String());
+
+	result.cachedDetectionsPtr = std::move(detectionsPtr);
+
+	QueueResult(result);
+
+	return true;
+}
+
+// Static scenes (and the repeated pre-alarm buffer frames) produce nearly identical frames,
+// there is no point running the inference on every one of them.
+bool Analytics::IsDuplicateFootage(Session& rSession, const JPEG::Signature& rSignature)
+{
+	if (!mSettings.isPrefilter)
+		return false;
+
+	std::lock_guard<std::mutex> lock(mCameraStatsMutex);
+
+	auto& rStats = *rSession.pCameraStats;
+
+	rStats.numSignatures++;
+	rStats.signatureUs += rSignature.costUs;
+
+	// Not a baseline JPEG, can't tell.
+	if (!rSignature.isValid)
+		return false;
+
+	// The event's first frame is always sent.
+	// NOTE:
+	// Frames are compared to the last sent frame (not the previous one), so that the slow scene changes still add up.
+	const bool isDuplicate = rSession.numQueued > 0 && rStats.lastSignature.isValid
+		&& JPEG::GetDistance(rStats.lastSignature, rSignature, mSettings.prefilterCellDelta) <= mSettings.prefilterMaxCells;
+
+	if (isDuplicate)
+		rStats.numDuplicates++;
+	else
+		rStats.lastSignature = rSignature;
+
+	return isDuplicate;
+}
+
+void Analytics::HandleQueuedFootageMap()
+{
+	if (mEventMap.empty())
+		return;
+
+	ScheduleFootage(std::chrono::steady_clock::now());
+
+	for (auto it = mEventMap.begin(); it != mEventMap.end(); )
+	{
+		const auto eventId = it->first;
+		auto& rSession = it->second;
+
+		// Deferred "EndEvent", release the session once there is nothing left to send and no more results to wait for.
+		// (If "person" was already detected, the results that are still in-flight are ignored by the "ProcessResults")
+		const bool isDrained = rSession.numInFlight == 0 && (rSession.isDone || rSession.footageQueue.empty());
+
+		if (rSession.isEnded && isDrained)
+		{
+			LOG_MESSAGE(Log::Channel::Analytics, "Analytics session (Event id: %" PRIu64 ") ended.", eventId);
+
+			it = mEventMap.erase(it);
+			continue;
+		}
+
+		++it;
+	}
+}
+
+// Sends the queued footage of all the events, while there are any connections available.
+// Order:
+//	1. The first frames of the new events. (Cameras with the lower person threshold first - they alarm on the weaker detections)
+//	2. The camera that was served the longest time ago. (Fair share across the cameras, no matter how many frames they upload)
+//	3. The oldest frame.
+void Analytics::ScheduleFootage(const TimePoint& rCurrentTP)
+{
+	size_t numQueued = 0;
+
+	for (auto& r : mEventMap)
+	{
+		auto& rSession = r.second;
+
+		// If "person" was detected with the appropriate threshold,
+		// We will stop sending all other event associated footage to the analytics server.
+		if (rSession.isDone)
+		{
+			for (const auto& rFrame : rSession.footageQueue)
+				gFootageLatency.Finish(rFrame.eventFootageId);
+
+			rSession.footageQueue.clear();
+		}
+		else
+			SkipStaleFootage(r.first, rSession, rCurrentTP);
+
+		numQueued += rSession.footageQueue.size();
+	}
+
+	HandleOverload(numQueued);
+
+	if (mIsOverloaded)
+	{
+		for (auto& r : mEventMap)
+			DecimateFootage(r.first, r.second);
+	}
+
+	// Events that can't get their connection right now. (Busy or the pool is empty)
+	Vector<EventId> waitingEvents;
+
+	for (;;)
+	{
+		auto itBest = mEventMap.end();
+		std::tuple<bool, U8, U64, TimePoint> bestKey;
+
+		for (auto it = mEventMap.begin(); it != mEventMap.end(); ++it)
+		{
+			const auto& rSession = it->second;
+
+			if (rSession.footageQueue.empty() || rSession.isDone)
+				continue;
+
+			if (std::find(waitingEvents.begin(), waitingEvents.end(), it->first) != waitingEvents.end())
+				continue;
+
+			const bool isNew = rSession.numSent < mSettings.firstFramesCount;
+
+			const auto key = std::make_tuple(!isNew, isNew ? rSession.personThreshold : U8(0), rSession.pCameraStats->scheduleIndex, rSession.footageQueue.front().queuedTP);
+
+			if (itBest == mEventMap.end() || key < bestKey)
+			{
+				itBest = it;
+				bestKey = key;
+			}
+		}
+
+		if (itBest != mEventMap.end())
+		{
+			const auto id = GetAvailableConnection(itBest->first);
+
+			if (id == InvalidAnalyticsSessionId)
+				waitingEvents.push_back(itBest->first);
+			else
+				SendSessionFootage(id, itBest->first, itBest->second, rCurrentTP);
+
+			continue;
+		}
+
+		// Nothing else is queued, system is idle.
+		if (!waitingEvents.empty() || mIsOverloaded || mBackfillQueue.empty())
+			return;
+
+		const auto id = GetAvailableConnection(mBackfillQueue.front().eventId);
+
+		if (id == InvalidAnalyticsSessionId)
+			return;
+
+		SendBackfillFootage(id, rCurrentTP);
+	}
+}
+
+// Overload is entered once the queued frames or the results latency exceed the limits,
+// and left only when the queue drains to the half of the limit. (So the mode doesn't flip on every tick)
+void Analytics::HandleOverload(size_t numQueued)
+{
+	// Latency of the fastest backend, while there are frames waiting for the results.
+	// (Latency is not updated without the results, so it's not trusted when nothing is in-flight)
+	U32 latencyMs = 0;
+
+	for (size_t i = 0; i < mBackendInFlight.size(); ++i)
+	{
+		if (mBackendInFlight.at(i) == 0 || mBackendNumResults.at(i) == 0)
+			continue;
+
+		if (latencyMs == 0 || mBackendLatencyMs.at(i) < latencyMs)
+			latencyMs = mBackendLatencyMs.at(i);
+	}
+
+	const bool isLatencyOver = mSettings.overloadLatencyMs > 0 && latencyMs > mSettings.overloadLatencyMs;
+
+	if (!mIsOverloaded)
+	{
+		const bool isQueueOver = mSettings.overloadQueueSize > 0 && numQueued > mSettings.overloadQueueSize;
+
+		if (isQueueOver || isLatencyOver)
+		{
+			LOG_WARNING(Log::Channel::Analytics, "Analytics is OVERLOADED, frames are decimated. (Queued: %u, Latency: %u ms)", static_cast<U32> (numQueued), latencyMs);
+			mIsOverloaded = true;
+		}
+	}
+	else
+	{
+		const bool isQueueOk = mSettings.overloadQueueSize == 0 || numQueued <= mSettings.overloadQueueSize / 2;
+
+		if (isQueueOk && !isLatencyOver)
+		{
+			LOG_MESSAGE(Log::Channel::Analytics, "Analytics is no longer overloaded. (Queued: %u, Latency: %u ms, Back-fill: %u)", static_cast<U32> (numQueued), latencyMs, static_cast<U32> (mBackfillQueue.size()));
+			mIsOverloaded = false;
+		}
+	}
+}
+
+// Leaves only the frames chosen by the "DecimationPolicy", the rest are moved to the back-fill queue.
+void Analytics::DecimateFootage(EventId eventId, Session& rSession)
+{
+	auto& rQueue = rSession.footageQueue;
+
+	if (rQueue.empty() || rSession.isDone)
+		return;
+
+	std::deque<Session::Footage> keptQueue;
+	U32 numDecimated = 0;
+
+	const size_t lastIndex = rQueue.size() - 1;
+
+	for (size_t i = 0; i < rQueue.size(); ++i)
+	{
+		auto& rFrame = rQueue.at(i);
+
+		bool isKept = false;
+
+		switch (mSettings.decimationPolicy)
+		{
+			case DecimationPolicy::Newest:			isKept = (i == lastIndex); break;
+			case DecimationPolicy::EveryNth:		isKept = (rFrame.index % mSettings.decimationN) == 0; break;
+			case DecimationPolicy::FirstAndLatest:	isKept = (rFrame.index < mSettings.decimationK) || (i == lastIndex); break;
+		}
+
+		// NOTE: Frames that were already sent once (failover) are always kept.
+		if (isKept || rFrame.numAttempts > 0)
+		{
+			keptQueue.push_back(std::move(rFrame));
+			continue;
+		}
+
+		numDecimated++;
+
+		if (mSettings.backfillQueueSize == 0)
+		{
+			gFootageLatency.Finish(rFrame.eventFootageId);
+			continue;
+		}
+
+		if (mBackfillQueue.size() >= mSettings.backfillQueueSize)
+		{
+			gFootageLatency.Finish(mBackfillQueue.front().eventFootageId);
+			mBackfillQueue.pop_front();
+			mNumBackfillDropped++;
+		}
+
+		mBackfillQueue.push_back({ eventId, rFrame.eventFootageId, rSession.cameraId, rSession.personThreshold, rFrame.queuedTP, rSession.footagePath + rFrame.fileName });
+	}
+
+	rQueue.swap(keptQueue);
+
+	if (numDecimated == 0)
+		return;
+
+	LOG_DEBUG(Log::Channel::Analytics, "Analytics decimated %u frames. (EventId: %" PRIu64 ", CameraId: %u)", numDecimated, eventId, rSession.cameraId);
+
+	std::lock_guard<std::mutex> lock(mCameraStatsMutex);
+
+	rSession.pCameraStats->numDecimated += numDecimated;
+}
+
+void Analytics::SendBackfillFootage(AnalyticsSessionId id, const TimePoint& rCurrentTP)
+{
+	auto& rInFlight = mAnalyticsInFlight.at(id);
+
+	const size_t maxFrames = std::min<size_t>({ mBackfillQueue.size(), mSettings.batchSize, mSettings.inFlightWindow - rInFlight.size() });
+
+	Vector<Session::Footage> footageList;
+	footageList.reserve(maxFrames);
+
+	// Only the frames of the connection's event. (The rest are sent using their own event's connection)
+	while (footageList.size() < maxFrames && mBackfillQueue.front().eventId == mAnalyticsEvents.at(id))
+	{
+		auto& rFrame = mBackfillQueue.front();
+
+		LOG_DEBUG(Log::Channel::Analytics, "Back-filling footage [Id: %u, EventId: %" PRIu64 ", EventFootageId: %" PRIu64 "]: %s", id, rFrame.eventId, rFrame.eventFootageId, rFrame.filePath.c_str());
+
+		footageList.push_back({ rFrame.eventFootageId, rFrame.filePath, 0, rFrame.queuedTP, 0, rFrame.cameraId });
+
+		rInFlight.push_back({ rFrame.eventId, rFrame.eventFootageId, rFrame.cameraId, rFrame.personThreshold, 0, true, rCurrentTP, rFrame.queuedTP, std::move(rFrame.filePath), {}, 0 });
+
+		gFootageLatency.Mark(rFrame.eventFootageId, FootageLatency::Stage::Sent);
+
+		mBackfillQueue.pop_front();
+	}
+
+	mBackendInFlight.at(mAnalyticsBackends.at(id)) += static_cast<U32> (footageList.size());
+
+	StartSendTask(id, std::move(footageList));
+}
+
+void Analytics::StartSendTask(AnalyticsSessionId id, Vector<Session::Footage>&& rFootageList)
+{
+	auto& rSendStatePtr = mAnalyticsSendStates.at(id);
+
+	rSendStatePtr->isSendAllowed = false;
+
+	mNumSendTasks++;
+	mMain.ThreadPoolPtr->Enqueue(
+		SendFootageTask,
+		this,
+		mAnalyticsSockets.at(id),
+		std::move(rFootageList),
+		rSendStatePtr,
+		mAnalyticsRings.at(id));
+}
+
+// Frames that waited longer than the deadline are not worth analyzing anymore.
+void Analytics::SkipStaleFootage(EventId eventId, Session& rSession, const TimePoint& rCurrentTP)
+{
+	if (mSettings.frameDeadlineSec == 0)
+		return;
+
+	U32 numSkipped = 0;
+
+	auto& rQueue = rSession.footageQueue;
+
+	while (!rQueue.empty())
+	{
+		auto seconds = std::chrono::duration_cast<std::chrono::seconds>(rCurrentTP - rQueue.front().queuedTP).count();
+
+		if (seconds < mSettings.frameDeadlineSec)
+			break;
+
+		gFootageLatency.Finish(rQueue.front().eventFootageId);
+		rQueue.pop_front();
+		numSkipped++;
+	}
+
+	if (numSkipped == 0)
+		return;
+
+	LOG_WARNING(Log::Channel::Analytics, "Analytics skipped %u stale frames. (Deadline: %u sec, EventId: %" PRIu64 ", CameraId: %u)", numSkipped, mSettings.frameDeadlineSec, eventId, rSession.cameraId);
+
+	std::lock_guard<std::mutex> lock(mCameraStatsMutex);
+
+	rSession.pCameraStats->numSkipped += numSkipped;
+}
+
+void Analytics::SendSessionFootage(AnalyticsSessionId id, EventId eventId, Session& rSession, const TimePoint& rCurrentTP)
+{
+	auto& rInFlight = mAnalyticsInFlight.at(id);
+
+	// Frames are pipelined: up to "inFlightWindow" frames might be waiting for the results at the same time.
+	const size_t numFrames = std::min<size_t>({ rSession.footageQueue.size(), mSettings.batchSize, mSettings.inFlightWindow - rInFlight.size() });
+
+	Vector<Session::Footage> footageList;
+	footageList.reserve(numFrames);
+
+	{
+		std::lock_guard<std::mutex> lock(mCameraStatsMutex);
+
+		auto& rStats = *rSession.pCameraStats;
+
+		rStats.scheduleIndex = ++mScheduleCounter;
+		rStats.numSent += numFrames;
+
+		for (size_t i = 0; i < numFrames; ++i)
+		{
+			const auto waitMs = std::chrono::duration_cast<std::chrono::milliseconds>(rCurrentTP - rSession.footageQueue.at(i).queuedTP).count();
+
+			size_t bucket = 0;
+
+			for (auto value = waitMs; value > 1 && bucket < NumWaitBuckets - 1; value >>= 1)
+				bucket++;
+
+			rStats.waitBuckets[bucket]++;
+		}
+	}
+
+	for (size_t i = 0; i < numFrames; ++i)
+	{
+		auto& rFrame = rSession.footageQueue.front();
+
+		LOG_DEBUG(Log::Channel::Analytics, "Analyzing footage [Id: %u, EventId: %" PRIu64 ", EventFootageId: %" PRIu64 "]: %s", id, eventId, rFrame.eventFootageId, rFrame.fileName.c_str());
+
+		footageList.push_back({ rFrame.eventFootageId, rSession.footagePath + rFrame.fileName, rFrame.numAttempts, rFrame.queuedTP, rFrame.index, rSession.cameraId });
+
+		rInFlight.push_back({ eventId, rFrame.eventFootageId, rSession.cameraId, rSession.personThreshold, rFrame.numAttempts, false, rCurrentTP, rFrame.queuedTP, std::move(rFrame.fileName), {}, rFrame.contentHash });
+
+		gFootageLatency.Mark(rFrame.eventFootageId, FootageLatency::Stage::Sent);
+
+		rSession.footageQueue.pop_front();
+	}
+
+	rSession.numSent += static_cast<U32> (numFrames);
+	rSession.numInFlight += static_cast<U32> (numFrames);
+	mBackendInFlight.at(mAnalyticsBackends.at(id)) += static_cast<U32> (numFrames);
+
+	StartSendTask(id, std::move(footageList));
+}
+
+void Analytics::LogSchedulerStats()
+{
+	std::lock_guard<std::mutex> lock(mCameraStatsMutex);
+
+	for (auto& r : mCameraStats)
+	{
+		const auto& rStats = r.second;
+
+		std::ostringstream ss;
+
+		for (size_t i = 0; i < NumWaitBuckets; ++i)
+		{
+			if (rStats.waitBuckets[i] == 0)
+				continue;
 
-			// TMEP?
-			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			if (i == NumWaitBuckets - 1)
+				ss << " >=" << (1u << i) << "ms:" << rStats.waitBuckets[i];
+			else
+				ss << " <" << (2u << i) << "ms:" << rStats.waitBuckets[i];
 		}
+
+		LOG_MESSAGE(Log::Channel::Analytics, "Analytics camera %u: sent: %" PRIu64 ", skipped: %" PRIu64 ", decimated: %" PRIu64 ", queue-wait:%s", r.first, rStats.numSent, rStats.numSkipped, rStats.numDecimated, ss.str().c_str());
+
+		if (rStats.numSignatures > 0)
+			LOG_MESSAGE(Log::Channel::Analytics, "Analytics camera %u prefilter: %" PRIu64 " of %" PRIu64 " frames duplicate (%.1f%%), signature: %" PRIu64 " us avg", r.first, rStats.numDuplicates, rStats.numSignatures, 100.0 * rStats.numDuplicates / rStats.numSignatures, rStats.signatureUs / rStats.numSignatures);
 	}
-	catch (const Exception& e)
+
+	if (!mBackfillQueue.empty() || mNumBackfillDropped > 0)
+		LOG_MESSAGE(Log::Channel::Analytics, "Analytics back-fill: %u queued, %" PRIu64 " dropped", static_cast<U32> (mBackfillQueue.size()), mNumBackfillDropped);
+
+	if (const U64 numPreprocessed = mNumPreprocessed)
+		LOG_MESSAGE(Log::Channel::Analytics, "Analytics preprocessed %" PRIu64 " frames: %" PRIu64 " KB -> %" PRIu64 " KB, %" PRIu64 " us avg", numPreprocessed, mPreprocessBytesIn / 1024, mPreprocessBytesOut / 1024, mPreprocessUs / numPreprocessed);
+
+	if (const U64 numCacheHits = mNumCacheHits)
+		LOG_MESSAGE(Log::Channel::Analytics, "Analytics frame cache: %" PRIu64 " frames reused the results", numCacheHits);
+
+	if (const U64 numRingFrames = mNumRingFrames)
+		LOG_MESSAGE(Log::Channel::Analytics, "Analytics shared memory: %" PRIu64 " frames, %" PRIu64 " sent using the socket", numRingFrames, mNumRingFallbacks.load());
+}
+
+// SAMPLE:
+// {"bucketsMs":[2,4,...,32768],"cameras":[{"id":6,"sent":10,"skipped":0,"decimated":0,"checked":12,"duplicates":2,"signatureUs":850,"wait":[3,5,...,0]}],
+//  "preprocess":{"frames":10,"bytesIn":4194304,"bytesOut":524288,"us":9000}}
+// NOTE: Bucket values are the upper bounds, the last bucket holds everything above the previous one.
+// "signatureUs" (prefilter) and "us" (preprocess) are the averages per frame.
+String Analytics::GetSchedulerStats()
+{
+	std::ostringstream ss;
+
+	ss << "{\"bucketsMs\":[";
+
+	for (size_t i = 0; i < NumWaitBuckets; ++i)
+		ss << (i ? "," : "") << (2u << i);
+
+	ss << "],\"cameras\":[";
+
+	std::lock_guard<std::mutex> lock(mCameraStatsMutex);
+
+	bool isFirst = true;
+
+	for (auto& r : mCameraStats)
 	{
-		LOG_ERROR(Log::Channel::Analytics, "Analytics: %s\n", e.GetText());
+		const auto& rStats = r.second;
+
+		ss	<< (isFirst ? "" : ",")
+			<< "{\"id\":"		<< r.first
+			<< ",\"sent\":"		<< rStats.numSent
+			<< ",\"skipped\":"	<< rStats.numSkipped
+			<< ",\"decimated\":"	<< rStats.numDecimated
+			<< ",\"checked\":"	<< rStats.numSignatures
+			<< ",\"duplicates\":"	<< rStats.numDuplicates
+			<< ",\"signatureUs\":"	<< (rStats.numSignatures ? rStats.signatureUs / rStats.numSignatures : 0) // Average
+			<< ",\"wait\":[";
+
+		for (size_t i = 0; i < NumWaitBuckets; ++i)
+			ss << (i ? "," : "") << rStats.waitBuckets[i];
+
+		ss << "]}";
+
+		isFirst = false;
 	}
 
-	LOG_MESSAGE(Log::Channel::Analytics, "Analytics thread stopped.");
+	const U64 numPreprocessed = mNumPreprocessed;
+
+	ss	<< "],\"preprocess\":{\"frames\":"	<< numPreprocessed
+		<< ",\"bytesIn\":"	<< mPreprocessBytesIn
+		<< ",\"bytesOut\":"	<< mPreprocessBytesOut
+		<< ",\"us\":"			<< (numPreprocessed ? mPreprocessUs / numPreprocessed : 0) // Average
+		<< "}}";
+
+	return ss.str();
 }
 
-void SendFootageTask(SocketId socketId, String path, String name, EventFootageId eventFootageId, std::shared_ptr<std::atomic_bool> footageSendAllowedPtr)
+// Footage that the send task failed to send will never get any results, so stop waiting for them.
+// (Footage that was read, but failed on the socket, is sent again - most likely using the other connection)
+// NOTE: Does nothing while the send task is still running for the connection.
+void Analytics::HandleFailedFootage(AnalyticsSessionId id)
 {
-	const String fileName(path + name);
-	Vector<char> fileBuffer;
+	auto& rSendState = *mAnalyticsSendStates.at(id);
 
-	try
+	if (!rSendState.isSendAllowed)
+		return;
+
+	for (auto eventFootageId : rSendState.failedIds)
 	{
-		// Read footage from file.
-		{
-			std::ifstream fileStream(fileName, std::ios::in | std::ifstream::binary);
+		InFlight frame;
 
-			if (!fileStream.is_open())
-				throw ExceptionVA("Failed to open: \"%s\".", fileName.c_str());
+		if (CompleteFootage(id, static_cast<U32> (eventFootageId), frame))
+			LOG_WARNING(Log::Channel::Analytics, "Footage was not sent for analyzing. [EventId: %" PRIu64 ", EventFootageId: %" PRIu64 "]", frame.eventId, eventFootageId);
+	}
 
-			// Determine the file size.
-			fileStream.seekg(0, std::ios_base::end);
+	for (auto eventFootageId : rSendState.unsentIds)
+	{
+		InFlight frame;
 
-			auto length = fileStream.tellg();
+		if (CompleteFootage(id, static_cast<U32> (eventFootageId), frame))
+			RequeueFootage(frame);
+	}
+
+	rSendState.failedIds.clear();
+	rSendState.unsentIds.clear();
+}
 
-			if (length == 0)
-				throw ExceptionVA("No data for: \"%s\".", fileName.c_str());
+// Removes the footage from the connection's in-flight list. (Results received or failed to send)
+bool Analytics::CompleteFootage(AnalyticsSessionId id, U32 fileId, InFlight& rFrame)
+{
+	auto& rInFlight = mAnalyticsInFlight.at(id);
 
-			// Pre-allocate the buffer for data storage.
-			fileBuffer.resize(static_cast<size_t> (length));
+	// IMPORTANT:
+	// Analytics server returns only the lower 32 bits of the "eventFootageId". (See "Frame::fileId")
+	auto it = std::find_if(rInFlight.begin(), rInFlight.end(), [fileId](const InFlight& r) { return static_cast<U32> (r.eventFootageId) == fileId; });
 
-			fileStream.seekg(0, std::ios_base::beg);
-			fileStream.read(&fileBuffer[0], length);
-		}
+	if (it == rInFlight.end())
+		return false;
 
-	#pragma pack(push, 1)
-		struct Frame
-		{
-			// Header.
-			uint8_t mark = 7;
-			uint8_t type = 2; // NET_MSG_TYPE_FRAME
-			U32 size = 0;
+	rFrame = *it;
+	rFrame.geometry = TakeFrameGeometry(rFrame.eventFootageId);
 
-			U32 fileId = 777;
-			U32 payloadSize = 0;
+	rInFlight.erase(it);
 
-			// ... Toliau seka payloadas/image'as.
-		} mFrame;
-	#pragma pack(pop)
+	ReleaseFootage(id, rFrame);
 
-		mFrame.payloadSize = static_cast<U32>(fileBuffer.size());
-		mFrame.size = static_cast<U32>(sizeof(Frame)) + mFrame.payloadSize;
+	return true;
+}
 
-		// TODO:
-		// "fileId" buvo skirtas video failams, atspingi video faile esancio kadru numeri.
-		// Bet kol kas video failu nepalaikome, o mums reikia perduoti "eventFootageId"
+// Frees up the backend's and the event's in-flight frame. (So the ended event session can be released)
+void Analytics::ReleaseFootage(AnalyticsSessionId id, const InFlight& rFrame)
+{
+	// Frame without any results. (Sent again with the new geometry, if requeued)
+	TakeFrameGeometry(rFrame.eventFootageId);
 
-		// IMPORTANT:
-		// fileId is 32 bits, eventFootageId is 64 bits of size.
-		mFrame.fileId = static_cast<U32> (eventFootageId);
+	auto& rBackendInFlight = mBackendInFlight.at(mAnalyticsBackends.at(id));
 
-		Socket::Send(socketId, (char*)&mFrame, sizeof(Frame));
-		Socket::Send(socketId, fileBuffer.data(), fileBuffer.size());
-	}
-	catch (const Exception& e)
+	if (rBackendInFlight > 0)
+		rBackendInFlight--;
+
+	// Back-filled frames are not counted by the event session.
+	if (rFrame.isBackfill)
+		return;
+
+	auto it = mEventMap.find(rFrame.eventId);
+	if (it == mEventMap.end())
+		return;
+
+	auto& rNumInFlight = it->second.numInFlight;
+
+	if (rNumInFlight > 0)
+		rNumInFlight--;
+}
+
+// Failover: puts the frame (that lost its connection before getting any results) back to the front of the event's queue.
+void Analytics::RequeueFootage(const InFlight& rFrame)
+{
+	// Back-fill is the best effort only.
+	if (rFrame.isBackfill)
+		return;
+
+	auto it = mEventMap.find(rFrame.eventId);
+	if (it == mEventMap.end() || it->second.isDone)
+		return;
+
+	if (rFrame.numAttempts + 1 >= MaxFootageAttempts)
 	{
-		LOG_ERROR(Log::Channel::Analytics, "Analytics::SendFootageTask: %s", e.GetText());
+		LOG_WARNING(Log::Channel::Analytics, "Analytics results lost. (Attempts: %u, EventId: %" PRIu64 ", EventFootageId: %" PRIu64 ")", rFrame.numAttempts + 1, rFrame.eventId, rFrame.eventFootageId);
+		return;
 	}
 
-	*footageSendAllowedPtr = true;
+	LOG_DEBUG(Log::Channel::Analytics, "Footage is queued again. [EventId: %" PRIu64 ", EventFootageId: %" PRIu64 "]", rFrame.eventId, rFrame.eventFootageId);
+
+	// NOTE: Frame index 0 - the requeued frame is never decimated. (See "DecimateFootage")
+	it->second.footageQueue.push_front({ rFrame.eventFootageId, rFrame.fileName, static_cast<U8> (rFrame.numAttempts + 1), rFrame.queuedTP, 0, 0, rFrame.contentHash });
 }
 
-// Checks if there is any queued footage that needs to be mapped to the event queue.
-void Analytics::HandleQueuedFootageList()
+void Analytics::TakeLatencySamples(Vector<U32>& rResultUs, Vector<U32>& rNotifyUs)
 {
-	std::lock_guard<std::mutex> lock(mFootageMutex);
+	std::lock_guard<std::mutex> lock(mLatencyMutex);
 
-	if (mFootageQueue.empty())
-		return;
+	rResultUs.insert(rResultUs.end(), mResultLatencyUs.begin(), mResultLatencyUs.end());
+	rNotifyUs.insert(rNotifyUs.end(), mNotifyLatencyUs.begin(), mNotifyLatencyUs.end());
 
-	for (auto& r : mFootageQueue)
+	mResultLatencyUs.clear();
+	mNotifyLatencyUs.clear();
+}
+
+// Parsing and the Database writes are left for the pool workers. (See "ProcessResults")
+void Analytics::QueueResult(const ResultsInfo& rResult)
+{
+	auto& rStrandPtr = mResultStrands[rResult.eventId];
+
+	if (!rStrandPtr)
+		rStrandPtr = std::make_shared<ResultStrand>();
+
+	bool isRunning;
 	{
-		auto it = mEventMap.find(r.eventId);
-		if (it == mEventMap.end())
-		{
-			// Probably "Analytics::EndEvent" was called while still having some queued footage...
-			// TODO: I should still analize all the queued footage...!
-			LOG_ERROR(Log::Channel::Analytics, "Analytics event map is missing event id: %" PRIu64 ", can't process event footage id: %" PRIu64, r.eventId, r.eventFootageId);
-			continue;
-		}
+		std::lock_guard<std::mutex> lock(rStrandPtr->mutex);
 
-		auto& rSession = it->second;
+		rStrandPtr->queue.push_back(rResult);
 
-		// If "person" was detected with the appropriate threshold,
-		// We will stop sending all other event associated footage to the analytics server.
-		if (!rSession.isDone)
-			rSession.footageQueue.push({ r.eventFootageId, r.name });
+		isRunning = rStrandPtr->isRunning;
+		rStrandPtr->isRunning = true;
 	}
 
-	mFootageQueue.clear();
+	if (!isRunning)
+	{
+		mNumResultTasks++;
+		mMain.ThreadPoolPtr->Enqueue(ProcessResultsTask, this, rStrandPtr);
+	}
 }
 
-void Analytics::HandleQueuedFootageMap()
+void Analytics::ProcessResultsTask(Analytics* pAnalytics, std::shared_ptr<ResultStrand> strandPtr)
 {
-	if (mEventMap.empty())
-		return;
+	pAnalytics->ProcessResults(*strandPtr);
 
-	for (auto& r : mEventMap)
+	pAnalytics->mNumResultTasks--;
+}
+
+// THREAD: Pool worker.
+// Processes the strand's results until its queue is empty. (Results queued meanwhile are processed by the same task)
+void Analytics::ProcessResults(ResultStrand& rStrand)
+{
+	auto databasePtr = TakeResultConnection();
+
+	for (;;)
 	{
-		auto& rSession = r.second;
+		ResultsInfo result;
+		{
+			std::lock_guard<std::mutex> lock(rStrand.mutex);
 
-		if (rSession.footageQueue.empty())
-			continue;
+			if (!rStrand.queue.empty() && mIsStopRequested)
+			{
+				// TODO: Finish processing queued results?
+				LOG_WARNING(Log::Channel::Analytics, "Analytics STOP requested while still holding %" PRIu64 " queued results!", rStrand.queue.size());
+				rStrand.queue.clear();
+			}
+
+			if (rStrand.queue.empty())
+			{
+				rStrand.isRunning = false;
+				break;
+			}
 
-		const auto eventId = r.first;
-		const auto sessionId = rSession.sessionId;
+			result = rStrand.queue.front();
+			rStrand.queue.pop_front();
+
+			// NOTE:
+			// After "isDone" was set, we still might get some queued data from the analytics server, we can ignore those...
+			if (rStrand.isDone)
+				continue;
+		}
 
-		if (mAnalyticsEvents.at(sessionId) != eventId)
+		if (!databasePtr)
 		{
-			LOG_ERROR(Log::Channel::Analytics, "Analytics session (id: %u) event id mismatch (%" PRIu64 " != %" PRIu64 ")", sessionId, mAnalyticsEvents.at(sessionId), eventId);
+			LOG_ERROR(Log::Channel::Analytics, "Analytics results are lost, no Database connection. (EventId: %" PRIu64 ", EventFootageId: %" PRIu64 ")", result.eventId, result.eventFootageId);
 			continue;
 		}
 
-		if (mAnalyticsStatus.at(sessionId) == SatusFlags::Ready)
+		Vector<Detection> detections;
+
+		if (result.cachedDetectionsPtr)
+			detections = *result.cachedDetectionsPtr;
+		else
 		{
-			auto& rFrame = rSession.footageQueue.front();
+			bool isParsed = true;
 
-			// 2019-06-06 FIX:
-			// Only send one image per-socket, per-event.
-			// Only separate event sessions are allowed to use a separate thread for sending image data.
-			if (*rSession.footageSendAllowedPtr == false)
-			{
-				LOG_DEBUG(Log::Channel::Analytics, "Footage send delayed... (Still analyzing previous footage) [EventId: %" PRIu64 ", EventFootageId: %" PRIu64 "]: %s", eventId, rFrame.eventFootageId, rFrame.fileName.c_str());
-			}
-			else
-			{
-				LOG_DEBUG(Log::Channel::Analytics, "Analyzing footage [EventId: %" PRIu64 ", EventFootageId: %" PRIu64 "]: %s", eventId, rFrame.eventFootageId, rFrame.fileName.c_str());
+			if (result.isBinary)
+				ParseBinaryResults(result.name, result.geometry, detections);
+			else if (!(isParsed = ParseXMLResults(result.name, result.geometry, detections)))
+				detections.clear();
+
+			if (isParsed && result.contentHash != 0)
+				AddCachedResult(result.cameraId, result.contentHash, detections);
+		}
 
-				*rSession.footageSendAllowedPtr = false;
+		const bool isNotified = WriteDetections(*databasePtr, result.cameraId, result.personThreshold, result.eventId, result.eventFootageId, result.isBackfill, detections);
 
-				mMain.ThreadPoolPtr->Enqueue(
-					SendFootageTask,
-					mAnalyticsSockets.at(sessionId),
-					mAnalyticsEventPaths.at(sessionId),
-					rFrame.fileName,
-					rFrame.eventFootageId,
-					rSession.footageSendAllowedPtr);
+		const auto notifiedTP = std::chrono::steady_clock::now();
 
-				rSession.footageQueue.pop();
-			}
+		// Notified footage is tracked until the CGI is delivered.
+		if (!isNotified)
+			gFootageLatency.Finish(result.eventFootageId);
+
+		// API subscribers get the detections straight from here. (See "EventStream")
+		if (mMain.EventStreamPtr && !detections.empty())
+			mMain.EventStreamPtr->PublishDetections(result.eventId, result.eventFootageId, result.cameraId, isNotified, detections);
+
+		// NOTE: Binary (and cached) results are not stored, the detections are all there is.
+		if (!result.isBinary && !result.cachedDetectionsPtr)
+			WriteXML(*databasePtr, result.eventFootageId, result.name);
+
+		if (mIsRecordingLatency)
+		{
+			const auto writtenTP = std::chrono::steady_clock::now();
+
+			std::lock_guard<std::mutex> lock(mLatencyMutex);
+
+			mResultLatencyUs.push_back(static_cast<U32> (std::chrono::duration_cast<std::chrono::microseconds>(writtenTP - result.queuedTP).count()));
+
+			if (isNotified)
+				mNotifyLatencyUs.push_back(static_cast<U32> (std::chrono::duration_cast<std::chrono::microseconds>(notifiedTP - result.queuedTP).count()));
 		}
-		else
+
+		// If "person" was detected with the appropriate threshold,
+		// We will stop sending all other event associated footage to the analytics server.
+		if (isNotified)
 		{
-			// Might still be trying to connect or Analytics server is taking long time to launch it's child.
-			LOG_DEBUG(Log::Channel::Analytics, "Analytics is still connecting for session id: %u", sessionId);
+			{
+				std::lock_guard<std::mutex> lock(rStrand.mutex);
+				rStrand.isDone = true;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mDetectedEventsMutex);
+				mDetectedEvents.push_back(result.eventId);
+			}
+
+			WakeUp();
 		}
 	}
+
+	ReleaseResultConnection(std::move(databasePtr));
 }
 
-void Analytics::WriteQueuedResults(Database::Connection& rDatabase)
+// THREAD: Any thread.
+bool Analytics::FindCachedResult(U32 cameraId, U64 contentHash, std::shared_ptr<const Vector<Detection>>& rDetectionsPtr)
 {
-	for (;;)
+	std::lock_guard<std::mutex> lock(mFrameCacheMutex);
+
+	auto it = mFrameCache.find(contentHash);
+
+	if (it == mFrameCache.end() || it->second.cameraId != cameraId)
+		return false;
+
+	mFrameCacheOrder.splice(mFrameCacheOrder.begin(), mFrameCacheOrder, it->second.orderIt);
+
+	rDetectionsPtr = it->second.detectionsPtr;
+
+	return true;
+}
+
+// THREAD: Pool worker.
+void Analytics::AddCachedResult(U32 cameraId, U64 contentHash, const Vector<Detection>& rDetections)
+{
+	auto detectionsPtr = std::make_shared<const Vector<Detection>>(rDetections);
+
+	std::lock_guard<std::mutex> lock(mFrameCacheMutex);
+
+	auto it = mFrameCache.find(contentHash);
+
+	if (it != mFrameCache.end())
 	{
-		if (mResultQueue.empty())
-			break;
+		mFrameCacheOrder.splice(mFrameCacheOrder.begin(), mFrameCacheOrder, it->second.orderIt);
+
+		it->second.cameraId = cameraId;
+		it->second.detectionsPtr = std::move(detectionsPtr);
+		return;
+	}
 
-		if (mIsStopRequested)
+	if (mFrameCache.size() >= mSettings.frameCacheSize)
+	{
+		mFrameCache.erase(mFrameCacheOrder.back());
+		mFrameCacheOrder.pop_back();
+	}
+
+	mFrameCacheOrder.push_front(contentHash);
+
+	mFrameCache[contentHash] = { cameraId, std::move(detectionsPtr), mFrameCacheOrder.begin() };
+}
+
+// Marks the events with a "person" detected as done and releases the result strands of the ended events.
+void Analytics::HandleResultStrands()
+{
+	mDetectedEventsMutex.lock();
+
+	if (!mDetectedEvents.empty())
+	{
+		Vector<EventId> detectedEvents;
+		detectedEvents.swap(mDetectedEvents);
+
+		mDetectedEventsMutex.unlock();
+
+		for (const auto eventId : detectedEvents)
 		{
-			// TODO: Finish processing queued results?
-			LOG_WARNING(Log::Channel::Analytics, "Analytics STOP requested while still holding %" PRIu64 " queued results!", mResultQueue.size());
-			break;
+			auto it = mEventMap.find(eventId);
+			if (it != mEventMap.end())
+				it->second.isDone = true;
 		}
+	}
+	else
+		mDetectedEventsMutex.unlock();
 
-		// Return a reference to the first element in the queue.
-		auto& rResult = mResultQueue.front();
-
-		// If "person" was detected with the appropriate threshold,
-		// We will stop sending all other event associated footage to the analytics server.
+	// Only the strands without the session can be released. (Ended or back-filled events)
+	if (mResultStrands.size() <= mEventMap.size())
+		return;
 
-		// NOTE:
-		// After "isDone" was set, we still might get some queued data from the analytics server, we can ignore those...
-		auto it = mEventMap.find(rResult.eventId);
-		if (it != mEventMap.end())
+	for (auto it = mResultStrands.begin(); it != mResultStrands.end(); )
+	{
+		if (mEventMap.find(it->first) == mEventMap.end())
 		{
-			if (it->second.isDone)
+			std::lock_guard<std::mutex> lock(it->second->mutex);
+
+			if (!it->second->isRunning)
+			{
+				it = mResultStrands.erase(it);
 				continue;
+			}
 		}
 
-		// "<Root incompleteResult="0" count="1" fileId="3295">"
-		auto eventFootageId = WriteXMLParsedResults(rDatabase, rResult.sessionId, rResult.cameraId, rResult.eventId, rResult.name);
+		++it;
+	}
+}
 
-		WriteXML(rDatabase, eventFootageId, rResult.name);
+// THREAD: Pool worker.
+UniquePtr<Database::Connection> Analytics::TakeResultConnection()
+{
+	{
+		std::lock_guard<std::mutex> lock(mResultConnectionsMutex);
 
+		if (!mResultConnections.empty())
+		{
+			auto databasePtr = std::move(mResultConnections.back());
+			mResultConnections.pop_back();
 
-		mResultQueue.pop();
+			return databasePtr;
+		}
 	}
+
+	auto databasePtr = std::make_unique<Database::Connection>();
+
+	if (!databasePtr->Connect(mDBInfo, 7, 3))
+		return nullptr;
+
+	return databasePtr;
+}
+
+// THREAD: Pool worker.
+void Analytics::ReleaseResultConnection(UniquePtr<Database::Connection> databasePtr)
+{
+	if (!databasePtr)
+		return;
+
+	std::lock_guard<std::mutex> lock(mResultConnectionsMutex);
+
+	mResultConnections.push_back(std::move(databasePtr));
 }
 
 void Analytics::WriteXML(Database::Connection& rDatabase, EventFootageId eventFootageId, const String& rXML)
@@ -709,7 +2386,19 @@ void Analytics::WriteXML(Database::Connection& rDatabase, EventFootageId eventFo
 	query.Exec(ss.str());
 }
 
-EventFootageId Analytics::WriteXMLParsedResults(Database::Connection& rDatabase, AnalyticsSessionId sessionId, U32 cameraId, EventId eventId, const String& rXML)
+// Object rectangle in the original frame. (Results are for the preprocessed frame)
+static void MapRectangle(const JPEG::Geometry& rGeometry, double x, double y, double width, double height, Analytics::Detection& rDetection)
+{
+	const double scale = static_cast<double> (1 << rGeometry.scaleShift);
+
+	rDetection.x = lround(x * scale) + rGeometry.offsetX;
+	rDetection.y = lround(y * scale) + rGeometry.offsetY;
+	rDetection.width = lround(width * scale);
+	rDetection.height = lround(height * scale);
+}
+
+// NOTE: Object rectangles are mapped back to the original frame. (The raw XML keeps the preprocessed frame's ones, see "WriteXML")
+bool Analytics::ParseXMLResults(const String& rXML, const JPEG::Geometry& rGeometry, Vector<Detection>& rDetections)
 {
 	tinyxml2::XMLDocument xml;
 
@@ -718,141 +2407,149 @@ EventFootageId Analytics::WriteXMLParsedResults(Database::Connection& rDatabase,
 	if (results != tinyxml2::XML_SUCCESS)
 	{
 		LOG_ERROR(Log::Channel::Analytics, "Failed to parse the XML!");
-		return 0;
+		return false;
 	}
 
 	auto pRootElement = xml.FirstChildElement("Root");
 	if (!pRootElement)
 	{
 		LOG_ERROR(Log::Channel::Analytics, "XML root element not found!");
-		return 0;
+		return false;
 	}
 
-	auto eventFootageId = static_cast<EventFootageId> (pRootElement->IntAttribute("fileId"));
-
-	// IMPORTANT: 
-	// The maximum number of rows in one VALUES clause is 1000 (TODO)
-	std::ostringstream ss;
-	ss << mSQLQuery.analyticsInsertSQLParsed;
-
+	// NOTE:
+	// "fileId" attribute holds only the lower 32 bits, "eventFootageId" is taken from the in-flight footage. (See "HandleResult")
 	U32 frameIndex = 1;
 
-	bool isFound = false;
-
-	UnorderedMap<String, U32> statsMap;
-
 	for (auto pResultElement = pRootElement->FirstChildElement(); pResultElement; pResultElement = pResultElement->NextSiblingElement()) 
 	{
 		int numObjects = pResultElement->IntAttribute("count");
 		if (numObjects == 0)
 			continue;
 
-		int objectIndex = 0;
-
 		for (auto pObjectElement = pResultElement->FirstChildElement(); pObjectElement; pObjectElement = pObjectElement->NextSiblingElement())
 		{
-			isFound = true;
+			Detection detection;
 
-			// TODO
-			// "analyticsUpdateStats"
-			{
-/*
-				// update vq_cameras_detections set count=count+1 where camera_id=[cameraID] and name='person'
-				{
-					std::ostringstream ss;
+			detection.name = pObjectElement->Attribute("name");
+			detection.frameIndex = frameIndex;
+			detection.probability = std::atoi(pObjectElement->Attribute("probability"));
 
-					ss << "UPDATE " << Database::Table::CameraDetections::TableName
-						<< "SET " << Database::Table::CameraDetections::Count
-						<< '=' << Database::Table::CameraDetections::Count
-						<< '+';
+			MapRectangle(rGeometry, pObjectElement->DoubleAttribute("x"), pObjectElement->DoubleAttribute("y"),
+				pObjectElement->DoubleAttribute("w"), pObjectElement->DoubleAttribute("h"), detection);
 
-					mSQLQuery.analyticsUpdateStats = ss.str();
-*/
-			}
+			rDetections.push_back(std::move(detection));
+		}
 
-			const String name(pObjectElement->Attribute("name"));
-			const int probability(std::atoi(pObjectElement->Attribute("probability"))); // Database::Table::Analytics::Probability
+		frameIndex++;
+	}
 
-			// If probability > personThreshold call CGI:
-			// https://www.viquant.io/ui/inform-user.php?eventID=[EventID]
-			if (name == "person")
-			{
-				const auto personThreshold = mAnalyticsThresholds.at(sessionId);
+	return true;
+}
 
-				if (probability > personThreshold)
-				{
-					std::ostringstream ss;
+// Binary results are already checked by the "HandleBinaryResult".
+void Analytics::ParseBinaryResults(const String& rData, const JPEG::Geometry& rGeometry, Vector<Detection>& rDetections)
+{
+	BinaryResults results;
+	memcpy(&results, rData.data(), sizeof(BinaryResults));
 
-#if PLATFORM_WINDOWS
-					ss	<< "/ui/inform-user.php?eventID=" << eventId
-						<< "&eventFrameID=" << eventFootageId; // NOTE: ampersandas i single quotes required for "curl"
-#else
-					ss << "/ui/inform-user.php?eventID=" << eventId
-						<< "'&'eventFrameID=" << eventFootageId; // NOTE: ampersandas i single quotes required for "curl"
-#endif
+	const char* pObject = rData.data() + sizeof(BinaryResults);
+
+	for (U16 i = 0; i < results.numObjects; ++i, pObject += sizeof(BinaryObject))
+	{
+		BinaryObject object;
+		memcpy(&object, pObject, sizeof(BinaryObject));
 
-					mMain.CGIManagerPtr->Add(ss.str());
+		Detection detection;
 
-					// If "person" was detected with the appropriate threshold,
-					// We will stop sending all other event associated footage to the analytics server.
-					auto it = mEventMap.find(eventId);
-					if (it != mEventMap.end())
-						it->second.isDone = true;
-				}
-			}
+		if (object.classId < mSettings.classNames.size())
+			detection.name = mSettings.classNames[object.classId];
+		else
+			detection.name = "class_" + std::to_string(object.classId);
+
+		detection.probability = object.probability;
+
+		MapRectangle(rGeometry, object.x, object.y, object.width, object.height, detection);
+
+		rDetections.push_back(std::move(detection));
+	}
+}
+
+// Returns true if the user was notified. (Person detected)
+bool Analytics::WriteDetections(Database::Connection& rDatabase, U32 cameraId, U8 personThreshold, EventId eventId, EventFootageId eventFootageId, bool isBackfill, const Vector<Detection>& rDetections)
+{
+	if (rDetections.empty())
+		return false;
+
+	// IMPORTANT: 
+	// The maximum number of rows in one VALUES clause is 1000 (TODO)
+	std::ostringstream ss;
+	ss << mSQLQuery.analyticsInsertSQLParsed;
 
-			auto& count = statsMap[name];
-			count++;
+	bool isNotified = false;
 
-			ss	<< "('"  << eventFootageId	// Database::Table::Analytics::EventFootageId
-				<< "','" << frameIndex		// Database::Table::Analytics::Frame
-				<< "','" << name			// Database::Table::Analytics::Type
-				<< "','" << probability		// Database::Table::Analytics::Probability
-				<< "','" << pObjectElement->Attribute("x")
-				<< "','" << pObjectElement->Attribute("y")
-				<< "','" << pObjectElement->Attribute("w")
-				<< "','" << pObjectElement->Attribute("h")
-				<< "')";
+	UnorderedMap<String, U32> statsMap;
+
+	for (size_t i = 0; i < rDetections.size(); ++i)
+	{
+		const auto& rDetection = rDetections[i];
 
-			if (objectIndex != numObjects - 1)
-				ss << ',';
+		// If probability > personThreshold call CGI:
+		// https://www.viquant.io/ui/inform-user.php?eventID=[EventID]
+		// NOTE: Back-filled results are stored for the records only, the moment to inform the user has passed.
+		if (rDetection.name == "person" && !isBackfill)
+		{
+			if (rDetection.probability > personThreshold)
+			{
+				mMain.CGIManagerPtr->AddNotification(eventId, eventFootageId);
 
-			objectIndex++;
+				isNotified = true;
+			}
 		}
 
-		frameIndex++;
+		auto& count = statsMap[rDetection.name];
+		count++;
+
+		ss	<< "('"  << eventFootageId			// Database::Table::Analytics::EventFootageId
+			<< "','" << rDetection.frameIndex	// Database::Table::Analytics::Frame
+			<< "','" << rDetection.name			// Database::Table::Analytics::Type
+			<< "','" << rDetection.probability	// Database::Table::Analytics::Probability
+			<< "','" << rDetection.x
+			<< "','" << rDetection.y
+			<< "','" << rDetection.width
+			<< "','" << rDetection.height
+			<< "')";
+
+		if (i != rDetections.size() - 1)
+			ss << ',';
 	}
 
 	// TODO: 
 	// Optimize STATS
 	// User might have only certain "objects" that he is interested in...
-	if (!statsMap.empty())
+	for (auto& rStats : statsMap)
 	{
-		for (auto& rStats : statsMap)
-		{
-			Database::Query query(rDatabase);
+		Database::Query query(rDatabase);
 
-			std::ostringstream ss;
+		std::ostringstream ss;
 
-			ss	<< mSQLQuery.analyticsUpdateStats // "UPDATE `vq_cameras_detections` SET `count`=`count`+"
-				<< rStats.second
-				<< " WHERE "	<< Database::Table::CameraDetections::CameraId
-				<< '='			<< cameraId
-				<< " AND "		<< Database::Table::CameraDetections::Name
-				<< "='"			<< rStats.first << "'";
+		ss	<< mSQLQuery.analyticsUpdateStats // "UPDATE `vq_cameras_detections` SET `count`=`count`+"
+			<< rStats.second
+			<< " WHERE "	<< Database::Table::CameraDetections::CameraId
+			<< '='			<< cameraId
+			<< " AND "		<< Database::Table::CameraDetections::Name
+			<< "='"			<< rStats.first << "'";
 
-			// SAMPLE:
-			// "UPDATE `vq_cameras_detections` SET `count`=`count`+1 WHERE `camera_id`=6 AND `name`='person'"
-			query.Exec(ss.str());
-		}
+		// SAMPLE:
+		// "UPDATE `vq_cameras_detections` SET `count`=`count`+1 WHERE `camera_id`=6 AND `name`='person'"
+		query.Exec(ss.str());
 	}
 
-	if (isFound)
 	{
 		Database::Query query(rDatabase);
 
 		query.Exec(ss.str());
 	}
 
-	return eventFootageId;
+	return isNotified;
 }
@@ -2,55 +2,237 @@
 #pragma once
 
 #include "Semaphore.hpp"
+#include "RingBuffer.hpp"
+
+#include "Analytics/JPEG.hpp"
+#include "Analytics/SharedMemoryRing.hpp"
 
 class Analytics
 {
+	// Parsing is benchmarked on its own. (See "Tools/MicroBenchmark")
+	friend class MicroBenchmark;
+
 public:
-	Analytics(Main& rApp, const Database::Info& rDBInfo, const String& rServerAddress, U16 serverPort, U16 connectTimeoutSec);
+	// Frames that are still sent while overloaded. (The rest are back-filled once the system is idle)
+	enum class DecimationPolicy : uint8_t
+	{
+		Newest,			// Only the newest queued frame of the event.
+		EveryNth,		// Every Nth event's frame.
+		FirstAndLatest	// The first K event's frames and the newest one.
+	};
+
+	struct Settings
+	{
+		struct Backend
+		{
+			String	address;
+			U16		port = 0;
+
+			// Analytics server runs on the same machine, frames are handed over using the shared memory. (See "SharedMemoryRing")
+			bool	isSharedMemory = false;
+		};
+
+		// Analytics servers, frames are dispatched to the one with the least outstanding frames.
+		Vector<Backend> backends;
+
+		U16		connectTimeoutSec = 0;
+
+		// Number of analytics connections (per backend) that are kept connected, so that the event's frames can be sent right away.
+		// Pooled connection is leased to a single event, the handshake (with the event's alarm id) is sent once it's leased.
+		U16		poolSize = 1;
+
+		// Pooled (not leased) connections older than this are reconnected. (0 - never)
+		U16		poolMaxAgeSec = 0;
+
+		// Maximum number of frames per connection that were sent, but are still waiting for the results.
+		U16		inFlightWindow = 1;
+
+		// Maximum number of frames written to the socket by a single send task.
+		// (Frames are still sent as separate "frame" messages, the protocol has no batch message)
+		U16		batchSize = 1;
+
+		// Frames without any results after this many seconds are treated as lost, the connection is recycled.
+		U16		resultTimeoutSec = 0;
+
+		// Frames that waited in the queue longer than this are skipped, they are too old to raise the alarm. (0 - never)
+		U16		frameDeadlineSec = 0;
+
+		// Number of the first event's frames that are sent before the frames of the already running events.
+		U16		firstFramesCount = 1;
+
+		// Overload is detected when the queued frames or the results latency (of the fastest backend) exceed these. (0 - not checked)
+		U32		overloadQueueSize = 0;
+		U32		overloadLatencyMs = 0;
+
+		DecimationPolicy decimationPolicy = DecimationPolicy::Newest;
+		U16		decimationN = 1; // "EveryNth"
+		U16		decimationK = 1; // "FirstAndLatest"
+
+		// Maximum number of the skipped frames kept for the back-fill.
+		U32		backfillQueueSize = 0;
+
+		// Frames nearly identical to the camera's last sent frame are not sent. (See "JPEG::Signature")
+		bool	isPrefilter = false;
+		U8		prefilterCellDelta = 0;	// Signature cell is changed if its luma differs more than this.
+		U16		prefilterMaxCells = 0;	// Frame is a duplicate if no more than this many cells changed.
+
+		// Frames are downscaled (by 2, 4 or 8) until they are no wider than this. (0 - never)
+		U16		maxFrameWidth = 0;
+
+		// Frames of these cameras are cropped to the region of interest. (Key is the camera id)
+		UnorderedMap<U32, JPEG::Region> cameraRegions;
+
+		// Binary results are asked for in the handshake, servers that don't support them still send the XML.
+		bool	isBinaryResults = false;
+
+		// Object names of the binary results' class ids.
+		Vector<String> classNames;
+
+		// Shared memory ring of each "isSharedMemory" backend's connection.
+		// Frames larger than the slot (or sent while all the slots are used) go through the socket.
+		U32		shmNumSlots = 0;
+		U32		shmSlotSize = 0;
+
+		// Results of this many recently analyzed frames are kept by the frame's content hash,
+		// byte-identical frames (resent by the camera) reuse them instead of being sent. (0 - disabled)
+		U32		frameCacheSize = 0;
+	};
+
+	Analytics(Main& rApp, const Database::Info& rDBInfo, const Settings& rSettings);
 	~Analytics();
 
 	void AddEvent(EventId eventId, U32 cameraId, U8 personThreshold, const String& rFootagePath);
 	void EndEvent(EventId eventId);
 
-	void AddFootage(EventId eventId, EventFootageId eventFootageId, const String& rName);
+	void AddFootage(EventId eventId, EventFootageId eventFootageId, const String& rName, const JPEG::Signature& rSignature, U64 contentHash);
 
-private:
+	// Signatures are computed by the FTP download tasks, only if the prefilter is enabled.
+	// THREAD: Any thread.
+	bool IsPrefilterEnabled() const { return mSettings.isPrefilter; }
+
+	// Content hashes are computed by the FTP download tasks, only if the frame cache is enabled. (See "Utils::Hash64")
+	// THREAD: Any thread.
+	bool IsFrameCacheEnabled() const { return mSettings.frameCacheSize != 0; }
+
+	// Wakes up the Analytics thread, so that the queued work is handled without waiting for any socket activity.
+	// THREAD: Any thread.
+	void WakeUp();
+
+	// Per-camera scheduler stats (queue-wait histograms) as JSON.
+	// THREAD: Any thread.
+	String GetSchedulerStats();
 
-	void ReleaseSession(AnalyticsSessionId id);
+	// Latencies (in microseconds) from "AddFootage" until the results were written to the Database
+	// and until the user notification was queued, are kept until taken. (Used by the benchmark, off by default)
+	// THREAD: Any thread.
+	void EnableLatencyRecording() { mIsRecordingLatency = true; }
+	void TakeLatencySamples(Vector<U32>& rResultUs, Vector<U32>& rNotifyUs);
 
-	bool HandleConnect(AnalyticsSessionId id, const TimePoint& rCurrentTP);
-	void HandleRead(AnalyticsSessionId id);
-	void HandleSend(AnalyticsSessionId id);
+	// Detected object (parsed results), the rectangle is in the original frame's coordinates.
+	struct Detection
+	{
+		String	name;
+		U32		frameIndex = 1;
+		int		probability = 0;
+		long	x = 0;
+		long	y = 0;
+		long	width = 0;
+		long	height = 0;
+	};
+
+private:
+
+	struct EventInfo;
+	struct Session;
+	struct SendState;
+	struct InFlight;
+
+	void StartSession(const EventInfo& rInfo);
+	void EndSession(EventId eventId);
+
+	void StartConnection(U16 backendIndex);
+	void ReleaseConnection(AnalyticsSessionId id);
+	AnalyticsSessionId GetAvailableConnection(EventId eventId);
+	bool LeaseConnection(AnalyticsSessionId id, EventId eventId);
+	bool IsLeaseEnded(AnalyticsSessionId id) const;
+
+	void HandleBackendFailure(U16 backendIndex, const TimePoint& rCurrentTP);
+	void HandleBackendReady(U16 backendIndex);
+	void LogBackendStats(const Vector<U32>& rNumConnections) const;
+
+	void HandleSocketEvent(AnalyticsSessionId id, U32 events);
+	bool HandleConnect(AnalyticsSessionId id);
+	bool HandleRead(AnalyticsSessionId id);
+	bool HandleMessages(AnalyticsSessionId id);
+	void HandleXMLResult(AnalyticsSessionId id, const char* pXML, size_t xmlSize);
+	void HandleBinaryResult(AnalyticsSessionId id, const char* pData, size_t size);
+	void HandleResult(AnalyticsSessionId id, U32 fileId, bool isBinary, const char* pData, size_t size);
+	void HandleTimeouts(const TimePoint& rCurrentTP);
+	void HandlePool(const TimePoint& rCurrentTP);
+	void HandleQueuedEvents();
 	void HandleQueuedFootageList();
 	void HandleQueuedFootageMap();
+	void UpdateMetrics();
+	void HandleFailedFootage(AnalyticsSessionId id);
+
+	bool IsDuplicateFootage(Session& rSession, const JPEG::Signature& rSignature);
+
+	JPEG::Geometry TakeFrameGeometry(EventFootageId eventFootageId);
+
+	void ScheduleFootage(const TimePoint& rCurrentTP);
+	void SkipStaleFootage(EventId eventId, Session& rSession, const TimePoint& rCurrentTP);
+	void SendSessionFootage(AnalyticsSessionId id, EventId eventId, Session& rSession, const TimePoint& rCurrentTP);
+	void LogSchedulerStats();
+
+	void HandleOverload(size_t numQueued);
+	void DecimateFootage(EventId eventId, Session& rSession);
+	void SendBackfillFootage(AnalyticsSessionId id, const TimePoint& rCurrentTP);
+
+	bool IsCachedFootage(EventId eventId, const Session& rSession, EventFootageId eventFootageId, const TimePoint& rQueuedTP, U64 contentHash);
+
+	bool CompleteFootage(AnalyticsSessionId id, U32 fileId, InFlight& rFrame);
+	void ReleaseFootage(AnalyticsSessionId id, const InFlight& rFrame);
+	void RequeueFootage(const InFlight& rFrame);
 
 private:
 
 	void ThreadProc();
 
-	void WriteQueuedResults(Database::Connection& rDatabase);
+	// Results stage. (Pool workers)
+	struct ResultsInfo;
+	struct ResultStrand;
 
-	EventFootageId WriteXMLParsedResults(Database::Connection& rDatabase, AnalyticsSessionId sessionId, U32 cameraId, EventId eventId, const String& rXML);
+	static void ProcessResultsTask(Analytics* pAnalytics, std::shared_ptr<ResultStrand> strandPtr);
+
+	void QueueResult(const ResultsInfo& rResult);
+	void ProcessResults(ResultStrand& rStrand);
+	void HandleResultStrands();
+
+	UniquePtr<Database::Connection> TakeResultConnection();
+	void ReleaseResultConnection(UniquePtr<Database::Connection> databasePtr);
+
+	static bool    ParseXMLResults(const String& rXML, const JPEG::Geometry& rGeometry, Vector<Detection>& rDetections);
+	void           ParseBinaryResults(const String& rData, const JPEG::Geometry& rGeometry, Vector<Detection>& rDetections);
+	bool           WriteDetections(Database::Connection& rDatabase, U32 cameraId, U8 personThreshold, EventId eventId, EventFootageId eventFootageId, bool isBackfill, const Vector<Detection>& rDetections);
 	void           WriteXML(Database::Connection& rDatabase, EventFootageId eventId, const String& rXML);
 
 private:
 
 	Main& mMain;
 
-	const U16				mConnectTimeoutSec;
-	const U16				mServerPort;
 	const Database::Info	mDBInfo;
-	const String			mServerAddress;
+	const Settings			mSettings;
 
 	std::atomic_bool		mIsStopRequested{ false };
 
 	std::unique_ptr<std::thread> mThreadPtr;
 
+	// Analytics thread sleeps in "epoll_wait" until any of the analytics sockets
+	// or the "wake" event (queued events, queued footage, finished footage sends) gets signaled.
+	int	mEpollId = -1;
+	int	mWakeEventId = -1;
 
-	Vector<char> mReadBuffer;
-
-	U8	mMessageType = 0;
-	U32	mMessageSize = 0;
+	TimePoint mStatsTP;
 
 	struct
 	{
@@ -63,57 +245,159 @@ private:
 	{
 		ResultsInfo() { };
 
-		ResultsInfo(AnalyticsSessionId id, U32 c, EventId e, U16 footageIndex, const String& rName)
+		ResultsInfo(AnalyticsSessionId id, U32 c, U8 personThreshold, bool isBackfill, EventId e, EventFootageId eventFootageId, const JPEG::Geometry& rGeometry, const TimePoint& rQueuedTP, U64 contentHash, bool isBinary, const String& rName)
 			: sessionId(id)
-			, footageIndex(footageIndex)
 			, cameraId(c)
+			, personThreshold(personThreshold)
+			, isBackfill(isBackfill)
 			, eventId(e)
+			, eventFootageId(eventFootageId)
+			, geometry(rGeometry)
+			, queuedTP(rQueuedTP)
+			, contentHash(contentHash)
+			, isBinary(isBinary)
 			, name(rName)
 		{ }
 
 		ResultsInfo(const ResultsInfo& r)
 			: sessionId(r.sessionId)
-			, footageIndex(r.footageIndex)
 			, cameraId(r.cameraId)
+			, personThreshold(r.personThreshold)
+			, isBackfill(r.isBackfill)
 			, eventId(r.eventId)
+			, eventFootageId(r.eventFootageId)
+			, geometry(r.geometry)
+			, queuedTP(r.queuedTP)
+			, contentHash(r.contentHash)
+			, isBinary(r.isBinary)
 			, name(r.name)
+			, cachedDetectionsPtr(r.cachedDetectionsPtr)
 		{ }
 
+		ResultsInfo& operator=(const ResultsInfo& r) = default;
+
 		AnalyticsSessionId sessionId = 0;
 
-		U16		footageIndex = 0;
 		U32		cameraId = 0;
+		U8		personThreshold = 0;
+		bool	isBackfill = false;
 		EventId eventId = 0;
-		String	name; // TEMP: For "mResultQueue" this XML result.
+		EventFootageId eventFootageId = 0;
+		JPEG::Geometry geometry; // Results are for the preprocessed frame.
+		TimePoint queuedTP; // When the footage was added. (See "AddFootage")
+		U64		contentHash = 0; // Results are added to the frame cache. (0 - not hashed)
+		bool	isBinary = false;
+		String	name; // TEMP: For "ResultStrand::queue" this XML result. (Or the binary results, see "BinaryResults")
+
+		// Frame was not sent, these are the results of the identical frame. (See "IsCachedFootage")
+		std::shared_ptr<const Vector<Detection>> cachedDetectionsPtr;
 	};
 
-	// Result's that were analyzed by the Analytics server 
-	// and are ready to be written to the Database.
-	// TODO: SITAM QUEUE REIKIA SUKURTI ATSKIRA STRUCT'A (NEBENAUDOTI "FootageInfo")
-	// NES mResultQueue REIKIA "sessionId", "cameraId" ir t.t. TUO TARPU "mFootageQueue" TO NEREIKIA!!!!
-	std::queue<ResultsInfo>		mResultQueue;
+	// Results are parsed and written to the Database by the pool workers, so the Analytics thread only reads the sockets.
+	// Results of the same event are processed one at the time, in the order they were received. (Events are processed in parallel)
+	struct ResultStrand
+	{
+		std::mutex mutex;
+		std::deque<ResultsInfo> queue;
+
+		bool isRunning = false;	// Task is queued or running. (See "ProcessResultsTask")
+		bool isDone = false;	// "person" was detected, the rest of the event's results are ignored.
+	};
+
+	// NOTE: Written only by the Analytics thread, the strand is kept alive by its task.
+	UnorderedMap<EventId, std::shared_ptr<ResultStrand>> mResultStrands;
+
+	std::atomic<U32>	mNumResultTasks{ 0 };
+
+	// Queued or running "SendFootageTask". (Waited for by the destructor)
+	std::atomic<U32>	mNumSendTasks{ 0 };
+
+	// Database connections of the workers, taken while processing the results.
+	Vector<UniquePtr<Database::Connection>> mResultConnections;
+	std::mutex			mResultConnectionsMutex;
+
+	// Events with a "person" detected, handled by the Analytics thread. (See "HandleResultStrands")
+	Vector<EventId>		mDetectedEvents;
+	std::mutex			mDetectedEventsMutex;
+
+	// See "TakeLatencySamples".
+	std::atomic_bool	mIsRecordingLatency{ false };
+	Vector<U32>			mResultLatencyUs;
+	Vector<U32>			mNotifyLatencyUs;
+	std::mutex			mLatencyMutex;
+
+	// Frame cache: the parsed results by the frame's content hash, the least recently used are dropped.
+	struct CachedResult
+	{
+		U32 cameraId = 0; // Same bytes from the other camera are analyzed again. (Different region of interest)
+		std::shared_ptr<const Vector<Detection>> detectionsPtr;
+		std::list<U64>::iterator orderIt;
+	};
+
+	bool FindCachedResult(U32 cameraId, U64 contentHash, std::shared_ptr<const Vector<Detection>>& rDetectionsPtr);
+	void AddCachedResult(U32 cameraId, U64 contentHash, const Vector<Detection>& rDetections);
+
+	UnorderedMap<U64, CachedResult> mFrameCache;
+	std::list<U64>		mFrameCacheOrder; // Most recently used first.
+	std::mutex			mFrameCacheMutex;
+
+	std::atomic<U64>	mNumCacheHits{ 0 };
 
 
+	//===================================================================================
+	// Event sessions are started and ended from the main thread,
+	// but the analytics sockets are owned by the Analytics thread. (See "HandleQueuedEvents")
+	struct EventInfo
+	{
+		EventInfo() { };
+
+		EventInfo(EventId eventId, U32 cameraId, U8 personThreshold, const String& rFootagePath, bool isEnd)
+			: eventId(eventId)
+			, cameraId(cameraId)
+			, personThreshold(personThreshold)
+			, isEnd(isEnd)
+			, footagePath(rFootagePath)
+		{ }
+
+		EventId eventId = 0;
+		U32		cameraId = 0;
+		U8		personThreshold = 0;
+		bool	isEnd = false;
+		String	footagePath;
+	};
+
+	Vector<EventInfo>	mEventQueue;
+	std::mutex			mEventMutex;
+
 	//===================================================================================
 	struct FootageInfo
 	{
 		FootageInfo() { };
 
-		FootageInfo(EventId eventId, EventFootageId eventFootageId, const String& rName)
+		FootageInfo(EventId eventId, EventFootageId eventFootageId, const String& rName, const TimePoint& rQueuedTP, const JPEG::Signature& rSignature, U64 contentHash)
 			: eventId(eventId)
 			, eventFootageId(eventFootageId)
 			, name(rName)
+			, queuedTP(rQueuedTP)
+			, signature(rSignature)
+			, contentHash(contentHash)
 		{ }
 
 		FootageInfo(const FootageInfo& r)
 			: eventId(r.eventId)
 			, eventFootageId(r.eventFootageId)
 			, name(r.name)
+			, queuedTP(r.queuedTP)
+			, signature(r.signature)
+			, contentHash(r.contentHash)
 		{ }
 
 		EventId eventId = 0;
 		EventFootageId eventFootageId = 0;
 		String	name; // Footage filename (without the path)
+		TimePoint queuedTP;
+		JPEG::Signature signature;
+		U64		contentHash = 0;
 	};
 
 	Vector<FootageInfo>	mFootageQueue;
@@ -124,45 +408,176 @@ private:
 	enum class SatusFlags : uint8_t
 	{
 		Free = 0,
-		Failed,
+		Failed,		// Socket is shut down, but can't be closed until the running send task finishes.
 		Connecting, // Socket is trying to connect.
 		Connected,	// Socket is connected, but still not initialized.
-		Handshake,
-		Ready
+		Handshake,	// Server's hello received, waiting in the pool. (Handshake is sent once leased, see "LeaseConnection")
+		Ready		// Leased to the event.
+	};
+
+	// Shared between the Analytics thread and the "SendFootageTask".
+	struct SendState
+	{
+		// Only one send task per-socket is allowed at the time.
+		std::atomic_bool isSendAllowed{ true };
+
+		// Footage that failed to be sent. (Written by the send task before "isSendAllowed" is set)
+		Vector<EventFootageId> failedIds;
+
+		// Footage that was read, but the socket failed to send it. (Sent again using the other connection)
+		Vector<EventFootageId> unsentIds;
 	};
 
+	// Footage that was sent to the analytics server and is waiting for the results.
+	// Frames are pipelined, so the results are matched by the "fileId". (See "Frame::fileId")
+	struct InFlight
+	{
+		EventId eventId;
+		EventFootageId eventFootageId;
+		U32 cameraId;
+		U8 personThreshold;
+		U8 numAttempts;
+		bool isBackfill;
+		TimePoint sentTP;
+		TimePoint queuedTP;
+		String fileName; // Kept for the failover. (See "RequeueFootage", full path for the back-fill)
+		JPEG::Geometry geometry; // Set once the results are received. (See "CompleteFootage")
+		U64 contentHash; // Frame cache. (0 - not hashed)
+	};
+
+	// Analytics servers, indexed the same as the "Settings::backends".
+	Vector<TimePoint>	mBackendRetryTPs;		// New connections are not started until this time point.
+	Vector<U16>			mBackendRetryDelaySec;	// Doubled after each failure, reset once connected.
+	Vector<bool>		mBackendIsUp;
+	Vector<U32>			mBackendInFlight;		// Frames waiting for the results on all the backend's connections.
+	Vector<U32>			mBackendLatencyMs;		// Moving average of the time it takes to get the results.
+	Vector<U64>			mBackendNumResults;
+	Vector<U64>			mBackendNumFailures;	// Failed connects, disconnects and result timeouts.
+
+	// Analytics sessions (connections) form a pool, each one is leased to a single event. (See "LeaseConnection")
 	AnalyticsSessionId			mAnalyticIdCounter = 0;
 	Vector<AnalyticsSessionId>	mAnalyticsReleasedIds;
 
 	Vector<SocketId>			mAnalyticsSockets;
-	Vector<U32>					mAnalyticsCameraIds;
-	Vector<U8>					mAnalyticsThresholds; // Person for now, use struct of Thresholds in the future?
-	Vector<EventId>				mAnalyticsEvents;
-	Vector<String>				mAnalyticsEventPaths;
+	Vector<U16>					mAnalyticsBackends;
+	Vector<EventId>				mAnalyticsEvents; // Event the connection is leased to. (0 - still pooled)
 	Vector<SatusFlags>			mAnalyticsStatus;
-	Vector<TimePoint>			mAnalyticsTimePoints;
+	Vector<TimePoint>			mAnalyticsTimePoints; // Last status change.
 	Vector<U32>					mAnalyticsUniqueId;
+	Vector<Vector<InFlight>>	mAnalyticsInFlight;
+	Vector<std::shared_ptr<SendState>> mAnalyticsSendStates;
+	Vector<RingBuffer>			mAnalyticsReadBuffers; // Received data, until the whole message arrives. (See "HandleMessages")
+	Vector<U16>					mAnalyticsProtocolVersion; // Sent with the handshake, tells the results format.
+	Vector<std::shared_ptr<SharedMemoryRing>> mAnalyticsRings; // "isSharedMemory" backends only, shared with the send task.
+	U32							mRingCounter = 0; // Ring names are never reused. (The send task might still hold the old ring)
 
-	struct Session
+	//===================================================================================
+	// Queue-wait histogram buckets: [0] < 2 ms, [i] < 2^(i+1) ms, the last one holds everything above.
+	static constexpr size_t NumWaitBuckets = 16;
+
+	struct CameraStats
 	{
-		Session()
-			: footageSendAllowedPtr(std::make_shared<std::atomic_bool>(true))
-		{ }
+		U64 scheduleIndex = 0; // "mScheduleCounter" value when the camera's frames were sent last. (Fair share)
+		U64 numSent = 0;
+		U64 numSkipped = 0;
+		U64 numDecimated = 0;
+		U64 waitBuckets[NumWaitBuckets] = {};
+
+		// Prefilter. (See "IsDuplicateFootage")
+		U64 numSignatures = 0;
+		U64 numDuplicates = 0;
+		U64 signatureUs = 0; // Total time spent computing the signatures.
+		JPEG::Signature lastSignature; // Of the last frame that was not a duplicate.
+	};
+
+	// NOTE:
+	// Written only by the Analytics thread (while holding the mutex), so the Analytics thread reads it without locking.
+	// Elements are never erased, so the sessions keep the pointers to them.
+	UnorderedMap<U32, CameraStats>	mCameraStats;
+	std::mutex						mCameraStatsMutex;
 
+	U64	mScheduleCounter = 0;
+
+	//===================================================================================
+	// Frames skipped by the overload decimation, sent once nothing else is queued.
+	struct Backfill
+	{
+		EventId eventId;
+		EventFootageId eventFootageId;
+		U32 cameraId;
+		U8 personThreshold;
+		TimePoint queuedTP;
+		String filePath;
+	};
+
+	bool					mIsOverloaded = false;
+	std::deque<Backfill>	mBackfillQueue;
+	U64						mNumBackfillDropped = 0;
+
+	struct Session
+	{
 		struct Footage
 		{
 			EventFootageId eventFootageId;
 			String fileName;
+			U8 numAttempts = 0; // Times it was sent, but the connection failed before the results.
+			TimePoint queuedTP;
+			U32 index = 0; // Event's frame number. (See "DecimateFootage")
+			U32 cameraId = 0; // Set for the send task only. (See "PreprocessFootage")
+			U64 contentHash = 0; // Frame cache. (0 - not hashed)
 		};
 
 		// If "person" was detected with the appropriate threshold,
 		// We will stop sending all other event associated footage to the analytics server.
 		bool isDone = false;
-		AnalyticsSessionId	sessionId = 0; // Analytics session id.
-		std::queue<Footage> footageQueue;
-		std::shared_ptr<std::atomic_bool> footageSendAllowedPtr;
+
+		// Event session was ended by the "EventManager", but some footage might still be queued.
+		// Session is released once all the queued footage is sent and analyzed.
+		bool isEnded = false;
+
+		U32		cameraId = 0;
+		U8		personThreshold = 0; // Person for now, use struct of Thresholds in the future?
+		String	footagePath;
+
+		// Number of the event's frames waiting for the results. (On any of the connections)
+		U32		numInFlight = 0;
+
+		// Number of the event's frames sent so far. (The first ones are sent before the other events' frames)
+		U32		numSent = 0;
+
+		U32		numQueued = 0;
+
+		CameraStats* pCameraStats = nullptr;
+
+		// NOTE: Frames of the failed connection are put back to the front. (See "RequeueFootage")
+		std::deque<Footage> footageQueue;
 	};
 
+	void StartSendTask(AnalyticsSessionId id, Vector<Session::Footage>&& rFootageList);
+
+	// NOTE: Footage "fileName" contains the full path.
+	static void SendFootageTask(Analytics* pAnalytics, SocketId socketId, Vector<Session::Footage> footageList, std::shared_ptr<SendState> sendStatePtr, std::shared_ptr<SharedMemoryRing> ringPtr);
+
+	void CreateRing(AnalyticsSessionId id);
+
+	// THREAD: Any thread. (Send task)
+	bool PreprocessFootage(const Session::Footage& rFootage, const char* pData, size_t size, Vector<char>& rOutput);
+
+	// Placement of the frames that were sent preprocessed, until their results are received.
+	// (Written by the send tasks before the frame is sent, so it's always there once the results arrive)
+	UnorderedMap<EventFootageId, JPEG::Geometry>	mFrameGeometry;
+	std::mutex										mFrameGeometryMutex;
+
+	// Preprocessing stats. (Updated by the send tasks)
+	std::atomic<U64>	mNumPreprocessed{ 0 };
+	std::atomic<U64>	mPreprocessBytesIn{ 0 };
+	std::atomic<U64>	mPreprocessBytesOut{ 0 };
+	std::atomic<U64>	mPreprocessUs{ 0 };
+
+	// Shared memory stats. (Updated by the send tasks)
+	std::atomic<U64>	mNumRingFrames{ 0 };
+	std::atomic<U64>	mNumRingFallbacks{ 0 }; // Sent using the socket, the ring was full or the frame didn't fit.
+
 	// TODO: Gal mums MAP'o visai cia nereikia, gal tiktu tiesiog Vector su pointeriu i QUEUE (std::queue<String>)?
 	std::unordered_map<EventId, Session> mEventMap;
 
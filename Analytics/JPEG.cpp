@@ -0,0 +1,1482 @@
+#include <PCH.hpp>
+
+#include "Analytics/JPEG.hpp"
+
+#include <string.h>	// memset, memcpy
+#include <math.h>	// cos, lroundf
+
+/*
+	Baseline JPEG (ITU-T T.81: SOF0/SOF1, 8 bit precision, Huffman coding).
+
+	Image is split into 8x8 blocks, every block is stored as 64 DCT coefficients.
+	The first coefficient (DC) is the block's average value: DC * Q[0] / 8 + 128.
+	So the 1/8 scaled image is available right after the Huffman decoding, no IDCT is required. (See "ComputeSignature")
+
+	Blocks are grouped into MCUs (Minimum Coded Units), the chroma components are usually subsampled:
+	4:2:0 MCU is 16x16 pixels - four luma blocks and a single block of each chroma component.
+	Cropping at the MCU boundaries doesn't change any block, the coefficients are just re-encoded. (See "Preprocess")
+*/
+
+namespace JPEG
+{
+	namespace
+	{
+		enum Marker : U8
+		{
+			SOF0 = 0xC0,	// Baseline DCT
+			SOF1 = 0xC1,	// Extended sequential DCT (Huffman)
+			DHT  = 0xC4,
+			JPG  = 0xC8,
+			DAC  = 0xCC,
+			RST0 = 0xD0,
+			RST7 = 0xD7,
+			SOI  = 0xD8,
+			EOI  = 0xD9,
+			SOS  = 0xDA,
+			DQT  = 0xDB,
+			DRI  = 0xDD,
+			APP0 = 0xE0,	// JFIF
+			APP14 = 0xEE,	// Adobe (Color transform)
+		};
+
+		constexpr int MaxComponents = 4;
+		constexpr int MaxTables = 4;
+
+		// Huffman codes up to this length are decoded with a single table lookup.
+		constexpr int LookupBits = 9;
+
+		// Entropy data that ended this many bytes too early is treated as truncated.
+		constexpr U32 MaxPaddingBytes = 16;
+
+		// Downscale factor is 2^"MaxScaleShift" at most. (1x1 pixel out of every block)
+		constexpr U8 MaxScaleShift = 3;
+
+		// Coefficient index (natural order) of the zig-zag ordered coefficient.
+		const U8 ZigZag[64] =
+		{
+			 0,  1,  8, 16,  9,  2,  3, 10,
+			17, 24, 32, 25, 18, 11,  4,  5,
+			12, 19, 26, 33, 40, 48, 41, 34,
+			27, 20, 13,  6,  7, 14, 21, 28,
+			35, 42, 49, 56, 57, 50, 43, 36,
+			29, 22, 15, 23, 30, 37, 44, 51,
+			58, 59, 52, 45, 38, 31, 39, 46,
+			53, 60, 61, 54, 47, 55, 62, 63
+		};
+
+		//===================================================================================
+		// Decoding
+
+		struct HuffmanTable
+		{
+			bool	isValid = false;
+
+			U8		lookupLength[1 << LookupBits]; // 0 - code is longer than "LookupBits".
+			U8		lookupValue[1 << LookupBits];
+
+			I32		maxCode[17];		// The largest code of the length. (-1 if there are none)
+			I32		valueOffset[17];	// "values" index of the length's first code, minus that code.
+			U8		values[256];
+
+			bool Build(const U8* pCounts, const U8* pValues, size_t numValues);
+		};
+
+		bool HuffmanTable::Build(const U8* pCounts, const U8* pValues, size_t numValues)
+		{
+			isValid = false;
+
+			memset(lookupLength, 0, sizeof(lookupLength));
+			memcpy(values, pValues, numValues);
+
+			I32 code = 0;
+			I32 index = 0;
+
+			for (int length = 1; length <= 16; ++length)
+			{
+				const int count = pCounts[length - 1];
+
+				valueOffset[length] = index - code;
+
+				for (int i = 0; i < count; ++i, ++code, ++index)
+				{
+					// All the codes of the length must fit into "length" bits. (Checked before the lookup is written)
+					if (code >= (1 << length))
+						return false;
+
+					if (length > LookupBits)
+						continue;
+
+					const int shift = LookupBits - length;
+					const int first = code << shift;
+
+					for (int j = 0; j < (1 << shift); ++j)
+					{
+						lookupLength[first + j] = static_cast<U8> (length);
+						lookupValue[first + j] = values[index];
+					}
+				}
+
+				maxCode[length] = (count > 0) ? code - 1 : -1;
+
+				code <<= 1;
+			}
+
+			isValid = true;
+			return true;
+		}
+
+		// Reads the entropy coded data. (Removes the stuffed zero bytes, stops at the markers)
+		class BitReader
+		{
+		public:
+			BitReader(const U8* pData, const U8* pEnd)
+				: mpData(pData)
+				, mpEnd(pEnd)
+			{ }
+
+			U32 Peek(int numBits)
+			{
+				if (mNumBits < numBits)
+					Fill();
+
+				return static_cast<U32> (mBuffer >> (64 - numBits));
+			}
+
+			void Skip(int numBits)
+			{
+				mBuffer <<= numBits;
+				mNumBits -= numBits;
+			}
+
+			// NOTE: "numBits" must be 1..16
+			U32 Read(int numBits)
+			{
+				const U32 value = Peek(numBits);
+				Skip(numBits);
+				return value;
+			}
+
+			// Skips the "RSTn" marker, the remaining bits of the interval are just the padding.
+			bool Restart()
+			{
+				mBuffer = 0;
+				mNumBits = 0;
+				mIsMarker = false;
+				mNumPaddingBytes = 0;
+
+				for (; mpData + 1 < mpEnd; ++mpData)
+				{
+					if (mpData[0] == 0xFF && mpData[1] >= RST0 && mpData[1] <= RST7)
+					{
+						mpData += 2;
+						return true;
+					}
+				}
+
+				return false;
+			}
+
+			bool IsTruncated() const { return mNumPaddingBytes > MaxPaddingBytes; }
+
+			const U8* GetPosition() const { return mpData; }
+
+		private:
+
+			void Fill()
+			{
+				while (mNumBits <= 56)
+				{
+					U32 byte = 0;
+
+					if (!mIsMarker && mpData < mpEnd)
+					{
+						byte = *mpData;
+
+						if (byte == 0xFF)
+						{
+							if (mpData + 1 < mpEnd && mpData[1] == 0x00)
+								mpData += 2; // Stuffed zero byte.
+							else
+							{
+								// Marker: feed zeros, the decoder must stop by itself.
+								mIsMarker = true;
+								byte = 0;
+								mNumPaddingBytes++;
+							}
+						}
+						else
+							mpData++;
+					}
+					else
+						mNumPaddingBytes++;
+
+					mBuffer |= static_cast<U64> (byte) << (56 - mNumBits);
+					mNumBits += 8;
+				}
+			}
+
+			const U8*	mpData;
+			const U8*	mpEnd;
+
+			U64		mBuffer = 0;
+			int		mNumBits = 0;
+			bool	mIsMarker = false;
+			U32		mNumPaddingBytes = 0;
+		};
+
+		inline int DecodeSymbol(BitReader& rReader, const HuffmanTable& rTable)
+		{
+			const U32 lookup = rReader.Peek(LookupBits);
+
+			if (const int length = rTable.lookupLength[lookup])
+			{
+				rReader.Skip(length);
+				return rTable.lookupValue[lookup];
+			}
+
+			const U32 code16 = rReader.Peek(16);
+
+			for (int length = LookupBits + 1; length <= 16; ++length)
+			{
+				const I32 code = static_cast<I32> (code16 >> (16 - length));
+
+				if (code <= rTable.maxCode[length])
+				{
+					rReader.Skip(length);
+					return rTable.values[rTable.valueOffset[length] + code];
+				}
+			}
+
+			return -1; // Corrupted data.
+		}
+
+		// Converts the "size" bits long value to the signed coefficient. (T.81 F.2.2.1 "EXTEND")
+		inline int Extend(U32 value, int size)
+		{
+			return (value < (1u << (size - 1))) ? static_cast<int> (value) - (1 << size) + 1 : static_cast<int> (value);
+		}
+
+		struct Component
+		{
+			U8	id = 0;
+			U8	h = 1;
+			U8	v = 1;
+			U8	tq = 0;	// Quantization table.
+			U8	td = 0;	// DC Huffman table.
+			U8	ta = 0;	// AC Huffman table.
+
+			int	predictor = 0; // DC value of the previous block.
+
+			// Number of blocks including the MCU padding.
+			U32	blocksPerLine = 0;
+			U32	blocksPerColumn = 0;
+
+			// Number of blocks that hold the image data.
+			U32	numBlocksX = 0;
+			U32	numBlocksY = 0;
+
+			// Quantized coefficients of all the blocks, natural order. (Only for the full decode)
+			Vector<I16> coefficients;
+		};
+
+		// Size and the MCU layout of the frame.
+		struct FrameInfo
+		{
+			U16		width = 0;
+			U16		height = 0;
+			U32		maxH = 1;
+			U32		maxV = 1;
+			U32		numMCUsX = 0;
+			U32		numMCUsY = 0;
+
+			Component	components[MaxComponents];
+			int			numComponents = 0;
+
+			// NOTE: Components (their sampling factors) must be already set.
+			void SetSize(U16 w, U16 h);
+		};
+
+		void FrameInfo::SetSize(U16 w, U16 h)
+		{
+			width = w;
+			height = h;
+
+			maxH = 1;
+			maxV = 1;
+
+			for (int i = 0; i < numComponents; ++i)
+			{
+				maxH = std::max<U32>(maxH, components[i].h);
+				maxV = std::max<U32>(maxV, components[i].v);
+			}
+
+			numMCUsX = (width + 8 * maxH - 1) / (8 * maxH);
+			numMCUsY = (height + 8 * maxV - 1) / (8 * maxV);
+
+			for (int i = 0; i < numComponents; ++i)
+			{
+				auto& rComponent = components[i];
+
+				rComponent.blocksPerLine = numMCUsX * rComponent.h;
+				rComponent.blocksPerColumn = numMCUsY * rComponent.v;
+
+				const U32 componentWidth = (width * rComponent.h + maxH - 1) / maxH;
+				const U32 componentHeight = (height * rComponent.v + maxV - 1) / maxV;
+
+				rComponent.numBlocksX = (componentWidth + 7) / 8;
+				rComponent.numBlocksY = (componentHeight + 7) / 8;
+			}
+		}
+
+		class Decoder
+		{
+		public:
+
+			// Full decode keeps all the coefficients of all the components. (All the scans are decoded)
+			// Otherwise decoding stops after the first scan that holds the first (luma) component, only its DC coefficients are kept.
+			bool Decode(const U8* pData, size_t size, bool isFull);
+
+			FrameInfo	mFrame;
+
+			// Quantized DC coefficients of the luma blocks. ("blocksPerLine" * "blocksPerColumn", not a full decode only)
+			Vector<I16>	mLumaDC;
+
+			U16			mQuantization[MaxTables][64] = {}; // Natural order.
+
+			// "APP0" and "APP14" segments (with the markers), they tell how the components are converted to RGB. (Full decode only)
+			Vector<char> mColorSegments;
+
+		private:
+
+			bool ParseFrame(const U8* p, const U8* pEnd);
+			bool ParseHuffmanTables(const U8* p, const U8* pEnd);
+			bool ParseQuantizationTables(const U8* p, const U8* pEnd);
+			bool ParseScan(const U8* p, const U8* pEnd);
+
+			bool DecodeScan(BitReader& rReader);
+			bool DecodeBlock(BitReader& rReader, Component& rComponent, I16* pBlock);
+			void StoreBlock(int componentIndex, U32 x, U32 y, const I16* pBlock);
+
+			static const U8* SkipEntropyData(const U8* p, const U8* pEnd);
+
+			bool	mIsFull = false;
+			U16		mRestartInterval = 0;
+
+			HuffmanTable mDCTables[MaxTables];
+			HuffmanTable mACTables[MaxTables];
+
+			// Components of the current scan. (Indices of "mFrame.components")
+			int		mScanComponents[MaxComponents] = {};
+			int		mNumScanComponents = 0;
+		};
+
+		bool Decoder::Decode(const U8* pData, size_t size, bool isFull)
+		{
+			const U8* p = pData;
+			const U8* pEnd = pData + size;
+
+			mIsFull = isFull;
+
+			if (size < 4 || p[0] != 0xFF || p[1] != SOI)
+				return false;
+
+			p += 2;
+
+			bool isFrame = false;
+
+			// Components that were decoded by any scan. (Bit per component)
+			U32 decodedMask = 0;
+
+			for (;;)
+			{
+				// Fill bytes might precede any marker.
+				while (p + 1 < pEnd && p[0] == 0xFF && p[1] == 0xFF)
+					p++;
+
+				if (p + 2 > pEnd || p[0] != 0xFF)
+					return false;
+
+				const U8 marker = p[1];
+
+				if (marker == EOI)
+					return isFull && isFrame && decodedMask == (1u << mFrame.numComponents) - 1;
+
+				if (p + 4 > pEnd)
+					return false;
+
+				const U32 length = (static_cast<U32> (p[2]) << 8) | p[3];
+
+				if (length < 2 || p + 2 + length > pEnd)
+					return false;
+
+				const U8* pSegment = p + 4;
+				const U8* pSegmentEnd = p + 2 + length;
+
+				p = pSegmentEnd;
+
+				switch (marker)
+				{
+					case SOF0:
+					case SOF1:
+						if (isFrame || !ParseFrame(pSegment, pSegmentEnd))
+							return false;
+						isFrame = true;
+						break;
+
+					case DHT:
+						if (!ParseHuffmanTables(pSegment, pSegmentEnd))
+							return false;
+						break;
+
+					case DQT:
+						if (!ParseQuantizationTables(pSegment, pSegmentEnd))
+							return false;
+						break;
+
+					case DRI:
+						if (pSegmentEnd - pSegment < 2)
+							return false;
+						mRestartInterval = static_cast<U16> ((pSegment[0] << 8) | pSegment[1]);
+						break;
+
+					case SOS:
+					{
+						if (!isFrame || !ParseScan(pSegment, pSegmentEnd))
+							return false;
+
+						if (!isFull && mScanComponents[0] != 0)
+						{
+							// Luma is stored in the other scan.
+							p = SkipEntropyData(p, pEnd);
+							break;
+						}
+
+						BitReader reader(p, pEnd);
+
+						if (!DecodeScan(reader))
+							return false;
+
+						if (!isFull)
+							return true;
+
+						for (int i = 0; i < mNumScanComponents; ++i)
+							decodedMask |= 1u << mScanComponents[i];
+
+						p = SkipEntropyData(reader.GetPosition(), pEnd);
+						break;
+					}
+
+					case APP0:
+					case APP14:
+						if (isFull)
+							mColorSegments.insert(mColorSegments.end(), pSegment - 4, pSegmentEnd);
+						break;
+
+					default:
+						// Progressive, lossless and arithmetic coded frames are not supported.
+						if ((marker & 0xF0) == 0xC0 && marker != JPG && marker != DAC)
+							return false;
+						break; // APPn, COM, etc.
+				}
+			}
+		}
+
+		bool Decoder::ParseFrame(const U8* p, const U8* pEnd)
+		{
+			if (pEnd - p < 6)
+				return false;
+
+			const U8 precision = p[0];
+
+			const U16 height = static_cast<U16> ((p[1] << 8) | p[2]);
+			const U16 width = static_cast<U16> ((p[3] << 8) | p[4]);
+
+			mFrame.numComponents = p[5];
+
+			// NOTE: Height 0 means it's defined later by the "DNL" marker, not supported.
+			if (precision != 8 || width == 0 || height == 0 || mFrame.numComponents < 1 || mFrame.numComponents > MaxComponents)
+				return false;
+
+			if (pEnd - p < 6 + mFrame.numComponents * 3)
+				return false;
+
+			p += 6;
+
+			for (int i = 0; i < mFrame.numComponents; ++i, p += 3)
+			{
+				auto& rComponent = mFrame.components[i];
+
+				rComponent.id = p[0];
+				rComponent.h = p[1] >> 4;
+				rComponent.v = p[1] & 15;
+				rComponent.tq = p[2];
+
+				if (rComponent.h < 1 || rComponent.h > 4 || rComponent.v < 1 || rComponent.v > 4 || rComponent.tq >= MaxTables)
+					return false;
+			}
+
+			mFrame.SetSize(width, height);
+
+			if (mIsFull)
+			{
+				for (int i = 0; i < mFrame.numComponents; ++i)
+				{
+					auto& rComponent = mFrame.components[i];
+					rComponent.coefficients.assign(static_cast<size_t> (rComponent.blocksPerLine) * rComponent.blocksPerColumn * 64, 0);
+				}
+			}
+			else
+			{
+				const auto& rLuma = mFrame.components[0];
+				mLumaDC.assign(static_cast<size_t> (rLuma.blocksPerLine) * rLuma.blocksPerColumn, 0);
+			}
+
+			return true;
+		}
+
+		bool Decoder::ParseHuffmanTables(const U8* p, const U8* pEnd)
+		{
+			while (p < pEnd)
+			{
+				if (pEnd - p < 17)
+					return false;
+
+				const U8 tableClass = p[0] >> 4;
+				const U8 tableId = p[0] & 15;
+
+				if (tableClass > 1 || tableId >= MaxTables)
+					return false;
+
+				const U8* pCounts = p + 1;
+
+				size_t numValues = 0;
+
+				for (int i = 0; i < 16; ++i)
+					numValues += pCounts[i];
+
+				if (numValues > 256 || static_cast<size_t> (pEnd - p) < 17 + numValues)
+					return false;
+
+				auto& rTable = (tableClass == 0) ? mDCTables[tableId] : mACTables[tableId];
+
+				if (!rTable.Build(pCounts, p + 17, numValues))
+					return false;
+
+				p += 17 + numValues;
+			}
+
+			return true;
+		}
+
+		bool Decoder::ParseQuantizationTables(const U8* p, const U8* pEnd)
+		{
+			while (p < pEnd)
+			{
+				const U8 precision = p[0] >> 4;
+				const U8 tableId = p[0] & 15;
+
+				const size_t tableSize = precision ? 128 : 64;
+
+				if (precision > 1 || tableId >= MaxTables || static_cast<size_t> (pEnd - p) < 1 + tableSize)
+					return false;
+
+				p++;
+
+				for (int i = 0; i < 64; ++i)
+				{
+					mQuantization[tableId][ZigZag[i]] = precision ? static_cast<U16> ((p[0] << 8) | p[1]) : p[0];
+					p += precision ? 2 : 1;
+				}
+			}
+
+			return true;
+		}
+
+		bool Decoder::ParseScan(const U8* p, const U8* pEnd)
+		{
+			if (pEnd - p < 1)
+				return false;
+
+			mNumScanComponents = p[0];
+
+			if (mNumScanComponents < 1 || mNumScanComponents > mFrame.numComponents || pEnd - p < 4 + mNumScanComponents * 2)
+				return false;
+
+			p++;
+
+			for (int i = 0; i < mNumScanComponents; ++i, p += 2)
+			{
+				int index = 0;
+
+				while (index < mFrame.numComponents && mFrame.components[index].id != p[0])
+					index++;
+
+				if (index == mFrame.numComponents)
+					return false;
+
+				auto& rComponent = mFrame.components[index];
+
+				rComponent.td = p[1] >> 4;
+				rComponent.ta = p[1] & 15;
+
+				if (rComponent.td >= MaxTables || rComponent.ta >= MaxTables)
+					return false;
+
+				mScanComponents[i] = index;
+			}
+
+			// Sequential scan always holds all the coefficients. (Ss = 0, Se = 63, Ah = Al = 0)
+			return p[0] == 0 && p[1] == 63 && p[2] == 0;
+		}
+
+		bool Decoder::DecodeScan(BitReader& rReader)
+		{
+			for (int i = 0; i < mNumScanComponents; ++i)
+			{
+				auto& rComponent = mFrame.components[mScanComponents[i]];
+
+				if (!mDCTables[rComponent.td].isValid || !mACTables[rComponent.ta].isValid)
+					return false;
+
+				rComponent.predictor = 0;
+			}
+
+			U32 numMCUs = 0;
+
+			auto Restart = [&]()
+			{
+				if (mRestartInterval == 0 || numMCUs == 0 || numMCUs % mRestartInterval != 0)
+					return;
+
+				rReader.Restart();
+
+				for (int i = 0; i < mNumScanComponents; ++i)
+					mFrame.components[mScanComponents[i]].predictor = 0;
+			};
+
+			I16 block[64];
+
+			if (mNumScanComponents == 1)
+			{
+				// Non-interleaved scan: single block MCUs, without the MCU padding.
+				const int index = mScanComponents[0];
+				auto& rComponent = mFrame.components[index];
+
+				for (U32 y = 0; y < rComponent.numBlocksY; ++y)
+				{
+					for (U32 x = 0; x < rComponent.numBlocksX; ++x, ++numMCUs)
+					{
+						Restart();
+
+						if (!DecodeBlock(rReader, rComponent, block))
+							return false;
+
+						StoreBlock(index, x, y, block);
+					}
+				}
+			}
+			else
+			{
+				for (U32 mcuY = 0; mcuY < mFrame.numMCUsY; ++mcuY)
+				{
+					for (U32 mcuX = 0; mcuX < mFrame.numMCUsX; ++mcuX, ++numMCUs)
+					{
+						Restart();
+
+						for (int i = 0; i < mNumScanComponents; ++i)
+						{
+							const int index = mScanComponents[i];
+							auto& rComponent = mFrame.components[index];
+
+							for (U32 by = 0; by < rComponent.v; ++by)
+							{
+								for (U32 bx = 0; bx < rComponent.h; ++bx)
+								{
+									if (!DecodeBlock(rReader, rComponent, block))
+										return false;
+
+									StoreBlock(index, mcuX * rComponent.h + bx, mcuY * rComponent.v + by, block);
+								}
+							}
+						}
+					}
+				}
+			}
+
+			return !rReader.IsTruncated();
+		}
+
+		// NOTE: Only the DC coefficient is set, if not a full decode.
+		bool Decoder::DecodeBlock(BitReader& rReader, Component& rComponent, I16* pBlock)
+		{
+			const int size = DecodeSymbol(rReader, mDCTables[rComponent.td]);
+
+			if (size < 0 || size > 11)
+				return false;
+
+			if (size > 0)
+				rComponent.predictor += Extend(rReader.Read(size), size);
+
+			if (mIsFull)
+				memset(pBlock, 0, 64 * sizeof(I16));
+
+			pBlock[0] = static_cast<I16> (rComponent.predictor);
+
+			const auto& rACTable = mACTables[rComponent.ta];
+
+			for (int k = 1; k < 64; )
+			{
+				const int symbol = DecodeSymbol(rReader, rACTable);
+
+				if (symbol < 0)
+					return false;
+
+				const int run = symbol >> 4;
+				const int acSize = symbol & 15;
+
+				if (acSize == 0)
+				{
+					if (run != 15)
+						break; // EOB
+
+					k += 16; // ZRL
+					continue;
+				}
+
+				k += run;
+
+				if (k > 63)
+					return false;
+
+				const U32 value = rReader.Read(acSize);
+
+				if (mIsFull)
+					pBlock[ZigZag[k]] = static_cast<I16> (Extend(value, acSize));
+
+				k++;
+			}
+
+			return !rReader.IsTruncated();
+		}
+
+		void Decoder::StoreBlock(int componentIndex, U32 x, U32 y, const I16* pBlock)
+		{
+			auto& rComponent = mFrame.components[componentIndex];
+
+			const size_t blockIndex = static_cast<size_t> (y) * rComponent.blocksPerLine + x;
+
+			if (mIsFull)
+				memcpy(&rComponent.coefficients[blockIndex * 64], pBlock, 64 * sizeof(I16));
+			else if (componentIndex == 0)
+				mLumaDC[blockIndex] = pBlock[0];
+		}
+
+		// Finds the marker that follows the entropy coded data.
+		const U8* Decoder::SkipEntropyData(const U8* p, const U8* pEnd)
+		{
+			for (; p + 1 < pEnd; ++p)
+			{
+				if (p[0] == 0xFF && p[1] != 0x00 && !(p[1] >= RST0 && p[1] <= RST7))
+					return p;
+			}
+
+			return pEnd;
+		}
+
+		//===================================================================================
+		// Encoding
+
+		// Huffman tables of the T.81 Annex K.3. (Hold all the symbols needed for the 8 bit precision)
+		struct HuffmanSpec
+		{
+			U8		counts[16];
+			U8		values[162];
+			size_t	numValues;
+		};
+
+		const HuffmanSpec LumaDCSpec =
+		{
+			{ 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 },
+			{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 },
+			12
+		};
+
+		const HuffmanSpec ChromaDCSpec =
+		{
+			{ 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 },
+			{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 },
+			12
+		};
+
+		const HuffmanSpec LumaACSpec =
+		{
+			{ 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 125 },
+			{
+				0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+				0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+				0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+				0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+				0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+				0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+				0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+				0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+				0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+				0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+				0xf9, 0xfa
+			},
+			162
+		};
+
+		const HuffmanSpec ChromaACSpec =
+		{
+			{ 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 119 },
+			{
+				0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+				0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+				0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+				0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+				0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+				0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+				0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+				0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+				0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+				0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+				0xf9, 0xfa
+			},
+			162
+		};
+
+		struct HuffmanCodes
+		{
+			U16	codes[256] = {};
+			U8	lengths[256] = {};
+
+			explicit HuffmanCodes(const HuffmanSpec& rSpec)
+			{
+				U16 code = 0;
+				size_t index = 0;
+
+				for (int length = 1; length <= 16; ++length, code <<= 1)
+				{
+					for (int i = 0; i < rSpec.counts[length - 1]; ++i, ++code, ++index)
+					{
+						codes[rSpec.values[index]] = code;
+						lengths[rSpec.values[index]] = static_cast<U8> (length);
+					}
+				}
+			}
+		};
+
+		// Writes the entropy coded data. (Stuffs the zero byte after every 0xFF)
+		class BitWriter
+		{
+		public:
+			explicit BitWriter(Vector<char>& rOutput)
+				: mrOutput(rOutput)
+			{ }
+
+			// NOTE: "numBits" must be 1..16
+			void Write(U32 bits, int numBits)
+			{
+				mBuffer = (mBuffer << numBits) | (bits & ((1u << numBits) - 1));
+				mNumBits += numBits;
+
+				while (mNumBits >= 8)
+				{
+					const char byte = static_cast<char> (mBuffer >> (mNumBits - 8));
+
+					mrOutput.push_back(byte);
+
+					if (byte == static_cast<char> (0xFF))
+						mrOutput.push_back(0);
+
+					mNumBits -= 8;
+				}
+			}
+
+			// The last byte is padded with 1-bits.
+			void Flush()
+			{
+				if (mNumBits > 0)
+					Write(0x7F, 8 - mNumBits);
+			}
+
+		private:
+			Vector<char>&	mrOutput;
+
+			U32		mBuffer = 0;
+			int		mNumBits = 0;
+		};
+
+		// Number of bits of the coefficient's magnitude. (Huffman symbol "size")
+		inline int GetValueSize(int value)
+		{
+			int size = 0;
+
+			for (U32 magnitude = static_cast<U32> (std::abs(value)); magnitude; magnitude >>= 1)
+				size++;
+
+			return size;
+		}
+
+		void EncodeBlock(BitWriter& rWriter, const I16* pBlock, int& rPredictor, const HuffmanCodes& rDC, const HuffmanCodes& rAC)
+		{
+			const int diff = pBlock[0] - rPredictor;
+			rPredictor = pBlock[0];
+
+			const int dcSize = GetValueSize(diff);
+
+			rWriter.Write(rDC.codes[dcSize], rDC.lengths[dcSize]);
+
+			// Negative values are stored as "value - 1" in "size" bits.
+			if (dcSize > 0)
+				rWriter.Write(static_cast<U32> (diff < 0 ? diff - 1 : diff), dcSize);
+
+			int run = 0;
+
+			for (int k = 1; k < 64; ++k)
+			{
+				const int value = pBlock[ZigZag[k]];
+
+				if (value == 0)
+				{
+					run++;
+					continue;
+				}
+
+				for (; run > 15; run -= 16)
+					rWriter.Write(rAC.codes[0xF0], rAC.lengths[0xF0]); // ZRL
+
+				const int acSize = GetValueSize(value);
+				const int symbol = (run << 4) | acSize;
+
+				rWriter.Write(rAC.codes[symbol], rAC.lengths[symbol]);
+				rWriter.Write(static_cast<U32> (value < 0 ? value - 1 : value), acSize);
+
+				run = 0;
+			}
+
+			if (run > 0)
+				rWriter.Write(rAC.codes[0x00], rAC.lengths[0x00]); // EOB
+		}
+
+		inline void WriteU8(Vector<char>& rOutput, U32 value)
+		{
+			rOutput.push_back(static_cast<char> (value));
+		}
+
+		inline void WriteU16(Vector<char>& rOutput, U32 value)
+		{
+			rOutput.push_back(static_cast<char> (value >> 8));
+			rOutput.push_back(static_cast<char> (value));
+		}
+
+		void WriteMarker(Vector<char>& rOutput, U8 marker)
+		{
+			WriteU8(rOutput, 0xFF);
+			WriteU8(rOutput, marker);
+		}
+
+		void WriteHuffmanSpec(Vector<char>& rOutput, U8 tableClassId, const HuffmanSpec& rSpec)
+		{
+			WriteU8(rOutput, tableClassId);
+
+			rOutput.insert(rOutput.end(), rSpec.counts, rSpec.counts + 16);
+			rOutput.insert(rOutput.end(), rSpec.values, rSpec.values + rSpec.numValues);
+		}
+
+		// Writes the baseline JPEG of the already quantized coefficients.
+		// Single scan, component 0 uses the luma Huffman tables, the rest use the chroma ones.
+		// "rSegments" are written right after the "SOI" as they are.
+		void Encode(const FrameInfo& rFrame, const U16 (&rQuantization)[MaxTables][64], const Vector<char>& rSegments, Vector<char>& rOutput)
+		{
+			static const HuffmanCodes LumaDC(LumaDCSpec);
+			static const HuffmanCodes LumaAC(LumaACSpec);
+			static const HuffmanCodes ChromaDC(ChromaDCSpec);
+			static const HuffmanCodes ChromaAC(ChromaACSpec);
+
+			U32 usedTables = 0; // Bit per quantization table.
+			bool is16Bit = false;
+
+			for (int i = 0; i < rFrame.numComponents; ++i)
+				usedTables |= 1u << rFrame.components[i].tq;
+
+			for (int t = 0; t < MaxTables; ++t)
+			{
+				for (int i = 0; (usedTables & (1u << t)) && i < 64; ++i)
+					is16Bit |= rQuantization[t][i] > 255;
+			}
+
+			WriteMarker(rOutput, SOI);
+
+			rOutput.insert(rOutput.end(), rSegments.begin(), rSegments.end());
+
+			for (int t = 0; t < MaxTables; ++t)
+			{
+				if (!(usedTables & (1u << t)))
+					continue;
+
+				WriteMarker(rOutput, DQT);
+				WriteU16(rOutput, 2 + 1 + (is16Bit ? 128 : 64));
+				WriteU8(rOutput, (is16Bit ? 0x10 : 0x00) | t);
+
+				for (int i = 0; i < 64; ++i)
+				{
+					if (is16Bit)
+						WriteU16(rOutput, rQuantization[t][ZigZag[i]]);
+					else
+						WriteU8(rOutput, rQuantization[t][ZigZag[i]]);
+				}
+			}
+
+			// NOTE: Baseline frame doesn't allow the 16 bit quantization tables.
+			WriteMarker(rOutput, is16Bit ? SOF1 : SOF0);
+			WriteU16(rOutput, 8 + 3 * rFrame.numComponents);
+			WriteU8(rOutput, 8);
+			WriteU16(rOutput, rFrame.height);
+			WriteU16(rOutput, rFrame.width);
+			WriteU8(rOutput, rFrame.numComponents);
+
+			for (int i = 0; i < rFrame.numComponents; ++i)
+			{
+				const auto& rComponent = rFrame.components[i];
+
+				WriteU8(rOutput, rComponent.id);
+				WriteU8(rOutput, (rComponent.h << 4) | rComponent.v);
+				WriteU8(rOutput, rComponent.tq);
+			}
+
+			WriteMarker(rOutput, DHT);
+			WriteU16(rOutput, static_cast<U32> (2 + 4 * 17 + LumaDCSpec.numValues + LumaACSpec.numValues + ChromaDCSpec.numValues + ChromaACSpec.numValues));
+			WriteHuffmanSpec(rOutput, 0x00, LumaDCSpec);
+			WriteHuffmanSpec(rOutput, 0x10, LumaACSpec);
+			WriteHuffmanSpec(rOutput, 0x01, ChromaDCSpec);
+			WriteHuffmanSpec(rOutput, 0x11, ChromaACSpec);
+
+			WriteMarker(rOutput, SOS);
+			WriteU16(rOutput, 6 + 2 * rFrame.numComponents);
+			WriteU8(rOutput, rFrame.numComponents);
+
+			for (int i = 0; i < rFrame.numComponents; ++i)
+			{
+				WriteU8(rOutput, rFrame.components[i].id);
+				WriteU8(rOutput, (i == 0) ? 0x00 : 0x11);
+			}
+
+			WriteU8(rOutput, 0);	// Ss
+			WriteU8(rOutput, 63);	// Se
+			WriteU8(rOutput, 0);	// Ah, Al
+
+			BitWriter writer(rOutput);
+
+			int predictors[MaxComponents] = {};
+
+			if (rFrame.numComponents == 1)
+			{
+				// Non-interleaved scan.
+				const auto& rComponent = rFrame.components[0];
+
+				for (U32 y = 0; y < rComponent.numBlocksY; ++y)
+				{
+					for (U32 x = 0; x < rComponent.numBlocksX; ++x)
+						EncodeBlock(writer, &rComponent.coefficients[(static_cast<size_t> (y) * rComponent.blocksPerLine + x) * 64], predictors[0], LumaDC, LumaAC);
+				}
+			}
+			else
+			{
+				for (U32 mcuY = 0; mcuY < rFrame.numMCUsY; ++mcuY)
+				{
+					for (U32 mcuX = 0; mcuX < rFrame.numMCUsX; ++mcuX)
+					{
+						for (int i = 0; i < rFrame.numComponents; ++i)
+						{
+							const auto& rComponent = rFrame.components[i];
+
+							for (U32 by = 0; by < rComponent.v; ++by)
+							{
+								for (U32 bx = 0; bx < rComponent.h; ++bx)
+								{
+									const size_t blockIndex = static_cast<size_t> (mcuY * rComponent.v + by) * rComponent.blocksPerLine + mcuX * rComponent.h + bx;
+
+									EncodeBlock(writer, &rComponent.coefficients[blockIndex * 64], predictors[i], (i == 0) ? LumaDC : ChromaDC, (i == 0) ? LumaAC : ChromaAC);
+								}
+							}
+						}
+					}
+				}
+			}
+
+			writer.Flush();
+
+			WriteMarker(rOutput, EOI);
+		}
+
+		//===================================================================================
+		// Downscaling
+
+		// "values[shift][i][u]" - the DCT basis C(u)/2 * cos((2x+1)*u*pi/16) averaged over the 2^shift pixels of the scaled pixel "i".
+		// Shift 0 is the plain 8 point basis. (Used for the forward DCT)
+		// NOTE:
+		// Averaged basis gives the box filtered block straight from the coefficients,
+		// and only the 8>>shift lowest frequencies are needed for that.
+		struct ScaledBasis
+		{
+			float values[MaxScaleShift + 1][8][8] = {};
+
+			ScaledBasis()
+			{
+				for (int shift = 0; shift <= MaxScaleShift; ++shift)
+				{
+					const int numPixels = 1 << shift;
+
+					for (int i = 0; i < (8 >> shift); ++i)
+					{
+						for (int u = 0; u < 8; ++u)
+						{
+							const double c = (u == 0) ? M_SQRT1_2 : 1.0;
+
+							double sum = 0.0;
+
+							for (int x = i * numPixels; x < (i + 1) * numPixels; ++x)
+								sum += cos((2 * x + 1) * u * M_PI / 16.0);
+
+							values[shift][i][u] = static_cast<float> (c / 2.0 * sum / numPixels);
+						}
+					}
+				}
+			}
+		};
+
+		// Builds the block out of the (2^shift)x(2^shift) source blocks, each one gives the (8>>shift)x(8>>shift) pixels.
+		// "ppSources" are row by row. Source and the output blocks use the same quantization table.
+		void ScaleBlocks(const I16* const* ppSources, U8 shift, const U16* pQuantization, I16* pOutput)
+		{
+			static const ScaledBasis basis;
+
+			const auto& rInverse = basis.values[shift];
+			const auto& rForward = basis.values[0];
+
+			const int numBlocks = 1 << shift;
+			const int numPixels = 8 >> shift;
+
+			// Level shifted pixels. (No need to add 128, the forward DCT would subtract it anyway)
+			float pixels[8][8];
+
+			for (int by = 0; by < numBlocks; ++by)
+			{
+				for (int bx = 0; bx < numBlocks; ++bx)
+				{
+					const I16* pSource = ppSources[by * numBlocks + bx];
+
+					float coefficients[8][8];
+
+					for (int v = 0; v < numPixels; ++v)
+					{
+						for (int u = 0; u < numPixels; ++u)
+							coefficients[v][u] = static_cast<float> (pSource[v * 8 + u] * pQuantization[v * 8 + u]);
+					}
+
+					// Rows, then columns.
+					float rows[8][8];
+
+					for (int v = 0; v < numPixels; ++v)
+					{
+						for (int x = 0; x < numPixels; ++x)
+						{
+							float sum = 0.0f;
+
+							for (int u = 0; u < numPixels; ++u)
+								sum += rInverse[x][u] * coefficients[v][u];
+
+							rows[v][x] = sum;
+						}
+					}
+
+					for (int y = 0; y < numPixels; ++y)
+					{
+						for (int x = 0; x < numPixels; ++x)
+						{
+							float sum = 0.0f;
+
+							for (int v = 0; v < numPixels; ++v)
+								sum += rInverse[y][v] * rows[v][x];
+
+							pixels[by * numPixels + y][bx * numPixels + x] = sum;
+						}
+					}
+				}
+			}
+
+			// Forward DCT, rows, then columns.
+			float rows[8][8];
+
+			for (int y = 0; y < 8; ++y)
+			{
+				for (int u = 0; u < 8; ++u)
+				{
+					float sum = 0.0f;
+
+					for (int x = 0; x < 8; ++x)
+						sum += rForward[x][u] * pixels[y][x];
+
+					rows[y][u] = sum;
+				}
+			}
+
+			for (int v = 0; v < 8; ++v)
+			{
+				for (int u = 0; u < 8; ++u)
+				{
+					float sum = 0.0f;
+
+					for (int y = 0; y < 8; ++y)
+						sum += rForward[y][v] * rows[y][u];
+
+					// 8 bit precision coefficients fit into 11 bits.
+					const long value = lroundf(sum / pQuantization[v * 8 + u]);
+
+					pOutput[v * 8 + u] = static_cast<I16> (std::min<long>(std::max<long>(value, -1023), 1023));
+				}
+			}
+		}
+	}
+
+	Signature ComputeSignature(const char* pData, size_t size)
+	{
+		const auto startTP = std::chrono::steady_clock::now();
+
+		Signature signature;
+
+		Decoder decoder;
+
+		if (decoder.Decode(reinterpret_cast<const U8*> (pData), size, false))
+		{
+			const auto& rLuma = decoder.mFrame.components[0];
+
+			const U32 numBlocksX = rLuma.numBlocksX;
+			const U32 numBlocksY = rLuma.numBlocksY;
+
+			// Every cell must hold at least one block.
+			if (numBlocksX >= SignatureSize && numBlocksY >= SignatureSize)
+			{
+				const I32 dcQuantization = decoder.mQuantization[rLuma.tq][0];
+
+				for (U32 cy = 0; cy < SignatureSize; ++cy)
+				{
+					const U32 y0 = cy * numBlocksY / SignatureSize;
+					const U32 y1 = (cy + 1) * numBlocksY / SignatureSize;
+
+					for (U32 cx = 0; cx < SignatureSize; ++cx)
+					{
+						const U32 x0 = cx * numBlocksX / SignatureSize;
+						const U32 x1 = (cx + 1) * numBlocksX / SignatureSize;
+
+						I32 sum = 0;
+
+						for (U32 y = y0; y < y1; ++y)
+						{
+							const I16* pRow = &decoder.mLumaDC[y * rLuma.blocksPerLine];
+
+							for (U32 x = x0; x < x1; ++x)
+								sum += pRow[x];
+						}
+
+						const I32 numBlocks = static_cast<I32> ((x1 - x0) * (y1 - y0));
+
+						// Block average = DC * Q[0] / 8 + 128
+						const I32 luma = sum * dcQuantization / (8 * numBlocks) + 128;
+
+						signature.cells[cy * SignatureSize + cx] = static_cast<U8> (std::min<I32>(std::max<I32>(luma, 0), 255));
+					}
+				}
+
+				signature.isValid = true;
+			}
+		}
+
+		signature.costUs = static_cast<U32> (std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTP).count());
+
+		return signature;
+	}
+
+	U32 GetDistance(const Signature& a, const Signature& b, U8 cellDelta)
+	{
+		U32 distance = 0;
+
+		for (size_t i = 0; i < SignatureSize * SignatureSize; ++i)
+		{
+			if (std::abs(static_cast<int> (a.cells[i]) - static_cast<int> (b.cells[i])) > cellDelta)
+				distance++;
+		}
+
+		return distance;
+	}
+
+	bool Preprocess(const char* pData, size_t size, const Region& rRegion, U16 maxWidth, Vector<char>& rOutput, Geometry& rGeometry)
+	{
+		Decoder decoder;
+
+		if (!decoder.Decode(reinterpret_cast<const U8*> (pData), size, true))
+			return false;
+
+		const auto& rSource = decoder.mFrame;
+
+		const U32 mcuWidth = 8 * rSource.maxH;
+		const U32 mcuHeight = 8 * rSource.maxV;
+
+		// Region (percent) expanded to the MCU boundaries.
+		const U32 regionX0 = std::min<U32>(rRegion.x, 100) * rSource.width / 100;
+		const U32 regionY0 = std::min<U32>(rRegion.y, 100) * rSource.height / 100;
+		const U32 regionX1 = std::min<U32>(rRegion.x + rRegion.width, 100) * rSource.width / 100;
+		const U32 regionY1 = std::min<U32>(rRegion.y + rRegion.height, 100) * rSource.height / 100;
+
+		if (regionX1 <= regionX0 || regionY1 <= regionY0)
+			return false;
+
+		const U32 mcuX0 = regionX0 / mcuWidth;
+		const U32 mcuY0 = regionY0 / mcuHeight;
+		const U32 mcuX1 = (regionX1 + mcuWidth - 1) / mcuWidth;
+		const U32 mcuY1 = (regionY1 + mcuHeight - 1) / mcuHeight;
+
+		const U32 cropX = mcuX0 * mcuWidth;
+		const U32 cropY = mcuY0 * mcuHeight;
+		const U32 cropWidth = std::min<U32>(rSource.width, mcuX1 * mcuWidth) - cropX;
+		const U32 cropHeight = std::min<U32>(rSource.height, mcuY1 * mcuHeight) - cropY;
+
+		U8 shift = 0;
+
+		while (maxWidth > 0 && (cropWidth >> shift) > maxWidth && shift < MaxScaleShift)
+			shift++;
+
+		// Nothing to do, the original is good as it is.
+		if (shift == 0 && cropWidth == rSource.width && cropHeight == rSource.height)
+			return false;
+
+		FrameInfo frame;
+
+		frame.numComponents = rSource.numComponents;
+
+		for (int i = 0; i < frame.numComponents; ++i)
+		{
+			auto& rComponent = frame.components[i];
+
+			rComponent.id = rSource.components[i].id;
+			rComponent.h = rSource.components[i].h;
+			rComponent.v = rSource.components[i].v;
+			rComponent.tq = rSource.components[i].tq;
+		}
+
+		frame.SetSize(static_cast<U16> ((cropWidth + (1u << shift) - 1) >> shift), static_cast<U16> ((cropHeight + (1u << shift) - 1) >> shift));
+
+		const U32 numScaled = 1u << shift;
+
+		const I16* sources[(1 << MaxScaleShift) * (1 << MaxScaleShift)];
+
+		for (int i = 0; i < frame.numComponents; ++i)
+		{
+			const auto& rSourceComponent = rSource.components[i];
+			auto& rComponent = frame.components[i];
+
+			rComponent.coefficients.resize(static_cast<size_t> (rComponent.blocksPerLine) * rComponent.blocksPerColumn * 64);
+
+			// Source blocks of the crop. (Blocks past the image data are replaced by the last ones)
+			const U32 sourceX0 = mcuX0 * rSourceComponent.h;
+			const U32 sourceY0 = mcuY0 * rSourceComponent.v;
+			const U32 sourceX1 = std::min<U32>(mcuX1 * rSourceComponent.h, rSourceComponent.numBlocksX);
+			const U32 sourceY1 = std::min<U32>(mcuY1 * rSourceComponent.v, rSourceComponent.numBlocksY);
+
+			auto GetSourceBlock = [&](U32 x, U32 y)
+			{
+				x = std::min<U32>(sourceX0 + x, sourceX1 - 1);
+				y = std::min<U32>(sourceY0 + y, sourceY1 - 1);
+
+				return &rSourceComponent.coefficients[(static_cast<size_t> (y) * rSourceComponent.blocksPerLine + x) * 64];
+			};
+
+			const U16* pQuantization = decoder.mQuantization[rComponent.tq];
+
+			for (U32 y = 0; y < rComponent.blocksPerColumn; ++y)
+			{
+				for (U32 x = 0; x < rComponent.blocksPerLine; ++x)
+				{
+					I16* pBlock = &rComponent.coefficients[(static_cast<size_t> (y) * rComponent.blocksPerLine + x) * 64];
+
+					// Lossless crop.
+					if (shift == 0)
+					{
+						memcpy(pBlock, GetSourceBlock(x, y), 64 * sizeof(I16));
+						continue;
+					}
+
+					for (U32 sy = 0; sy < numScaled; ++sy)
+					{
+						for (U32 sx = 0; sx < numScaled; ++sx)
+							sources[sy * numScaled + sx] = GetSourceBlock(x * numScaled + sx, y * numScaled + sy);
+					}
+
+					ScaleBlocks(sources, shift, pQuantization, pBlock);
+				}
+			}
+		}
+
+		rOutput.clear();
+		rOutput.reserve(size);
+
+		Encode(frame, decoder.mQuantization, decoder.mColorSegments, rOutput);
+
+		rGeometry.offsetX = static_cast<U16> (cropX);
+		rGeometry.offsetY = static_cast<U16> (cropY);
+		rGeometry.scaleShift = shift;
+
+		return true;
+	}
+
+	bool AddHuffmanTables(const char* pData, size_t size, Vector<char>& rOutput)
+	{
+		const U8* const pStart = reinterpret_cast<const U8*> (pData);
+		const U8* const pEnd = pStart + size;
+
+		if (size < 4 || pStart[0] != 0xFF || pStart[1] != SOI)
+			return false;
+
+		// Segments until the first scan.
+		const U8* p = pStart + 2;
+
+		for (;;)
+		{
+			if (p + 4 > pEnd || p[0] != 0xFF)
+				return false;
+
+			const U8 marker = p[1];
+
+			if (marker == DHT)
+				return false;
+
+			if (marker == SOS)
+				break;
+
+			const U32 length = (static_cast<U32> (p[2]) << 8) | p[3];
+
+			if (length < 2 || p + 2 + length > pEnd)
+				return false;
+
+			p += 2 + length;
+		}
+
+		rOutput.clear();
+		rOutput.reserve(size + 512);
+
+		rOutput.insert(rOutput.end(), pData, reinterpret_cast<const char*> (p));
+
+		WriteMarker(rOutput, DHT);
+		WriteU16(rOutput, static_cast<U32> (2 + 4 * 17 + LumaDCSpec.numValues + LumaACSpec.numValues + ChromaDCSpec.numValues + ChromaACSpec.numValues));
+		WriteHuffmanSpec(rOutput, 0x00, LumaDCSpec);
+		WriteHuffmanSpec(rOutput, 0x10, LumaACSpec);
+		WriteHuffmanSpec(rOutput, 0x01, ChromaDCSpec);
+		WriteHuffmanSpec(rOutput, 0x11, ChromaACSpec);
+
+		rOutput.insert(rOutput.end(), reinterpret_cast<const char*> (p), pData + size);
+
+		return true;
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+// Minimal baseline JPEG codec used by the Analytics prefilter and the frame preprocessing.
+// Only the entropy coded data is decoded (no full size IDCT), everything is done with the DCT coefficients.
+namespace JPEG
+{
+	// Signature grid width and height (in cells).
+	constexpr size_t SignatureSize = 16;
+
+	struct Signature
+	{
+		bool	isValid = false;
+		U32		costUs = 0; // Time it took to compute.
+
+		// Average luma of the image cells.
+		U8		cells[SignatureSize * SignatureSize] = {};
+	};
+
+	// Computes the signature of the baseline (sequential, Huffman coded) JPEG.
+	// Signature is invalid for any other data. (Progressive JPEG, not a JPEG at all, corrupted file, etc)
+	// THREAD: Any thread.
+	Signature ComputeSignature(const char* pData, size_t size);
+
+	// Number of the cells which luma differs more than "cellDelta".
+	U32 GetDistance(const Signature& a, const Signature& b, U8 cellDelta);
+
+	// Region of interest, in percent of the frame size.
+	struct Region
+	{
+		U8	x = 0;
+		U8	y = 0;
+		U8	width = 100;
+		U8	height = 100;
+	};
+
+	// Placement of the preprocessed frame within the original one:
+	// original = (preprocessed << scaleShift) + offset
+	struct Geometry
+	{
+		U16	offsetX = 0;
+		U16	offsetY = 0;
+		U8	scaleShift = 0;
+	};
+
+	// Crops the baseline JPEG to the region (expanded to the MCU boundaries) and
+	// downscales it by 2, 4 or 8, until it's no wider than "maxWidth". (0 - not downscaled)
+	// Crop alone is lossless, the scaled blocks are computed from the low frequency coefficients of the source blocks.
+	// Returns false if the JPEG is not supported or there is nothing to do, the original should be used then.
+	// THREAD: Any thread.
+	bool Preprocess(const char* pData, size_t size, const Region& rRegion, U16 maxWidth, Vector<char>& rOutput, Geometry& rGeometry);
+
+	// Motion JPEG frames (AVI clips) usually leave out the Huffman tables, the T.81 Annex K ones are implied.
+	// Writes the frame with these tables added, returns false if it already has them (or it's not a JPEG).
+	// THREAD: Any thread.
+	bool AddHuffmanTables(const char* pData, size_t size, Vector<char>& rOutput);
+}
@@ -0,0 +1,113 @@
+#include <PCH.hpp>
+
+#include "Analytics/SharedMemoryRing.hpp"
+
+#include <string.h>	// strerror
+
+#ifndef PLATFORM_WINDOWS
+#include <unistd.h>			// ftruncate, close, syscall
+#include <fcntl.h>			// O_CREAT
+#include <sys/mman.h>		// shm_open, mmap
+#include <sys/syscall.h>	// SYS_futex
+#include <linux/futex.h>
+#endif
+
+// NOTE: The consumer is another process, so the futex is not "FUTEX_PRIVATE_FLAG".
+static void WakeFutex(std::atomic<U32>* pWord)
+{
+	syscall(SYS_futex, reinterpret_cast<U32*> (pWord), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+SharedMemoryRing::~SharedMemoryRing()
+{
+	if (mpMemory != nullptr)
+		munmap(mpMemory, mMemorySize);
+
+	if (mFileId != -1)
+	{
+		close(mFileId);
+		shm_unlink(mName.c_str());
+	}
+}
+
+void SharedMemoryRing::Create(const String& rName, U32 numSlots, U32 slotSize)
+{
+	if (numSlots == 0 || slotSize == 0)
+		throw ExceptionVA("Invalid shared memory ring size. (Slots: %u, Slot size: %u)", numSlots, slotSize);
+
+	mName = rName;
+	mNumSlots = numSlots;
+	mSlotSize = slotSize;
+
+	// Slots are cache line aligned, so the headers of the neighbour slots don't share the line.
+	mSlotStride = (sizeof(SlotHeader) + slotSize + 63) & ~static_cast<size_t> (63);
+	mMemorySize = sizeof(Layout) + mSlotStride * numSlots;
+
+	// Left over by the crashed process with the same pid.
+	shm_unlink(mName.c_str());
+
+	mFileId = shm_open(mName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+
+	if (mFileId == -1)
+		throw ExceptionVA("Failed for \"shm_open\": %s (Error: %s)", mName.c_str(), strerror(errno));
+
+	if (ftruncate(mFileId, static_cast<off_t> (mMemorySize)) == -1)
+		throw ExceptionVA("Failed for \"ftruncate\": %s (Error: %s)", mName.c_str(), strerror(errno));
+
+	void* pMemory = mmap(nullptr, mMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED, mFileId, 0);
+
+	if (pMemory == MAP_FAILED)
+		throw ExceptionVA("Failed for \"mmap\": %s (Error: %s)", mName.c_str(), strerror(errno));
+
+	mpMemory = pMemory;
+
+	// NOTE: New shared memory is zero filled, the counters are already 0.
+	mpLayout = new (mpMemory) Layout();
+
+	mpLayout->numSlots = numSlots;
+	mpLayout->slotSize = slotSize;
+	mpLayout->version = Version;
+
+	// Consumer checks the magic last.
+	std::atomic_thread_fence(std::memory_order_release);
+
+	mpLayout->magic = Magic;
+}
+
+SharedMemoryRing::SlotHeader* SharedMemoryRing::GetSlot(U32 index) const
+{
+	char* pSlots = static_cast<char*> (mpMemory) + sizeof(Layout);
+
+	return reinterpret_cast<SlotHeader*> (pSlots + mSlotStride * (index % mNumSlots));
+}
+
+char* SharedMemoryRing::AcquireSlot()
+{
+	const U32 tail = mpLayout->tail.load(std::memory_order_acquire);
+
+	if (mHead - tail >= mNumSlots)
+		return nullptr;
+
+	return reinterpret_cast<char*> (GetSlot(mHead) + 1);
+}
+
+void SharedMemoryRing::Publish(U32 fileId, U32 size)
+{
+	SlotHeader* pSlot = GetSlot(mHead);
+
+	pSlot->fileId = fileId;
+	pSlot->size = size;
+
+	++mHead;
+
+	// IMPORTANT:
+	// Sequentially consistent, so the "isConsumerWaiting" is not read before the "head" is visible.
+	// (Otherwise the consumer could check the "head" and go to sleep right after we saw it awake)
+	mpLayout->head.store(mHead, std::memory_order_seq_cst);
+
+	if (mpLayout->isConsumerWaiting.load(std::memory_order_seq_cst) != 0)
+	{
+		mpLayout->doorbell.fetch_add(1, std::memory_order_seq_cst);
+		WakeFutex(&mpLayout->doorbell);
+	}
+}
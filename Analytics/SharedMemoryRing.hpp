@@ -0,0 +1,69 @@
+#pragma once
+
+// Frame hand-off to the analytics server running on the same machine. (Instead of the TCP loopback)
+// POSIX shared memory holds a ring of fixed size frame slots, the server is told its name with the "ShmAttach" message.
+// Frames are read from the disk straight into the slot, the server is woken up by the futex "doorbell"
+// only if it's waiting for the frames. Results are still received from the connection's socket.
+// THREAD: Single producer (the connection's send task), single consumer (the analytics server).
+class SharedMemoryRing
+{
+public:
+	static constexpr U32 Magic = 0x51565352; // "RSVQ"
+	static constexpr U32 Version = 1;
+
+	// Shared layout: "Layout" followed by "numSlots" slots, each is "SlotHeader" followed by "slotSize" bytes of data.
+	// NOTE: Counters only grow (and wrap around), the slot index is the counter modulo "numSlots".
+	struct Layout
+	{
+		U32 magic = 0;
+		U32 version = 0;
+		U32 numSlots = 0;
+		U32 slotSize = 0;
+
+		alignas(64) std::atomic<U32> head{ 0 };		// Published frames. (Producer)
+		alignas(64) std::atomic<U32> tail{ 0 };		// Consumed frames, the slot can be reused. (Consumer)
+		alignas(64) std::atomic<U32> doorbell{ 0 };	// Futex word, bumped when the waiting consumer must wake up.
+		std::atomic<U32> isConsumerWaiting{ 0 };
+	};
+
+	struct SlotHeader
+	{
+		U32 fileId = 0; // Same as "Frame::fileId".
+		U32 size = 0;
+	};
+
+	SharedMemoryRing() { }
+	~SharedMemoryRing();
+
+	SharedMemoryRing(const SharedMemoryRing&) = delete;
+	SharedMemoryRing& operator=(const SharedMemoryRing&) = delete;
+
+	// Creates (and maps) the new shared memory object, it's removed by the destructor.
+	// Throws "Exception" on failure.
+	void Create(const String& rName, U32 numSlots, U32 slotSize);
+
+	const String& GetName() const { return mName; }
+	U32 GetNumSlots() const { return mNumSlots; }
+	U32 GetSlotCapacity() const { return mSlotSize; }
+
+	// Returns the data of the next free slot, nullptr if all of them are still used by the consumer.
+	// The slot is handed to the consumer by the "Publish".
+	char* AcquireSlot();
+	void Publish(U32 fileId, U32 size);
+
+private:
+
+	SlotHeader* GetSlot(U32 index) const;
+
+	String	mName;
+	int		mFileId = -1;
+	void*	mpMemory = nullptr;
+	size_t	mMemorySize = 0;
+
+	U32		mNumSlots = 0;
+	U32		mSlotSize = 0;
+	size_t	mSlotStride = 0;
+
+	Layout*	mpLayout = nullptr;
+	U32		mHead = 0; // Producer's copy of the "Layout::head".
+};
@@ -1,142 +1,1308 @@
-
 #include "PCH.hpp"
 
-#include "Main.hpp"
 #include "Socket.hpp"
 
 #include "CGI/CGIManager.hpp"
 
+#include <string.h>	// memcpy
+#include <stdlib.h>	// strtoull
+
 #ifndef PLATFORM_WINDOWS
-//#include <sys/types.h>
-//#include <sys/socket.h>
+#include <unistd.h>		// close
+#include <signal.h>		// pthread_sigmask
 #include <netdb.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #endif
 
-CGIManager::CGIManager(const String& rHostname, U16 port)
-	: mHostname(rHostname)
-	, mPort(port)
-{
-	LOG_MESSAGE(Log::Channel::CGI, "Notifications host: %s:%u", rHostname.c_str(), port);
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
 /*
-	addrinfo hints {};
+	MINTYS
+
+	Anksciau kiekvienas pranesimas buvo "system("curl ...")" is main thread'o:
+	fork + exec, DNS uzklausa ir TLS handshake kiekviena karta, o FTP ir API laukdavo kol curl baigs.
+
+	Dabar pranesimus siuncia CGI thread'as (epoll + eventfd, kaip ir Analytics).
+	Prisijungimai laikomi atviri (HTTP/1.1 keep-alive) ir naudojami kitoms uzklausoms,
+	vienu metu siunciama ne daugiau "maxConnections" uzklausu.
+*/
+
+// Epoll "data" value used to identify the wake event. (Connection ids are used for the sockets)
+constexpr U64 WakeEventTag = U64_MAX;
+
+constexpr int MaxEpollEvents = 16;
+
+// Maximum time to stay in "epoll_wait" without any activity. (Used for the timeouts)
+constexpr int EpollTimeoutMs = 500;
+
+// Delay before connecting to the host again after the connect failure. (Doubled after each failure)
+constexpr U16 MinRetryDelaySec = 1;
+constexpr U16 MaxRetryDelaySec = 30;
+
+// How many times the request is sent before it's dropped. (Connection failures, the HTTP errors are not retried)
+constexpr U8 MaxRequestAttempts = 3;
+
+// Anything larger is treated as a broken response. (Only the status is used, the body is dropped)
+constexpr size_t MaxResponseSize = 1 << 20;
+
+constexpr int StatsIntervalSec = 60;
+
+struct CGIManager::Address
+{
+	sockaddr_storage	address{};
+	socklen_t			size = 0;
+};
+
+static String GetSSLError()
+{
+	char text[256];
+
+	const auto errorCode = ERR_get_error();
+
+	if (errorCode == 0)
+		return "Unknown";
+
+	ERR_error_string_n(errorCode, text, sizeof(text));
+
+	// The rest of the queue is not needed.
+	ERR_clear_error();
+
+	return text;
+}
+
+static String ToLower(String text)
+{
+	std::transform(text.begin(), text.end(), text.begin(), [](char c) { return static_cast<char> (tolower(static_cast<unsigned char> (c))); });
+	return text;
+}
+
+struct HTTPResponse
+{
+	int		statusCode = 0;
+	bool	isKeepAlive = true;
+	bool	isUntilClose = false; // No "Content-Length" or "chunked", the body ends when the connection is closed.
+	size_t	size = 0;
+};
+
+// Returns true once the whole response is in the buffer.
+// Throws "Exception" if it's not an HTTP response.
+static bool ParseResponse(const String& rBuffer, HTTPResponse& rResponse)
+{
+	const auto headerEnd = rBuffer.find("\r\n\r\n");
+
+	if (headerEnd == String::npos)
+		return false;
+
+	// "HTTP/1.1 200 OK"
+	if (rBuffer.compare(0, 5, "HTTP/") != 0)
+		throw Exception("Invalid HTTP response!");
+
+	const auto statusPos = rBuffer.find(' ');
+
+	if (statusPos == String::npos || statusPos > headerEnd)
+		throw Exception("Invalid HTTP status line!");
+
+	rResponse.statusCode = atoi(rBuffer.c_str() + statusPos + 1);
+	rResponse.isKeepAlive = (rBuffer.compare(0, 8, "HTTP/1.0") != 0);
+	rResponse.isUntilClose = false;
+
+	long long contentLength = -1;
+	bool isChunked = false;
+
+	for (size_t lineStart = rBuffer.find("\r\n") + 2; lineStart < headerEnd; )
 	{
-		hints.ai_family = AF_UNSPEC;	// To allow both IPv4 and IPv6 addresses.
-		hints.ai_socktype = SOCK_STREAM;
-		hints.ai_protocol = IPPROTO_TCP;
+		const auto lineEnd = rBuffer.find("\r\n", lineStart);
+		const auto colonPos = rBuffer.find(':', lineStart);
+
+		if (colonPos != String::npos && colonPos < lineEnd)
+		{
+			const String name(ToLower(rBuffer.substr(lineStart, colonPos - lineStart)));
+			const String value(ToLower(rBuffer.substr(colonPos + 1, lineEnd - colonPos - 1)));
+
+			if (name == "content-length")
+				contentLength = strtoll(value.c_str(), nullptr, 10);
+			else if (name == "transfer-encoding")
+				isChunked = (value.find("chunked") != String::npos);
+			else if (name == "connection")
+			{
+				if (value.find("close") != String::npos)
+					rResponse.isKeepAlive = false;
+				else if (value.find("keep-alive") != String::npos)
+					rResponse.isKeepAlive = true;
+			}
+		}
+
+		lineStart = lineEnd + 2;
 	}
 
-	const String portString(std::to_string(mPort));
+	const size_t bodyStart = headerEnd + 4;
 
-	int result = getaddrinfo(mHostname.c_str(), portString.c_str(), &hints, &mpAddrInfo);
-	if (result != 0)
-		throw ExceptionVA("Failed for \"getaddrinfo(\"%s:%s\")\"! (Error: %s, Code: %d)", mHostname.c_str(), portString.c_str(), gai_strerror(result), result);
+	if (rResponse.statusCode / 100 == 1 || rResponse.statusCode == 204 || rResponse.statusCode == 304)
+	{
+		rResponse.size = bodyStart;
+		return true;
+	}
 
-	// TMEP: Testing...
-	for (int i = 0; i < 5; ++i)
+	if (isChunked)
 	{
-		Add("/ui/inform-user.php?eventID=" + std::to_string(i));
+		// Chunk: size (hex), CRLF, data, CRLF. The last one is empty, followed by the optional trailers and CRLF.
+		for (size_t pos = bodyStart; ; )
+		{
+			const auto lineEnd = rBuffer.find("\r\n", pos);
+
+			if (lineEnd == String::npos)
+				return false;
+
+			const auto chunkSize = strtoull(rBuffer.c_str() + pos, nullptr, 16);
+
+			if (chunkSize == 0)
+			{
+				const auto end = rBuffer.find("\r\n\r\n", lineEnd);
+
+				if (end == String::npos)
+					return false;
+
+				rResponse.size = end + 4;
+				return true;
+			}
+
+			if (chunkSize > MaxResponseSize)
+				throw Exception("HTTP response chunk is too large!");
+
+			pos = lineEnd + 2 + chunkSize + 2;
+
+			if (pos > rBuffer.size())
+				return false;
+		}
 	}
-*/
+
+	if (contentLength >= 0)
+	{
+		if (rBuffer.size() < bodyStart + static_cast<size_t> (contentLength))
+			return false;
+
+		rResponse.size = bodyStart + static_cast<size_t> (contentLength);
+		return true;
+	}
+
+	rResponse.isUntilClose = true;
+	rResponse.isKeepAlive = false;
+
+	return false;
+}
+
+CGIManager::CGIManager(const Settings& rSettings)
+	: mSettings(rSettings)
+	, mRetryDelaySec(MinRetryDelaySec)
+{
+	LOG_MESSAGE(Log::Channel::CGI, "Notifications host: %s:%u (%s, connections: %u, keep-alive: %u sec, timeout: %u sec)",
+		mSettings.hostname.c_str(), mSettings.port, mSettings.isSecure ? "HTTPS" : "HTTP", mSettings.maxConnections, mSettings.keepAliveSec, mSettings.requestTimeoutSec);
+
+	if (mSettings.maxConnections == 0)
+		throw Exception("Notifications need at least one connection!");
+
+	if (!mSettings.batchPath.empty())
+		LOG_MESSAGE(Log::Channel::CGI, "Notifications are batched: %s (window: %u ms, max: %u)", mSettings.batchPath.c_str(), mSettings.batchWindowMs, mSettings.maxBatchSize);
+
+	if (mSettings.coalesceWindowSec != 0 || mSettings.rateLimitPerSec != 0)
+		LOG_MESSAGE(Log::Channel::CGI, "Notifications coalesce window: %u sec, rate limit: %u/sec (burst: %u)", mSettings.coalesceWindowSec, mSettings.rateLimitPerSec, mSettings.rateBurst);
+
+	mNumTokens = mSettings.rateBurst;
+	mTokensTP = std::chrono::steady_clock::now();
+
+	mEpollId = epoll_create1(EPOLL_CLOEXEC);
+
+	if (mEpollId == -1)
+	{
+		int errorCode = Socket::GetErrorCode();
+		throw ExceptionVA("CGI manager failed for \"epoll_create1\"! (Error: %s, Code: %d)", Socket::GetErrorString(errorCode), errorCode);
+	}
+
+	mWakeEventId = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (mWakeEventId == -1)
+	{
+		int errorCode = Socket::GetErrorCode();
+		throw ExceptionVA("CGI manager failed for \"eventfd\"! (Error: %s, Code: %d)", Socket::GetErrorString(errorCode), errorCode);
+	}
+
+	{
+		epoll_event event{};
+
+		event.events = EPOLLIN;
+		event.data.u64 = WakeEventTag;
+
+		if (epoll_ctl(mEpollId, EPOLL_CTL_ADD, mWakeEventId, &event) == -1)
+		{
+			int errorCode = Socket::GetErrorCode();
+			throw ExceptionVA("CGI manager failed to register the wake event! (Error: %s, Code: %d)", Socket::GetErrorString(errorCode), errorCode);
+		}
+	}
+
+	if (mSettings.isSecure)
+	{
+		mpSSLContext = SSL_CTX_new(TLS_client_method());
+
+		if (mpSSLContext == nullptr)
+			throw ExceptionVA("Failed for \"SSL_CTX_new\"! (Error: %s)", GetSSLError().c_str());
+
+		SSL_CTX_set_min_proto_version(mpSSLContext, TLS1_2_VERSION);
+		SSL_CTX_set_verify(mpSSLContext, SSL_VERIFY_PEER, nullptr);
+
+		if (SSL_CTX_set_default_verify_paths(mpSSLContext) != 1)
+			throw ExceptionVA("Failed to load the trusted certificates! (Error: %s)", GetSSLError().c_str());
+	}
+
+	{
+		const auto numConnections = mSettings.maxConnections;
+
+		mConnectionSockets.resize(numConnections, INVALID_SOCKET);
+		mConnectionStatus.resize(numConnections, Status::Free);
+		mConnectionSSL.resize(numConnections, nullptr);
+		mConnectionTimePoints.resize(numConnections);
+		mConnectionRequests.resize(numConnections);
+		mConnectionSendBuffers.resize(numConnections);
+		mConnectionSendOffsets.resize(numConnections, 0);
+		mConnectionReadBuffers.resize(numConnections);
+		mConnectionNumRequests.resize(numConnections, 0);
+	}
+
+	mThreadPtr = std::make_unique<std::thread>(&CGIManager::ThreadProc, this);
 }
 
 CGIManager::~CGIManager()
 {
-//	if (mpAddrInfo)
-//		freeaddrinfo(mpAddrInfo);
+	mIsStopRequested = true;
+
+	WakeUp();
+
+	mThreadPtr->join();
+
+	if (!mPending.empty() || !mQueue.empty() || !mBatch.empty())
+		LOG_WARNING(Log::Channel::CGI, "CGI manager stopped while still holding %zu queued CGI's!", mPending.size() + mQueue.size() + mBatch.size());
+
+	if (mpSSLSession != nullptr)
+		SSL_SESSION_free(mpSSLSession);
+
+	if (mpSSLContext != nullptr)
+		SSL_CTX_free(mpSSLContext);
+
+	close(mWakeEventId);
+	close(mEpollId);
 }
 
+// Request is sent by the CGI thread. (See "HandlePending")
 void CGIManager::Add(const String& rCGI)
 {
 	LOG_MESSAGE(Log::Channel::CGI, "Adding CGI for processing: \"%s\".", rCGI.c_str());
 
 	mQueueMutex.lock();
-	mQueue.emplace_back(rCGI);
+	mQueue.emplace_back(rCGI, std::chrono::steady_clock::now());
 	mQueueMutex.unlock();
+
+	WakeUp();
 }
 
-void CGIManager::Process()
+// Request is made by the CGI thread, so the same event's notifications can be coalesced. (See "HandleNotification")
+void CGIManager::AddNotification(EventId eventId, EventFootageId eventFootageId)
 {
+	Request request;
+
+	request.queuedTP = std::chrono::steady_clock::now();
+	request.eventId = eventId;
+	request.eventFootageId = eventFootageId;
+	request.isQueuedNotification = true;
+
 	mQueueMutex.lock();
+	mQueue.emplace_back(std::move(request));
+	mQueueMutex.unlock();
+
+	WakeUp();
+}
+
+void CGIManager::WakeUp()
+{
+	eventfd_write(mWakeEventId, 1);
+}
+
+void CGIManager::ThreadProc()
+{
+	LOG_MESSAGE(Log::Channel::CGI, "CGI thread started.");
 
-	if (mQueue.empty())
+	if (gpFlightRecorder)
+		gpFlightRecorder->SetThreadName("CGI");
+
+	// NOTE:
+	// TLS connections are written by the OpenSSL using "write", the SIGPIPE (when the host closes the connection)
+	// would terminate the whole server. Blocked signal stays pending on this thread instead.
 	{
-		mQueueMutex.unlock();
-		return;
+		sigset_t signals;
+
+		sigemptyset(&signals);
+		sigaddset(&signals, SIGPIPE);
+
+		pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+	}
+
+	mStatsTP = std::chrono::steady_clock::now();
+
+	try
+	{
+		epoll_event events[MaxEpollEvents];
+
+		while (!mIsStopRequested)
+		{
+			const int numEvents = epoll_wait(mEpollId, events, MaxEpollEvents, GetWaitMs(std::chrono::steady_clock::now()));
+
+			if (numEvents == -1 && Socket::GetErrorCode() != EINTR)
+			{
+				int errorCode = Socket::GetErrorCode();
+				throw ExceptionVA("Failed for \"epoll_wait\"! (Error: %s, Code: %d)", Socket::GetErrorString(errorCode), errorCode);
+			}
+
+			for (int i = 0; i < numEvents; ++i)
+			{
+				if (events[i].data.u64 == WakeEventTag)
+				{
+					eventfd_t value;
+					eventfd_read(mWakeEventId, &value);
+					continue;
+				}
+
+				HandleSocketEvent(static_cast<ConnectionId> (events[i].data.u64), events[i].events);
+			}
+
+			const auto currentTP = std::chrono::steady_clock::now();
+
+			HandleQueuedRequests(currentTP);
+
+			HandleBatch(currentTP);
+
+			HandleTimeouts(currentTP);
+
+			HandlePending(currentTP);
+
+			Metrics::Set(gMetrics.cgiQueueDepth, mPending.size() + mBatch.size());
+
+			if (std::chrono::duration_cast<std::chrono::seconds>(currentTP - mStatsTP).count() >= StatsIntervalSec)
+			{
+				LogStats();
+				mStatsTP = currentTP;
+			}
+		}
+	}
+	catch (const Exception& e)
+	{
+		LOG_ERROR(Log::Channel::CGI, "CGI manager: %s", e.GetText());
 	}
 
-	Vector<String> localQueue;
-	localQueue.resize(mQueue.size());
-	std::copy(mQueue.begin(), mQueue.end(), localQueue.begin());
+	// NOTE: Released here, the "close_notify" is written while the SIGPIPE is still blocked.
+	for (ConnectionId id = 0; id < mSettings.maxConnections; ++id)
+		ReleaseConnection(id, false);
+
+	LOG_MESSAGE(Log::Channel::CGI, "CGI thread stopped.");
+}
 
-	mQueue.clear();
+void CGIManager::HandleQueuedRequests(const TimePoint& rCurrentTP)
+{
+	Vector<Request> localQueue;
 
+	mQueueMutex.lock();
+	localQueue.swap(mQueue);
 	mQueueMutex.unlock();
 
-	for (auto& rCGI : localQueue)
+	for (auto& rRequest : localQueue)
+	{
+		if (rRequest.isQueuedNotification)
+			HandleNotification(std::move(rRequest), rCurrentTP);
+		else
+			mPending.emplace_back(std::move(rRequest));
+	}
+
+	// Events outside the coalesce window are forgotten.
+	if (mNotifiedEvents.empty() || std::chrono::duration_cast<std::chrono::seconds>(rCurrentTP - mNotifiedPruneTP).count() < mSettings.coalesceWindowSec)
+		return;
+
+	for (auto it = mNotifiedEvents.begin(); it != mNotifiedEvents.end(); )
+	{
+		if (std::chrono::duration_cast<std::chrono::seconds>(rCurrentTP - it->second).count() >= mSettings.coalesceWindowSec)
+			it = mNotifiedEvents.erase(it);
+		else
+			++it;
+	}
+
+	mNotifiedPruneTP = rCurrentTP;
+}
+
+// Several frames (or several persons of the same frame) of the event can cross the threshold,
+// the user is informed once per "coalesceWindowSec". The first notification is not delayed.
+void CGIManager::HandleNotification(Request&& rRequest, const TimePoint& rCurrentTP)
+{
+	if (mSettings.coalesceWindowSec != 0)
 	{
-		if (gIsQuitRequested)
+		auto it = mNotifiedEvents.find(rRequest.eventId);
+
+		if (it != mNotifiedEvents.end() && std::chrono::duration_cast<std::chrono::seconds>(rCurrentTP - it->second).count() < mSettings.coalesceWindowSec)
 		{
-			// TODO: Finish processing queued results?
-			LOG_WARNING(Log::Channel::CGI, "CGI manager detected STOP requested while still holding %" PRIu64 " queued CGI's!", mQueue.size());
-			break;
+			gFootageLatency.Finish(rRequest.eventFootageId);
+
+			mStats.numCoalesced++;
+			return;
 		}
 
-		LOG_MESSAGE(Log::Channel::CGI, "Processing CGI: \"%s\".", rCGI.c_str());
+		mNotifiedEvents[rRequest.eventId] = rCurrentTP;
+	}
 
-#if 1
-		std::ostringstream ss;
+	if (!mSettings.batchPath.empty())
+	{
+		if (mBatch.empty())
+			mBatchTP = rRequest.queuedTP;
 
-#if PLATFORM_WINDOWS
-		ss << "curl \"http://" << mHostname << rCGI << "\"";
-#else
-		ss << "curl -X GET https://" << mHostname << rCGI;
-#endif
+		mBatch.emplace_back(rRequest.eventId, rRequest.eventFootageId);
+		return;
+	}
+
+	std::ostringstream ss;
+
+	ss	<< "/ui/inform-user.php?eventID=" << rRequest.eventId
+		<< "&eventFrameID=" << rRequest.eventFootageId;
+
+	rRequest.cgi = ss.str();
+	rRequest.isQueuedNotification = false;
+
+	mPending.emplace_back(std::move(rRequest));
+}
+
+// Batch is sent once its window has passed and the rate limit allows it, so the alarm storm ends up in a few large batches.
+// (Full batch is sent right away)
+void CGIManager::HandleBatch(const TimePoint& rCurrentTP)
+{
+	if (mBatch.empty())
+		return;
+
+	const bool isFull = (mSettings.maxBatchSize != 0 && mBatch.size() >= mSettings.maxBatchSize);
+
+	if (!isFull)
+	{
+		if (std::chrono::duration_cast<std::chrono::milliseconds>(rCurrentTP - mBatchTP).count() < mSettings.batchWindowMs)
+			return;
+
+		// Waits for the previous requests (and the tokens), collecting more notifications meanwhile.
+		if (!mPending.empty() || GetNumTokens(rCurrentTP) == 0)
+			return;
+	}
+
+	// PHP reads them as arrays: "$_POST['eventID'][i]", "$_POST['eventFrameID'][i]".
+	std::ostringstream ss;
+
+	for (size_t i = 0; i < mBatch.size(); ++i)
+	{
+		if (i != 0)
+			ss << '&';
+
+		ss << "eventID%5B%5D=" << mBatch[i].first << "&eventFrameID%5B%5D=" << mBatch[i].second;
+	}
 
-		system(ss.str().c_str());
-#else
-		String cgiContent;
+	Request request(mSettings.batchPath, mBatchTP);
+
+	request.body = ss.str();
+
+	for (const auto& r : mBatch)
+	{
+		request.batchEventIds.push_back(r.first);
+		request.batchFootageIds.push_back(r.second);
+	}
+
+	LOG_MESSAGE(Log::Channel::CGI, "Notifications batch: %zu notifications.", mBatch.size());
+
+	mStats.numBatched += static_cast<U32> (mBatch.size());
+
+	mBatch.clear();
+
+	mPending.emplace_back(std::move(request));
+}
+
+void CGIManager::HandleTimeouts(const TimePoint& rCurrentTP)
+{
+	for (ConnectionId id = 0; id < mSettings.maxConnections; ++id)
+	{
+		const auto status = mConnectionStatus.at(id);
+
+		if (status == Status::Free)
+			continue;
+
+		const auto elapsedSec = std::chrono::duration_cast<std::chrono::seconds>(rCurrentTP - mConnectionTimePoints.at(id)).count();
+
+		if (status == Status::Idle)
+		{
+			if (elapsedSec >= mSettings.keepAliveSec)
+				ReleaseConnection(id, false);
+		}
+		else if (mSettings.requestTimeoutSec != 0 && elapsedSec >= mSettings.requestTimeoutSec)
 		{
-			std::ostringstream	ss;
+			LOG_ERROR(Log::Channel::CGI, "Notifications connection (id: %u) timed out. (Status: %u)", id, static_cast<U32> (status));
+
+			if (status == Status::Connecting || status == Status::Handshaking)
+				HandleConnectFailure(rCurrentTP);
 
-			ss << "GET " << rCGI << " HTTP/1.1\r\n";
-			ss << "Host: " << mHostname/* << ":" << mPort */<< "\r\n";
-			ss << "Connection: keep-alive\r\n";
-			ss << "\r\n";
-			cgiContent = ss.str();
+			// Host might still handle the request that was fully sent.
+			ReleaseConnection(id, status != Status::Receiving);
 		}
+	}
+}
 
-		SocketId socketId = INVALID_SOCKET;
+// Idle connections take the pending requests first, new connections are made only for the rest of them.
+void CGIManager::HandlePending(const TimePoint& rCurrentTP)
+{
+	if (mPending.empty())
+		return;
 
-		try
+	size_t numStarting = 0;
+	size_t numFree = 0;
+
+	for (ConnectionId id = 0; id < mSettings.maxConnections && !mPending.empty(); ++id)
+	{
+		switch (mConnectionStatus.at(id))
 		{
-			if ((socketId = socket(mpAddrInfo->ai_family, mpAddrInfo->ai_socktype, mpAddrInfo->ai_protocol)) == INVALID_SOCKET)
+			case Status::Idle:
 			{
-				int errorCode = Socket::GetErrorCode();
-				throw ExceptionVA("Failed for \"socket\"! (Error: %s, Code: %d)", Socket::GetErrorString(errorCode), errorCode);
-			}
+				if (!TakeToken(rCurrentTP))
+					break;
 
-			if (connect(socketId, mpAddrInfo->ai_addr, mpAddrInfo->ai_addrlen) == SOCKET_ERROR)
-			{
-				int errorCode = Socket::GetErrorCode();
-				throw ExceptionVA("Failed for \"connect\"! (Error: %s, Code: %d)", Socket::GetErrorString(errorCode), errorCode);
+				Request request(std::move(mPending.front()));
+				mPending.pop_front();
+
+				StartRequest(id, std::move(request));
+				break;
 			}
 
-			auto bytesSent = send(socketId, cgiContent.c_str(), cgiContent.size(), 0);
+			case Status::Connecting:
+			case Status::Handshaking:
+				numStarting++;
+				break;
 
-			if (bytesSent == SOCKET_ERROR)
-			{
-				int errorCode = Socket::GetErrorCode();
-				throw ExceptionVA("Failed for \"send\"! (Error: %s, Code: %d)", Socket::GetErrorString(errorCode), errorCode);
-			}
+			case Status::Free:
+				numFree++;
+				break;
 
-			printf("bytesSent: %d\n", bytesSent);
-		}
-		catch (const Exception& e)
-		{
-			LOG_ERROR(Log::Channel::CGI, e.GetText());
+			default:
+				break;
 		}
+	}
 
-		Socket::Close(socketId);
-#endif
+	if (rCurrentTP < mRetryTP)
+		return;
+
+	// Connections that are still connecting will take the requests once ready. (See "HandleReady")
+	// NOTE: No more connections than the requests the rate limit allows right now.
+	size_t numWanted = (mPending.size() > numStarting) ? mPending.size() - numStarting : 0;
+
+	numWanted = std::min<size_t>(numWanted, GetNumTokens(rCurrentTP));
+
+	for (; numWanted > 0 && numFree > 0; --numWanted, --numFree)
+	{
+		StartConnection(rCurrentTP);
+
+		if (rCurrentTP < mRetryTP)
+			break;
 	}
 }
+
+void CGIManager::LogStats()
+{
+	if (mStats.numSent == 0 && mStats.numFailed == 0)
+		return;
+
+	LOG_MESSAGE(Log::Channel::CGI, "Notifications: sent: %u (reused connections: %u), failed: %u, new connections: %u (TLS resumed: %u), latency avg: %" PRIu64 " ms, max: %u ms",
+		mStats.numSent, mStats.numReused, mStats.numFailed, mStats.numConnects, mStats.numResumed,
+		mStats.numSent ? mStats.totalLatencyMs / mStats.numSent : 0, mStats.maxLatencyMs);
+
+	if (mStats.numCoalesced != 0 || mStats.numBatched != 0)
+		LOG_MESSAGE(Log::Channel::CGI, "Notifications coalesced: %u, batched: %u", mStats.numCoalesced, mStats.numBatched);
+
+	mStats = {};
+}
+
+// Takes the token for the next request. (Always succeeds if the rate is not limited)
+bool CGIManager::TakeToken(const TimePoint& rCurrentTP)
+{
+	if (mSettings.rateLimitPerSec == 0)
+		return true;
+
+	if (GetNumTokens(rCurrentTP) == 0)
+		return false;
+
+	mNumTokens -= 1.0;
+
+	return true;
+}
+
+// Bucket is refilled at "rateLimitPerSec" up to the "rateBurst".
+U32 CGIManager::GetNumTokens(const TimePoint& rCurrentTP)
+{
+	if (mSettings.rateLimitPerSec == 0)
+		return U32_MAX;
+
+	const double elapsedSec = std::chrono::duration<double>(rCurrentTP - mTokensTP).count();
+
+	mNumTokens = std::min<double>(mSettings.rateBurst, mNumTokens + elapsedSec * mSettings.rateLimitPerSec);
+	mTokensTP = rCurrentTP;
+
+	return static_cast<U32> (mNumTokens);
+}
+
+// "epoll_wait" timeout: until the batch is due or the next token is available (whichever is needed), no longer than "EpollTimeoutMs".
+int CGIManager::GetWaitMs(const TimePoint& rCurrentTP) const
+{
+	int waitMs = EpollTimeoutMs;
+
+	if (!mBatch.empty())
+	{
+		const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(rCurrentTP - mBatchTP).count();
+
+		waitMs = std::min<int>(waitMs, static_cast<int> (std::max<long long>(mSettings.batchWindowMs - elapsedMs, 0)));
+	}
+
+	if ((!mPending.empty() || !mBatch.empty()) && mSettings.rateLimitPerSec != 0 && mNumTokens < 1.0)
+	{
+		const int tokenMs = static_cast<int> ((1.0 - mNumTokens) * 1000.0 / mSettings.rateLimitPerSec) + 1;
+
+		waitMs = std::min(waitMs, tokenMs);
+	}
+
+	return waitMs;
+}
+
+// Resolves the host, once per "dnsCacheSec". (Or after the connect failure)
+// NOTE: "getaddrinfo" blocks, but only the CGI thread.
+bool CGIManager::Resolve(const TimePoint& rCurrentTP)
+{
+	if (!mAddresses.empty() && std::chrono::duration_cast<std::chrono::seconds>(rCurrentTP - mResolvedTP).count() < mSettings.dnsCacheSec)
+		return true;
+
+	addrinfo hints{};
+	{
+		hints.ai_family = AF_UNSPEC;	// To allow both IPv4 and IPv6 addresses.
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+		hints.ai_flags = AI_ADDRCONFIG;
+	}
+
+	const String portString(std::to_string(mSettings.port));
+
+	addrinfo* pAddrInfo = nullptr;
+
+	const int result = getaddrinfo(mSettings.hostname.c_str(), portString.c_str(), &hints, &pAddrInfo);
+
+	if (result != 0)
+	{
+		LOG_ERROR(Log::Channel::CGI, "Failed for \"getaddrinfo(\"%s:%s\")\"! (Error: %s, Code: %d)", mSettings.hostname.c_str(), portString.c_str(), gai_strerror(result), result);
+
+		// Last known addresses are better than none.
+		return !mAddresses.empty();
+	}
+
+	mAddresses.clear();
+
+	for (auto* p = pAddrInfo; p != nullptr; p = p->ai_next)
+	{
+		if (p->ai_addrlen > sizeof(sockaddr_storage))
+			continue;
+
+		Address address;
+
+		memcpy(&address.address, p->ai_addr, p->ai_addrlen);
+		address.size = p->ai_addrlen;
+
+		mAddresses.emplace_back(address);
+	}
+
+	freeaddrinfo(pAddrInfo);
+
+	mAddressIndex = 0;
+	mResolvedTP = rCurrentTP;
+
+	return !mAddresses.empty();
+}
+
+void CGIManager::StartConnection(const TimePoint& rCurrentTP)
+{
+	ConnectionId id = 0;
+
+	while (id < mSettings.maxConnections && mConnectionStatus.at(id) != Status::Free)
+		++id;
+
+	if (id == mSettings.maxConnections)
+		return;
+
+	if (!Resolve(rCurrentTP))
+	{
+		HandleConnectFailure(rCurrentTP);
+		return;
+	}
+
+	const auto& rAddress = mAddresses.at(mAddressIndex % mAddresses.size());
+
+	SocketId socketId = INVALID_SOCKET;
+
+	try
+	{
+		socketId = socket(rAddress.address.ss_family, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+
+		if (socketId == INVALID_SOCKET)
+		{
+			int errorCode = Socket::GetErrorCode();
+			throw ExceptionVA("Failed for \"socket\"! (Error: %s, Code: %d)", Socket::GetErrorString(errorCode), errorCode);
+		}
+
+		Socket::SetNonBlocking(socketId);
+		Socket::SetKeepAlive(socketId);
+
+		// NOTE: Connection completes asynchronously, see "HandleConnect".
+		if (connect(socketId, reinterpret_cast<const sockaddr*> (&rAddress.address), rAddress.size) == SOCKET_ERROR)
+		{
+			int errorCode = Socket::GetErrorCode();
+
+			if (errorCode != EINPROGRESS)
+				throw ExceptionVA("Failed for \"connect\"! (Error: %s, Code: %d)", Socket::GetErrorString(errorCode), errorCode);
+		}
+
+		epoll_event event{};
+
+		event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+		event.data.u64 = id;
+
+		if (epoll_ctl(mEpollId, EPOLL_CTL_ADD, socketId, &event) == -1)
+		{
+			int errorCode = Socket::GetErrorCode();
+			throw ExceptionVA("Failed for \"epoll_ctl\"! (Error: %s, Code: %d)", Socket::GetErrorString(errorCode), errorCode);
+		}
+	}
+	catch (const Exception& e)
+	{
+		LOG_ERROR(Log::Channel::CGI, "Notifications connection to %s:%u failed: %s", mSettings.hostname.c_str(), mSettings.port, e.GetText());
+		Socket::Close(socketId);
+
+		HandleConnectFailure(rCurrentTP);
+		return;
+	}
+
+	mConnectionSockets.at(id) = socketId;
+	mConnectionStatus.at(id) = Status::Connecting;
+	mConnectionTimePoints.at(id) = rCurrentTP;
+	mConnectionReadBuffers.at(id).clear();
+	mConnectionNumRequests.at(id) = 0;
+
+	mStats.numConnects++;
+}
+
+// The next address is tried (and the host is resolved again) after the retry delay.
+void CGIManager::HandleConnectFailure(const TimePoint& rCurrentTP)
+{
+	mAddressIndex++;
+	mResolvedTP = TimePoint();
+
+	mRetryTP = rCurrentTP + std::chrono::seconds(mRetryDelaySec);
+	mRetryDelaySec = std::min<U16>(mRetryDelaySec * 2, MaxRetryDelaySec);
+}
+
+// Request of the connection is sent again if it's safe to retry (unless it already was sent too many times), otherwise it's failed.
+// NOTE: Request that was fully sent might have been handled by the host already, so it's not retried. (Duplicate notification)
+void CGIManager::ReleaseConnection(ConnectionId id, bool isRetried)
+{
+	if (mConnectionStatus.at(id) == Status::Free)
+		return;
+
+	auto& rRequest = mConnectionRequests.at(id);
+
+	if (!rRequest.cgi.empty())
+	{
+		if (isRetried && rRequest.attempts < MaxRequestAttempts && !mIsStopRequested)
+			mPending.emplace_front(std::move(rRequest));
+		else
+		{
+			LOG_ERROR(Log::Channel::CGI, "Failed to send CGI: \"%s\" (Attempts: %u)", rRequest.cgi.c_str(), rRequest.attempts);
+			mStats.numFailed++;
+		}
+
+		rRequest = Request();
+	}
+
+	auto*& rpSSL = mConnectionSSL.at(id);
+
+	if (rpSSL != nullptr)
+	{
+		// "close_notify" is sent only if the connection is still fine, the answer is not waited for.
+		if (!isRetried && mConnectionStatus.at(id) == Status::Idle)
+			SSL_shutdown(rpSSL);
+
+		SSL_free(rpSSL);
+		rpSSL = nullptr;
+	}
+
+	// NOTE: Closing the socket removes it from the epoll set as well.
+	Socket::Close(mConnectionSockets.at(id));
+
+	mConnectionSendBuffers.at(id).clear();
+	mConnectionReadBuffers.at(id).clear();
+	mConnectionStatus.at(id) = Status::Free;
+}
+
+void CGIManager::HandleSocketEvent(ConnectionId id, U32 events)
+{
+	// Connection might be released while handling the previous events of the same "epoll_wait" call.
+	switch (mConnectionStatus.at(id))
+	{
+		case Status::Free:
+			break;
+
+		case Status::Connecting:
+			if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+			{
+				if (HandleConnect(id))
+					HandleHandshake(id);
+			}
+			break;
+
+		case Status::Handshaking:
+			HandleHandshake(id);
+			break;
+
+		case Status::Sending:
+			HandleSend(id);
+			break;
+
+		// NOTE: Hang-up is noticed by the read, so the last response data is not lost.
+		case Status::Receiving:
+			HandleReceive(id);
+			break;
+
+		case Status::Idle:
+			HandleIdle(id);
+			break;
+	}
+}
+
+// Returns true if the TLS handshake should be started.
+bool CGIManager::HandleConnect(ConnectionId id)
+{
+	const auto socketId = mConnectionSockets.at(id);
+	const auto currentTP = std::chrono::steady_clock::now();
+
+	// NOTE:
+	// Socket becomes "writable" when the asynchronous connect completes, "SO_ERROR" tells if it succeeded.
+	int errorCode = 0;
+	socklen_t errorCodeSize = sizeof(errorCode);
+
+	if (getsockopt(socketId, SOL_SOCKET, SO_ERROR, &errorCode, &errorCodeSize) == SOCKET_ERROR)
+		errorCode = Socket::GetErrorCode();
+
+	if (errorCode != 0)
+	{
+		LOG_ERROR(Log::Channel::CGI, "Notifications connection failed to connect to: %s:%u (Error: %s, Code: %d, Id: %u)", mSettings.hostname.c_str(), mSettings.port, Socket::GetErrorString(errorCode), errorCode, id);
+		ReleaseConnection(id, true);
+
+		HandleConnectFailure(currentTP);
+		return false;
+	}
+
+	if (!mSettings.isSecure)
+	{
+		mRetryDelaySec = MinRetryDelaySec;
+
+		HandleReady(id);
+		return false;
+	}
+
+	SSL* pSSL = SSL_new(mpSSLContext);
+
+	if (pSSL == nullptr)
+	{
+		LOG_ERROR(Log::Channel::CGI, "Failed for \"SSL_new\"! (Error: %s)", GetSSLError().c_str());
+		ReleaseConnection(id, true);
+		return false;
+	}
+
+	mConnectionSSL.at(id) = pSSL;
+
+	SSL_set_fd(pSSL, socketId);
+	SSL_set_mode(pSSL, SSL_MODE_ENABLE_PARTIAL_WRITE);
+
+	// SNI and the certificate's host name check.
+	SSL_set_tlsext_host_name(pSSL, mSettings.hostname.c_str());
+	SSL_set1_host(pSSL, mSettings.hostname.c_str());
+
+	// Abbreviated handshake, if the host still knows the session.
+	if (mpSSLSession != nullptr)
+		SSL_set_session(pSSL, mpSSLSession);
+
+	mConnectionStatus.at(id) = Status::Handshaking;
+
+	return true;
+}
+
+void CGIManager::HandleHandshake(ConnectionId id)
+{
+	SSL* pSSL = mConnectionSSL.at(id);
+
+	const int result = SSL_connect(pSSL);
+
+	if (result == 1)
+	{
+		if (SSL_session_reused(pSSL))
+			mStats.numResumed++;
+
+		mRetryDelaySec = MinRetryDelaySec;
+
+		HandleReady(id);
+		return;
+	}
+
+	const int error = SSL_get_error(pSSL, result);
+
+	if (error == SSL_ERROR_WANT_READ)
+	{
+		SetEvents(id, EPOLLIN | EPOLLRDHUP);
+		return;
+	}
+
+	if (error == SSL_ERROR_WANT_WRITE)
+	{
+		SetEvents(id, EPOLLIN | EPOLLOUT | EPOLLRDHUP);
+		return;
+	}
+
+	const long verifyResult = SSL_get_verify_result(pSSL);
+
+	if (verifyResult != X509_V_OK)
+		LOG_ERROR(Log::Channel::CGI, "Notifications host certificate is not trusted: %s (Id: %u)", X509_verify_cert_error_string(verifyResult), id);
+	else
+		LOG_ERROR(Log::Channel::CGI, "Notifications TLS handshake failed: %s (Id: %u)", GetSSLError().c_str(), id);
+
+	ReleaseConnection(id, true);
+
+	HandleConnectFailure(std::chrono::steady_clock::now());
+}
+
+// Connection takes the next pending request or stays idle.
+void CGIManager::HandleReady(ConnectionId id)
+{
+	if (mPending.empty() || !TakeToken(std::chrono::steady_clock::now()))
+	{
+		mConnectionStatus.at(id) = Status::Idle;
+		mConnectionTimePoints.at(id) = std::chrono::steady_clock::now();
+
+		SetEvents(id, EPOLLIN | EPOLLRDHUP);
+		return;
+	}
+
+	Request request(std::move(mPending.front()));
+	mPending.pop_front();
+
+	StartRequest(id, std::move(request));
+}
+
+void CGIManager::StartRequest(ConnectionId id, Request&& rRequest)
+{
+	LOG_MESSAGE(Log::Channel::CGI, "Processing CGI: \"%s\". (Id: %u)", rRequest.cgi.c_str(), id);
+
+	rRequest.attempts++;
+
+	// Batch is traced once per its event.
+	if (rRequest.batchEventIds.empty())
+		TRACE_EVENT(CGIRequest, rRequest.eventId, id, rRequest.attempts);
+
+	for (auto eventId : rRequest.batchEventIds)
+		TRACE_EVENT(CGIRequest, eventId, id, rRequest.attempts);
+
+	{
+		const bool isDefaultPort = (mSettings.port == (mSettings.isSecure ? 443 : 80));
+
+		std::ostringstream ss;
+
+		ss << (rRequest.body.empty() ? "GET " : "POST ") << rRequest.cgi << " HTTP/1.1\r\n";
+		ss << "Host: " << mSettings.hostname;
+
+		if (!isDefaultPort)
+			ss << ':' << mSettings.port;
+
+		ss << "\r\n";
+		ss << "User-Agent: ViQuantServer\r\n";
+		ss << "Connection: keep-alive\r\n";
+
+		if (!rRequest.body.empty())
+		{
+			ss << "Content-Type: application/x-www-form-urlencoded\r\n";
+			ss << "Content-Length: " << rRequest.body.size() << "\r\n";
+		}
+
+		ss << "\r\n";
+		ss << rRequest.body;
+
+		mConnectionSendBuffers.at(id) = ss.str();
+	}
+
+	if (mConnectionNumRequests.at(id) != 0)
+		mStats.numReused++;
+
+	mConnectionRequests.at(id) = std::move(rRequest);
+	mConnectionSendOffsets.at(id) = 0;
+	mConnectionReadBuffers.at(id).clear();
+	mConnectionStatus.at(id) = Status::Sending;
+	mConnectionTimePoints.at(id) = std::chrono::steady_clock::now();
+
+	HandleSend(id);
+}
+
+void CGIManager::HandleSend(ConnectionId id)
+{
+	const auto& rBuffer = mConnectionSendBuffers.at(id);
+	auto& rOffset = mConnectionSendOffsets.at(id);
+
+	while (rOffset < rBuffer.size())
+	{
+		const ssize_t numBytes = WriteData(id, rBuffer.data() + rOffset, rBuffer.size() - rOffset);
+
+		if (numBytes < 0)
+		{
+			LOG_ERROR(Log::Channel::CGI, "Notifications connection (id: %u) failed to send the request.", id);
+			ReleaseConnection(id, true);
+			return;
+		}
+
+		if (numBytes == 0)
+		{
+			SetEvents(id, EPOLLIN | EPOLLOUT | EPOLLRDHUP);
+			return;
+		}
+
+		rOffset += static_cast<size_t> (numBytes);
+	}
+
+	mConnectionStatus.at(id) = Status::Receiving;
+
+	SetEvents(id, EPOLLIN | EPOLLRDHUP);
+}
+
+void CGIManager::HandleReceive(ConnectionId id)
+{
+	auto& rBuffer = mConnectionReadBuffers.at(id);
+
+	char data[16 * 1024];
+
+	bool isClosed = false;
+
+	for (;;)
+	{
+		const ssize_t numBytes = ReadData(id, data, sizeof(data));
+
+		if (numBytes == 0)
+			break;
+
+		if (numBytes < 0)
+		{
+			isClosed = true;
+			break;
+		}
+
+		rBuffer.append(data, static_cast<size_t> (numBytes));
+
+		if (rBuffer.size() > MaxResponseSize)
+		{
+			LOG_ERROR(Log::Channel::CGI, "Notifications connection (id: %u) response is too large.", id);
+			ReleaseConnection(id, false);
+			return;
+		}
+	}
+
+	HTTPResponse response;
+
+	try
+	{
+		if (ParseResponse(rBuffer, response))
+		{
+			HandleResponse(id, response.statusCode, response.isKeepAlive && !isClosed);
+			return;
+		}
+	}
+	catch (const Exception& e)
+	{
+		LOG_ERROR(Log::Channel::CGI, "Notifications connection (id: %u): %s", id, e.GetText());
+		ReleaseConnection(id, false);
+		return;
+	}
+
+	if (!isClosed)
+		return;
+
+	if (response.isUntilClose)
+	{
+		HandleResponse(id, response.statusCode, false);
+		return;
+	}
+
+	// NOTE:
+	// Kept alive connection might be closed by the host just before the request, it's sent again.
+	// Otherwise (new connection or the partial response) the host might have handled it already.
+	const bool isRetried = mConnectionNumRequests.at(id) != 0 && rBuffer.empty();
+
+	LOG_ERROR(Log::Channel::CGI, "Notifications connection (id: %u) was closed by the host before the response. (Received: %zu bytes)", id, rBuffer.size());
+	ReleaseConnection(id, isRetried);
+}
+
+void CGIManager::HandleResponse(ConnectionId id, int statusCode, bool isKeepAlive)
+{
+	auto& rRequest = mConnectionRequests.at(id);
+
+	const auto currentTP = std::chrono::steady_clock::now();
+	const auto latencyMs = static_cast<U32> (std::chrono::duration_cast<std::chrono::milliseconds>(currentTP - rRequest.queuedTP).count());
+
+	if (statusCode / 100 == 2)
+		LOG_MESSAGE(Log::Channel::CGI, "CGI sent: \"%s\" (Status: %d, %u ms)", rRequest.cgi.c_str(), statusCode, latencyMs);
+	else
+		LOG_ERROR(Log::Channel::CGI, "CGI failed: \"%s\" (Status: %d, %u ms)", rRequest.cgi.c_str(), statusCode, latencyMs);
+
+	if (rRequest.batchEventIds.empty())
+		TRACE_EVENT(CGIResponse, rRequest.eventId, id, statusCode);
+
+	for (auto eventId : rRequest.batchEventIds)
+		TRACE_EVENT(CGIResponse, eventId, id, statusCode);
+
+	mStats.numSent++;
+	mStats.totalLatencyMs += latencyMs;
+	mStats.maxLatencyMs = std::max(mStats.maxLatencyMs, latencyMs);
+
+	// NOTE: Plain CGI requests have no footage.
+	if (rRequest.eventFootageId != 0)
+		rRequest.batchFootageIds.push_back(rRequest.eventFootageId);
+
+	for (auto eventFootageId : rRequest.batchFootageIds)
+	{
+		if (statusCode / 100 == 2)
+			gFootageLatency.Mark(eventFootageId, FootageLatency::Stage::Delivered);
+		else
+			gFootageLatency.Finish(eventFootageId);
+	}
+
+	rRequest = Request();
+
+	mConnectionNumRequests.at(id)++;
+
+	// Session is taken after the response, TLS 1.3 hosts send the session tickets after the handshake.
+	SSL* pSSL = mConnectionSSL.at(id);
+
+	if (pSSL != nullptr && !SSL_session_reused(pSSL) && mConnectionNumRequests.at(id) == 1)
+	{
+		if (mpSSLSession != nullptr)
+			SSL_SESSION_free(mpSSLSession);
+
+		mpSSLSession = SSL_get1_session(pSSL);
+	}
+
+	if (!isKeepAlive)
+	{
+		ReleaseConnection(id, false);
+		return;
+	}
+
+	HandleReady(id);
+}
+
+// Idle connection is readable only if it was closed by the host. (Or the TLS session tickets arrived)
+void CGIManager::HandleIdle(ConnectionId id)
+{
+	char data[1024];
+
+	for (;;)
+	{
+		const ssize_t numBytes = ReadData(id, data, sizeof(data));
+
+		if (numBytes == 0)
+			return;
+
+		if (numBytes < 0)
+			break;
+
+		LOG_WARNING(Log::Channel::CGI, "Notifications connection (id: %u) received unexpected data while idle.", id);
+		break;
+	}
+
+	ReleaseConnection(id, false);
+}
+
+bool CGIManager::SetEvents(ConnectionId id, U32 events)
+{
+	epoll_event event{};
+
+	event.events = events;
+	event.data.u64 = id;
+
+	if (epoll_ctl(mEpollId, EPOLL_CTL_MOD, mConnectionSockets.at(id), &event) == -1)
+	{
+		int errorCode = Socket::GetErrorCode();
+		LOG_ERROR(Log::Channel::CGI, "CGI manager failed for \"epoll_ctl\"! (Error: %s, Code: %d, Id: %u)", Socket::GetErrorString(errorCode), errorCode, id);
+		ReleaseConnection(id, mConnectionStatus.at(id) != Status::Receiving);
+		return false;
+	}
+
+	return true;
+}
+
+// Returns the number of bytes written, 0 if the socket is not writable right now, -1 on failure.
+ssize_t CGIManager::WriteData(ConnectionId id, const char* pData, size_t size)
+{
+	SSL* pSSL = mConnectionSSL.at(id);
+
+	if (pSSL == nullptr)
+	{
+		const ssize_t numBytes = send(mConnectionSockets.at(id), pData, size, MSG_NOSIGNAL);
+
+		if (numBytes == SOCKET_ERROR)
+			return (Socket::GetErrorCode() == EAGAIN || Socket::GetErrorCode() == EWOULDBLOCK) ? 0 : -1;
+
+		return numBytes;
+	}
+
+	const int result = SSL_write(pSSL, pData, static_cast<int> (size));
+
+	if (result > 0)
+		return result;
+
+	const int error = SSL_get_error(pSSL, result);
+
+	return (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) ? 0 : -1;
+}
+
+// Returns the number of bytes read, 0 if there is no more data right now, -1 if the connection was closed (or failed).
+ssize_t CGIManager::ReadData(ConnectionId id, char* pBuffer, size_t size)
+{
+	SSL* pSSL = mConnectionSSL.at(id);
+
+	if (pSSL == nullptr)
+	{
+		const ssize_t numBytes = recv(mConnectionSockets.at(id), pBuffer, size, 0);
+
+		if (numBytes == SOCKET_ERROR)
+			return (Socket::GetErrorCode() == EAGAIN || Socket::GetErrorCode() == EWOULDBLOCK) ? 0 : -1;
+
+		return (numBytes == 0) ? -1 : numBytes;
+	}
+
+	const int result = SSL_read(pSSL, pBuffer, static_cast<int> (size));
+
+	if (result > 0)
+		return result;
+
+	const int error = SSL_get_error(pSSL, result);
+
+	if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE)
+		return 0;
+
+	// "SSL_ERROR_ZERO_RETURN" - closed by the host, the rest are failures.
+	ERR_clear_error();
+
+	return -1;
+}
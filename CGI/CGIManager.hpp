@@ -1,25 +1,202 @@
-
 #pragma once
 
-struct addrinfo;
+typedef struct ssl_st SSL;
+typedef struct ssl_ctx_st SSL_CTX;
+typedef struct ssl_session_st SSL_SESSION;
 
+// User notifications ("/ui/inform-user.php" CGI calls) are sent by the CGI thread using its own HTTP/1.1 client.
+// Connections to the notifications host are kept alive and reused by the following requests,
+// the host's address is resolved once per "dnsCacheSec" and the TLS sessions are resumed.
 class CGIManager
 {
 public:
-	CGIManager(const String& rHostname, U16 port);
+	struct Settings
+	{
+		String	hostname;
+		U16		port = 0;
+
+		bool	isSecure = true; // HTTPS.
+
+		// Maximum number of the connections (and the requests sent at the same time, one per connection).
+		U16		maxConnections = 1;
+
+		// Idle connections are closed after this many seconds.
+		U16		keepAliveSec = 0;
+
+		// Connection (or the request) is failed if not done in time.
+		U16		requestTimeoutSec = 0;
+
+		// Resolved addresses of the host are reused for this long.
+		U16		dnsCacheSec = 0;
+
+		// Notifications of the same event within this window are sent once. (0 - all of them are sent)
+		U16		coalesceWindowSec = 0;
+
+		// Notifications are collected for "batchWindowMs" (or until there are "maxBatchSize" of them)
+		// and sent as a single POST to this path. (Empty - one GET per notification)
+		String	batchPath;
+		U16		batchWindowMs = 0;
+		U16		maxBatchSize = 0;
+
+		// Requests per second to the host, "rateBurst" of them can be sent at once. (0 - not limited)
+		// NOTE: Batched notifications keep collecting while the requests are limited.
+		U16		rateLimitPerSec = 0;
+		U16		rateBurst = 1;
+	};
+
+	explicit CGIManager(const Settings& rSettings);
 	~CGIManager();
 
+	// THREAD: Any thread.
 	void Add(const String& rCGI);
 
-	void Process();
+	// Informs the user about the detected person. ("/ui/inform-user.php", coalesced and batched)
+	// THREAD: Any thread.
+	void AddNotification(EventId eventId, EventFootageId eventFootageId);
+
+private:
+
+	using ConnectionId = U16;
+
+	enum class Status : uint8_t
+	{
+		Free,
+		Connecting,
+		Handshaking,	// TLS.
+		Idle,			// Kept alive for the next request.
+		Sending,
+		Receiving
+	};
+
+	struct Request
+	{
+		Request() { }
+
+		Request(const String& rCGI, const TimePoint& rQueuedTP)
+			: cgi(rCGI)
+			, queuedTP(rQueuedTP)
+		{ }
+
+		String		cgi;
+		String		body; // POST, if not empty.
+		TimePoint	queuedTP;
+		U8			attempts = 0;
+
+		// Notification, the request is made by the CGI thread. (See "HandleNotification")
+		EventId			eventId = InvalidEventId;
+		EventFootageId	eventFootageId = 0;
+		bool			isQueuedNotification = false; // Not coalesced / batched yet.
+
+		// Batched notifications. (See "FootageLatency" and the "CGIRequest" trace)
+		Vector<EventId>			batchEventIds;
+		Vector<EventFootageId>	batchFootageIds;
+	};
+
+	void ThreadProc();
+
+	void WakeUp();
+
+	void HandleQueuedRequests(const TimePoint& rCurrentTP);
+	void HandleNotification(Request&& rRequest, const TimePoint& rCurrentTP);
+	void HandleBatch(const TimePoint& rCurrentTP);
+	void HandleTimeouts(const TimePoint& rCurrentTP);
+	void HandlePending(const TimePoint& rCurrentTP);
+	void LogStats();
+
+	bool TakeToken(const TimePoint& rCurrentTP);
+	U32  GetNumTokens(const TimePoint& rCurrentTP);
+	int  GetWaitMs(const TimePoint& rCurrentTP) const;
+
+	bool Resolve(const TimePoint& rCurrentTP);
+
+	void StartConnection(const TimePoint& rCurrentTP);
+	void ReleaseConnection(ConnectionId id, bool isRetried);
+	void HandleConnectFailure(const TimePoint& rCurrentTP);
+
+	void HandleSocketEvent(ConnectionId id, U32 events);
+	bool HandleConnect(ConnectionId id);
+	void HandleHandshake(ConnectionId id);
+	void HandleReady(ConnectionId id);
+	void HandleSend(ConnectionId id);
+	void HandleReceive(ConnectionId id);
+	void HandleIdle(ConnectionId id);
+	void HandleResponse(ConnectionId id, int statusCode, bool isKeepAlive);
+
+	void StartRequest(ConnectionId id, Request&& rRequest);
+
+	bool SetEvents(ConnectionId id, U32 events);
+
+	ssize_t WriteData(ConnectionId id, const char* pData, size_t size);
+	ssize_t ReadData(ConnectionId id, char* pBuffer, size_t size);
 
 private:
 
-	const String	mHostname;
-	const U16		mPort;
+	const Settings	mSettings;
+
+	std::atomic_bool mIsStopRequested{ false };
+
+	std::unique_ptr<std::thread> mThreadPtr;
+
+	// CGI thread sleeps in "epoll_wait" until any of the connections or the "wake" event (queued requests) gets signaled.
+	int	mEpollId = -1;
+	int	mWakeEventId = -1;
 
-	addrinfo*		mpAddrInfo = nullptr;
+	SSL_CTX*		mpSSLContext = nullptr;
+	SSL_SESSION*	mpSSLSession = nullptr; // Last session, new connections try to resume it.
 
-	Vector<String>	mQueue;
+	// Requests added by the other threads.
+	Vector<Request>	mQueue;
 	std::mutex		mQueueMutex;
+
+	// Requests waiting for the connection. (CGI thread)
+	std::deque<Request> mPending;
+
+	// When the event's notification was last accepted. (Coalescing, see "Settings::coalesceWindowSec")
+	UnorderedMap<EventId, TimePoint> mNotifiedEvents;
+	TimePoint	mNotifiedPruneTP;
+
+	// Notifications of the next batch, "mBatchTP" is when the first of them was added.
+	Vector<std::pair<EventId, EventFootageId>> mBatch;
+	TimePoint	mBatchTP;
+
+	// Token bucket. (See "Settings::rateLimitPerSec")
+	double		mNumTokens = 0.0;
+	TimePoint	mTokensTP;
+
+	// Resolved addresses of the notifications host, the next one is tried after the connect failure.
+	struct Address;
+
+	Vector<Address>	mAddresses;
+	size_t			mAddressIndex = 0;
+	TimePoint		mResolvedTP;
+
+	// No new connections until then. (Connect failures)
+	TimePoint		mRetryTP;
+	U16				mRetryDelaySec = 0;
+
+	// Connections, "Settings::maxConnections" of them.
+	Vector<SocketId>	mConnectionSockets;
+	Vector<Status>		mConnectionStatus;
+	Vector<SSL*>		mConnectionSSL;
+	Vector<TimePoint>	mConnectionTimePoints; // When the current status was entered.
+	Vector<Request>		mConnectionRequests;
+	Vector<String>		mConnectionSendBuffers;
+	Vector<size_t>		mConnectionSendOffsets;
+	Vector<String>		mConnectionReadBuffers;
+	Vector<U32>			mConnectionNumRequests; // Completed by the connection. (Keep-alive reuse)
+
+	TimePoint	mStatsTP;
+
+	struct
+	{
+		U32 numSent = 0;
+		U32 numFailed = 0;
+		U32 numReused = 0;		// Sent using the kept alive connection.
+		U32 numConnects = 0;
+		U32 numResumed = 0;		// TLS sessions.
+		U64 totalLatencyMs = 0;	// From "Add" until the response. (Of the "numSent")
+		U32 maxLatencyMs = 0;
+		U32 numCoalesced = 0;	// Notifications not sent, the event was just notified.
+		U32 numBatched = 0;		// Notifications sent in the batches.
+	} mStats;
 };
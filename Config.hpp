@@ -29,6 +29,16 @@ public:
 		}
 	}
 
+	// Same as "Read", but uses the default value (without reporting any errors) if the key is missing.
+	template<typename T>
+	inline void Read(const char* pKey, T& r, const std::common_type_t<T>& rDefault) const
+	{
+		if (mMap.find(pKey) == mMap.end())
+			r = rDefault;
+		else
+			Read(pKey, r);
+	}
+
 private:
 
 	std::unordered_map<String, String> mMap;
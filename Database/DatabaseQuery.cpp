@@ -20,6 +20,18 @@ namespace Database
 	{
 		auto handle = mConnection.GetHandle();
 
+		TRACE_EVENT(DBQueryStart, 0, 0, rQueryString.size());
+
+		const auto statement = static_cast<size_t> (Metrics::GetStatement(rQueryString));
+		const auto startTP = std::chrono::steady_clock::now();
+
+		// Includes the reconnect, if there was one.
+		auto AddLatency = [&]()
+		{
+			Metrics::Add(gMetrics.dbStatements[statement]);
+			Metrics::Add(gMetrics.dbLatencyUs[statement], std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTP).count());
+		};
+
 		if (mysql_ping(handle) != 0)
 		{
 			LOG_WARNING(Log::Channel::DB, "Disconnected from the Database! (Trying to reconnec)");
@@ -29,11 +41,20 @@ namespace Database
 		if (mysql_query(handle, rQueryString.c_str()) != 0)
 		{
 			LOG_ERROR(Log::Channel::DB, "Query failed: \"%s\"! (Reason: %s)", rQueryString.c_str(), mysql_error(handle));
+
+			TRACE_EVENT(DBQueryEnd, 1, 0, 0);
+
+			AddLatency();
+			Metrics::Add(gMetrics.dbFailures[statement]);
 			return false;
 		}
 
 		mpResult = mysql_store_result(handle);
 
+		TRACE_EVENT(DBQueryEnd, 0, 0, NumResults());
+
+		AddLatency();
+
 		return true;
 	}
 
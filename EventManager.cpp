@@ -9,6 +9,8 @@
 
 #include "Analytics/Analytics.hpp"
 
+#include "API/EventStream.hpp"
+
 #include "EventManager.hpp"
 
 #include <iomanip> // std::put_time, std::setw
@@ -20,12 +22,12 @@ EventManager::EventManager(Main& rApp, U32 eventSessionTimeoutSec)
 
 // IMPORTANT: Can be called from any ThreadPool thread. (FTP Server)
 // Queue will be handled by the "EventManager::HandleQueuedFootageNotices"
-void EventManager::AddFootageNotice(EventId eventId, const String& rName, const String& rTimestampStr, U16 timestampMs)
+void EventManager::AddFootageNotice(EventId eventId, const String& rName, const String& rTimestampStr, U16 timestampMs, const JPEG::Signature& rSignature, U64 contentHash, const FootageLatency::Timeline& rTimeline)
 {
 	LOG_DEBUG(Log::Channel::Events, "AddFootageNotice - EventId: %u (%s) - %s:%d", eventId, rName.c_str(), rTimestampStr.c_str(), timestampMs);
 
 	mFootageMutex.lock();
-	mFootageQueue.emplace_back(eventId, rName, rTimestampStr, timestampMs);
+	mFootageQueue.emplace_back(eventId, rName, rTimestampStr, timestampMs, rSignature, contentHash, rTimeline);
 	mFootageMutex.unlock();
 }
 
@@ -77,6 +79,8 @@ EventSessionId EventManager::AddSession(const String& rHashKey)
 
 	mSessionMap.emplace(rHashKey, id);
 
+	Metrics::Set(gMetrics.numEventSessions, mSessionMap.size());
+
 	// Stores a footage index offset that get's incremented every time a new footage (i.e. JPEG image) is received.
 	mSessionFootageIndex.at(id) = 0;
 
@@ -158,11 +162,16 @@ void EventManager::HandleTimeouts()
 
 					mMain.AnalyticsPtr->EndEvent(eventId);
 
+					if (mMain.EventStreamPtr)
+						mMain.EventStreamPtr->PublishEventEnd(eventId);
+
 					mSessionEventIds.at(id) = InvalidEventId;
 				}
 
 				it = mSessionMap.erase(it);
 
+				Metrics::Set(gMetrics.numEventSessions, mSessionMap.size());
+
 				mSessionReleasedIds.push_back(id);
 			}
 			else
@@ -238,7 +247,13 @@ void EventManager::HandleQueuedFootageNotices()
 
 		const auto eventFootageId = static_cast<EventFootageId>(query.LastInsertId());
 
-		mMain.AnalyticsPtr->AddFootage(r.eventId, eventFootageId, r.name);
+		if (eventFootageId != 0)
+			gFootageLatency.Start(eventFootageId, r.timeline, std::chrono::steady_clock::now());
+
+		mMain.AnalyticsPtr->AddFootage(r.eventId, eventFootageId, r.name, r.signature, r.contentHash);
+
+		if (mMain.EventStreamPtr)
+			mMain.EventStreamPtr->PublishFootage(r.eventId, eventFootageId, r.name, r.timestampStr, r.timestampMs);
 	}
 
 #else
@@ -288,6 +303,9 @@ EventId EventManager::AuthenticateSession(EventSessionId sessionId, U32 userId,
 	mSessionCameraIds.at(sessionId) = cameraId;
 	mSessionEventIds.at(sessionId) = eventId;
 
+	if (mMain.EventStreamPtr && eventId != 0)
+		mMain.EventStreamPtr->PublishEventStart(eventId, cameraId);
+
 	return eventId;
 }
 
@@ -1,6 +1,8 @@
 
 #pragma once
 
+#include "Analytics/JPEG.hpp"
+
 class Main;
 
 class EventManager
@@ -12,7 +14,7 @@ public:
 	void EventSessionTimeoutLock(EventSessionId sessionId);
 	void EventSessionTimeoutUnlock(EventSessionId sessionId);
 
-	void AddFootageNotice(EventId eventId, const String& rName, const String& rTimestampStr, U16 timestampMs);
+	void AddFootageNotice(EventId eventId, const String& rName, const String& rTimestampStr, U16 timestampMs, const JPEG::Signature& rSignature, U64 contentHash, const FootageLatency::Timeline& rTimeline);
 
 	bool HasSession(const String& rHashKey, EventSessionId* pEventSessionId) const;
 
@@ -102,11 +104,14 @@ private:
 	{
 		FootageInfo() { };
 
-		FootageInfo(EventId e, const String& rName, const String& rTimestampStr, U16 timestampMs)
+		FootageInfo(EventId e, const String& rName, const String& rTimestampStr, U16 timestampMs, const JPEG::Signature& rSignature, U64 contentHash, const FootageLatency::Timeline& rTimeline)
 			: eventId(e)
 			, timestampMs(timestampMs)
 			, name(rName)
 			, timestampStr(rTimestampStr)
+			, signature(rSignature)
+			, contentHash(contentHash)
+			, timeline(rTimeline)
 		{ }
 
 		FootageInfo(const FootageInfo& r)
@@ -114,6 +119,9 @@ private:
 			, timestampMs(r.timestampMs)
 			, name(r.name)
 			, timestampStr(r.timestampStr)
+			, signature(r.signature)
+			, contentHash(r.contentHash)
+			, timeline(r.timeline)
 		{ }
 
 		EventId	eventId = 0;
@@ -121,6 +129,11 @@ private:
 
 		String	name;
 		String	timestampStr;
+
+		JPEG::Signature signature; // Analytics prefilter.
+		U64		contentHash = 0; // Analytics frame cache. (0 - not hashed)
+
+		FootageLatency::Timeline timeline; // FTP stages. (See "FootageLatency::Start")
 	};
 
 	Vector<FootageInfo>	mFootageQueue;
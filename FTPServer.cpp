@@ -17,6 +17,7 @@
 
 #include "FTPServer.hpp"
 #include "FileNameParser.hpp"
+#include "AVIDemuxer.hpp"
 
 #ifndef PLATFORM_WINDOWS
 #include <unistd.h>
@@ -29,6 +30,7 @@
 #endif 
 
 #include <iostream>
+#include <iomanip>	// std::get_time, std::put_time
 #include <regex>
 
 #include <string.h> // strerror
@@ -65,9 +67,11 @@
 #define ENABLE_ANALYTICS 1
 
 // NOTE: Port >1024 require root permissions.
-FTPServer::FTPServer(Main& rApp, U32 passiveSockTimeoutSec)
+FTPServer::FTPServer(Main& rApp, U32 passiveSockTimeoutSec, U32 linkCacheSize, U32 clipFrameStep)
 	: mMain(rApp)
 	, mPassiveSocketTimeoutSec(passiveSockTimeoutSec)
+	, mLinkCacheSize(linkCacheSize)
+	, mClipFrameStep(clipFrameStep)
 {
 	SetupAuthSQLQuery();
 
@@ -172,6 +176,8 @@ void FTPServer::HandleNewConnection()
 
 	mClientActiveIds.push_back(clientId);
 
+	Metrics::Set(gMetrics.numFTPClients, mClientActiveIds.size());
+
 //	printf("CLIENT ID: %d - (List size: %d, pre-allocated: %d)\n", clientId, mClientActiveIds.size(), mClientSockets.size());
 
 	// Immediately send "Welcome" message to the client and expect for fast response.
@@ -186,11 +192,241 @@ void FTPServer::HandleNewConnection()
 // Gali buti, kad nereikia kaskart sukurineti socketo, bo "FTPCommand::PORT" turetu 
 // viena karta sukurti socketa ir per ji prisijungus mums turetu siusti multiple feimus?
 
+// Byte-identical footage (cameras resend their buffered frames) is hard-linked to the earlier file instead of being written again.
+// (Falls back to writing the file if the link fails, e.g. the earlier file was deleted or is on the other file system)
+static void WriteFootage(FTPServer* pFTPServer, const char* pData, size_t size, U64 contentHash, const String& rPath, const String& rFileName)
+{
+	const String fullPath(rPath + rFileName);
+
+	if (contentHash != 0 && pFTPServer->IsLinkingDuplicates())
+	{
+		String storedPath;
+
+		if (pFTPServer->FindStoredFootage(contentHash, size, storedPath) && link(storedPath.c_str(), fullPath.c_str()) == 0)
+		{
+			LOG_MESSAGE(Log::Channel::FTP, "File ready (Bytes %d, linked to \"%s\")...", size, storedPath.c_str());
+			return;
+		}
+	}
+
+	std::fstream file(fullPath, std::ios::out | std::fstream::binary);
+
+	if (!file.is_open())
+		throw ExceptionVA("Failed to write \"%s\" (Path: \"%s\"). Error: %s", rFileName.c_str(), rPath.c_str(), strerror(Socket::GetErrorCode()));
+
+	file.write(pData, size);
+
+	LOG_MESSAGE(Log::Channel::FTP, "File ready (Bytes %d)...", size);
+
+	if (contentHash != 0 && pFTPServer->IsLinkingDuplicates())
+		pFTPServer->AddStoredFootage(contentHash, size, fullPath);
+}
+
+static String AddFootageIndex(String filename, U16 footageIndex)
+{
+#if 0
+	// File name starts with a number (footage index) that get's incremented per-event session every time a new footage is received.
+	// (We can have more than one consecutive client connection per-event session. 
+	//  At the same time, single client connection can send multiple footages)
+	filename = std::to_string(footageIndex) + '_' + filename;
+#else
+	// Add footage index at the end of the filename for better filename sorting. 
+	// (Tom was having problems, decided that we need index at the end instead of the beginning)
+	const String suffix('_' + std::to_string(footageIndex));
+
+	auto extensionPos = filename.find_last_of('.');
+
+	if (extensionPos != String::npos)
+		filename.insert(extensionPos, suffix);
+	else
+		filename += suffix;
+#endif
+
+	return filename;
+}
+
+// "offsetMs" is added for the frames of the clip. (Their time within the clip)
+static void GetFootageTimestamp(const FileNameParser& rParser, U32 offsetMs, String& rDateTime, U16& rMS)
+{
+	// 2019-09-19
+	// Mobotix filename can look like this: "mx16bd8d00"
+	// So "FileNameParser" will fail to parse out the timestamp information.
+	// In this case we will be using machine's local timestamp.
+	if (!rParser.IsParsed())
+		Utils::StringFromLocaltime(rDateTime, rMS);
+	else
+	{
+		rDateTime = rParser.GetTimestampStr();
+		rMS = rParser.GetTimestampMs();
+	}
+
+	if (offsetMs == 0)
+		return;
+
+	std::tm tm{};
+	std::istringstream input(rDateTime);
+
+	input >> std::get_time(&tm, "%Y-%m-%d %H:%M:%S");
+
+	if (input.fail())
+		return;
+
+	tm.tm_isdst = -1;
+
+	const U32 totalMs = rMS + offsetMs;
+	const time_t time = mktime(&tm) + totalMs / 1000;
+
+	std::ostringstream output;
+	output << std::put_time(localtime(&time), "%Y-%m-%d %H:%M:%S");
+
+	rDateTime = output.str();
+	rMS = static_cast<U16> (totalMs % 1000);
+}
+
+// Motion JPEG clip is written to the disk as it's received, every "ftp_clip_frame_step"th frame is stored as a separate JPEG footage,
+// so the Analytics gets the frames it understands. (The clip itself is kept next to its frames, it's listed as the footage only if no frames were extracted)
+static void DownloadClip(FTPServer* pFTPServer, EventManager* pEventManager, SocketId fileSocket, EventId eventId, const String& rPath, const String& rFileName, bool isPrefilter, bool isHashing, FootageLatency::Timeline timeline)
+{
+	std::fstream file(rPath + rFileName, std::ios::out | std::fstream::binary);
+
+	if (!file.is_open())
+		throw ExceptionVA("Failed to write \"%s\" (Path: \"%s\"). Error: %s", rFileName.c_str(), rPath.c_str(), strerror(Socket::GetErrorCode()));
+
+	const FileNameParser fnParser(rFileName);
+	const String baseName(rFileName.substr(0, rFileName.find_last_of('.')));
+
+	const AVIDemuxer* pDemuxer = nullptr;
+
+	size_t numBytes = 0;
+	U32 numFrames = 0;
+
+	Vector<char> frame;
+
+	AVIDemuxer demuxer(pFTPServer->GetClipFrameStep(), [&](U32 frameIndex, const char* pData, size_t size)
+	{
+		// So the frame is a valid JPEG on its own.
+		if (JPEG::AddHuffmanTables(pData, size, frame))
+		{
+			pData = frame.data();
+			size = frame.size();
+		}
+
+		char suffix[16];
+		snprintf(suffix, sizeof(suffix), "_f%05u.jpg", frameIndex);
+
+		const String frameName(baseName + suffix);
+
+		JPEG::Signature signature;
+
+		if (isPrefilter)
+			signature = JPEG::ComputeSignature(pData, size);
+
+		const U64 contentHash = isHashing ? Utils::Hash64(pData, size) : 0;
+
+		WriteFootage(pFTPServer, pData, size, contentHash, rPath, frameName);
+
+		timeline.writtenTP = std::chrono::steady_clock::now();
+
+		String dateTimeStr; U16 ms;
+		GetFootageTimestamp(fnParser, static_cast<U32> (static_cast<U64> (frameIndex) * pDemuxer->GetMicroSecPerFrame() / 1000), dateTimeStr, ms);
+
+		pEventManager->AddFootageNotice(eventId, frameName, dateTimeStr, ms, signature, contentHash, timeline);
+
+		numFrames++;
+	});
+
+	pDemuxer = &demuxer;
+
+	Socket::Read(fileSocket, [&](const char* pData, size_t size)
+	{
+		file.write(pData, size);
+		numBytes += size;
+
+		if (demuxer.IsValid())
+			demuxer.Feed(pData, size);
+	});
+
+	Metrics::Add(gMetrics.numFootage);
+	Metrics::Add(gMetrics.footageBytes, numBytes);
+
+	if (!demuxer.IsValid())
+		LOG_WARNING(Log::Channel::FTP, "Clip \"%s\" is not a RIFF/AVI, no frames were extracted.", rFileName.c_str());
+
+	LOG_MESSAGE(Log::Channel::FTP, "Clip ready (Bytes %zu, frames: %u, stored: %u)...", numBytes, demuxer.GetNumFrames(), numFrames);
+
+	// No frames, the clip itself is listed as the footage. (As it was before the frames were extracted, so the upload is not lost)
+	if (numFrames == 0)
+	{
+		file.close();
+
+		timeline.writtenTP = std::chrono::steady_clock::now();
+
+		String dateTimeStr; U16 ms;
+		GetFootageTimestamp(fnParser, 0, dateTimeStr, ms);
+
+		pEventManager->AddFootageNotice(eventId, rFileName, dateTimeStr, ms, JPEG::Signature(), 0, timeline);
+	}
+}
+
+// Reads the footage from the connected file socket, stores it and queues it for the Event manager.
+// "rTimeline" has the STOR and the accepted data connection stages. (See "FootageLatency")
+static void DownloadFootage(FTPServer* pFTPServer, EventManager* pEventManager, SocketId fileSocket, EventId eventId, U16 footageIndex, const String& rPath, const String& rFileName, bool isPrefilter, bool isHashing, const FootageLatency::Timeline& rTimeline)
+{
+	TRACE_EVENT(TransferStart, eventId, footageIndex, 0);
+
+	// MJPEG clips are written as they arrive, only the selected frames are kept in memory. (See "DownloadClip")
+	if (pFTPServer->GetClipFrameStep() != 0 && FileNameParser(rFileName).IsFileType(FileType::AVI))
+	{
+		DownloadClip(pFTPServer, pEventManager, fileSocket, eventId, rPath, AddFootageIndex(rFileName, footageIndex), isPrefilter, isHashing, rTimeline);
+
+		TRACE_EVENT(TransferEnd, eventId, footageIndex, 0);
+		return;
+	}
+
+	// TODO: Optimizuoti: 
+	// Galime iskart rasyti i faila, neskaityti is pradziu i atminti o po to i faila...
+	// (Bet gal tai kaip tik negerai, nes HDD daugiau seekins ir darys write operaciju, nei kad viena dideli atminties gabala i faila irasytu?)
+	// BET: mums gali reiketi ir failo, ir iskart siusti i Analytics serveri.
+	Vector<char> dataBuffer;
+
+	Socket::Read(fileSocket, dataBuffer);
+
+	TRACE_EVENT(TransferEnd, eventId, footageIndex, dataBuffer.size());
+
+	Metrics::Add(gMetrics.numFootage);
+	Metrics::Add(gMetrics.footageBytes, dataBuffer.size());
+
+	// Analytics prefilter, computed while the data is still in memory.
+	JPEG::Signature signature;
+
+	if (isPrefilter)
+		signature = JPEG::ComputeSignature(dataBuffer.data(), dataBuffer.size());
+
+	// Analytics frame cache and the duplicate footage links. (0 - not hashed)
+	const U64 contentHash = isHashing ? Utils::Hash64(dataBuffer.data(), dataBuffer.size()) : 0;
+
+	// Try to parse the footage timestamp from it's filename.
+	FileNameParser fnParser(rFileName);
+
+	const String filename(AddFootageIndex(rFileName, footageIndex));
+
+	WriteFootage(pFTPServer, dataBuffer.data(), dataBuffer.size(), contentHash, rPath, filename);
+
+	FootageLatency::Timeline timeline(rTimeline);
+
+	timeline.writtenTP = std::chrono::steady_clock::now();
+
+	String dateTimeStr; U16 ms;
+	GetFootageTimestamp(fnParser, 0, dateTimeStr, ms);
+
+	pEventManager->AddFootageNotice(eventId, filename, dateTimeStr, ms, signature, contentHash, timeline);
+}
+
 // The "ACTIVE" mode (FTPCommand::PORT) is when we're connecting directly to the device and receiving data through the connected socket.
 
 // IMPORTANT: 
 // Not passing "path" and "filename" as a reference, because "DownloadFootage" is executend in a separate thread and reference might get lost.
-void DownloadFootageActiveTask(FTPServer* pFTPServer, EventManager* pEventManager, ClientId clientId, EventId eventId, EventSessionId eventSessionId, U16 footageIndex, const String path, String filename, U32 cameraId, U32 ipAddress, U16 port)
+void DownloadFootageActiveTask(FTPServer* pFTPServer, EventManager* pEventManager, ClientId clientId, EventId eventId, EventSessionId eventSessionId, U16 footageIndex, const String path, String filename, U32 cameraId, U32 ipAddress, U16 port, bool isPrefilter, bool isHashing, TimePoint storTP)
 {
 	SocketId fileSocket = INVALID_SOCKET;
 
@@ -234,56 +470,9 @@ void DownloadFootageActiveTask(FTPServer* pFTPServer, EventManager* pEventManage
 		// TODO TODO TODO TODO.....
 		// Sutvarkyti situacija kai feilina prisijungti!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 
+		const FootageLatency::Timeline timeline{ storTP, std::chrono::steady_clock::now(), TimePoint() };
 
-		// TODO: Optimizuoti: 
-		// Galime iskart rasyti i faila, neskaityti is pradziu i atminti o po to i faila...
-		// (Bet gal tai kaip tik negerai, nes HDD daugiau seekins ir darys write operaciju, nei kad viena dideli atminties gabala i faila irasytu?)
-		// BET: mums gali reiketi ir failo, ir iskart siusti i Analytics serveri.
-		Vector<char> dataBuffer;
-
-		Socket::Read(fileSocket, dataBuffer);
-
-		// Try to parse the footage timestamp from it's filename.
-		FileNameParser fnParser(filename);
-
-#if 0
-		filename = std::to_string(footageIndex) + '_' + filename;
-#else
-		// Add footage index at the end of the filename for better filename sorting. 
-		// (Tom was having problems, decided that we need index at the end instead of the beginning)
-		const String suffix('_' + std::to_string(footageIndex));
-
-		auto extensionPos = filename.find_last_of('.');
-
-		if (extensionPos != String::npos)
-			filename.insert(extensionPos, suffix);
-		else
-			filename += suffix;
-#endif
-//		printf("FOOTAGE PATH: %s\n", path.c_str());
-
-		std::fstream file(path + filename, std::ios::out | std::fstream::binary);
-
-		if (!file.is_open())
-			throw ExceptionVA("Failed to write \"%s\" (Path: \"%s\"). Error: %s", filename.c_str(), path.c_str(), strerror(Socket::GetErrorCode()));
-
-		file.write(dataBuffer.data(), dataBuffer.size());
-
-		LOG_MESSAGE(Log::Channel::FTP, "File ready (Bytes %d)...", dataBuffer.size());
-
-		// 2019-09-19
-		// Mobotix filename can look like this: "mx16bd8d00"
-		// So "FileNameParser" will fail to parse out the timestamp information.
-		// In this case we will be using machine's local timestamp.
-		if (!fnParser.IsParsed())
-		{
-			String dateTimeStr; U16 ms;
-			Utils::StringFromLocaltime(dateTimeStr, ms);
-
-			pEventManager->AddFootageNotice(eventId, filename, dateTimeStr, ms);
-		}
-		else
-			pEventManager->AddFootageNotice(eventId, filename, fnParser.GetTimestampStr(), fnParser.GetTimestampMs());
+		DownloadFootage(pFTPServer, pEventManager, fileSocket, eventId, footageIndex, path, filename, isPrefilter, isHashing, timeline);
 	}
 	catch (const Exception& e)
 	{
@@ -303,7 +492,7 @@ void DownloadFootageActiveTask(FTPServer* pFTPServer, EventManager* pEventManage
 // Not passing "path" and "filename" as a reference, because "DownloadFootage" is executend in a separate thread and reference might get lost.
 // NOTE:
 // "passiveSocketId" is non-blocking.
-void DownloadFootagePassiveTask(FTPServer* pFTPServer, EventManager* pEventManager, ClientId clientId, EventId eventId, EventSessionId eventSessionId, U16 footageIndex, const String path, String filename, SocketId passiveSocketId, U32 passiveSocketTimeoutSec)
+void DownloadFootagePassiveTask(FTPServer* pFTPServer, EventManager* pEventManager, ClientId clientId, EventId eventId, EventSessionId eventSessionId, U16 footageIndex, const String path, String filename, SocketId passiveSocketId, U32 passiveSocketTimeoutSec, bool isPrefilter, bool isHashing, TimePoint storTP)
 {
 	SocketId fileSocket = INVALID_SOCKET;
 
@@ -345,62 +534,12 @@ void DownloadFootagePassiveTask(FTPServer* pFTPServer, EventManager* pEventManag
 			throw ExceptionVA("Failed for \"accept\"! Error: %s, Code: %d", Socket::GetErrorString(errorCode), errorCode);
 		}
 
+		const FootageLatency::Timeline timeline{ storTP, std::chrono::steady_clock::now(), TimePoint() };
+
 		// Socket will be blocking by default, so set it to a non-blocking.
 		Socket::SetNonBlocking(fileSocket);
 
-		// TODO: Optimizuoti: 
-		// Galime iskart rasyti i faila, neskaityti is pradziu i atminti o po to i faila...
-		// (Bet gal tai kaip tik negerai, nes HDD daugiau seekins ir darys write operaciju, nei kad viena dideli atminties gabala i faila irasytu?)
-		// BET: mums gali reiketi ir failo, ir iskart siusti i Analytics serveri.
-		Vector<char> dataBuffer;
-
-		Socket::Read(fileSocket, dataBuffer);
-
-		// Try to parse the footage timestamp from it's filename.
-		FileNameParser fnParser(filename);
-
-#if 0
-		// File name starts with a number (footage index) that get's incremented per-event session every time a new footage is received.
-		// (We can have more than one consecutive client connection per-event session. 
-		//  At the same time, single client connection can send multiple footages)
-		filename = std::to_string(footageIndex) + '_' + filename;
-#else
-		// Add footage index at the end of the filename for better filename sorting. 
-		// (Tom was having problems, decided that we need index at the end instead of the beginning)
-		const String suffix('_' + std::to_string(footageIndex));
-
-		auto extensionPos = filename.find_last_of('.');
-
-		if (extensionPos != String::npos)
-			filename.insert(extensionPos, suffix);
-		else
-			filename += suffix;
-#endif
-
-		std::fstream file(path + filename, std::ios::out | std::fstream::binary);
-
-		if (!file.is_open())
-			throw ExceptionVA("Failed to write \"%s\" (Path: \"%s\"). Error: %s", filename.c_str(), path.c_str(), strerror(Socket::GetErrorCode()));
-		else
-		{
-			file.write(dataBuffer.data(), dataBuffer.size());
-
-			LOG_MESSAGE(Log::Channel::FTP, "File ready (Bytes %d)...", dataBuffer.size());
-		}
-
-		// 2019-09-19
-		// Mobotix filename can look like this: "mx16bd8d00"
-		// So "FileNameParser" will fail to parse out the timestamp information.
-		// In this case we will be using machine's local timestamp.
-		if (!fnParser.IsParsed())
-		{
-			String dateTimeStr; U16 ms;
-			Utils::StringFromLocaltime(dateTimeStr, ms);
-
-			pEventManager->AddFootageNotice(eventId, filename, dateTimeStr, ms);
-		}
-		else
-			pEventManager->AddFootageNotice(eventId, filename, fnParser.GetTimestampStr(), fnParser.GetTimestampMs());
+		DownloadFootage(pFTPServer, pEventManager, fileSocket, eventId, footageIndex, path, filename, isPrefilter, isHashing, timeline);
 	}
 	catch (const Exception& e)
 	{
@@ -696,10 +835,8 @@ void FTPServer::HandleClients(Database::Connection& rDatabase)
 							ipAddress |= octet << (i * 8);
 						else
 						{ // 4, 5
-						//		 if (i == 4) port  = octet * 256;
-						//	else if (i == 5) port += octet;
-
-							port |= octet << ((i - 4) * 8);
+							// High byte first. (Host order, "DownloadFootageActiveTask" converts it with "htons")
+							port = (port << 8) | octet;
 						}
 					}
 					// TODO: In case of failing to parse, return error code "501".
@@ -793,9 +930,15 @@ void FTPServer::HandleClients(Database::Connection& rDatabase)
 						auto& rFTPSession = mFTPSessionMap[clientId];
 						auto footageIndex = mClientEventSessionFootageOffsetIndexes.at(clientId)++;
 
+						TRACE_EVENT(StorReceived, eventId, footageIndex, 0);
+
+						const auto storTP = std::chrono::steady_clock::now();
+
 						// Enter the "timout-lock" stage. (don't timeout while footage is downloading or queued for download)
 						ClientTimeoutLock(clientId);
 
+						const bool isHashing = mMain.AnalyticsPtr->IsFrameCacheEnabled() || IsLinkingDuplicates();
+
 						// NOTE:
 						// Download footage task is added to the thread pool task queue.
 						// So there might be some footage that is still not processed fast enough and the event session might be timedout some time ago...
@@ -803,10 +946,10 @@ void FTPServer::HandleClients(Database::Connection& rDatabase)
 						{
 							const auto cameraId = mMain.EventManagerPtr->GetCameraId(eventSessionId);
 
-							mMain.ThreadPoolPtr->Enqueue(DownloadFootageActiveTask, this, mMain.EventManagerPtr.get(), clientId, eventId, eventSessionId, footageIndex, footagePath, fileName, cameraId, rFTPSession.address, rFTPSession.port);
+							mMain.ThreadPoolPtr->Enqueue(DownloadFootageActiveTask, this, mMain.EventManagerPtr.get(), clientId, eventId, eventSessionId, footageIndex, footagePath, fileName, cameraId, rFTPSession.address, rFTPSession.port, mMain.AnalyticsPtr->IsPrefilterEnabled(), isHashing, storTP);
 						}
 						else
-							mMain.ThreadPoolPtr->Enqueue(DownloadFootagePassiveTask, this, mMain.EventManagerPtr.get(), clientId, eventId, eventSessionId, footageIndex, footagePath, fileName, rFTPSession.passiveSocketId, mPassiveSocketTimeoutSec);
+							mMain.ThreadPoolPtr->Enqueue(DownloadFootagePassiveTask, this, mMain.EventManagerPtr.get(), clientId, eventId, eventSessionId, footageIndex, footagePath, fileName, rFTPSession.passiveSocketId, mPassiveSocketTimeoutSec, mMain.AnalyticsPtr->IsPrefilterEnabled(), isHashing, storTP);
 					}
 
 					// NOTICE: 
@@ -994,6 +1137,8 @@ void FTPServer::HandleInactiveClients()
 	auto it = std::remove_if(mClientActiveIds.begin(), mClientActiveIds.end(), IsInactive);
 
 	mClientActiveIds.erase(it, mClientActiveIds.end());
+
+	Metrics::Set(gMetrics.numFTPClients, mClientActiveIds.size());
 }
 
 // THREAD: FTPServer thread (Main thread)
@@ -1018,6 +1163,49 @@ void FTPServer::ClientTimeoutUnlock(ClientId clientId)
 	mClientTimeoutLocks.at(clientId) = false;
 }
 
+bool FTPServer::FindStoredFootage(U64 contentHash, size_t size, String& rFullPath)
+{
+	std::lock_guard<std::mutex> lock(mStoredFootageMutex);
+
+	auto it = mStoredFootage.find(contentHash);
+
+	if (it == mStoredFootage.end() || it->second.size != size)
+		return false;
+
+	mStoredFootageOrder.splice(mStoredFootageOrder.begin(), mStoredFootageOrder, it->second.orderIt);
+
+	rFullPath = it->second.fullPath;
+
+	return true;
+}
+
+void FTPServer::AddStoredFootage(U64 contentHash, size_t size, const String& rFullPath)
+{
+	std::lock_guard<std::mutex> lock(mStoredFootageMutex);
+
+	auto it = mStoredFootage.find(contentHash);
+
+	// The earlier file failed to link (most likely deleted), the new one is linked from now on.
+	if (it != mStoredFootage.end())
+	{
+		mStoredFootageOrder.splice(mStoredFootageOrder.begin(), mStoredFootageOrder, it->second.orderIt);
+
+		it->second.size = size;
+		it->second.fullPath = rFullPath;
+		return;
+	}
+
+	if (mStoredFootage.size() >= mLinkCacheSize)
+	{
+		mStoredFootage.erase(mStoredFootageOrder.back());
+		mStoredFootageOrder.pop_back();
+	}
+
+	mStoredFootageOrder.push_front(contentHash);
+
+	mStoredFootage[contentHash] = { size, rFullPath, mStoredFootageOrder.begin() };
+}
+
 void FTPServer::SetupAuthSQLQuery()
 {
 	using namespace Database::Table;
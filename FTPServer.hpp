@@ -46,8 +46,11 @@ struct FTPSession
 
 class FTPServer
 {
+	// Parsing is benchmarked on its own. (See "Tools/MicroBenchmark")
+	friend class MicroBenchmark;
+
 public:
-	FTPServer(Main& rApp, U32 passiveSockTimeoutSec);
+	FTPServer(Main& rApp, U32 passiveSockTimeoutSec, U32 linkCacheSize, U32 clipFrameStep);
 	~FTPServer();
 
 	bool Start(U16 port);
@@ -60,6 +63,16 @@ public:
 	void ClientTimeoutLock(ClientId clientId);
 	void ClientTimeoutUnlock(ClientId clientId);
 
+	// Byte-identical footage (same content hash and size) is stored as a hard link to the earlier file.
+	// THREAD: Any thread. (Download tasks)
+	bool IsLinkingDuplicates() const { return mLinkCacheSize != 0; }
+	bool FindStoredFootage(U64 contentHash, size_t size, String& rFullPath);
+	void AddStoredFootage(U64 contentHash, size_t size, const String& rFullPath);
+
+	// Every Nth frame of the uploaded MJPEG clips (AVI) is stored as a separate JPEG footage. (0 - clips are stored as they are)
+	// THREAD: Any thread. (Download tasks)
+	U32 GetClipFrameStep() const { return mClipFrameStep; }
+
 private:
 
 	ClientId AddClient(SocketId socketId);
@@ -68,7 +81,7 @@ private:
 
 	bool CheckAuthentification(EventSessionId eventSessionId, const String& rUsername, const String& rPassword, U32* pUserId, U32* pSiteId, U32* pCameraId, bool* pIsArmed, U8* pPersonThreshold);
 
-	FTPCommand GetCommandType(char* pBuffer, ssize_t size);
+	static FTPCommand GetCommandType(char* pBuffer, ssize_t size);
 
 	String GetCommandName(FTPCommand commandType);
 
@@ -103,6 +116,22 @@ private:
 
 	UnorderedMap<ClientId, FTPSession> mFTPSessionMap;
 
+	//==========================================================
+	// Recently stored footage by the content hash, the least recently used are dropped. (See "FindStoredFootage")
+	struct StoredFootage
+	{
+		size_t size = 0;
+		String fullPath;
+		std::list<U64>::iterator orderIt;
+	};
+
+	const U32				mLinkCacheSize;
+	const U32				mClipFrameStep;
+
+	UnorderedMap<U64, StoredFootage> mStoredFootage;
+	std::list<U64>			mStoredFootageOrder; // Most recently used first.
+	std::mutex				mStoredFootageMutex;
+
 	struct
 	{
 		String authA;
@@ -0,0 +1,284 @@
+#include "PCH.hpp"
+
+#include "FootageLatency.hpp"
+
+FootageLatency gFootageLatency;
+
+//===================================================================================
+// LatencyHistogram
+//===================================================================================
+
+/*
+	SAMPLE: (SubBuckets = 32)
+	Bucket 0..63		- values 0..63 (exact)
+	Bucket 64..95		- values 64..127 (by 2)
+	Bucket 96..127		- values 128..255 (by 4)
+	...
+*/
+
+size_t LatencyHistogram::GetBucket(U64 value)
+{
+	const U64 maxValue = (U64(1) << MaxValueBits) - 1;
+
+	if (value > maxValue)
+		value = maxValue;
+
+	if (value < SubBuckets * 2)
+		return static_cast<size_t> (value);
+
+	U32 topBit = 0;
+
+	while (value >> (topBit + 1))
+		topBit++;
+
+	const U32 shift = topBit - SubBucketBits;
+
+	return static_cast<size_t> (shift * SubBuckets + (value >> shift));
+}
+
+U64 LatencyHistogram::GetBucketHighest(size_t bucket)
+{
+	if (bucket < SubBuckets * 2)
+		return bucket;
+
+	const U32 shift = static_cast<U32> (bucket / SubBuckets) - 1;
+	const U64 subBucket = bucket - shift * SubBuckets;
+
+	return ((subBucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(U64 valueUs)
+{
+	mBuckets[GetBucket(valueUs)].fetch_add(1, std::memory_order_relaxed);
+
+	mCount.fetch_add(1, std::memory_order_relaxed);
+	mSum.fetch_add(valueUs, std::memory_order_relaxed);
+
+	U64 maxUs = mMax.load(std::memory_order_relaxed);
+
+	while (valueUs > maxUs && !mMax.compare_exchange_weak(maxUs, valueUs, std::memory_order_relaxed))
+		;
+}
+
+U64 LatencyHistogram::GetPercentile(double percentile) const
+{
+	// NOTE: Counted from the buckets, the "mCount" might be ahead of them while recording.
+	U64 counts[NumBuckets];
+	U64 total = 0;
+
+	for (size_t i = 0; i < NumBuckets; ++i)
+		total += (counts[i] = mBuckets[i].load(std::memory_order_relaxed));
+
+	if (total == 0)
+		return 0;
+
+	const U64 rank = std::max<U64>(1, static_cast<U64> (static_cast<double> (total) * percentile / 100.0 + 0.5));
+
+	U64 count = 0;
+
+	for (size_t i = 0; i < NumBuckets; ++i)
+	{
+		count += counts[i];
+
+		if (count >= rank)
+			return std::min(GetBucketHighest(i), GetMax());
+	}
+
+	return GetMax();
+}
+
+//===================================================================================
+// FootageLatency
+//===================================================================================
+
+const char* FootageLatency::GetSpanName(Span span)
+{
+	static const char* spanNames[NumSpans] = { "connect", "transfer", "insert", "queue", "analytics", "notify", "analyzed", "total" };
+
+	return spanNames[static_cast<size_t> (span)];
+}
+
+void FootageLatency::SetSettings(const Settings& rSettings)
+{
+	mSettings = rSettings;
+
+	mPruneTP = mLogTP = std::chrono::steady_clock::now();
+}
+
+void FootageLatency::Record(Span span, const TimePoint& rFromTP, const TimePoint& rToTP)
+{
+	const auto us = std::chrono::duration_cast<std::chrono::microseconds>(rToTP - rFromTP).count();
+
+	mHistograms[static_cast<size_t> (span)].Record(us > 0 ? static_cast<U64> (us) : 0);
+}
+
+// THREAD: Main thread. (See "EventManager::HandleQueuedFootageNotices")
+void FootageLatency::Start(EventFootageId eventFootageId, const Timeline& rTimeline, const TimePoint& rInsertedTP)
+{
+	Record(Span::Connect, rTimeline.storTP, rTimeline.acceptedTP);
+	Record(Span::Transfer, rTimeline.acceptedTP, rTimeline.writtenTP);
+	Record(Span::Insert, rTimeline.writtenTP, rInsertedTP);
+
+	std::lock_guard<std::mutex> lock(mEntriesMutex);
+
+	mEntries[eventFootageId] = { rTimeline.storTP, rInsertedTP, Stage::Inserted };
+}
+
+// THREAD: Analytics thread ("Sent", "Result") or the CGI thread ("Delivered").
+void FootageLatency::Mark(EventFootageId eventFootageId, Stage stage)
+{
+	const auto currentTP = std::chrono::steady_clock::now();
+
+	std::lock_guard<std::mutex> lock(mEntriesMutex);
+
+	auto it = mEntries.find(eventFootageId);
+
+	// Not tracked (or expired), or the stage was already passed. (Frame sent again after the connection failure)
+	if (it == mEntries.end() || it->second.stage >= stage)
+		return;
+
+	auto& rEntry = it->second;
+
+	if (static_cast<U8> (stage) == static_cast<U8> (rEntry.stage) + 1)
+		Record(static_cast<Span> (static_cast<U8> (stage) - 1), rEntry.lastTP, currentTP);
+
+	if (stage == Stage::Result)
+		Record(Span::Analyzed, rEntry.storTP, currentTP);
+
+	if (stage == Stage::Delivered)
+	{
+		Record(Span::Total, rEntry.storTP, currentTP);
+
+		mEntries.erase(it);
+		return;
+	}
+
+	rEntry.lastTP = currentTP;
+	rEntry.stage = stage;
+}
+
+void FootageLatency::Finish(EventFootageId eventFootageId)
+{
+	std::lock_guard<std::mutex> lock(mEntriesMutex);
+
+	mEntries.erase(eventFootageId);
+}
+
+void FootageLatency::Update(const TimePoint& rCurrentTP)
+{
+	if (mSettings.maxAgeSec != 0 && std::chrono::duration_cast<std::chrono::seconds>(rCurrentTP - mPruneTP).count() >= 60)
+	{
+		mPruneTP = rCurrentTP;
+
+		std::lock_guard<std::mutex> lock(mEntriesMutex);
+
+		for (auto it = mEntries.begin(); it != mEntries.end();)
+		{
+			if (std::chrono::duration_cast<std::chrono::seconds>(rCurrentTP - it->second.storTP).count() >= mSettings.maxAgeSec)
+			{
+				it = mEntries.erase(it);
+				mNumExpired++;
+			}
+			else
+				++it;
+		}
+	}
+
+	if (mSettings.logIntervalSec != 0 && std::chrono::duration_cast<std::chrono::seconds>(rCurrentTP - mLogTP).count() >= mSettings.logIntervalSec)
+	{
+		mLogTP = rCurrentTP;
+
+		LogHistograms();
+	}
+}
+
+/*
+	SAMPLE:
+	{"spans":[{"name":"connect","count":120,"meanUs":850,"p50Us":767,"p90Us":1535,"p99Us":3071,"p999Us":3071,"maxUs":2980},...],"tracked":4,"expired":0}
+*/
+String FootageLatency::FormatJSON() const
+{
+	std::ostringstream ss;
+
+	ss << "{\"spans\":[";
+
+	for (size_t i = 0; i < NumSpans; ++i)
+	{
+		const auto& rHistogram = mHistograms[i];
+		const U64 count = rHistogram.GetCount();
+
+		ss	<< (i ? "," : "")
+			<< "{\"name\":\""	<< GetSpanName(static_cast<Span> (i)) << '"'
+			<< ",\"count\":"	<< count
+			<< ",\"meanUs\":"	<< (count ? rHistogram.GetSum() / count : 0)
+			<< ",\"p50Us\":"	<< rHistogram.GetPercentile(50.0)
+			<< ",\"p90Us\":"	<< rHistogram.GetPercentile(90.0)
+			<< ",\"p99Us\":"	<< rHistogram.GetPercentile(99.0)
+			<< ",\"p999Us\":"	<< rHistogram.GetPercentile(99.9)
+			<< ",\"maxUs\":"	<< rHistogram.GetMax()
+			<< '}';
+	}
+
+	size_t numTracked;
+	{
+		std::lock_guard<std::mutex> lock(mEntriesMutex);
+		numTracked = mEntries.size();
+	}
+
+	ss	<< "],\"tracked\":"	<< numTracked
+		<< ",\"expired\":"	<< mNumExpired.load()
+		<< '}';
+
+	return ss.str();
+}
+
+/*
+	SAMPLE:
+	# HELP viquant_footage_latency_seconds Time of the footage pipeline stages, from the STOR until the user notification.
+	# TYPE viquant_footage_latency_seconds summary
+	viquant_footage_latency_seconds{span="connect",quantile="0.5"} 0.000767
+	viquant_footage_latency_seconds_sum{span="connect"} 0.102
+	viquant_footage_latency_seconds_count{span="connect"} 120
+*/
+void FootageLatency::FormatMetrics(std::ostringstream& rStream) const
+{
+	static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+	const char* pName = "viquant_footage_latency_seconds";
+
+	rStream	<< "# HELP " << pName << " Time of the footage pipeline stages, from the STOR until the user notification.\n"
+			<< "# TYPE " << pName << " summary\n";
+
+	for (size_t i = 0; i < NumSpans; ++i)
+	{
+		const auto& rHistogram = mHistograms[i];
+		const char* pSpan = GetSpanName(static_cast<Span> (i));
+
+		for (double quantile : quantiles)
+			rStream << pName << "{span=\"" << pSpan << "\",quantile=\"" << quantile << "\"} " << static_cast<double> (rHistogram.GetPercentile(quantile * 100.0)) / 1e6 << '\n';
+
+		rStream	<< pName << "_sum{span=\"" << pSpan << "\"} " << static_cast<double> (rHistogram.GetSum()) / 1e6 << '\n'
+				<< pName << "_count{span=\"" << pSpan << "\"} " << rHistogram.GetCount() << '\n';
+	}
+}
+
+// SAMPLE: "Footage latency [total]: 52 footage, p50 812.3 ms, p90 1503.1 ms, p99 2945.0 ms, p99.9 2945.0 ms, max 2941.7 ms"
+void FootageLatency::LogHistograms() const
+{
+	for (size_t i = 0; i < NumSpans; ++i)
+	{
+		const auto& rHistogram = mHistograms[i];
+
+		if (rHistogram.GetCount() == 0)
+			continue;
+
+		LOG_MESSAGE(Log::Channel::Main, "Footage latency [%s]: %" PRIu64 " footage, p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, p99.9 %.1f ms, max %.1f ms",
+			GetSpanName(static_cast<Span> (i)),
+			rHistogram.GetCount(),
+			rHistogram.GetPercentile(50.0) / 1000.0,
+			rHistogram.GetPercentile(90.0) / 1000.0,
+			rHistogram.GetPercentile(99.0) / 1000.0,
+			rHistogram.GetPercentile(99.9) / 1000.0,
+			rHistogram.GetMax() / 1000.0);
+	}
+}
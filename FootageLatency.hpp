@@ -0,0 +1,134 @@
+#pragma once
+
+// HDR-style latency histogram (in microseconds), the buckets are linear within each power of two.
+// Values below "2 * SubBuckets" are exact, the rest are within 1/SubBuckets (~3%) of the value.
+// THREAD: Any thread, the buckets are the relaxed atomics.
+class LatencyHistogram
+{
+public:
+	static constexpr U32 SubBucketBits = 5;
+	static constexpr U64 SubBuckets = U64(1) << SubBucketBits;
+
+	// Larger values are clamped. (~38 hours)
+	static constexpr U32 MaxValueBits = 37;
+	static constexpr size_t NumBuckets = static_cast<size_t> ((MaxValueBits - SubBucketBits + 1) * SubBuckets);
+
+	void Record(U64 valueUs);
+
+	U64 GetCount() const	{ return mCount.load(std::memory_order_relaxed); }
+	U64 GetSum() const		{ return mSum.load(std::memory_order_relaxed); }
+	U64 GetMax() const		{ return mMax.load(std::memory_order_relaxed); }
+
+	// Highest value of the bucket the percentile (0 - 100) falls into. (0 - nothing recorded)
+	U64 GetPercentile(double percentile) const;
+
+private:
+
+	static size_t GetBucket(U64 value);
+	static U64 GetBucketHighest(size_t bucket);
+
+	std::atomic<U64> mBuckets[NumBuckets] = {};
+	std::atomic<U64> mCount{ 0 };
+	std::atomic<U64> mSum{ 0 };
+	std::atomic<U64> mMax{ 0 };
+};
+
+// Time from the camera's STOR until the user notification, by the stages every footage passes.
+// Stages until the Database insert are carried with the footage (see "Timeline"), the rest are tracked by the "EventFootageId".
+// Histograms are served by the API ("/latency" and "/metrics") and written to the log every "logIntervalSec". (Since the start)
+// THREAD: Any thread.
+class FootageLatency
+{
+public:
+	enum class Stage : U8
+	{
+		Stor,		// STOR parsed. (FTP)
+		Accepted,	// Data connection accepted. (Or connected, the ACTIVE mode)
+		Written,	// Footage file written.
+		Inserted,	// Footage row inserted. (EventManager)
+		Sent,		// Sent to the analytics server. (Analytics)
+		Result,		// Analytics results received.
+		Delivered	// User notification delivered. (CGI)
+	};
+
+	// Each stage's time since the previous one, then the end-to-end ones.
+	enum class Span : U8
+	{
+		Connect,	// Stor - Accepted.
+		Transfer,	// Accepted - Written.
+		Insert,		// Written - Inserted.
+		Queue,		// Inserted - Sent.
+		Analytics,	// Sent - Result.
+		Notify,		// Result - Delivered.
+		Analyzed,	// Stor - Result. (Every analyzed footage)
+		Total		// Stor - Delivered.
+	};
+
+	static constexpr size_t NumSpans = static_cast<size_t> (Span::Total) + 1;
+
+	struct Settings
+	{
+		// Histograms are written to the log this often. (0 - never)
+		U32 logIntervalSec = 0;
+
+		// Footage that hasn't reached the notification in this time (not notified or dropped) is no longer tracked.
+		U32 maxAgeSec = 0;
+	};
+
+	// Stages before the footage gets its "EventFootageId". (FTP download task)
+	struct Timeline
+	{
+		TimePoint storTP;
+		TimePoint acceptedTP;
+		TimePoint writtenTP;
+	};
+
+	static const char* GetSpanName(Span span);
+
+	void SetSettings(const Settings& rSettings);
+
+	// Footage was inserted, it's tracked until delivered (or "Finish").
+	void Start(EventFootageId eventFootageId, const Timeline& rTimeline, const TimePoint& rInsertedTP);
+
+	// Span is recorded only if the footage has just passed the previous stage. (Cached results skip the "Sent")
+	void Mark(EventFootageId eventFootageId, Stage stage);
+
+	// No notification follows. (Nothing detected, coalesced, failed or the frame was dropped)
+	void Finish(EventFootageId eventFootageId);
+
+	// Drops the expired footage, writes the histograms to the log. (Main thread)
+	void Update(const TimePoint& rCurrentTP);
+
+	const LatencyHistogram& GetHistogram(Span span) const { return mHistograms[static_cast<size_t> (span)]; }
+
+	String FormatJSON() const;
+	void FormatMetrics(std::ostringstream& rStream) const;
+
+	void LogHistograms() const;
+
+private:
+
+	void Record(Span span, const TimePoint& rFromTP, const TimePoint& rToTP);
+
+	struct Entry
+	{
+		TimePoint storTP;
+		TimePoint lastTP; // Of the "stage".
+		Stage stage;
+	};
+
+	Settings mSettings;
+
+	LatencyHistogram mHistograms[NumSpans];
+
+	UnorderedMap<EventFootageId, Entry> mEntries;
+	mutable std::mutex mEntriesMutex;
+
+	// Main thread.
+	TimePoint mPruneTP;
+	TimePoint mLogTP;
+
+	std::atomic<U64> mNumExpired{ 0 };
+};
+
+extern FootageLatency gFootageLatency;
@@ -0,0 +1,118 @@
+#include "PCH.hpp"
+
+#include "FlightRecorder.hpp"
+
+#include <string.h> // strncpy, memcpy
+
+FlightRecorder* gpFlightRecorder = nullptr;
+
+static U64 GetTimeNs()
+{
+	return static_cast<U64> (std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Rounded up to the power of two, so the ring index is just masked.
+static U64 GetRingSize(U32 ringSize)
+{
+	U64 size = 1;
+
+	while (size < ringSize)
+		size <<= 1;
+
+	return size;
+}
+
+FlightRecorder::FlightRecorder(U32 ringSize)
+	: mRingMask(GetRingSize(ringSize) - 1)
+{
+	// NOTE: Threads keep their ring pointers, so there is only one recorder in the process lifetime.
+	gpFlightRecorder = this;
+}
+
+FlightRecorder::~FlightRecorder()
+{
+	gpFlightRecorder = nullptr;
+}
+
+void FlightRecorder::SetThreadName(const char* pName)
+{
+	Ring& rRing = GetRing();
+
+	strncpy(rRing.name, pName, sizeof(rRing.name) - 1);
+}
+
+FlightRecorder::Ring& FlightRecorder::AddRing()
+{
+	auto ringPtr = std::make_unique<Ring>();
+
+	ringPtr->records.resize(static_cast<size_t> (mRingMask + 1));
+
+	std::lock_guard<std::mutex> lock(mRingsMutex);
+
+	ringPtr->index = static_cast<U32> (mRings.size());
+
+	mRings.emplace_back(std::move(ringPtr));
+
+	return *mRings.back();
+}
+
+void FlightRecorder::Dump(String& rOutput) const
+{
+	const U64 ringSize = mRingMask + 1;
+
+	std::lock_guard<std::mutex> lock(mRingsMutex);
+
+	FileHeader fileHeader;
+
+	fileHeader.numThreads = static_cast<U32> (mRings.size());
+	fileHeader.dumpTimeNs = GetTimeNs();
+
+	rOutput.append(reinterpret_cast<const char*> (&fileHeader), sizeof(fileHeader));
+
+	Vector<Record> records;
+
+	for (const auto& rRingPtr : mRings)
+	{
+		const Ring& rRing = *rRingPtr;
+
+		const U64 head = rRing.head.load(std::memory_order_acquire);
+		const U64 first = (head > ringSize) ? head - ringSize : 0;
+
+		records.clear();
+
+		for (U64 i = first; i < head; ++i)
+			records.push_back(rRing.records[i & mRingMask]);
+
+		// Records the thread has overwritten (or was writing) while they were copied are dropped.
+		const U64 newHead = rRing.head.load(std::memory_order_acquire);
+		const U64 numOverwritten = (newHead >= first + ringSize) ? std::min<U64>(newHead - (first + ringSize) + 1, records.size()) : 0;
+
+		records.erase(records.begin(), records.begin() + static_cast<size_t> (numOverwritten));
+
+		ThreadHeader threadHeader;
+
+		threadHeader.threadIndex = rRing.index;
+		threadHeader.numRecords = static_cast<U32> (records.size());
+
+		memcpy(threadHeader.name, rRing.name, sizeof(threadHeader.name));
+
+		rOutput.append(reinterpret_cast<const char*> (&threadHeader), sizeof(threadHeader));
+		rOutput.append(reinterpret_cast<const char*> (records.data()), records.size() * sizeof(Record));
+	}
+}
+
+bool FlightRecorder::DumpToFile(const String& rFileName) const
+{
+	String data;
+
+	Dump(data);
+
+	std::ofstream file(rFileName, std::ios::out | std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open())
+		return false;
+
+	file.write(data.data(), data.size());
+
+	return file.good();
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+// Binary trace of the hot path events. Every thread writes the last "ringSize" of its events into its own ring, without any locking.
+// Dumped on SIGUSR1 (next to the log files) or by the API ("/trace"), "Tools/TraceDecoder" turns the dump into the Chrome trace JSON.
+// THREAD: Add - any thread.
+class FlightRecorder
+{
+public:
+	// NOTE: Values are stored in the dumps, new types are added to the end.
+	enum class Type : U16
+	{
+		StorReceived,		// id0: eventId, id1: footage index.
+		TransferStart,		// id0: eventId, id1: footage index.
+		TransferEnd,		// id0: eventId, id1: footage index, value: bytes.
+		DBQueryStart,		// value: query length.
+		DBQueryEnd,			// id0: 1 - failed, value: rows.
+		AnalyticsSend,		// id0: eventFootageId, value: bytes. (Of the whole batch, if sent using the socket)
+		AnalyticsResult,	// id0: eventFootageId, id1: eventId, value: latency (ms).
+		CGIRequest,			// id0: eventId, id1: connection id, value: attempt. (One per event of the batch)
+		CGIResponse			// id0: eventId, id1: connection id, value: HTTP status. (One per event of the batch)
+	};
+
+	// Dump: "FileHeader", then every thread's "ThreadHeader" followed by its "numRecords" of the "Record" (oldest first).
+#pragma pack(push, 1)
+	struct FileHeader
+	{
+		char	magic[4] = { 'V', 'Q', 'F', 'R' };
+		U32		version = 1;
+		U32		numThreads = 0;
+		U64		dumpTimeNs = 0;
+	};
+
+	struct ThreadHeader
+	{
+		U32		threadIndex = 0;
+		U32		numRecords = 0;
+		char	name[16] = {};
+	};
+
+	struct Record
+	{
+		U64		timeNs;	// "steady_clock".
+		U64		id0;
+		U64		id1;
+		U32		value;
+		U16		type;
+		U16		reserved;
+	};
+#pragma pack(pop)
+
+	explicit FlightRecorder(U32 ringSize);
+	~FlightRecorder();
+
+	inline void Add(Type type, U64 id0, U64 id1, U32 value)
+	{
+		Ring& rRing = GetRing();
+
+		const U64 head = rRing.head.load(std::memory_order_relaxed);
+
+		Record& rRecord = rRing.records[head & mRingMask];
+
+		rRecord.timeNs = static_cast<U64> (std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		rRecord.id0 = id0;
+		rRecord.id1 = id1;
+		rRecord.value = value;
+		rRecord.type = static_cast<U16> (type);
+		rRecord.reserved = 0;
+
+		rRing.head.store(head + 1, std::memory_order_release);
+	}
+
+	// Shown as the thread's name by the decoder. (Up to 15 characters)
+	void SetThreadName(const char* pName);
+
+	// THREAD: Any thread, the rings keep being written while they're copied.
+	void Dump(String& rOutput) const;
+	bool DumpToFile(const String& rFileName) const;
+
+private:
+
+	struct Ring
+	{
+		std::atomic<U64>	head{ 0 }; // Number of the records ever written.
+		Vector<Record>		records;
+		U32					index = 0;
+		char				name[16] = {};
+	};
+
+	inline Ring& GetRing()
+	{
+		thread_local Ring* tpRing = nullptr;
+
+		if (!tpRing)
+			tpRing = &AddRing();
+
+		return *tpRing;
+	}
+
+	Ring& AddRing();
+
+private:
+
+	const U64 mRingMask;
+
+	// Rings of all the threads that ever added the record. (Kept until the end, the dump can still see them)
+	Vector<UniquePtr<Ring>>	mRings;
+	mutable std::mutex		mRingsMutex;
+};
+
+extern FlightRecorder* gpFlightRecorder;
+
+#define TRACE_EVENT(type, id0, id1, value)	(gpFlightRecorder ? gpFlightRecorder->Add(FlightRecorder::Type::type, static_cast<U64> (id0), static_cast<U64> (id1), static_cast<U32> (value)) : (void)0)
@@ -1,4 +1,3 @@
-
 #include "PCH.hpp"
 
 #include "Main.hpp"
@@ -6,11 +5,40 @@
 #include "Log.hpp"
 
 #include <cstdarg>	// va_start
+#include <time.h>	// localtime_r
+
+#if PLATFORM_WINDOWS
+#include <io.h>		// _commit
+#else
+#include <unistd.h>	// fsync
+#endif
 
 Log* gpLog = nullptr;
 
-Log::Log(const String& rPath)
+static void GetLocaltime(time_t posixTime, struct tm& rTM)
+{
+#if PLATFORM_WINDOWS
+	localtime_s(&rTM, &posixTime);
+#else
+	localtime_r(&posixTime, &rTM);
+#endif
+}
+
+// SAMPLE: "20190306_121007_log.txt"
+static String GetFileName(time_t posixTime)
+{
+	struct tm tm;
+	GetLocaltime(posixTime, tm);
+
+	char buffer[32];
+	strftime(buffer, sizeof(buffer), "%Y%m%d_%H%M%S_log.txt", &tm);
+
+	return buffer;
+}
+
+Log::Log(const String& rPath, const Settings& rSettings)
 	: mLogPath(rPath)
+	, mSettings(rSettings)
 	, mThread(&Log::ThreadProc, this)
 {
 	gpLog = this;
@@ -24,19 +52,91 @@ Log::~Log()
 {
 	Write(Channel::Main, Level::Info, __LINE__, __FUNCTION__, "End.");
 
-	mIsStopRequested = true;
+	{
+		std::lock_guard<std::mutex> lock(mQueueLock);
+		mIsStopRequested = true;
+	}
 
 	mCondition.notify_all();
 	mThread.join();
 }
 
-void Log::Write(Channel channel, Level level, int line, const char* pFuncName, const String& rMessage)
+Log::Level Log::GetLevel(Channel channel) const
+{
+	return static_cast<Level> (mLevels[static_cast<size_t> (channel)].load(std::memory_order_relaxed));
+}
+
+void Log::SetLevel(Channel channel, Level level)
+{
+	mLevels[static_cast<size_t> (channel)] = static_cast<U8> (level);
+}
+
+void Log::SetLevel(Level level)
+{
+	for (auto& rLevel : mLevels)
+		rLevel = static_cast<U8> (level);
+}
+
+bool Log::ParseLevel(const String& rName, Level& rLevel)
 {
-	mQueueLock.lock();
-	mQueue.emplace(channel, level, line, pFuncName, rMessage);
-	mQueueLock.unlock();
+	for (auto level : { Level::Debug, Level::Info, Level::Warning, Level::Error })
+	{
+		if (rName == GetLevelName(level))
+		{
+			rLevel = level;
+			return true;
+		}
+	}
 
-	mCondition.notify_one();
+	return false;
+}
+
+bool Log::ParseChannel(const String& rName, Channel& rChannel)
+{
+	for (size_t i = 0; i < NumChannels; ++i)
+	{
+		if (rName == GetChannelName(static_cast<Channel> (i)))
+		{
+			rChannel = static_cast<Channel> (i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const char* Log::GetLevelName(Level level)
+{
+	switch (level)
+	{
+		case Level::Debug:		return "debug";
+		case Level::Info:		return "info";
+		case Level::Warning:	return "warning";
+		case Level::Error:		return "error";
+	}
+
+	return "";
+}
+
+const char* Log::GetChannelName(Channel channel)
+{
+	switch (channel)
+	{
+		case Channel::Main:			return "main";
+		case Channel::DB:			return "db";
+		case Channel::API:			return "api";
+		case Channel::FTP:			return "ftp";
+		case Channel::CGI:			return "cgi";
+		case Channel::Analytics:	return "analytics";
+		case Channel::Events:		return "events";
+	}
+
+	return "";
+}
+
+void Log::Write(Channel channel, Level level, int line, const char* pFuncName, const String& rMessage)
+{
+	Push(channel, level, line, pFuncName, String(rMessage));
 }
 
 void Log::WriteVA(Channel channel, Level level, int line, const char* pFunctionName, const char* pFormat, ...)
@@ -46,7 +146,7 @@ void Log::WriteVA(Channel channel, Level level, int line, const char* pFunctionN
 	va_list args;
 	va_start(args, pFormat);
 
-	// Returns the number of characters written (not including the terminating null) 
+	// Returns the number of characters written (not including the terminating null)
 	// Or a negative value if an output error occurs.
 	size_t length = vsnprintf(buffer, sizeof(buffer) - 1, pFormat, args);
 
@@ -57,84 +157,231 @@ void Log::WriteVA(Channel channel, Level level, int line, const char* pFunctionN
 
 	buffer[sizeof(buffer) - 1] = 0;
 
-	Write(channel, level, line, pFunctionName, String(buffer, length));
+	Push(channel, level, line, pFunctionName, String(buffer, length));
 }
 
-void Log::ThreadProc()
+void Log::Push(Channel channel, Level level, int line, const char* pFuncName, String&& rMessage)
 {
-	String fileName;
+	bool needsWakeUp = false;
+
 	{
-		auto posixTime = time(nullptr);
-		auto tm = localtime(&posixTime);
+		std::lock_guard<std::mutex> lock(mQueueLock);
+
+		const bool wasEmpty = mQueue.empty();
+
+		mQueue.emplace_back(channel, level, line, pFuncName, std::move(rMessage));
 
-		char buffer[16];
-		strftime(buffer, sizeof(buffer), "%Y%m%d_%H%M%S", tm);
+		Metrics::Set(gMetrics.logQueueDepth, mQueue.size());
 
-		fileName = buffer;
-		fileName += "_log.txt";
+		// Log thread is already woken up by the previous records.
+		if (mSettings.writeIntervalMs == 0)
+			needsWakeUp = wasEmpty;
+		else if ((level == Level::Error || mQueue.size() >= MaxQueued) && !mIsUrgent)
+			needsWakeUp = mIsUrgent = true;
 	}
 
-	std::ofstream file(mLogPath + fileName, std::ios_base::out | std::ios_base::trunc);
+	if (needsWakeUp)
+		mCondition.notify_one();
+}
 
-	if (!file.is_open())
-	{
+void Log::ThreadProc()
+{
+	// NOTE: Records are still taken (and echoed) if the file fails to open, so the queue doesn't keep growing.
+	if (!OpenFile())
 		std::cout << "Failed to open the log file!" << std::endl;
-		return;
-	}
+
+	Vector<Info> records;
+	String buffer;
+
+	const auto writeInterval = std::chrono::milliseconds(mSettings.writeIntervalMs);
+	const auto syncInterval = std::chrono::seconds(mSettings.syncIntervalSec);
+
+	auto syncTP = std::chrono::steady_clock::now();
+	bool needsSync = false;
 
 	for (;;)
 	{
-		std::unique_lock<std::mutex> lock(mQueueLock);
+		bool isStopRequested;
+
+		{
+			std::unique_lock<std::mutex> lock(mQueueLock);
+
+			const auto hasRecords = [this] { return !mQueue.empty() || mIsStopRequested; };
+
+			if (mSettings.writeIntervalMs != 0)
+				mCondition.wait_for(lock, writeInterval, [this] { return mIsUrgent || mIsStopRequested; });
+			else if (needsSync)
+				mCondition.wait_until(lock, syncTP + syncInterval, hasRecords);
+			else
+				mCondition.wait(lock, hasRecords);
+
+			records.swap(mQueue);
+			mIsUrgent = false;
+
+			Metrics::Set(gMetrics.logQueueDepth, 0);
+
+			isStopRequested = mIsStopRequested;
+		}
+
+		if (!records.empty())
+		{
+			buffer.clear();
+
+			Format(records, buffer);
+
+			records.clear();
+
+			if (mSettings.isConsoleEcho)
+			{
+				fwrite(buffer.data(), 1, buffer.size(), stdout);
+				fflush(stdout);
+			}
+
+			// Unbuffered, a single "write" for the whole batch.
+			if (mpFile)
+			{
+				fwrite(buffer.data(), 1, buffer.size(), mpFile);
+
+				mFileSize += buffer.size();
+				needsSync = (mSettings.syncIntervalSec != 0);
+			}
+		}
+
+		if (isStopRequested)
+			break;
+
+		const auto currentTP = std::chrono::steady_clock::now();
+
+		if (needsSync && currentTP - syncTP >= syncInterval)
+		{
+			SyncFile();
+
+			needsSync = false;
+			syncTP = currentTP;
+		}
+
+		//=============================================
+		// Rotation.
+		if (mpFile)
+		{
+			const auto posixTime = time(nullptr);
+
+			const bool isTooLarge = (mSettings.maxFileSizeMB != 0 && mFileSize >= (static_cast<size_t> (mSettings.maxFileSizeMB) << 20));
+			const bool isTooOld = (mSettings.maxFileAgeHours != 0 && posixTime - mFileOpenTime >= static_cast<time_t> (mSettings.maxFileAgeHours) * 3600);
+
+			// NOTE: File names have seconds, the current file is kept until the name changes.
+			if ((isTooLarge || isTooOld) && posixTime != mFileOpenTime)
+			{
+				CloseFile();
+				needsSync = false;
+
+				if (!OpenFile())
+					std::cout << "Failed to open the next log file!" << std::endl;
+			}
+		}
+	}
+
+	CloseFile();
+}
+
+// SAMPLE: "[2019-03-06 12:10:07.711] | [FTP]  | I | Text"
+void Log::Format(const Vector<Info>& rRecords, String& rBuffer)
+{
+	for (const auto& rRecord : rRecords)
+	{
+		const auto posixTime = std::chrono::system_clock::to_time_t(rRecord.timePoint);
 
-		mCondition.wait(lock, [this] { return !mQueue.empty() || mIsStopRequested; });
+		if (posixTime != mPrefixTime)
+		{
+			struct tm tm;
+			GetLocaltime(posixTime, tm);
 
-		if (mIsStopRequested && mQueue.empty())
-			return;
+			strftime(mPrefix, sizeof(mPrefix), "%Y-%m-%d %H:%M:%S", &tm);
 
-		auto& rRecord = mQueue.front();
+			mPrefixTime = posixTime;
+		}
 
-		std::ostringstream ss;
+		const auto ms = static_cast<U32> (std::chrono::duration_cast<std::chrono::milliseconds>(rRecord.timePoint.time_since_epoch()).count() % 1000);
 
-		ss << '[' << Utils::StringFromLocaltime(true, true, true) << "] | ";
+		rBuffer += '[';
+		rBuffer += mPrefix;
+		rBuffer += '.';
+		rBuffer += static_cast<char> ('0' + ms / 100);
+		rBuffer += static_cast<char> ('0' + ms / 10 % 10);
+		rBuffer += static_cast<char> ('0' + ms % 10);
+		rBuffer += "] | ";
 
 		switch (rRecord.channel)
 		{
-			case Channel::Main:			ss << "[Main] | ";	break;
-			case Channel::DB:			ss << "[DB]   | ";	break;
-			case Channel::API:			ss << "[API]  | ";	break;
-			case Channel::FTP:			ss << "[FTP]  | ";	break;
-			case Channel::CGI:			ss << "[CGI]  | ";	break;
-			case Channel::Analytics:	ss << "[ANL]  | ";	break;
-			case Channel::Events:		ss << "[EVN]  | ";	break;
+			case Channel::Main:			rBuffer += "[Main] | ";	break;
+			case Channel::DB:			rBuffer += "[DB]   | ";	break;
+			case Channel::API:			rBuffer += "[API]  | ";	break;
+			case Channel::FTP:			rBuffer += "[FTP]  | ";	break;
+			case Channel::CGI:			rBuffer += "[CGI]  | ";	break;
+			case Channel::Analytics:	rBuffer += "[ANL]  | ";	break;
+			case Channel::Events:		rBuffer += "[EVN]  | ";	break;
 			default:
 				break;
 		}
 
 		switch (rRecord.level)
 		{
-			case Level::Debug:		ss << 'D';	break;
-			case Level::Info:		ss << 'I';	break;
-			case Level::Warning:	ss << 'W';	break;
-			case Level::Error:		ss << 'E';	break;
+			case Level::Debug:		rBuffer += 'D';	break;
+			case Level::Info:		rBuffer += 'I';	break;
+			case Level::Warning:	rBuffer += 'W';	break;
+			case Level::Error:		rBuffer += 'E';	break;
 		}
 
-		ss << " | " << rRecord.text;
+		rBuffer += " | ";
+		rBuffer += rRecord.text;
 
 		if (rRecord.level == Level::Error)
-			ss << " (Func: " << rRecord.func << ", Line: " << rRecord.line << ")";
+		{
+			rBuffer += " (Func: ";
+			rBuffer += rRecord.pFunc;
+			rBuffer += ", Line: ";
+			rBuffer += std::to_string(rRecord.line);
+			rBuffer += ')';
+		}
 
-//#if _DEBUG
-		std::cout << ss.str() << std::endl;
-//#endif
+		// NOTE: File is opened in the binary mode, so the CRLF is written on every platform.
+		rBuffer += "\r\n";
+	}
+}
 
-		// NOTE: On some platforms "std::endl" will just write LF, but not CRLF. So using "\r\n" instead.
+bool Log::OpenFile()
+{
+	mFileOpenTime = time(nullptr);
+	mFileSize = 0;
+
+	mpFile = fopen((mLogPath + GetFileName(mFileOpenTime)).c_str(), "wb");
+
+	if (!mpFile)
+		return false;
+
+	// Every batch is written with a single call, buffering would only copy it.
+	setvbuf(mpFile, nullptr, _IONBF, 0);
+
+	return true;
+}
+
+void Log::CloseFile()
+{
+	if (!mpFile)
+		return;
+
+	if (mSettings.syncIntervalSec != 0)
+		SyncFile();
+
+	fclose(mpFile);
+	mpFile = nullptr;
+}
+
+void Log::SyncFile()
+{
 #if PLATFORM_WINDOWS
-		file << ss.str() << std::endl;
+	_commit(_fileno(mpFile));
 #else
-		file << ss.str() << "\r\n"; // std::endl;
+	fsync(fileno(mpFile));
 #endif
-		file.flush();
-
-		mQueue.pop();
-	}
 }
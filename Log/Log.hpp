@@ -1,4 +1,3 @@
-
 #pragma once
 
 class Log
@@ -15,6 +14,8 @@ public:
 		Events
 	};
 
+	static constexpr size_t NumChannels = static_cast<size_t> (Channel::Events) + 1;
+
 	enum class Level
 	{
 		Debug,
@@ -23,50 +24,134 @@ public:
 		Error
 	};
 
-	Log(const String& rPath);
+	struct Settings
+	{
+		// Records are also written to the standard output.
+		bool	isConsoleEcho = true;
+
+		// Queued records are written at most this often. (0 - as soon as the log thread wakes up)
+		// NOTE: Errors (and the full queue) are written right away.
+		U32		writeIntervalMs = 0;
+
+		// Written data is synced to the disk ("fsync") at most this often. (0 - left to the OS)
+		U32		syncIntervalSec = 0;
+
+		// New log file is started when the current one gets this large or this old. (0 - never)
+		U32		maxFileSizeMB = 0;
+		U32		maxFileAgeHours = 0;
+	};
+
+	Log(const String& rPath, const Settings& rSettings);
 	~Log();
 
 	void WriteVA(Channel channel, Level level, int line, const char* pFuncName, const char* pFormat, ...);
 	void Write(Channel channel, Level level, int line, const char* pFuncName, const String& rMessage);
 
-private:
+	// Records below the channel's level are dropped by the "LOG_*" macros, before the arguments are evaluated.
+	// THREAD: Any thread.
+	inline bool IsEnabled(Channel channel, Level level) const
+	{
+		return static_cast<U8> (level) >= mLevels[static_cast<size_t> (channel)].load(std::memory_order_relaxed);
+	}
 
-	void ThreadProc();
+	Level GetLevel(Channel channel) const;
+
+	void SetLevel(Channel channel, Level level);
+	void SetLevel(Level level); // All the channels.
+
+	// "debug", "info", "warning", "error" and the channel names ("main", "db", "api", "ftp", "cgi", "analytics", "events").
+	static bool ParseLevel(const String& rName, Level& rLevel);
+	static bool ParseChannel(const String& rName, Channel& rChannel);
+
+	static const char* GetLevelName(Level level);
+	static const char* GetChannelName(Channel channel);
+
+private:
 
 	struct Info
 	{
-		Info(Channel channel, Level level, int line, const String& rFuncName, const String& rMessage)
+		Info(Channel channel, Level level, int line, const char* pFuncName, String&& rMessage)
 			: channel(channel)
 			, level(level)
 			, line(line)
-			, func(rFuncName)
-			, text(rMessage)
-			, timePoint(std::chrono::steady_clock::now())
+			, pFunc(pFuncName)
+			, text(std::move(rMessage))
+			, timePoint(std::chrono::system_clock::now())
 		{ }
 
 		Channel		channel;
 		Level		level;
 		int			line;
-		String		func;
+		const char*	pFunc; // "__FUNCTION__", static storage.
 		String		text;
-		TimePoint	timePoint;
+
+		std::chrono::system_clock::time_point timePoint;
 	};
 
+	void Push(Channel channel, Level level, int line, const char* pFuncName, String&& rMessage);
+
+	void ThreadProc();
+
+	// Appends the records to the "rBuffer", one line each.
+	void Format(const Vector<Info>& rRecords, String& rBuffer);
+
+	bool OpenFile();
+	void CloseFile();
+	void SyncFile();
+
+	// Records are written when there are this many of them, even if the "Settings::writeIntervalMs" is not over.
+	static constexpr size_t MaxQueued = 4096;
+
 private:
 
 	const String			mLogPath;
+	const Settings			mSettings;
+
+	std::atomic<U8>			mLevels[NumChannels] = {};
 
 	std::atomic_bool		mIsStopRequested{ false };
 	std::condition_variable	mCondition;
 
-	std::thread				mThread;
-	std::queue<Info>		mQueue;
+	// Log thread swaps out the whole queue.
+	Vector<Info>			mQueue;
 	std::mutex				mQueueLock;
+	bool					mIsUrgent = false; // Queue has the error. (Or it is full)
+
+	// Log thread.
+	FILE*					mpFile = nullptr;
+	size_t					mFileSize = 0;
+	time_t					mFileOpenTime = 0;
+
+	// Date and time prefix of the records, formatted once per second.
+	time_t					mPrefixTime = 0;
+	char					mPrefix[24] = {};
+
+	std::thread				mThread;
 };
 
 extern Log* gpLog;
 
-#define LOG_DEBUG(channel, ...)		gpLog->WriteVA(channel, Log::Level::Debug, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOG_MESSAGE(channel, ...)	gpLog->WriteVA(channel, Log::Level::Info, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOG_WARNING(channel, ...)	gpLog->WriteVA(channel, Log::Level::Warning, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOG_ERROR(channel, ...)		gpLog->WriteVA(channel, Log::Level::Error, __LINE__, __FUNCTION__, __VA_ARGS__)
+// Records below this level are not compiled at all. (Set by the build configuration, 0 - "Level::Debug")
+// NOTE: The arguments are still referenced (never evaluated), so the locals used only by the record don't warn.
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+#define LOG_WRITE(channel, level, ...)	(gpLog->IsEnabled(channel, level) ? gpLog->WriteVA(channel, level, __LINE__, __FUNCTION__, __VA_ARGS__) : (void)0)
+
+#define LOG_DISCARD(channel, level, ...)	(false ? LOG_WRITE(channel, level, __VA_ARGS__) : (void)0)
+
+#if LOG_MIN_LEVEL > 0
+#define LOG_DEBUG(channel, ...)		LOG_DISCARD(channel, Log::Level::Debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(channel, ...)		LOG_WRITE(channel, Log::Level::Debug, __VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL > 1
+#define LOG_MESSAGE(channel, ...)	LOG_DISCARD(channel, Log::Level::Info, __VA_ARGS__)
+#else
+#define LOG_MESSAGE(channel, ...)	LOG_WRITE(channel, Log::Level::Info, __VA_ARGS__)
+#endif
+
+#define LOG_WARNING(channel, ...)	LOG_WRITE(channel, Log::Level::Warning, __VA_ARGS__)
+#define LOG_ERROR(channel, ...)		LOG_WRITE(channel, Log::Level::Error, __VA_ARGS__)
@@ -16,6 +16,7 @@
 #include "Utils.hpp"
 
 #include "API/APIServer.hpp"
+#include "API/EventStream.hpp"
 #include "CGI/CGIManager.hpp"
 
 #include <csignal>	// signal
@@ -29,6 +30,14 @@ void SignalHandler(int n)
 	gIsQuitRequested = true;
 }
 
+// Flight recorder dump is written by the main loop. (See "FlightRecorder")
+static std::atomic_bool gIsTraceDumpRequested = {false};
+
+static void TraceSignalHandler(int /*n*/)
+{
+	gIsTraceDumpRequested = true;
+}
+
 Main::Main()
 {
 #if PLATFORM_WINDOWS
@@ -39,6 +48,9 @@ Main::Main()
 	signal(SIGABRT, &SignalHandler);
 	signal(SIGTERM, &SignalHandler);
 	signal(SIGINT, &SignalHandler);
+#ifndef PLATFORM_WINDOWS
+	signal(SIGUSR1, &TraceSignalHandler);
+#endif
 
 	mysql_library_init(0, nullptr, nullptr);
 }
@@ -69,6 +81,10 @@ int Main::Run()
 
 		SetupLogSystem();
 
+		SetupFlightRecorder();
+
+		SetupFootageLatency();
+
 		LOG_MESSAGE(Log::Channel::Main, "Num CPU cores: %d", std::thread::hardware_concurrency());
 		LOG_MESSAGE(Log::Channel::Main, "Main thread id: %s", ThreadIdToString(std::this_thread::get_id()).c_str());
 		LOG_MESSAGE(Log::Channel::Main, "Work path: %s", GetPathApplication().c_str());
@@ -109,7 +125,10 @@ int Main::Run()
 
 			EventManagerPtr->HandleQueuedFootageNotices();
 
-			CGIManagerPtr->Process();
+			if (gIsTraceDumpRequested.exchange(false))
+				DumpFlightRecorder();
+
+			gFootageLatency.Update(std::chrono::steady_clock::now());
 
 //			printf("Peu...\n");
 //			std::this_thread::sleep_for(std::chrono::seconds(3));
@@ -177,21 +196,126 @@ void Main::SetupLogSystem()
 	if (!Utils::MakePath(logPath))
 		throw ExceptionVA("Failed to setup log path: \"%s\"!", logPath.c_str());
 
-	LogFilePtr = std::make_unique<Log>(logPath);
+	mPathFor.log = logPath;
+
+	Log::Settings settings;
+
+	ConfigPtr->Read("log_console", settings.isConsoleEcho, true);
+	ConfigPtr->Read("log_write_interval_ms", settings.writeIntervalMs, 0);
+	ConfigPtr->Read("log_sync_interval_sec", settings.syncIntervalSec, 0);
+	ConfigPtr->Read("log_max_file_size_mb", settings.maxFileSizeMB, 0);
+	ConfigPtr->Read("log_max_file_age_hours", settings.maxFileAgeHours, 0);
+
+	LogFilePtr = std::make_unique<Log>(logPath, settings);
+
+	// SAMPLE: "log_level=info", "log_level_ftp=debug" (Can be changed at runtime, see the API "/log/level")
+	String levelName;
+
+	ConfigPtr->Read("log_level", levelName, String());
+
+	Log::Level level;
+
+	if (Log::ParseLevel(levelName, level))
+		LogFilePtr->SetLevel(level);
+	else if (!levelName.empty())
+		LOG_ERROR(Log::Channel::Main, "Config key \"log_level\" has invalid level: \"%s\"", levelName.c_str());
+
+	for (size_t i = 0; i < Log::NumChannels; ++i)
+	{
+		const auto channel = static_cast<Log::Channel> (i);
+		const String key = String("log_level_") + Log::GetChannelName(channel);
+
+		ConfigPtr->Read(key.c_str(), levelName, String());
+
+		if (Log::ParseLevel(levelName, level))
+			LogFilePtr->SetLevel(channel, level);
+		else if (!levelName.empty())
+			LOG_ERROR(Log::Channel::Main, "Config key \"%s\" has invalid level: \"%s\"", key.c_str(), levelName.c_str());
+	}
+}
+
+void Main::SetupFlightRecorder()
+{
+	U32 ringSize;
+
+	// Records per thread, 32 bytes each. (0 - not recording)
+	ConfigPtr->Read("trace_ring_size", ringSize, 16384);
+
+	if (ringSize == 0)
+		return;
+
+	FlightRecorderPtr = std::make_unique<FlightRecorder>(ringSize);
+
+	FlightRecorderPtr->SetThreadName("Main");
+}
+
+void Main::SetupFootageLatency()
+{
+	FootageLatency::Settings settings;
+
+	// Histograms are also served by the API "/latency". (0 - not logged)
+	ConfigPtr->Read("latency_log_interval_sec", settings.logIntervalSec, 300);
+	ConfigPtr->Read("latency_max_age_sec", settings.maxAgeSec, 600);
+
+	gFootageLatency.SetSettings(settings);
+}
+
+// SAMPLE: "log/20190306_121007_trace.bin"
+void Main::DumpFlightRecorder()
+{
+	if (!FlightRecorderPtr)
+	{
+		LOG_WARNING(Log::Channel::Main, "Flight recorder dump requested, but it's not recording!");
+		return;
+	}
+
+	char timeStr[16];
+	{
+		auto posixTime = time(nullptr);
+		strftime(timeStr, sizeof(timeStr), "%Y%m%d_%H%M%S", localtime(&posixTime));
+	}
+
+	const String fileName(mPathFor.log + timeStr + "_trace.bin");
+
+	if (FlightRecorderPtr->DumpToFile(fileName))
+		LOG_MESSAGE(Log::Channel::Main, "Flight recorder dumped: \"%s\"", fileName.c_str());
+	else
+		LOG_ERROR(Log::Channel::Main, "Failed to dump the flight recorder: \"%s\"", fileName.c_str());
 }
 
 void Main::SetupNotificationsManager()
 {
-	String hostname;
-	U16 port;
+	CGIManager::Settings settings;
+
+	ConfigPtr->Read("notifications_host", settings.hostname);
+	ConfigPtr->Read("norifications_port", settings.port);
+
+	if (settings.hostname.empty())	throw Exception("Config key \"notifications_host\" is missing the value!");
+	if (settings.port == 0)			throw Exception("Config key \"norifications_port\" is missing the value!");
+
+	ConfigPtr->Read("notifications_https", settings.isSecure, true);
 
-	ConfigPtr->Read("notifications_host", hostname);
-	ConfigPtr->Read("norifications_port", port);
+	// NOTE: "norifications_port" is the plain HTTP port only, HTTPS always went to 443. (Existing configs keep working)
+	if (settings.isSecure)
+		ConfigPtr->Read("notifications_https_port", settings.port, 443);
 
-	if (hostname.empty())	throw Exception("Config key \"notifications_host\" is missing the value!");
-	if (port == 0)			throw Exception("Config key \"norifications_port\" is missing the value!");
+	ConfigPtr->Read("notifications_max_connections", settings.maxConnections, 4);
+	ConfigPtr->Read("notifications_keep_alive_sec", settings.keepAliveSec, 60);
+	ConfigPtr->Read("notifications_timeout_sec", settings.requestTimeoutSec, 10);
+	ConfigPtr->Read("notifications_dns_cache_sec", settings.dnsCacheSec, 300);
 
-	CGIManagerPtr = std::make_unique<CGIManager>(hostname, port);
+	ConfigPtr->Read("notifications_coalesce_sec", settings.coalesceWindowSec, 0);
+
+	// Batched delivery: one POST with all the notifications of the window. (Empty - disabled)
+	ConfigPtr->Read("notifications_batch_path", settings.batchPath, String());
+
+	ConfigPtr->Read("notifications_batch_window_ms", settings.batchWindowMs, 200);
+	ConfigPtr->Read("notifications_batch_max", settings.maxBatchSize, 100);
+
+	ConfigPtr->Read("notifications_rate_limit", settings.rateLimitPerSec, 0);
+	ConfigPtr->Read("notifications_rate_burst", settings.rateBurst, 5);
+
+	CGIManagerPtr = std::make_unique<CGIManager>(settings);
 }
 
 void Main::SetupFootagePath()
@@ -236,15 +360,138 @@ void Main::SetupEventManager()
 
 void Main::SetupAnalytics(const Database::Info& rDBInfo)
 {
-	String serverAddres;
-	U16	serverPort;
-	U16	connectTimeoutSec;
+	Analytics::Settings settings;
+
+	// Optional: list of analytics servers "address:port,address:port,..."
+	String servers;
+	ConfigPtr->Read("analytics_servers", servers, String());
+
+	if (servers.empty())
+	{
+		Analytics::Settings::Backend backend;
+
+		ConfigPtr->Read("analytics_address", backend.address);
+		ConfigPtr->Read("analytics_port", backend.port);
+
+		settings.backends.push_back(backend);
+	}
+	else
+	{
+		// "address:port,address:port,..." ("shm@address:port" - frames are sent using the shared memory, see "SharedMemoryRing")
+		std::istringstream ss(servers);
+		String server;
+
+		while (std::getline(ss, server, ','))
+		{
+			Analytics::Settings::Backend backend;
+
+			if (server.compare(0, 4, "shm@") == 0)
+			{
+				backend.isSharedMemory = true;
+				server.erase(0, 4);
+			}
+
+			const auto pos = server.find(':');
+
+			if (pos == String::npos || !Utils::StringTo(server.c_str() + pos + 1, backend.port))
+			{
+				LOG_ERROR(Log::Channel::Main, "Config key \"analytics_servers\" has invalid server: \"%s\"", server.c_str());
+				continue;
+			}
+
+			backend.address = server.substr(0, pos);
+
+			settings.backends.push_back(backend);
+		}
+	}
+
+	ConfigPtr->Read("analytics_connect_timeout_sec", settings.connectTimeoutSec);
+
+	// Optional.
+	ConfigPtr->Read("analytics_pool_size", settings.poolSize, 2);
+	ConfigPtr->Read("analytics_pool_max_age_sec", settings.poolMaxAgeSec, 600);
+	ConfigPtr->Read("analytics_inflight_window", settings.inFlightWindow, 4);
+	ConfigPtr->Read("analytics_batch_size", settings.batchSize, 1);
+	ConfigPtr->Read("analytics_result_timeout_sec", settings.resultTimeoutSec, 30);
+	// NOTE: Opt-in, stale frames are dropped for good. (Not back-filled)
+	ConfigPtr->Read("analytics_frame_deadline_sec", settings.frameDeadlineSec, 0);
+	ConfigPtr->Read("analytics_first_frames", settings.firstFramesCount, 2);
+	ConfigPtr->Read("analytics_overload_queue_size", settings.overloadQueueSize, 200);
+	ConfigPtr->Read("analytics_overload_latency_ms", settings.overloadLatencyMs, 5000);
+	ConfigPtr->Read("analytics_decimation_n", settings.decimationN, 3);
+	ConfigPtr->Read("analytics_decimation_k", settings.decimationK, 2);
+	ConfigPtr->Read("analytics_backfill_queue_size", settings.backfillQueueSize, 10000);
+	// NOTE: Opt-in, skipped frames get no results. (A small or distant person might change no cell more than the delta)
+	ConfigPtr->Read("analytics_prefilter", settings.isPrefilter, false);
+	ConfigPtr->Read("analytics_prefilter_cell_delta", settings.prefilterCellDelta, 8);
+	ConfigPtr->Read("analytics_prefilter_max_cells", settings.prefilterMaxCells, 0);
+	ConfigPtr->Read("analytics_max_frame_width", settings.maxFrameWidth, 0);
+	ConfigPtr->Read("analytics_shm_slots", settings.shmNumSlots, 16);
+	ConfigPtr->Read("analytics_shm_slot_size", settings.shmSlotSize, 2 << 20);
+	ConfigPtr->Read("analytics_frame_cache_size", settings.frameCacheSize, 0);
+
+	{
+		// Per-camera region of interest (in percent): "cameraId:x,y,width,height;cameraId:x,y,width,height;..."
+		String regions;
+		ConfigPtr->Read("analytics_roi", regions, String());
 
-	ConfigPtr->Read("analytics_address", serverAddres);
-	ConfigPtr->Read("analytics_port", serverPort);
-	ConfigPtr->Read("analytics_connect_timeout_sec", connectTimeoutSec);
+		std::istringstream ss(regions);
+		String item;
 
-	AnalyticsPtr = std::make_unique<Analytics>(*this, rDBInfo, serverAddres, serverPort, connectTimeoutSec);
+		while (std::getline(ss, item, ';'))
+		{
+			unsigned int cameraId, x, y, width, height;
+
+			if (sscanf(item.c_str(), "%u:%u,%u,%u,%u", &cameraId, &x, &y, &width, &height) != 5 || x + width > 100 || y + height > 100 || width == 0 || height == 0)
+			{
+				LOG_ERROR(Log::Channel::Main, "Config key \"analytics_roi\" has invalid region: \"%s\"", item.c_str());
+				continue;
+			}
+
+			auto& rRegion = settings.cameraRegions[cameraId];
+
+			rRegion.x = static_cast<U8> (x);
+			rRegion.y = static_cast<U8> (y);
+			rRegion.width = static_cast<U8> (width);
+			rRegion.height = static_cast<U8> (height);
+		}
+	}
+
+	ConfigPtr->Read("analytics_binary_results", settings.isBinaryResults, false);
+
+	{
+		// Object names of the binary results, in the class id order: "person,car,..."
+		String classes;
+		ConfigPtr->Read("analytics_classes", classes, String("person"));
+
+		std::istringstream ss(classes);
+		String name;
+
+		while (std::getline(ss, name, ','))
+			settings.classNames.push_back(name);
+	}
+
+	{
+		// "newest", "nth" or "first_latest"
+		String policy;
+		ConfigPtr->Read("analytics_decimation", policy, String("newest"));
+
+		if (policy == "nth")
+			settings.decimationPolicy = Analytics::DecimationPolicy::EveryNth;
+		else if (policy == "first_latest")
+			settings.decimationPolicy = Analytics::DecimationPolicy::FirstAndLatest;
+		else if (policy == "newest")
+			settings.decimationPolicy = Analytics::DecimationPolicy::Newest;
+		else
+			LOG_ERROR(Log::Channel::Main, "Config key \"analytics_decimation\" has unknown policy: \"%s\"", policy.c_str());
+	}
+
+	if (settings.poolSize == 0)			settings.poolSize = 1;
+	if (settings.inFlightWindow == 0)	settings.inFlightWindow = 1;
+	if (settings.batchSize == 0)		settings.batchSize = 1;
+	if (settings.decimationN == 0)		settings.decimationN = 1;
+
+	AnalyticsPtr = std::make_unique<Analytics>(*this, rDBInfo, settings);
 }
 
 void Main::SetupFTPServer()
@@ -264,7 +511,15 @@ void Main::SetupFTPServer()
 		LOG_WARNING(Log::Channel::Main, "Config \"ftp_passive_soc_timeout_sec\" not set! (Using default, %u seconds)", passiveSocketTimeout);
 	}
 
-	FTPServerPtr = std::make_unique<FTPServer>(*this, passiveSocketTimeout);
+	// Byte-identical footage is hard-linked to the earlier file. (Number of the recent files remembered, 0 - disabled)
+	U32 linkCacheSize;
+	ConfigPtr->Read("ftp_link_duplicates", linkCacheSize, 0);
+
+	// Every Nth frame of the uploaded MJPEG clips is stored (and analyzed) as a separate JPEG footage. (0 - disabled)
+	U32 clipFrameStep;
+	ConfigPtr->Read("ftp_clip_frame_step", clipFrameStep, 0);
+
+	FTPServerPtr = std::make_unique<FTPServer>(*this, passiveSocketTimeout, linkCacheSize, clipFrameStep);
 
 	if (!FTPServerPtr->Start(port))
 		throw Exception("FTP server failed to start!");
@@ -279,12 +534,19 @@ void Main::SetupAPIServer()
 	if (port == 0)
 		throw Exception("Config is missing API server port!");
 
+	// Records kept for the reconnecting "/events" subscribers.
+	U32 eventHistorySize;
+	ConfigPtr->Read("api_event_history", eventHistorySize, 1000);
+
+	EventStreamPtr = std::make_unique<EventStream>(eventHistorySize);
+
 	APIServerPtr = std::make_unique<APIServer>(*this);
 
 	if (!APIServerPtr->Start(port))
 		throw Exception("API server failed to start!");
 }
 
+#if !defined(ANALYTICS_BENCHMARK) && !defined(MICRO_BENCHMARK)
 // Main application entry point.
 int main(int argc, char *argv[])
 {
@@ -302,4 +564,5 @@ int main(int argc, char *argv[])
 	}
 
 	return result;
-}
\ No newline at end of file
+}
+#endif // !ANALYTICS_BENCHMARK && !MICRO_BENCHMARK
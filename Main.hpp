@@ -3,6 +3,7 @@
 
 // Forward declarations.
 class Log;
+class FlightRecorder;
 class Config;
 class ThreadPool;
 class EventManager;
@@ -10,6 +11,7 @@ class FTPServer;
 class APIServer;
 class Analytics;
 class CGIManager;
+class EventStream;
 
 extern std::atomic_bool gIsQuitRequested;
 
@@ -17,6 +19,9 @@ namespace Database { struct Info; class Connection; }
 
 class Main
 {
+	// Sets up only the subsystems it needs. (See "Tools/AnalyticsBenchmark")
+	friend class AnalyticsBenchmark;
+
 public:
 	Main();
 	~Main();
@@ -29,10 +34,12 @@ public:
 	const String& GetPathFootage() const;
 
 	UniquePtr<Log>					LogFilePtr;
+	UniquePtr<FlightRecorder>		FlightRecorderPtr;
 	UniquePtr<Config>				ConfigPtr;
 	UniquePtr<Database::Connection>	DatabasePtr;
 	UniquePtr<ThreadPool>			ThreadPoolPtr;
 	UniquePtr<EventManager>			EventManagerPtr;
+	UniquePtr<EventStream>			EventStreamPtr; // Outlives the "Analytics", its pool workers publish the detections.
 	UniquePtr<Analytics>			AnalyticsPtr;
 	UniquePtr<FTPServer>			FTPServerPtr;
 	UniquePtr<APIServer>			APIServerPtr;
@@ -41,6 +48,9 @@ public:
 private:
 
 	void SetupLogSystem();
+	void SetupFlightRecorder();
+	void DumpFlightRecorder();
+	void SetupFootageLatency();
 	void SetupFootagePath();
 	void SetupNotificationsManager();
 	void SetupDatabaseConnection(Database::Info& rDBInfo);
@@ -54,6 +64,7 @@ private:
 	{
 		String application;
 		String footage;
+		String log;
 //		String appData;
 //		String userDocuments;
 	} mPathFor;
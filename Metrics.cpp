@@ -0,0 +1,88 @@
+#include "PCH.hpp"
+
+#include "Metrics.hpp"
+
+#include <ctype.h>	// toupper
+#include <string.h>	// strncmp
+
+Metrics gMetrics;
+
+/*
+	SAMPLE:
+	# HELP viquant_footage_received_total Footage files received by the FTP server.
+	# TYPE viquant_footage_received_total counter
+	viquant_footage_received_total 1234
+*/
+
+static void WriteMetric(std::ostringstream& ss, const char* pName, const char* pType, const char* pHelp, U64 value)
+{
+	ss	<< "# HELP " << pName << ' ' << pHelp << '\n'
+		<< "# TYPE " << pName << ' ' << pType << '\n'
+		<< pName << ' ' << value << '\n';
+}
+
+static void WriteStatementMetric(std::ostringstream& ss, const char* pName, const char* pHelp, const std::atomic<U64>* pValues)
+{
+	static const char* statementNames[Metrics::NumStatements] = { "select", "insert", "update", "delete", "other" };
+
+	ss	<< "# HELP " << pName << ' ' << pHelp << '\n'
+		<< "# TYPE " << pName << " counter\n";
+
+	for (size_t i = 0; i < Metrics::NumStatements; ++i)
+		ss << pName << "{type=\"" << statementNames[i] << "\"} " << pValues[i].load(std::memory_order_relaxed) << '\n';
+}
+
+Metrics::Statement Metrics::GetStatement(const String& rQuery)
+{
+	const size_t start = rQuery.find_first_not_of(" \t\r\n(");
+
+	if (start == String::npos)
+		return Statement::Other;
+
+	char keyword[8] = {};
+
+	for (size_t i = 0; i < sizeof(keyword) - 1 && start + i < rQuery.size(); ++i)
+		keyword[i] = static_cast<char> (toupper(static_cast<unsigned char> (rQuery[start + i])));
+
+	if (strncmp(keyword, "SELECT", 6) == 0)	return Statement::Select;
+	if (strncmp(keyword, "INSERT", 6) == 0)	return Statement::Insert;
+	if (strncmp(keyword, "UPDATE", 6) == 0)	return Statement::Update;
+	if (strncmp(keyword, "DELETE", 6) == 0)	return Statement::Delete;
+
+	return Statement::Other;
+}
+
+String Metrics::Format() const
+{
+	std::ostringstream ss;
+
+	auto Get = [](const std::atomic<U64>& rValue) { return rValue.load(std::memory_order_relaxed); };
+
+	WriteMetric(ss, "viquant_ftp_clients", "gauge", "Connected FTP clients.", Get(numFTPClients));
+	WriteMetric(ss, "viquant_footage_received_total", "counter", "Footage files received by the FTP server.", Get(numFootage));
+	WriteMetric(ss, "viquant_footage_received_bytes_total", "counter", "Bytes of the received footage.", Get(footageBytes));
+
+	WriteMetric(ss, "viquant_event_sessions", "gauge", "Active event sessions.", Get(numEventSessions));
+
+	WriteMetric(ss, "viquant_pool_queue_depth", "gauge", "Thread pool tasks waiting for the worker.", Get(poolQueueDepth));
+	WriteMetric(ss, "viquant_pool_tasks_total", "counter", "Thread pool tasks started.", Get(poolTasks));
+	WriteMetric(ss, "viquant_pool_wait_microseconds_total", "counter", "Time the started tasks spent in the queue.", Get(poolWaitUs));
+
+	WriteStatementMetric(ss, "viquant_db_statements_total", "Database statements executed.", dbStatements);
+	WriteStatementMetric(ss, "viquant_db_failures_total", "Database statements failed.", dbFailures);
+	WriteStatementMetric(ss, "viquant_db_latency_microseconds_total", "Time spent executing the database statements.", dbLatencyUs);
+
+	WriteMetric(ss, "viquant_analytics_in_flight", "gauge", "Frames sent to the analytics servers, waiting for the results.", Get(analyticsInFlight));
+	WriteMetric(ss, "viquant_analytics_queue_depth", "gauge", "Frames of the active events waiting to be sent.", Get(analyticsQueueDepth));
+	WriteMetric(ss, "viquant_analytics_backfill_depth", "gauge", "Decimated frames waiting to be back-filled.", Get(analyticsBackfillDepth));
+	WriteMetric(ss, "viquant_analytics_results_total", "counter", "Analytics results received.", Get(analyticsResults));
+	WriteMetric(ss, "viquant_analytics_latency_milliseconds_total", "counter", "Time from sending the frames until their results.", Get(analyticsLatencyMs));
+
+	WriteMetric(ss, "viquant_cgi_queue_depth", "gauge", "CGI requests and the batched notifications waiting to be sent.", Get(cgiQueueDepth));
+
+	WriteMetric(ss, "viquant_log_queue_depth", "gauge", "Log records waiting for the log thread.", Get(logQueueDepth));
+
+	gFootageLatency.FormatMetrics(ss);
+
+	return ss.str();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+// Counters and gauges of all the subsystems, served by the API "/metrics". (Prometheus text format)
+// Updated on the hot path, so only the relaxed atomics. (Sums and counts, the averages are left to the Prometheus)
+// THREAD: Any thread.
+class Metrics
+{
+public:
+	// Database statements, by the first keyword. (See "Database::Query::Exec")
+	enum class Statement
+	{
+		Select,
+		Insert,
+		Update,
+		Delete,
+		Other
+	};
+
+	static constexpr size_t NumStatements = static_cast<size_t> (Statement::Other) + 1;
+
+	static Statement GetStatement(const String& rQuery);
+
+	inline static void Add(std::atomic<U64>& rCounter, U64 value = 1)
+	{
+		rCounter.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	inline static void Set(std::atomic<U64>& rGauge, U64 value)
+	{
+		rGauge.store(value, std::memory_order_relaxed);
+	}
+
+	String Format() const;
+
+	// FTP.
+	std::atomic<U64> numFTPClients{ 0 };		// Gauge.
+	std::atomic<U64> numFootage{ 0 };
+	std::atomic<U64> footageBytes{ 0 };
+
+	// Events.
+	std::atomic<U64> numEventSessions{ 0 };	// Gauge.
+
+	// Thread pool.
+	std::atomic<U64> poolQueueDepth{ 0 };		// Gauge.
+	std::atomic<U64> poolTasks{ 0 };
+	std::atomic<U64> poolWaitUs{ 0 };			// Queued until started, of the "poolTasks".
+
+	// Database.
+	std::atomic<U64> dbStatements[NumStatements] = {};
+	std::atomic<U64> dbFailures[NumStatements] = {};
+	std::atomic<U64> dbLatencyUs[NumStatements] = {};
+
+	// Analytics.
+	std::atomic<U64> analyticsInFlight{ 0 };	// Gauge.
+	std::atomic<U64> analyticsQueueDepth{ 0 };	// Gauge.
+	std::atomic<U64> analyticsBackfillDepth{ 0 };// Gauge.
+	std::atomic<U64> analyticsResults{ 0 };
+	std::atomic<U64> analyticsLatencyMs{ 0 };	// Sent until the result, of the "analyticsResults".
+
+	// CGI.
+	std::atomic<U64> cgiQueueDepth{ 0 };		// Gauge. (Pending requests and the batched notifications)
+
+	// Log.
+	std::atomic<U64> logQueueDepth{ 0 };		// Gauge.
+};
+
+extern Metrics gMetrics;
@@ -15,6 +15,8 @@
 #include <algorithm>
 #include <utility>
 #include <queue>
+#include <deque>
+#include <list>
 #include <mutex>
 #include <iostream> // std::cout
 #include <condition_variable>
@@ -32,3 +34,6 @@
 
 #include "Exception.hpp"
 #include "Log/Log.hpp"
+#include "Log/FlightRecorder.hpp"
+#include "Metrics.hpp"
+#include "FootageLatency.hpp"
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <string.h>	// memcpy
+
+// Byte ring buffer for the incrementally received socket data.
+// Data is written directly into the free space ("GetWriteArea" + "Commit") and consumed from the front,
+// so the partial messages stay in place until the rest of them arrive.
+// Capacity is always a power of two, it's only increased. (When full, or for the message larger than the buffer)
+// THREAD: Not thread-safe, owned by a single connection.
+class RingBuffer
+{
+public:
+	explicit RingBuffer(size_t capacity = 4096)
+	{
+		Reserve(capacity);
+	}
+
+	size_t GetSize() const { return mTail - mHead; }
+	size_t GetCapacity() const { return mData.size(); }
+
+	void Clear()
+	{
+		mHead = 0;
+		mTail = 0;
+	}
+
+	// Makes sure "size" bytes fit into the buffer.
+	void Reserve(size_t size)
+	{
+		if (size <= mData.size())
+			return;
+
+		size_t capacity = mData.empty() ? 1024 : mData.size();
+
+		while (capacity < size)
+			capacity *= 2;
+
+		// Data is moved to the beginning of the new buffer.
+		Vector<char> data(capacity);
+
+		const size_t size0 = GetSize();
+
+		if (size0 != 0)
+			Peek(0, data.data(), size0);
+
+		mData.swap(data);
+		mHead = 0;
+		mTail = size0;
+	}
+
+	// Returns the contiguous free space after the data. (Never zero, the buffer is grown when full)
+	char* GetWriteArea(size_t& rSize)
+	{
+		if (GetSize() == mData.size())
+			Reserve(mData.size() * 2);
+
+		const size_t mask = mData.size() - 1;
+		const size_t tail = mTail & mask;
+		const size_t head = mHead & mask;
+
+		rSize = (tail >= head) ? mData.size() - tail : head - tail;
+
+		return mData.data() + tail;
+	}
+
+	// Adds the bytes written to the "GetWriteArea".
+	void Commit(size_t size)
+	{
+		mTail += size;
+	}
+
+	// Copies the bytes starting at the "offset" (from the front) without consuming them.
+	void Peek(size_t offset, void* pDestination, size_t size) const
+	{
+		const size_t mask = mData.size() - 1;
+		const size_t start = (mHead + offset) & mask;
+		const size_t size0 = std::min(size, mData.size() - start);
+
+		memcpy(pDestination, mData.data() + start, size0);
+		memcpy(static_cast<char*> (pDestination) + size0, mData.data(), size - size0);
+	}
+
+	// Returns the first "size" bytes as a contiguous memory.
+	// NOTE: Data that wraps around is copied, the pointer is valid until the buffer is modified.
+	const char* GetContiguous(size_t size)
+	{
+		const size_t start = mHead & (mData.size() - 1);
+
+		if (start + size <= mData.size())
+			return mData.data() + start;
+
+		mScratch.resize(size);
+		Peek(0, mScratch.data(), size);
+
+		return mScratch.data();
+	}
+
+	void Consume(size_t size)
+	{
+		mHead += size;
+
+		// Empty buffer starts from the beginning again, so the next message is less likely to wrap around.
+		if (mHead == mTail)
+			Clear();
+	}
+
+private:
+
+	Vector<char> mData;
+	Vector<char> mScratch; // Wrapped messages. (See "GetContiguous")
+
+	// Positions only grow, they are masked when accessing the data.
+	size_t mHead = 0;
+	size_t mTail = 0;
+};
@@ -261,6 +261,40 @@ namespace Socket
 		}
 	}
 
+	void Read(SocketId socketId, const std::function<void(const char* pData, size_t size)>& rHandler)
+	{
+		char buffer[64 * 1024];
+
+		for (;;)
+		{
+			ssize_t bytesReceived = recv(socketId, buffer, sizeof(buffer), 0);
+
+			if (bytesReceived == 0)
+				break; // No more data.
+
+			if (bytesReceived == SOCKET_ERROR)
+			{
+				int errorCode = Socket::GetErrorCode();
+
+				// Can occur when dealing with the non-blocking socket.
+#if PLATFORM_WINDOWS
+				if (errorCode == WSAEWOULDBLOCK) // 10035
+#else
+				if (errorCode == EWOULDBLOCK) // "Resource temporarily unavailable", code: 11
+#endif
+				{
+					std::this_thread::yield();
+					continue;
+				}
+
+				LOG_ERROR(Log::Channel::Main, "Failed for \"recv\"! (Error: %s, Code: %d)", Socket::GetErrorString(errorCode), errorCode);
+				return;
+			}
+
+			rHandler(buffer, static_cast<size_t> (bytesReceived));
+		}
+	}
+
 	void SetReusable(SocketId socketId)
 	{
 		int enable = 1;
@@ -275,6 +309,21 @@ namespace Socket
 		}
 	}
 
+	// Lets the OS detect the dead peer on the otherwise idle (long living) connection.
+	void SetKeepAlive(SocketId socketId)
+	{
+		int enable = 1;
+#if PLATFORM_WINDOWS
+		if (setsockopt(socketId, SOL_SOCKET, SO_KEEPALIVE, (char*)&enable, sizeof(enable)) < 0)
+#else
+		if (setsockopt(socketId, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable)) < 0)
+#endif
+		{
+			int errorCode = Socket::GetErrorCode();
+			throw ExceptionVA("Failed for \"setsockopt(SO_KEEPALIVE)\"! (Error: %s, Code: %d)", Socket::GetErrorString(errorCode), errorCode);
+		}
+	}
+
 	// Make socket the "non-blocking".
 	void SetNonBlocking(SocketId socketId)
 	{
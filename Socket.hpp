@@ -1,6 +1,8 @@
 
 #pragma once
 
+#include <functional>
+
 namespace Socket
 {
 	SocketId CreateServer(U16& rPort, int maxConnectionsQuery, bool isBlocking = false);
@@ -18,7 +20,11 @@ namespace Socket
 	bool Read(SocketId socketId, char* pBuffer, const size_t bufferSize);
 	void Read(SocketId socketId, Vector<char>& rDataBuffer);
 
+	// Hands the data to the "rHandler" as it's received, until the socket is closed. (Large files are not kept in memory)
+	void Read(SocketId socketId, const std::function<void(const char* pData, size_t size)>& rHandler);
+
 	void SetReusable(SocketId socketId);
+	void SetKeepAlive(SocketId socketId);
 	void SetNonBlocking(SocketId socketId);
 	bool IsBlocking(SocketId socketId);
 
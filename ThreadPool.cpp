@@ -29,11 +29,14 @@ void ThreadPool::initializeWithThreads(size_t numThreads)
 {
 	for (size_t i = 0; i < numThreads; ++i)
 	{
-		mThreads.emplace_back([this]
+		mThreads.emplace_back([this, i]
 		{
+			if (gpFlightRecorder)
+				gpFlightRecorder->SetThreadName(("Pool " + std::to_string(i)).c_str());
+
 			for (;;)
 			{
-				std::function<void()> task;
+				Task task;
 				{
 					std::unique_lock<std::mutex> lock(mTaskLock);
 
@@ -45,9 +48,14 @@ void ThreadPool::initializeWithThreads(size_t numThreads)
 					task = std::move(mTasks.front());
 
 					mTasks.pop();
+
+					Metrics::Set(gMetrics.poolQueueDepth, mTasks.size());
 				}
-				
-				task();
+
+				Metrics::Add(gMetrics.poolTasks);
+				Metrics::Add(gMetrics.poolWaitUs, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - task.queuedTP).count());
+
+				task.function();
 
 				mNumTasks--;
 			}
@@ -72,8 +72,10 @@ public:
 		{
 			std::unique_lock<std::mutex> lock(mTaskLock);
 
-			mTasks.emplace([taskPtr]() { (*taskPtr)(); });
+			mTasks.push({ [taskPtr]() { (*taskPtr)(); }, std::chrono::steady_clock::now() });
 //			mTasks.emplace(wrapper_func);
+
+			Metrics::Set(gMetrics.poolQueueDepth, mTasks.size());
 		}
 
 		mNumTasks++;
@@ -87,7 +89,13 @@ private:
 
 	Vector<std::thread>		mThreads;
 
-	std::queue<std::function<void()>>	mTasks;
+	struct Task
+	{
+		std::function<void()>	function;
+		TimePoint				queuedTP; // Queue wait. (See "Metrics::poolWaitUs")
+	};
+
+	std::queue<Task>		mTasks;
 	std::mutex							mTaskLock;
 
 	std::condition_variable	mCondition;
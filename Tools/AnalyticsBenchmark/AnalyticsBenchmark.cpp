@@ -0,0 +1,226 @@
+#include <PCH.hpp>
+
+#include "Main.hpp"
+#include "Config.hpp"
+#include "ThreadPool.hpp"
+
+#include "Database/Database.hpp"
+
+#include "Analytics/Analytics.hpp"
+
+#include "CGI/CGIManager.hpp"
+
+/*
+	End-to-end analytics latency: every frame is a separate event (so a detection doesn't stop the other frames),
+	the latency is measured from "Analytics::AddFootage" until the results are written to the Database
+	and until the user notification is queued. (See "Analytics::TakeLatencySamples")
+
+	"Server.conf" next to the executable is used, as is:
+	- "analytics_servers" should point to the "MockAnalytics" (or the real analytics server),
+	- "db_*" should point to the test Database, results are written there.
+	"notifications_*" are NOT used: the notifications go to a local sink (nothing listens there), so the real users
+	are never notified. The latency is measured only until "CGIManager::AddNotification".
+
+	Usage: AnalyticsBenchmark <frame.jpg> [numFrames] [framesPerSec] [numCameras]
+	(framesPerSec 0 - all the frames are queued at once)
+*/
+
+// Benchmark events don't collide with the real ones. (Footage directory and the Database rows)
+constexpr EventId BaseEventId = 900000000;
+
+// Notifications sink. (Discard port, the connections are refused)
+constexpr const char* NotificationsHost = "127.0.0.1";
+constexpr U16 NotificationsPort = 9;
+
+// Gives up when no results arrive for this long.
+constexpr int IdleTimeoutSec = 30;
+
+static U32 GetPercentile(const Vector<U32>& rSorted, double percentile)
+{
+	if (rSorted.empty())
+		return 0;
+
+	const auto index = static_cast<size_t> (percentile * static_cast<double> (rSorted.size()));
+
+	return rSorted.at(std::min(index, rSorted.size() - 1));
+}
+
+class AnalyticsBenchmark
+{
+public:
+	struct Settings
+	{
+		String	framePath;
+		U32		numFrames = 1000;
+		U32		framesPerSec = 0;
+		U32		numCameras = 16;
+	};
+
+	explicit AnalyticsBenchmark(const Settings& rSettings)
+		: mSettings(rSettings)
+	{ }
+
+	int Run();
+
+private:
+
+	void Setup();
+	String CopyFrame();
+
+	void Report(double seconds, Vector<U32>& rResultUs, Vector<U32>& rNotifyUs) const;
+
+	const Settings mSettings;
+
+	Main mApp;
+};
+
+// Only the subsystems used by the Analytics are set up. (No FTP, API or event manager)
+void AnalyticsBenchmark::Setup()
+{
+	mApp.ConfigPtr = std::make_unique<Config>(mApp.GetPathApplication() + "Server.conf");
+
+	mApp.SetupLogSystem();
+	mApp.SetupFootagePath();
+
+	CGIManager::Settings notifications;
+
+	notifications.hostname = NotificationsHost;
+	notifications.port = NotificationsPort;
+	notifications.isSecure = false;
+
+	mApp.CGIManagerPtr = std::make_unique<CGIManager>(notifications);
+
+	Database::Info dbInfo;
+
+	mApp.SetupDatabaseConnection(dbInfo);
+	mApp.SetupThreadPool();
+	mApp.SetupAnalytics(dbInfo);
+
+	mApp.AnalyticsPtr->EnableLatencyRecording();
+}
+
+// Frame is copied to the footage directory once, all the events use the same file.
+String AnalyticsBenchmark::CopyFrame()
+{
+	const String footagePath = mApp.CreateFootagePath(BaseEventId, 0, 0, 0);
+
+	std::ifstream input(mSettings.framePath, std::ios::in | std::ifstream::binary);
+
+	if (!input.is_open())
+		throw ExceptionVA("Failed to open: \"%s\".", mSettings.framePath.c_str());
+
+	std::ofstream output(footagePath + "benchmark.jpg", std::ios::out | std::ofstream::binary);
+
+	output << input.rdbuf();
+
+	if (!output)
+		throw ExceptionVA("Failed to write: \"%sbenchmark.jpg\".", footagePath.c_str());
+
+	return footagePath;
+}
+
+int AnalyticsBenchmark::Run()
+{
+	Setup();
+
+	const String footagePath = CopyFrame();
+
+	auto& rAnalytics = *mApp.AnalyticsPtr;
+
+	// Pool connections are made in the background, the first frames should not wait for them.
+	std::this_thread::sleep_for(std::chrono::seconds(2));
+
+	printf("Queuing %u frames (%u cameras, %u frames/s)...\n", mSettings.numFrames, mSettings.numCameras, mSettings.framesPerSec);
+
+	const auto startTP = std::chrono::steady_clock::now();
+
+	Vector<U32> resultUs;
+	Vector<U32> notifyUs;
+
+	auto lastResultTP = startTP;
+
+	for (U32 i = 0; i < mSettings.numFrames; ++i)
+	{
+		if (mSettings.framesPerSec != 0)
+			std::this_thread::sleep_until(startTP + std::chrono::microseconds(static_cast<U64> (i) * 1000000 / mSettings.framesPerSec));
+
+		const EventId eventId = BaseEventId + i;
+
+		rAnalytics.AddEvent(eventId, 1 + i % mSettings.numCameras, 50, footagePath);
+		rAnalytics.AddFootage(eventId, eventId, "benchmark.jpg", JPEG::Signature(), 0);
+		rAnalytics.EndEvent(eventId);
+	}
+
+	while (resultUs.size() < mSettings.numFrames && !gIsQuitRequested)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		const auto numResults = resultUs.size();
+
+		rAnalytics.TakeLatencySamples(resultUs, notifyUs);
+
+		const auto currentTP = std::chrono::steady_clock::now();
+
+		if (resultUs.size() != numResults)
+			lastResultTP = currentTP;
+		else if (currentTP - lastResultTP > std::chrono::seconds(IdleTimeoutSec))
+		{
+			printf("No results for %d seconds, giving up.\n", IdleTimeoutSec);
+			break;
+		}
+	}
+
+	const double seconds = std::chrono::duration<double>(lastResultTP - startTP).count();
+
+	Report(seconds, resultUs, notifyUs);
+
+	return (resultUs.size() == mSettings.numFrames) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void AnalyticsBenchmark::Report(double seconds, Vector<U32>& rResultUs, Vector<U32>& rNotifyUs) const
+{
+	std::sort(rResultUs.begin(), rResultUs.end());
+	std::sort(rNotifyUs.begin(), rNotifyUs.end());
+
+	printf("Frames: %u, results: %zu, notifications: %zu, time: %.2f s, throughput: %.1f frames/s\n",
+		mSettings.numFrames, rResultUs.size(), rNotifyUs.size(), seconds, (seconds > 0.0) ? static_cast<double> (rResultUs.size()) / seconds : 0.0);
+
+	printf("AddFootage -> DB written:   p50: %.2f ms, p99: %.2f ms, max: %.2f ms\n",
+		GetPercentile(rResultUs, 0.50) / 1000.0, GetPercentile(rResultUs, 0.99) / 1000.0, GetPercentile(rResultUs, 1.0) / 1000.0);
+
+	printf("AddFootage -> CGI notified: p50: %.2f ms, p99: %.2f ms, max: %.2f ms\n",
+		GetPercentile(rNotifyUs, 0.50) / 1000.0, GetPercentile(rNotifyUs, 0.99) / 1000.0, GetPercentile(rNotifyUs, 1.0) / 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <frame.jpg> [numFrames] [framesPerSec] [numCameras]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	AnalyticsBenchmark::Settings settings;
+
+	settings.framePath = argv[1];
+
+	if (argc > 2) settings.numFrames = static_cast<U32> (atoi(argv[2]));
+	if (argc > 3) settings.framesPerSec = static_cast<U32> (atoi(argv[3]));
+	if (argc > 4) settings.numCameras = static_cast<U32> (atoi(argv[4]));
+
+	if (settings.numCameras == 0)
+		settings.numCameras = 1;
+
+	try
+	{
+		AnalyticsBenchmark benchmark(settings);
+
+		return benchmark.Run();
+	}
+	catch (const Exception& e)
+	{
+		printf("ERROR: %s\n", e.GetText());
+	}
+
+	return EXIT_FAILURE;
+}
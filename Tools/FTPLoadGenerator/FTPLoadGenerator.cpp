@@ -0,0 +1,885 @@
+// Camera fleet for the FTP server, every camera is a thread speaking the FTP dialect of a device we support:
+// "hikvision"		- USER, PASS, TYPE I, then PASV and STOR for every frame. ("192.168.0.64_01_20190319093422939_MOTION_DETECTION.jpg")
+// "hikvision-port"	- Same, but the ACTIVE mode. (PORT, the server connects to the camera)
+// "panasonic"		- BL-C cameras: MODE S and STRU F after the login, every frame is renamed (RNFR, RNTO) after STOR,
+//					  the previous frame is deleted (DELE) and the transfer aborted (ABOR) before QUIT.
+// "mobotix"		- PASV, the file names without the timestamp. ("mx16bd8d00.jpg", see "GetFootageTimestamp")
+//
+// Camera sends "burst" frames (one FTP connection, "rate" frames per second) every event,
+// the events are "interval" seconds apart on average. (Exponentially distributed, like the independent motion events)
+// Frames are JPEG (SOI, comments, EOI) of "size" +- "jitter" KB, unique per camera and frame. (Not linked as the duplicates)
+//
+// Server replies to every command before reading the next one (see "FTPServer::HandleClients"), so the commands are sent one at a time.
+// Cameras authenticate as "user" / "password", "{id}" in them is replaced with the camera number. (1 - cameras)
+//
+// Phases, in microseconds:
+// Connect	- TCP connect until the "220" welcome.
+// Login	- USER until the "230". (PASS is checked against the database, once per event session)
+// Open		- PASV / PORT until the reply. (Every frame)
+// Stor		- STOR until the "150".
+// Data		- Data connection connected (PASV) or accepted (PORT), frame sent and the connection closed.
+// Frame	- Open until the "226". (Including the Panasonic RNFR / RNTO)
+// Session	- Connect until the "221" after QUIT.
+//
+// Usage: FTPLoadGenerator [-a address] [-p port] [-c cameras] [-d dialect,...] [-u user] [-w password] [-s sizeKB] [-j jitterKB]
+//                         [-r rate] [-b burst] [-i intervalSec] [-R rampSec] [-t durationSec] [-T timeoutSec]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <poll.h>
+
+namespace
+{
+	typedef uint8_t		U8;
+	typedef uint16_t	U16;
+	typedef uint32_t	U32;
+	typedef uint64_t	U64;
+
+	typedef std::chrono::steady_clock::time_point TimePoint;
+
+	enum class Dialect : U8
+	{
+		HikVision,
+		HikVisionPort,
+		Panasonic,
+		Mobotix
+	};
+
+	const char* DialectNames[] = { "hikvision", "hikvision-port", "panasonic", "mobotix" };
+
+	enum class Phase : U8
+	{
+		Connect,
+		Login,
+		Open,
+		Stor,
+		Data,
+		Frame,
+		Session
+	};
+
+	constexpr size_t NumPhases = static_cast<size_t> (Phase::Session) + 1;
+
+	const char* PhaseNames[NumPhases] = { "connect", "login", "open", "stor", "data", "frame", "session" };
+
+	struct Settings
+	{
+		std::string address = "127.0.0.1";
+		U16		port = 21;
+		U32		numCameras = 100;
+		std::vector<Dialect> dialects = { Dialect::HikVision }; // Assigned to the cameras in turn.
+		std::string user = "camera{id}";
+		std::string password = "camera{id}";
+		U32		sizeKB = 200;		// Frame size.
+		U32		jitterKB = 50;		// Frame size +- this, uniformly distributed.
+		double	rate = 2.0;			// Frames per second within the burst. (0 - as fast as possible)
+		U32		burst = 5;			// Frames per connection.
+		double	intervalSec = 30.0;	// Average time between the bursts. (0 - back to back)
+		double	rampSec = 10.0;		// Cameras are started evenly within this time.
+		U32		durationSec = 60;	// 0 - until interrupted.
+		U32		timeoutSec = 10;	// Of every reply and the data connection.
+	};
+
+	Settings gSettings;
+
+	std::atomic_bool gIsStopRequested{ false };
+
+	// Same buckets as the server's "LatencyHistogram": linear within each power of two, 32 per power. (Microseconds)
+	class Histogram
+	{
+	public:
+		static constexpr U32 SubBucketBits = 5;
+		static constexpr U64 SubBuckets = U64(1) << SubBucketBits;
+		static constexpr U32 MaxValueBits = 37;
+		static constexpr size_t NumBuckets = static_cast<size_t> ((MaxValueBits - SubBucketBits + 1) * SubBuckets);
+
+		void Record(U64 valueUs)
+		{
+			mBuckets[GetBucket(valueUs)].fetch_add(1, std::memory_order_relaxed);
+
+			mCount.fetch_add(1, std::memory_order_relaxed);
+			mSum.fetch_add(valueUs, std::memory_order_relaxed);
+
+			U64 maxUs = mMax.load(std::memory_order_relaxed);
+
+			while (valueUs > maxUs && !mMax.compare_exchange_weak(maxUs, valueUs, std::memory_order_relaxed))
+				;
+		}
+
+		U64 GetCount() const	{ return mCount.load(std::memory_order_relaxed); }
+		U64 GetSum() const		{ return mSum.load(std::memory_order_relaxed); }
+		U64 GetMax() const		{ return mMax.load(std::memory_order_relaxed); }
+
+		// Highest value of the bucket the percentile (0 - 100) falls into.
+		U64 GetPercentile(double percentile) const
+		{
+			U64 total = 0;
+
+			for (size_t i = 0; i < NumBuckets; ++i)
+				total += mBuckets[i].load(std::memory_order_relaxed);
+
+			if (total == 0)
+				return 0;
+
+			const U64 rank = std::max<U64>(1, static_cast<U64> (static_cast<double> (total) * percentile / 100.0 + 0.5));
+
+			U64 count = 0;
+
+			for (size_t i = 0; i < NumBuckets; ++i)
+			{
+				count += mBuckets[i].load(std::memory_order_relaxed);
+
+				if (count >= rank)
+					return std::min(GetBucketHighest(i), GetMax());
+			}
+
+			return GetMax();
+		}
+
+	private:
+
+		static size_t GetBucket(U64 value)
+		{
+			const U64 maxValue = (U64(1) << MaxValueBits) - 1;
+
+			if (value > maxValue)
+				value = maxValue;
+
+			if (value < SubBuckets * 2)
+				return static_cast<size_t> (value);
+
+			U32 topBit = 0;
+
+			while (value >> (topBit + 1))
+				topBit++;
+
+			const U32 shift = topBit - SubBucketBits;
+
+			return static_cast<size_t> (shift * SubBuckets + (value >> shift));
+		}
+
+		static U64 GetBucketHighest(size_t bucket)
+		{
+			if (bucket < SubBuckets * 2)
+				return bucket;
+
+			const U32 shift = static_cast<U32> (bucket / SubBuckets) - 1;
+			const U64 subBucket = bucket - shift * SubBuckets;
+
+			return ((subBucket + 1) << shift) - 1;
+		}
+
+		std::atomic<U64> mBuckets[NumBuckets] = {};
+		std::atomic<U64> mCount{ 0 };
+		std::atomic<U64> mSum{ 0 };
+		std::atomic<U64> mMax{ 0 };
+	};
+
+	Histogram gHistograms[NumPhases];
+
+	std::atomic<U64> gNumConnections{ 0 };
+	std::atomic<U64> gNumFrames{ 0 };
+	std::atomic<U64> gNumBytes{ 0 };
+	std::atomic<U64> gNumFailures{ 0 };
+
+	void Record(Phase phase, std::chrono::steady_clock::duration duration)
+	{
+		const auto us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+
+		gHistograms[static_cast<size_t> (phase)].Record(us > 0 ? static_cast<U64> (us) : 0);
+	}
+
+	// "{id}" replaced with the camera number.
+	std::string FormatCredential(std::string text, U32 cameraNumber)
+	{
+		const std::string id(std::to_string(cameraNumber));
+
+		for (size_t pos = text.find("{id}"); pos != std::string::npos; pos = text.find("{id}", pos + id.size()))
+			text.replace(pos, 4, id);
+
+		return text;
+	}
+
+	// "20190319093422939" (Local time, with the milliseconds)
+	std::string FormatTimestamp()
+	{
+		timeval tv;
+		gettimeofday(&tv, nullptr);
+
+		tm localTime;
+		localtime_r(&tv.tv_sec, &localTime);
+
+		char text[80];
+		snprintf(text, sizeof(text), "%04d%02d%02d%02d%02d%02d%03d", localTime.tm_year + 1900, localTime.tm_mon + 1, localTime.tm_mday,
+			localTime.tm_hour, localTime.tm_min, localTime.tm_sec, static_cast<int> (tv.tv_usec / 1000));
+
+		return text;
+	}
+
+	std::string CreateFileName(Dialect dialect, U32 cameraNumber, U32 frameCounter)
+	{
+		char text[96];
+
+		switch (dialect)
+		{
+		case Dialect::HikVision:
+		case Dialect::HikVisionPort:
+			snprintf(text, sizeof(text), "10.%u.%u.%u_01_%s_MOTION_DETECTION.jpg", (cameraNumber >> 16) & 0xff, (cameraNumber >> 8) & 0xff, cameraNumber & 0xff, FormatTimestamp().c_str());
+			break;
+
+		case Dialect::Panasonic:
+			snprintf(text, sizeof(text), "BLC140_%u_%s.jpg", cameraNumber, FormatTimestamp().c_str());
+			break;
+
+		case Dialect::Mobotix:
+			snprintf(text, sizeof(text), "mx%08x.jpg", (cameraNumber << 16) ^ frameCounter);
+			break;
+		}
+
+		return text;
+	}
+
+	// SOI, comment segments up to the size, EOI. Camera number and the frame counter are in the first comment.
+	void CreateFrame(std::vector<char>& rFrame, size_t size, U32 cameraNumber, U32 frameCounter)
+	{
+		size = std::max<size_t>(size, 64);
+
+		rFrame.assign(size, '.');
+
+		rFrame[0] = static_cast<char> (0xFF);
+		rFrame[1] = static_cast<char> (0xD8);
+
+		size_t offset = 2;
+
+		while (offset + 4 < size - 2)
+		{
+			const size_t length = std::min<size_t>(size - 2 - offset - 2, 0xFFFF);
+
+			if (length < 2)
+				break;
+
+			rFrame[offset + 0] = static_cast<char> (0xFF);
+			rFrame[offset + 1] = static_cast<char> (0xFE);
+			rFrame[offset + 2] = static_cast<char> (length >> 8);
+			rFrame[offset + 3] = static_cast<char> (length & 0xFF);
+
+			if (offset == 2)
+				snprintf(&rFrame[offset + 4], std::min<size_t>(length - 2, 32), "%u:%u", cameraNumber, frameCounter);
+
+			offset += 2 + length;
+		}
+
+		rFrame[size - 2] = static_cast<char> (0xFF);
+		rFrame[size - 1] = static_cast<char> (0xD9);
+	}
+
+	// Control connection. Replies are read line by line. (The "150" and "226" might come in one packet)
+	class Connection
+	{
+	public:
+		~Connection()
+		{
+			if (mSocketId != -1)
+				close(mSocketId);
+		}
+
+		void Connect(const sockaddr_in& rAddr)
+		{
+			if ((mSocketId = CreateSocket()) == -1)
+				throw "Failed for \"socket\"";
+
+			if (connect(mSocketId, reinterpret_cast<const sockaddr*> (&rAddr), sizeof(rAddr)) == -1)
+				throw "Failed to connect";
+		}
+
+		int GetSocketId() const { return mSocketId; }
+
+		void SendCommand(const std::string& rCommand)
+		{
+			const std::string line(rCommand + "\r\n");
+
+			if (send(mSocketId, line.data(), line.size(), MSG_NOSIGNAL) != static_cast<ssize_t> (line.size()))
+				throw "Failed to send the command";
+		}
+
+		// Reply code, throws if it's not the expected one.
+		int ReadReply(int expectedCode, std::string* pText = nullptr)
+		{
+			size_t end;
+
+			while ((end = mPending.find("\r\n")) == std::string::npos)
+			{
+				char buffer[512];
+
+				const ssize_t bytesReceived = recv(mSocketId, buffer, sizeof(buffer), 0);
+
+				if (bytesReceived == 0)
+					throw "Connection closed by the server";
+
+				if (bytesReceived < 0)
+				{
+					if (errno == EINTR)
+						continue;
+
+					throw errno == EAGAIN ? "Reply timeout" : "Failed to read the reply";
+				}
+
+				mPending.append(buffer, static_cast<size_t> (bytesReceived));
+			}
+
+			const std::string line(mPending, 0, end);
+
+			mPending.erase(0, end + 2);
+
+			const int code = atoi(line.c_str());
+
+			if (code != expectedCode)
+				throw "Unexpected reply";
+
+			if (pText != nullptr)
+				*pText = line;
+
+			return code;
+		}
+
+		int Command(const std::string& rCommand, int expectedCode, std::string* pText = nullptr)
+		{
+			SendCommand(rCommand);
+
+			return ReadReply(expectedCode, pText);
+		}
+
+		static int CreateSocket()
+		{
+			const int socketId = socket(AF_INET, SOCK_STREAM, 0);
+
+			if (socketId == -1)
+				return -1;
+
+			timeval timeout{ static_cast<time_t> (gSettings.timeoutSec), 0 };
+
+			setsockopt(socketId, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+			setsockopt(socketId, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+			const int isOn = 1;
+			setsockopt(socketId, IPPROTO_TCP, TCP_NODELAY, &isOn, sizeof(isOn));
+
+			return socketId;
+		}
+
+	private:
+
+		int			mSocketId = -1;
+		std::string mPending;
+	};
+
+	// Closes the socket when leaving the scope.
+	struct SocketGuard
+	{
+		int socketId = -1;
+
+		~SocketGuard()
+		{
+			if (socketId != -1)
+				close(socketId);
+		}
+	};
+
+	void SendAll(int socketId, const char* pData, size_t size)
+	{
+		while (size > 0)
+		{
+			const ssize_t bytesSent = send(socketId, pData, size, MSG_NOSIGNAL);
+
+			if (bytesSent < 0)
+			{
+				if (errno == EINTR)
+					continue;
+
+				throw "Failed to send the frame";
+			}
+
+			pData += bytesSent;
+			size -= static_cast<size_t> (bytesSent);
+		}
+	}
+
+	// "227 Entering Passive Mode (192,168,10,119,239,77)"
+	sockaddr_in ParsePassiveAddress(const std::string& rText)
+	{
+		const size_t start = rText.find('(');
+
+		unsigned int h1, h2, h3, h4, p1, p2;
+
+		if (start == std::string::npos || sscanf(rText.c_str() + start, "(%u,%u,%u,%u,%u,%u)", &h1, &h2, &h3, &h4, &p1, &p2) != 6)
+			throw "Invalid PASV reply";
+
+		sockaddr_in addr{};
+
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl((h1 << 24) | (h2 << 16) | (h3 << 8) | h4);
+		addr.sin_port = htons(static_cast<U16> ((p1 << 8) | p2));
+
+		return addr;
+	}
+
+
+	// Local address of the control connection. (PORT)
+	in_addr GetLocalAddress(int socketId)
+	{
+		sockaddr_in addr{};
+		socklen_t addrSize = sizeof(addr);
+
+		if (getsockname(socketId, reinterpret_cast<sockaddr*> (&addr), &addrSize) == -1)
+			throw "Failed for \"getsockname\"";
+
+		return addr.sin_addr;
+	}
+
+	// PASV: the camera connects to the port the server listens on. (Before the STOR, as the HikVision cameras do)
+	void SendFramePassive(Connection& rConnection, const std::string& rFileName, const std::vector<char>& rFrame)
+	{
+		const auto openTP = std::chrono::steady_clock::now();
+
+		std::string text;
+		rConnection.Command("PASV", 227, &text);
+
+		const auto openedTP = std::chrono::steady_clock::now();
+		Record(Phase::Open, openedTP - openTP);
+
+		const sockaddr_in dataAddr(ParsePassiveAddress(text));
+
+		SocketGuard dataSocket;
+
+		if ((dataSocket.socketId = Connection::CreateSocket()) == -1 || connect(dataSocket.socketId, reinterpret_cast<const sockaddr*> (&dataAddr), sizeof(dataAddr)) == -1)
+			throw "Failed to connect the data connection";
+
+		const auto connectedTP = std::chrono::steady_clock::now();
+
+		rConnection.Command("STOR " + rFileName, 150);
+
+		const auto storedTP = std::chrono::steady_clock::now();
+		Record(Phase::Stor, storedTP - connectedTP);
+
+		SendAll(dataSocket.socketId, rFrame.data(), rFrame.size());
+
+		close(dataSocket.socketId);
+		dataSocket.socketId = -1;
+
+		Record(Phase::Data, (connectedTP - openedTP) + (std::chrono::steady_clock::now() - storedTP));
+	}
+
+	// PORT: the server connects to the camera after the STOR. (See "DownloadFootageActiveTask")
+	void SendFrameActive(Connection& rConnection, const std::string& rFileName, const std::vector<char>& rFrame)
+	{
+		const auto openTP = std::chrono::steady_clock::now();
+
+		SocketGuard listenSocket;
+
+		sockaddr_in addr{};
+
+		addr.sin_family = AF_INET;
+		addr.sin_addr = GetLocalAddress(rConnection.GetSocketId());
+		addr.sin_port = 0;
+
+		socklen_t addrSize = sizeof(addr);
+
+		if ((listenSocket.socketId = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+			bind(listenSocket.socketId, reinterpret_cast<const sockaddr*> (&addr), sizeof(addr)) == -1 ||
+			listen(listenSocket.socketId, 1) == -1 ||
+			getsockname(listenSocket.socketId, reinterpret_cast<sockaddr*> (&addr), &addrSize) == -1)
+			throw "Failed to listen for the data connection";
+
+		const U32 address = ntohl(addr.sin_addr.s_addr);
+		const U16 port = ntohs(addr.sin_port);
+
+		char command[64];
+		snprintf(command, sizeof(command), "PORT %u,%u,%u,%u,%u,%u", address >> 24, (address >> 16) & 0xff, (address >> 8) & 0xff, address & 0xff, port >> 8, port & 0xff);
+
+		rConnection.Command(command, 200);
+
+		const auto openedTP = std::chrono::steady_clock::now();
+		Record(Phase::Open, openedTP - openTP);
+
+		rConnection.Command("STOR " + rFileName, 150);
+
+		const auto storedTP = std::chrono::steady_clock::now();
+		Record(Phase::Stor, storedTP - openedTP);
+
+		pollfd pollFd{ listenSocket.socketId, POLLIN, 0 };
+
+		const int result = poll(&pollFd, 1, static_cast<int> (gSettings.timeoutSec * 1000));
+
+		if (result == 0)
+			throw "Data connection timeout";
+
+		SocketGuard dataSocket;
+
+		if (result < 0 || (dataSocket.socketId = accept(listenSocket.socketId, nullptr, nullptr)) == -1)
+			throw "Failed to accept the data connection";
+
+		SendAll(dataSocket.socketId, rFrame.data(), rFrame.size());
+
+		close(dataSocket.socketId);
+		dataSocket.socketId = -1;
+
+		Record(Phase::Data, std::chrono::steady_clock::now() - storedTP);
+	}
+
+	// Sleeps in the short steps, so the stop is not delayed. Returns false if the stop was requested.
+	bool SleepUntil(const TimePoint& rWakeTP)
+	{
+		while (!gIsStopRequested)
+		{
+			const auto currentTP = std::chrono::steady_clock::now();
+
+			if (currentTP >= rWakeTP)
+				return true;
+
+			std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(rWakeTP - currentTP, std::chrono::milliseconds(100)));
+		}
+
+		return false;
+	}
+
+	struct Camera
+	{
+		U32			number = 0;
+		Dialect		dialect = Dialect::HikVision;
+		std::string user;
+		std::string password;
+
+		U32			frameCounter = 0;
+		std::vector<char> frame;
+		std::mt19937 random;
+	};
+
+	// One event: login, "burst" frames, QUIT.
+	void SendBurst(Camera& rCamera, const sockaddr_in& rServerAddr)
+	{
+		const bool isActive = rCamera.dialect == Dialect::HikVisionPort;
+		const bool isPanasonic = rCamera.dialect == Dialect::Panasonic;
+
+		const auto sessionTP = std::chrono::steady_clock::now();
+
+		Connection connection;
+
+		connection.Connect(rServerAddr);
+		connection.ReadReply(220);
+
+		gNumConnections++;
+
+		const auto loginTP = std::chrono::steady_clock::now();
+		Record(Phase::Connect, loginTP - sessionTP);
+
+		connection.Command("USER " + rCamera.user, 331);
+		connection.Command("PASS " + rCamera.password, 230);
+
+		Record(Phase::Login, std::chrono::steady_clock::now() - loginTP);
+
+		connection.Command("TYPE I", 200);
+
+		if (isPanasonic)
+		{
+			connection.Command("MODE S", 200);
+			connection.Command("STRU F", 200);
+		}
+
+		const U32 minSize = gSettings.sizeKB > gSettings.jitterKB ? (gSettings.sizeKB - gSettings.jitterKB) * 1024 : 1024;
+		const U32 maxSize = (gSettings.sizeKB + gSettings.jitterKB) * 1024;
+
+		std::uniform_int_distribution<U32> sizeDistribution(minSize, std::max(minSize, maxSize));
+
+		const std::string storedName("BLC140_" + std::to_string(rCamera.number) + ".jpg");
+
+		auto frameTP = std::chrono::steady_clock::now();
+
+		for (U32 i = 0; i < gSettings.burst && !gIsStopRequested; ++i)
+		{
+			const std::string fileName(CreateFileName(rCamera.dialect, rCamera.number, rCamera.frameCounter));
+
+			CreateFrame(rCamera.frame, sizeDistribution(rCamera.random), rCamera.number, rCamera.frameCounter++);
+
+			frameTP = std::chrono::steady_clock::now();
+
+			if (isActive)
+				SendFrameActive(connection, fileName, rCamera.frame);
+			else
+				SendFramePassive(connection, fileName, rCamera.frame);
+
+			connection.ReadReply(226);
+
+			// Uploaded under a new name, then renamed to the one the BL-C keeps overwriting.
+			if (isPanasonic)
+			{
+				connection.Command("RNFR " + fileName, 350);
+				connection.Command("RNTO " + storedName, 250);
+			}
+
+			Record(Phase::Frame, std::chrono::steady_clock::now() - frameTP);
+
+			gNumFrames++;
+			gNumBytes += rCamera.frame.size();
+
+			if (gSettings.rate > 0.0 && i + 1 < gSettings.burst)
+				SleepUntil(frameTP + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / gSettings.rate)));
+		}
+
+		if (isPanasonic)
+		{
+			connection.Command("DELE " + storedName, 250);
+			connection.Command("ABOR", 226);
+		}
+
+		connection.Command("QUIT", 221);
+
+		Record(Phase::Session, std::chrono::steady_clock::now() - sessionTP);
+	}
+
+	void CameraProc(U32 number, Dialect dialect, double startSec, sockaddr_in serverAddr)
+	{
+		Camera camera;
+
+		camera.number = number;
+		camera.dialect = dialect;
+		camera.user = FormatCredential(gSettings.user, number);
+		camera.password = FormatCredential(gSettings.password, number);
+		camera.random.seed(number);
+
+		std::exponential_distribution<double> intervalDistribution(gSettings.intervalSec > 0.0 ? 1.0 / gSettings.intervalSec : 1.0);
+
+		auto wakeTP = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(startSec));
+
+		while (SleepUntil(wakeTP))
+		{
+			double waitSec = gSettings.intervalSec > 0.0 ? intervalDistribution(camera.random) : 0.0;
+
+			try
+			{
+				SendBurst(camera, serverAddr);
+			}
+			catch (const char* pError)
+			{
+				if (gIsStopRequested)
+					break;
+
+				// Only the first ones, the rest are counted. (The whole fleet fails the same way)
+				if (gNumFailures++ < 20)
+					printf("Camera %u (%s): %s!\n", number, DialectNames[static_cast<size_t> (dialect)], pError);
+
+				waitSec = std::max(waitSec, 1.0);
+			}
+
+			wakeTP = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(waitSec));
+		}
+	}
+
+	// "hikvision,panasonic" (Cameras get them in turn)
+	bool ParseDialects(const char* pText, std::vector<Dialect>& rDialects)
+	{
+		rDialects.clear();
+
+		std::string text(pText);
+		size_t start = 0;
+
+		while (start <= text.size())
+		{
+			size_t end = text.find(',', start);
+
+			if (end == std::string::npos)
+				end = text.size();
+
+			const std::string name(text, start, end - start);
+
+			size_t i = 0;
+
+			while (i < sizeof(DialectNames) / sizeof(DialectNames[0]) && name != DialectNames[i])
+				i++;
+
+			if (i == sizeof(DialectNames) / sizeof(DialectNames[0]))
+			{
+				printf("Unknown dialect \"%s\"! (hikvision, hikvision-port, panasonic, mobotix)\n", name.c_str());
+				return false;
+			}
+
+			rDialects.push_back(static_cast<Dialect> (i));
+
+			start = end + 1;
+		}
+
+		return !rDialects.empty();
+	}
+
+	void PrintSummary(double elapsedSec)
+	{
+		const U64 numConnections = gNumConnections;
+		const U64 numFrames = gNumFrames;
+		const U64 numBytes = gNumBytes;
+
+		printf("\nDuration: %.1f s, cameras: %u\n", elapsedSec, gSettings.numCameras);
+		printf("Connections: %llu (%.1f/s), frames: %llu (%.1f/s), %.1f MB (%.2f MB/s), failures: %llu\n\n",
+			static_cast<unsigned long long> (numConnections), static_cast<double> (numConnections) / elapsedSec,
+			static_cast<unsigned long long> (numFrames), static_cast<double> (numFrames) / elapsedSec,
+			static_cast<double> (numBytes) / (1024.0 * 1024.0), static_cast<double> (numBytes) / (1024.0 * 1024.0) / elapsedSec,
+			static_cast<unsigned long long> (gNumFailures.load()));
+
+		printf("%-10s %10s %10s %10s %10s %10s %10s\n", "Phase (ms)", "count", "mean", "p50", "p90", "p99", "max");
+
+		for (size_t i = 0; i < NumPhases; ++i)
+		{
+			const Histogram& rHistogram = gHistograms[i];
+			const U64 count = rHistogram.GetCount();
+
+			printf("%-10s %10llu %10.2f %10.2f %10.2f %10.2f %10.2f\n", PhaseNames[i], static_cast<unsigned long long> (count),
+				count ? static_cast<double> (rHistogram.GetSum()) / static_cast<double> (count) / 1000.0 : 0.0,
+				static_cast<double> (rHistogram.GetPercentile(50.0)) / 1000.0,
+				static_cast<double> (rHistogram.GetPercentile(90.0)) / 1000.0,
+				static_cast<double> (rHistogram.GetPercentile(99.0)) / 1000.0,
+				static_cast<double> (rHistogram.GetMax()) / 1000.0);
+		}
+	}
+
+	void HandleSignal(int)
+	{
+		gIsStopRequested = true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int option;
+
+	while ((option = getopt(argc, argv, "a:p:c:d:u:w:s:j:r:b:i:R:t:T:")) != -1)
+	{
+		switch (option)
+		{
+		case 'a': gSettings.address = optarg; break;
+		case 'p': gSettings.port = static_cast<U16> (atoi(optarg)); break;
+		case 'c': gSettings.numCameras = static_cast<U32> (atoi(optarg)); break;
+		case 'd':
+			if (!ParseDialects(optarg, gSettings.dialects))
+				return EXIT_FAILURE;
+			break;
+		case 'u': gSettings.user = optarg; break;
+		case 'w': gSettings.password = optarg; break;
+		case 's': gSettings.sizeKB = static_cast<U32> (atoi(optarg)); break;
+		case 'j': gSettings.jitterKB = static_cast<U32> (atoi(optarg)); break;
+		case 'r': gSettings.rate = atof(optarg); break;
+		case 'b': gSettings.burst = static_cast<U32> (atoi(optarg)); break;
+		case 'i': gSettings.intervalSec = atof(optarg); break;
+		case 'R': gSettings.rampSec = atof(optarg); break;
+		case 't': gSettings.durationSec = static_cast<U32> (atoi(optarg)); break;
+		case 'T': gSettings.timeoutSec = static_cast<U32> (atoi(optarg)); break;
+		default:
+			printf("Usage: %s [-a address] [-p port] [-c cameras] [-d dialect,...] [-u user] [-w password] [-s sizeKB] [-j jitterKB]\n"
+				"       [-r rate] [-b burst] [-i intervalSec] [-R rampSec] [-t durationSec] [-T timeoutSec]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	sockaddr_in serverAddr{};
+
+	serverAddr.sin_family = AF_INET;
+	serverAddr.sin_port = htons(gSettings.port);
+
+	if (inet_pton(AF_INET, gSettings.address.c_str(), &serverAddr.sin_addr) != 1)
+	{
+		printf("Invalid address \"%s\"!\n", gSettings.address.c_str());
+		return EXIT_FAILURE;
+	}
+
+	if (gSettings.numCameras == 0 || gSettings.burst == 0)
+	{
+		printf("Nothing to send! (Cameras: %u, burst: %u)\n", gSettings.numCameras, gSettings.burst);
+		return EXIT_FAILURE;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, HandleSignal);
+	signal(SIGTERM, HandleSignal);
+
+	printf("FTP load on %s:%u (cameras: %u, frame: %u +- %u KB, rate: %.1f/s, burst: %u, interval: %.1f s, ramp: %.1f s, duration: %u s)\n",
+		gSettings.address.c_str(), gSettings.port, gSettings.numCameras, gSettings.sizeKB, gSettings.jitterKB,
+		gSettings.rate, gSettings.burst, gSettings.intervalSec, gSettings.rampSec, gSettings.durationSec);
+
+	const auto startTP = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> cameraThreads;
+	cameraThreads.reserve(gSettings.numCameras);
+
+	for (U32 i = 0; i < gSettings.numCameras; ++i)
+	{
+		const Dialect dialect = gSettings.dialects[i % gSettings.dialects.size()];
+		const double startSec = gSettings.rampSec * static_cast<double> (i) / static_cast<double> (gSettings.numCameras);
+
+		cameraThreads.emplace_back(CameraProc, i + 1, dialect, startSec, serverAddr);
+	}
+
+	U64 lastNumConnections = 0;
+	U64 lastNumFrames = 0;
+	U64 lastNumBytes = 0;
+
+	const auto stopTP = startTP + std::chrono::seconds(gSettings.durationSec);
+
+	auto reportTP = startTP;
+
+	while (!gIsStopRequested)
+	{
+		const auto nextReportTP = reportTP + std::chrono::seconds(5);
+
+		SleepUntil(gSettings.durationSec != 0 ? std::min(nextReportTP, stopTP) : nextReportTP);
+
+		const auto currentTP = std::chrono::steady_clock::now();
+		const double elapsedSec = std::chrono::duration<double>(currentTP - reportTP).count();
+
+		reportTP = currentTP;
+
+		const U64 numConnections = gNumConnections;
+		const U64 numFrames = gNumFrames;
+		const U64 numBytes = gNumBytes;
+
+		printf("Connections: %.1f/s, frames: %.1f/s, %.2f MB/s, frame p99: %.1f ms, failures: %llu\n",
+			static_cast<double> (numConnections - lastNumConnections) / elapsedSec,
+			static_cast<double> (numFrames - lastNumFrames) / elapsedSec,
+			static_cast<double> (numBytes - lastNumBytes) / (1024.0 * 1024.0) / elapsedSec,
+			static_cast<double> (gHistograms[static_cast<size_t> (Phase::Frame)].GetPercentile(99.0)) / 1000.0,
+			static_cast<unsigned long long> (gNumFailures.load()));
+
+		lastNumConnections = numConnections;
+		lastNumFrames = numFrames;
+		lastNumBytes = numBytes;
+
+		if (gSettings.durationSec != 0 && currentTP >= stopTP)
+			break;
+	}
+
+	gIsStopRequested = true;
+
+	// Cameras waiting for a reply stop within the "timeoutSec".
+	for (auto& rThread : cameraThreads)
+		rThread.join();
+
+	PrintSummary(std::chrono::duration<double>(std::chrono::steady_clock::now() - startTP).count());
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+// Malformed JPEG files must be rejected by the decoder, the frames come straight from the FTP uploads.
+// (Best run with the address sanitizer, "-fsanitize=address")
+//
+// Usage: JPEGTest
+
+#include "PCH.hpp"
+
+#include "Analytics/JPEG.hpp"
+
+namespace
+{
+	// SOI, a single DHT segment (DC table 0) with the given code counts and "numValues" values.
+	Vector<char> CreateHuffmanTableJPEG(const Vector<U8>& rCounts)
+	{
+		Vector<U8> data = { 0xFF, 0xD8 };
+
+		size_t numValues = 0;
+
+		for (U8 count : rCounts)
+			numValues += count;
+
+		const size_t length = 2 + 1 + 16 + numValues;
+
+		data.insert(data.end(), { 0xFF, 0xC4, static_cast<U8> (length >> 8), static_cast<U8> (length & 0xFF), 0x00 });
+
+		for (size_t i = 0; i < 16; ++i)
+			data.push_back(i < rCounts.size() ? rCounts[i] : 0);
+
+		for (size_t i = 0; i < numValues; ++i)
+			data.push_back(static_cast<U8> (i));
+
+		data.insert(data.end(), { 0xFF, 0xD9 });
+
+		return Vector<char>(data.begin(), data.end());
+	}
+
+	int gNumFailed = 0;
+
+	void Check(const char* pName, bool isPassed)
+	{
+		printf("%-48s %s\n", pName, isPassed ? "OK" : "FAILED");
+
+		if (!isPassed)
+			gNumFailed++;
+	}
+
+	// Decoder must reject the table, nothing is written past the lookup tables.
+	void CheckRejected(const char* pName, const Vector<U8>& rCounts)
+	{
+		const Vector<char> data(CreateHuffmanTableJPEG(rCounts));
+
+		Vector<char> output;
+		JPEG::Geometry geometry;
+
+		const bool isRejected = !JPEG::ComputeSignature(data.data(), data.size()).isValid &&
+			!JPEG::Preprocess(data.data(), data.size(), JPEG::Region(), 320, output, geometry);
+
+		Check(pName, isRejected);
+	}
+}
+
+int main()
+{
+	// 200 codes of the length 1. (Only 2 fit)
+	CheckRejected("DHT/TooManyShortCodes", { 200 });
+
+	// 2 codes of the length 1, then 1 more of the length 2. (Nothing left for it)
+	CheckRejected("DHT/OverfullAfterLongerLength", { 2, 1 });
+
+	// 5 codes of the length 2. (Only 4 fit)
+	CheckRejected("DHT/TooManyCodesOfLength", { 0, 5 });
+
+	// Length 1 is full, so is every longer one. (Length 10 is not in the single lookup)
+	CheckRejected("DHT/OverfullLongCode", { 2, 0, 0, 0, 0, 0, 0, 0, 0, 1 });
+
+	printf("\n%s\n", gNumFailed == 0 ? "All passed." : "FAILED!");
+
+	return gNumFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,507 @@
+#include <PCH.hpp>
+
+#include "Main.hpp"
+#include "Utils.hpp"
+#include "Socket.hpp"
+#include "ThreadPool.hpp"
+
+#include "Database/Database.hpp"
+
+#include "EventManager.hpp"
+
+#include "Analytics/Analytics.hpp"
+
+#include "FTPServer.hpp"
+#include "FileNameParser.hpp"
+
+#include <string.h> // strstr
+
+/*
+	Microbenchmarks of the hot parsing and queueing code, so the regressions show up as the numbers.
+	Inputs are the vendor filenames, FTP commands and the analytics results as they are received.
+
+	Every case is run until it takes at least "minTimeMs", then "NumRepetitions" more times with the same iteration count.
+	The fastest and the median time per iteration are reported.
+
+	Usage: MicroBenchmark [filter] [minTimeMs]
+	(filter - only the cases with the name containing it, minTimeMs - 500 by default)
+
+	NOTE: "Log::WriteVA" writes a few hundred MB to the "benchmark_log/" next to the executable.
+
+	SAMPLE:
+	Case                                     Iterations       Fastest        Median
+	FTPServer::GetCommandType                  10000000       17.5 ns       26.9 ns
+*/
+
+constexpr int NumRepetitions = 5;
+
+// Same as the log's queue limit, the log thread is woken up once it's reached.
+constexpr U64 LogDrainInterval = 4096;
+
+// Keeps the compiler from optimizing the benchmarked call away.
+template<typename T>
+inline void DoNotOptimize(const T& rValue)
+{
+	asm volatile("" : : "r,m"(rValue) : "memory");
+}
+
+// Timed iterations of a single run, the case can leave its setup out. (See "PauseTiming")
+class BenchmarkState
+{
+public:
+	explicit BenchmarkState(U64 numIterations)
+		: mNumIterations(numIterations)
+		, mStartTP(std::chrono::steady_clock::now())
+	{ }
+
+	U64 GetNumIterations() const { return mNumIterations; }
+
+	void PauseTiming()
+	{
+		mElapsed += std::chrono::steady_clock::now() - mStartTP;
+	}
+
+	void ResumeTiming()
+	{
+		mStartTP = std::chrono::steady_clock::now();
+	}
+
+	double Stop()
+	{
+		PauseTiming();
+
+		return std::chrono::duration<double>(mElapsed).count();
+	}
+
+private:
+
+	const U64 mNumIterations;
+
+	TimePoint mStartTP;
+	std::chrono::steady_clock::duration mElapsed{ 0 };
+};
+
+class MicroBenchmark
+{
+public:
+	struct Settings
+	{
+		String	filter;
+		U32		minTimeMs = 500;
+	};
+
+	explicit MicroBenchmark(const Settings& rSettings)
+		: mSettings(rSettings)
+	{ }
+
+	int Run();
+
+private:
+
+	using CaseFunction = void (MicroBenchmark::*)(BenchmarkState&);
+
+	struct Case
+	{
+		const char*		pName;
+		CaseFunction	function;
+	};
+
+	void Setup();
+	void RunCase(const Case& rCase);
+
+	void FileNameParser_HikVision(BenchmarkState& rState);
+	void FileNameParser_Axis(BenchmarkState& rState);
+	void FileNameParser_Mobotix(BenchmarkState& rState);
+	void FTPServer_GetCommandType(BenchmarkState& rState);
+	void Analytics_ParseXMLResults_Empty(BenchmarkState& rState);
+	void Analytics_ParseXMLResults_Detections(BenchmarkState& rState);
+	void Log_WriteVA(BenchmarkState& rState);
+	void Log_WriteVA_Filtered(BenchmarkState& rState);
+	void ThreadPool_EnqueueWaitAll(BenchmarkState& rState);
+	void EventManager_AddSession(BenchmarkState& rState);
+	void EventManager_HasSession(BenchmarkState& rState);
+	void EventManager_HasSession_Miss(BenchmarkState& rState);
+
+	void ParseFileNames(BenchmarkState& rState, const Vector<String>& rNames);
+	void ParseXML(BenchmarkState& rState, const String& rXML);
+
+	const Settings mSettings;
+
+	Main mApp;
+};
+
+//===================================================================================
+// Inputs.
+//===================================================================================
+
+// "IP address_channel number_capture time_event type.jpg" and the "gg" (serial number) prefix.
+static const Vector<String> HikVisionNames =
+{
+	"192.168.0.64_01_20190319093422939_MOTION_DETECTION.jpg",
+	"10.11.37.189_01_20150917094425492_FACE_DETECTION.jpg",
+	"gg_733804851_20190319124752348_MOTION_DETECTION.jpg",
+	"192.168.1.108_01_20190611183012004_LINE_CROSSING_DETECTION.jpg"
+};
+
+// Date/time suffix of the action rule upload, not parsed. (The local time is used)
+static const Vector<String> AxisNames =
+{
+	"Front_door20190319_093422_94.jpg",
+	"axis-ACCC8E0F1A2B_2019-03-19_09-34-22-939.jpg",
+	"Parking_lot_20190611_183012_00.jpg"
+};
+
+// Sequence numbers only. (See "GetFootageTimestamp")
+static const Vector<String> MobotixNames =
+{
+	"mx16bd8d00.jpg",
+	"mx16bd8d01.jpg",
+	"E00000012.jpg"
+};
+
+// As received by the "FTPServer::HandleClients", the last one is not supported.
+static const Vector<String> FTPCommands =
+{
+	"USER camera01\r\n",
+	"PASS secret\r\n",
+	"TYPE I\r\n",
+	"PASV\r\n",
+	"STOR 192.168.0.64_01_20190319093422939_MOTION_DETECTION.jpg\r\n",
+	"NOOP\r\n",
+	"QUIT\r\n",
+	"SIZE 192.168.0.64_01_20190319093422939_MOTION_DETECTION.jpg\r\n"
+};
+
+// Most of the frames have nothing detected.
+static const String EmptyXML =
+	"<Root incompleteResult=\"0\" count=\"1\" fileId=\"3295\"><Result count=\"0\"></Result></Root>";
+
+static const String DetectionsXML =
+	"<Root incompleteResult=\"0\" count=\"1\" fileId=\"3296\"><Result count=\"3\">"
+	"<Object name=\"person\" probability=\"87\" x=\"412\" y=\"208\" w=\"96\" h=\"244\"/>"
+	"<Object name=\"person\" probability=\"64\" x=\"1030\" y=\"300\" w=\"70\" h=\"180\"/>"
+	"<Object name=\"car\" probability=\"92\" x=\"120\" y=\"540\" w=\"380\" h=\"210\"/>"
+	"</Result></Root>";
+
+// Event sessions are keyed by "username + password". (See "FTPServer::HandleClients")
+constexpr size_t NumSessions = 1024;
+
+static String GetSessionKey(size_t index)
+{
+	char key[32];
+	snprintf(key, sizeof(key), "camera%04zuP4ssw0rd", index);
+
+	return key;
+}
+
+//===================================================================================
+// Cases.
+//===================================================================================
+
+void MicroBenchmark::ParseFileNames(BenchmarkState& rState, const Vector<String>& rNames)
+{
+	for (U64 i = 0; i < rState.GetNumIterations(); ++i)
+	{
+		FileNameParser parser(rNames[i % rNames.size()]);
+
+		DoNotOptimize(parser);
+	}
+}
+
+void MicroBenchmark::FileNameParser_HikVision(BenchmarkState& rState)
+{
+	ParseFileNames(rState, HikVisionNames);
+}
+
+void MicroBenchmark::FileNameParser_Axis(BenchmarkState& rState)
+{
+	ParseFileNames(rState, AxisNames);
+}
+
+void MicroBenchmark::FileNameParser_Mobotix(BenchmarkState& rState)
+{
+	ParseFileNames(rState, MobotixNames);
+}
+
+void MicroBenchmark::FTPServer_GetCommandType(BenchmarkState& rState)
+{
+	rState.PauseTiming();
+
+	// NOTE: The command is parsed from the receive buffer, in place.
+	Vector<Vector<char>> buffers;
+
+	for (const auto& rCommand : FTPCommands)
+		buffers.emplace_back(rCommand.begin(), rCommand.end());
+
+	rState.ResumeTiming();
+
+	for (U64 i = 0; i < rState.GetNumIterations(); ++i)
+	{
+		auto& rBuffer = buffers[i % buffers.size()];
+
+		DoNotOptimize(FTPServer::GetCommandType(rBuffer.data(), static_cast<ssize_t> (rBuffer.size())));
+	}
+}
+
+void MicroBenchmark::ParseXML(BenchmarkState& rState, const String& rXML)
+{
+	const JPEG::Geometry geometry;
+
+	Vector<Analytics::Detection> detections;
+
+	for (U64 i = 0; i < rState.GetNumIterations(); ++i)
+	{
+		detections.clear();
+
+		DoNotOptimize(Analytics::ParseXMLResults(rXML, geometry, detections));
+	}
+}
+
+void MicroBenchmark::Analytics_ParseXMLResults_Empty(BenchmarkState& rState)
+{
+	ParseXML(rState, EmptyXML);
+}
+
+void MicroBenchmark::Analytics_ParseXMLResults_Detections(BenchmarkState& rState)
+{
+	ParseXML(rState, DetectionsXML);
+}
+
+// Record is queued for the log thread, formatting and writing the file are not included.
+// (The queue is let to drain every "LogDrainInterval" records, so it doesn't grow faster than the file is written)
+void MicroBenchmark::Log_WriteVA(BenchmarkState& rState)
+{
+	for (U64 i = 0; i < rState.GetNumIterations(); ++i)
+	{
+		if (i % LogDrainInterval == 0 && i != 0)
+		{
+			rState.PauseTiming();
+
+			while (gMetrics.logQueueDepth.load(std::memory_order_relaxed) != 0)
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+			rState.ResumeTiming();
+		}
+
+		LOG_MESSAGE(Log::Channel::FTP, "File ready (Bytes %d)...", static_cast<int> (i));
+	}
+}
+
+// Records of the channel with the higher level. (Checked at runtime, unlike the "LOG_MIN_LEVEL")
+void MicroBenchmark::Log_WriteVA_Filtered(BenchmarkState& rState)
+{
+	for (U64 i = 0; i < rState.GetNumIterations(); ++i)
+		LOG_MESSAGE(Log::Channel::Events, "AddFootageNotice - EventId: %u", static_cast<U32> (i));
+}
+
+void MicroBenchmark::ThreadPool_EnqueueWaitAll(BenchmarkState& rState)
+{
+	for (U64 i = 0; i < rState.GetNumIterations(); ++i)
+		mApp.ThreadPoolPtr->Enqueue([]() { });
+
+	mApp.ThreadPoolPtr->waitAll();
+}
+
+// Sessions are released (timed out) every "NumSessions", so the ids are reused as they are in production.
+void MicroBenchmark::EventManager_AddSession(BenchmarkState& rState)
+{
+	rState.PauseTiming();
+
+	EventManager eventManager(mApp, 0);
+
+	Vector<String> keys;
+
+	for (size_t i = 0; i < NumSessions; ++i)
+		keys.push_back(GetSessionKey(i));
+
+	rState.ResumeTiming();
+
+	for (U64 i = 0; i < rState.GetNumIterations(); ++i)
+	{
+		const size_t index = static_cast<size_t> (i % NumSessions);
+
+		if (index == 0 && i != 0)
+		{
+			rState.PauseTiming();
+			eventManager.HandleTimeouts();
+			rState.ResumeTiming();
+		}
+
+		DoNotOptimize(eventManager.AddSession(keys[index]));
+	}
+
+	rState.PauseTiming();
+}
+
+void MicroBenchmark::EventManager_HasSession(BenchmarkState& rState)
+{
+	rState.PauseTiming();
+
+	EventManager eventManager(mApp, 0);
+
+	Vector<String> keys;
+
+	for (size_t i = 0; i < NumSessions; ++i)
+	{
+		keys.push_back(GetSessionKey(i));
+		eventManager.AddSession(keys.back());
+	}
+
+	rState.ResumeTiming();
+
+	EventSessionId eventSessionId = 0;
+
+	for (U64 i = 0; i < rState.GetNumIterations(); ++i)
+	{
+		DoNotOptimize(eventManager.HasSession(keys[i % NumSessions], &eventSessionId));
+		DoNotOptimize(eventSessionId);
+	}
+
+	rState.PauseTiming();
+}
+
+// New camera's login. (Or the event session that has timed out)
+void MicroBenchmark::EventManager_HasSession_Miss(BenchmarkState& rState)
+{
+	rState.PauseTiming();
+
+	EventManager eventManager(mApp, 0);
+
+	Vector<String> keys;
+
+	for (size_t i = 0; i < NumSessions; ++i)
+	{
+		eventManager.AddSession(GetSessionKey(i));
+		keys.push_back(GetSessionKey(NumSessions + i));
+	}
+
+	rState.ResumeTiming();
+
+	EventSessionId eventSessionId = 0;
+
+	for (U64 i = 0; i < rState.GetNumIterations(); ++i)
+		DoNotOptimize(eventManager.HasSession(keys[i % NumSessions], &eventSessionId));
+
+	rState.PauseTiming();
+}
+
+//===================================================================================
+// Runner.
+//===================================================================================
+
+// Log is written next to the executable, only the errors are echoed. (See "Log_WriteVA")
+void MicroBenchmark::Setup()
+{
+	const String logPath(mApp.GetPathApplication() + "benchmark_log/");
+
+	if (!Utils::MakePath(logPath))
+		throw ExceptionVA("Failed to setup log path: \"%s\"!", logPath.c_str());
+
+	Log::Settings settings;
+
+	settings.isConsoleEcho = false;
+
+	mApp.LogFilePtr = std::make_unique<Log>(logPath, settings);
+	mApp.LogFilePtr->SetLevel(Log::Level::Info);
+
+	// Released sessions are logged as the timeouts. (Also see "Log_WriteVA_Filtered")
+	mApp.LogFilePtr->SetLevel(Log::Channel::Events, Log::Level::Warning);
+
+	mApp.ThreadPoolPtr = std::make_unique<ThreadPool>(std::thread::hardware_concurrency());
+}
+
+void MicroBenchmark::RunCase(const Case& rCase)
+{
+	const double minSeconds = mSettings.minTimeMs / 1000.0;
+
+	// Iterations are increased until the run takes long enough.
+	U64 numIterations = 1;
+
+	for (;;)
+	{
+		BenchmarkState state(numIterations);
+
+		(this->*rCase.function)(state);
+
+		const double seconds = state.Stop();
+
+		if (seconds >= minSeconds || numIterations >= (U64(1) << 40))
+			break;
+
+		const double scale = (seconds > 0.0) ? std::min(10.0, 1.4 * minSeconds / seconds) : 10.0;
+
+		numIterations = std::max(numIterations + 1, static_cast<U64> (static_cast<double> (numIterations) * scale));
+	}
+
+	Vector<double> nsPerIteration;
+
+	for (int i = 0; i < NumRepetitions; ++i)
+	{
+		BenchmarkState state(numIterations);
+
+		(this->*rCase.function)(state);
+
+		nsPerIteration.push_back(state.Stop() * 1e9 / static_cast<double> (numIterations));
+	}
+
+	std::sort(nsPerIteration.begin(), nsPerIteration.end());
+
+	printf("%-38s %12" PRIu64 " %10.1f ns %10.1f ns\n", rCase.pName, numIterations, nsPerIteration.front(), nsPerIteration[nsPerIteration.size() / 2]);
+}
+
+int MicroBenchmark::Run()
+{
+	static const Case cases[] =
+	{
+		{ "FileNameParser/HikVision",				&MicroBenchmark::FileNameParser_HikVision },
+		{ "FileNameParser/Axis",					&MicroBenchmark::FileNameParser_Axis },
+		{ "FileNameParser/Mobotix",					&MicroBenchmark::FileNameParser_Mobotix },
+		{ "FTPServer::GetCommandType",				&MicroBenchmark::FTPServer_GetCommandType },
+		{ "Analytics::ParseXMLResults/Empty",		&MicroBenchmark::Analytics_ParseXMLResults_Empty },
+		{ "Analytics::ParseXMLResults/Detections",	&MicroBenchmark::Analytics_ParseXMLResults_Detections },
+		{ "Log::WriteVA",							&MicroBenchmark::Log_WriteVA },
+		{ "Log::WriteVA/Filtered",					&MicroBenchmark::Log_WriteVA_Filtered },
+		{ "ThreadPool::Enqueue+waitAll",			&MicroBenchmark::ThreadPool_EnqueueWaitAll },
+		{ "EventManager::AddSession",				&MicroBenchmark::EventManager_AddSession },
+		{ "EventManager::HasSession",				&MicroBenchmark::EventManager_HasSession },
+		{ "EventManager::HasSession/Miss",			&MicroBenchmark::EventManager_HasSession_Miss }
+	};
+
+	Setup();
+
+	printf("%-38s %12s %13s %13s\n", "Case", "Iterations", "Fastest", "Median");
+
+	for (const auto& rCase : cases)
+	{
+		if (!mSettings.filter.empty() && !strstr(rCase.pName, mSettings.filter.c_str()))
+			continue;
+
+		RunCase(rCase);
+
+		if (gIsQuitRequested)
+			break;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	MicroBenchmark::Settings settings;
+
+	if (argc > 1) settings.filter = argv[1];
+	if (argc > 2) settings.minTimeMs = static_cast<U32> (atoi(argv[2]));
+
+	try
+	{
+		MicroBenchmark benchmark(settings);
+
+		return benchmark.Run();
+	}
+	catch (const Exception& e)
+	{
+		printf("ERROR: %s\n", e.GetText());
+	}
+
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,606 @@
+// Stand-in for the Analytics (inference) server, speaks the same protocol as "Analytics":
+// 1. Server sends the "hello" (client id and the protocol version).
+// 2. Client sends the "handshake", then any number of the "frame" messages (JPEG payload).
+// 3. Server answers every frame with the "result" message, in the order the frames were received.
+//    (Binary results if the handshake asked for the protocol version 6, XML otherwise)
+// 4. "shm attach" message switches the frames to the shared memory ring (the "shm@" backends, see "SharedMemoryRing"),
+//    they are consumed by a separate thread. Results are still sent using the socket.
+//
+// Usage: MockAnalytics [-p port] [-d delayMs] [-j jitterMs] [-r detectionRate] [-o objects] [-s resultSize] [-x]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <mutex>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+namespace
+{
+	typedef uint8_t		U8;
+	typedef uint16_t	U16;
+	typedef uint32_t	U32;
+
+	// Same as "Analytics::LeaseConnection" and "Analytics::SendFootageTask".
+#pragma pack(push, 1)
+	struct Hello
+	{
+		U32 clientId = 0;
+		U16 protocolVersion = 0;
+	};
+
+	struct Header
+	{
+		U8	mark = 7;
+		U8	type = 0;
+		U32	size = 0; // Whole message, including the header.
+	};
+
+	struct BinaryResults
+	{
+		U32 fileId = 0;
+		U16 numObjects = 0;
+		U16 flags = 0;
+	};
+
+	struct BinaryObject
+	{
+		U16 classId = 0; // 0 - "person"
+		U8	probability = 0;
+		U8	reserved = 0;
+		U16 x = 0;
+		U16 y = 0;
+		U16 width = 0;
+		U16 height = 0;
+	};
+#pragma pack(pop)
+
+	// Same as "SharedMemoryRing".
+	constexpr U32 RingMagic = 0x51565352;
+	constexpr U32 RingVersion = 1;
+
+	struct RingLayout
+	{
+		U32 magic = 0;
+		U32 version = 0;
+		U32 numSlots = 0;
+		U32 slotSize = 0;
+
+		alignas(64) std::atomic<U32> head{ 0 };
+		alignas(64) std::atomic<U32> tail{ 0 };
+		alignas(64) std::atomic<U32> doorbell{ 0 };
+		std::atomic<U32> isConsumerWaiting{ 0 };
+	};
+
+	struct SlotHeader
+	{
+		U32 fileId = 0;
+		U32 size = 0;
+	};
+
+#pragma pack(push, 1)
+	struct ShmAttach
+	{
+		U32 numSlots = 0;
+		U32 slotSize = 0;
+		char name[64];
+	};
+#pragma pack(pop)
+
+	// Handshake starts with the fields sent before its header. (clientId, type, quality, streamType)
+	constexpr size_t HandshakePrefixSize = 12;
+
+	constexpr U8 MessageTypeFrame = 2;
+	constexpr U8 MessageTypeResult = 3;
+	constexpr U8 MessageTypeBinaryResults = 4;
+	constexpr U8 MessageTypeShmAttach = 5;
+
+	constexpr U16 XMLProtocolVersion = 5;
+	constexpr U16 BinaryProtocolVersion = 6;
+
+	constexpr U32 MaxMessageSize = 16 << 20;
+
+	struct Settings
+	{
+		U16		port = 5000;
+		U32		delayMs = 50;		// Inference time per frame.
+		U32		jitterMs = 0;		// Added to the delay, uniformly distributed.
+		double	detectionRate = 0.5;// Share of the frames with a person detected.
+		U32		numObjects = 1;		// Objects per frame with a detection.
+		U32		resultSize = 0;		// Result XML is padded to this size. (Bytes)
+		bool	isXMLOnly = false;	// Acts as the older server, without the binary results.
+	};
+
+	Settings gSettings;
+
+	std::atomic<U32> gClientIdCounter{ 1 };
+	std::atomic<uint64_t> gNumFrames{ 0 };
+	std::atomic<uint64_t> gNumDetections{ 0 };
+
+	bool ReadAll(int socketId, void* pBuffer, size_t size)
+	{
+		char* p = static_cast<char*> (pBuffer);
+
+		while (size > 0)
+		{
+			const ssize_t bytesReceived = recv(socketId, p, size, 0);
+
+			if (bytesReceived == 0)
+				return false;
+
+			if (bytesReceived < 0)
+			{
+				if (errno == EINTR)
+					continue;
+
+				return false;
+			}
+
+			p += bytesReceived;
+			size -= static_cast<size_t> (bytesReceived);
+		}
+
+		return true;
+	}
+
+	bool SendAll(int socketId, const void* pBuffer, size_t size)
+	{
+		const char* p = static_cast<const char*> (pBuffer);
+
+		while (size > 0)
+		{
+			const ssize_t bytesSent = send(socketId, p, size, MSG_NOSIGNAL);
+
+			if (bytesSent < 0)
+			{
+				if (errno == EINTR)
+					continue;
+
+				return false;
+			}
+
+			p += bytesSent;
+			size -= static_cast<size_t> (bytesSent);
+		}
+
+		return true;
+	}
+
+	// <Root incompleteResult="0" count="1" fileId="3295"><Result count="1"><Object name="person" probability="87" x="10" y="20" w="30" h="60"/></Result></Root>
+	std::string CreateResult(U32 fileId, bool isDetected, std::mt19937& rRandom)
+	{
+		std::string xml;
+
+		xml.reserve(256 + gSettings.resultSize);
+
+		xml += "<Root incompleteResult=\"0\" count=\"1\" fileId=\"" + std::to_string(fileId) + "\">";
+		xml += "<Result count=\"" + std::to_string(isDetected ? gSettings.numObjects : 0) + "\">";
+
+		if (isDetected)
+		{
+			for (U32 i = 0; i < gSettings.numObjects; ++i)
+			{
+				const U32 x = rRandom() % 1600;
+				const U32 y = rRandom() % 800;
+
+				xml += "<Object name=\"person\" probability=\"" + std::to_string(60 + rRandom() % 40) + "\""
+					" x=\"" + std::to_string(x) + "\" y=\"" + std::to_string(y) + "\""
+					" w=\"" + std::to_string(40 + rRandom() % 200) + "\" h=\"" + std::to_string(80 + rRandom() % 200) + "\"/>";
+			}
+		}
+
+		xml += "</Result>";
+
+		// Padding. (Larger results, same parsed content)
+		if (xml.size() + 16 < gSettings.resultSize)
+		{
+			xml += "<!--";
+			xml.append(gSettings.resultSize - xml.size() - 10, '.');
+			xml += "-->";
+		}
+
+		xml += "</Root>";
+
+		return xml;
+	}
+
+	std::string CreateBinaryResults(U32 fileId, bool isDetected, std::mt19937& rRandom)
+	{
+		BinaryResults results;
+
+		results.fileId = fileId;
+		results.numObjects = static_cast<U16> (isDetected ? gSettings.numObjects : 0);
+
+		std::string data(reinterpret_cast<const char*> (&results), sizeof(results));
+
+		for (U16 i = 0; i < results.numObjects; ++i)
+		{
+			BinaryObject object;
+
+			object.probability = static_cast<U8> (60 + rRandom() % 40);
+			object.x = static_cast<U16> (rRandom() % 1600);
+			object.y = static_cast<U16> (rRandom() % 800);
+			object.width = static_cast<U16> (40 + rRandom() % 200);
+			object.height = static_cast<U16> (80 + rRandom() % 200);
+
+			data.append(reinterpret_cast<const char*> (&object), sizeof(object));
+		}
+
+		return data;
+	}
+
+	struct Client
+	{
+		int		socketId = -1;
+		U32		clientId = 0;
+		bool	isBinary = false;
+
+		// Results of the socket and the shared memory frames.
+		std::mutex sendMutex;
+
+		std::atomic_bool isClosed{ false };
+	};
+
+	// Inference and the results. Returns false if the client disconnected.
+	bool HandleFrame(Client& rClient, U32 fileId, std::mt19937& rRandom)
+	{
+		const U32 delayMs = gSettings.delayMs + (gSettings.jitterMs ? rRandom() % (gSettings.jitterMs + 1) : 0);
+
+		if (delayMs)
+			std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+
+		const bool isDetected = std::generate_canonical<double, 32>(rRandom) < gSettings.detectionRate;
+
+		std::string message;
+		Header resultHeader;
+
+		if (rClient.isBinary)
+		{
+			// Binary results: header, "BinaryResults" and the objects.
+			const std::string data(CreateBinaryResults(fileId, isDetected, rRandom));
+
+			resultHeader.type = MessageTypeBinaryResults;
+			resultHeader.size = static_cast<U32> (sizeof(Header) + data.size());
+
+			message.reserve(resultHeader.size);
+			message.append(reinterpret_cast<const char*> (&resultHeader), sizeof(resultHeader));
+			message += data;
+		}
+		else
+		{
+			// Result: header, file id, XML.
+			const std::string xml(CreateResult(fileId, isDetected, rRandom));
+
+			resultHeader.type = MessageTypeResult;
+			resultHeader.size = static_cast<U32> (sizeof(Header) + sizeof(fileId) + xml.size());
+
+			message.reserve(resultHeader.size);
+			message.append(reinterpret_cast<const char*> (&resultHeader), sizeof(resultHeader));
+			message.append(reinterpret_cast<const char*> (&fileId), sizeof(fileId));
+			message += xml;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(rClient.sendMutex);
+
+			if (!SendAll(rClient.socketId, message.data(), message.size()))
+				return false;
+		}
+
+		gNumFrames++;
+
+		if (isDetected)
+			gNumDetections++;
+
+		return true;
+	}
+
+	// Shared memory frames: waits on the doorbell (futex) while the ring is empty.
+	// NOTE: The slot is released after the "inference", like the real server that reads the frame in place.
+	void RingProc(Client* pClient, RingLayout* pLayout, size_t slotStride)
+	{
+		std::mt19937 random(pClient->clientId + 0x10000);
+
+		char* pSlots = reinterpret_cast<char*> (pLayout) + sizeof(RingLayout);
+
+		U32 tail = pLayout->tail.load(std::memory_order_relaxed);
+
+		while (!pClient->isClosed)
+		{
+			if (pLayout->head.load(std::memory_order_acquire) == tail)
+			{
+				const U32 doorbell = pLayout->doorbell.load();
+
+				pLayout->isConsumerWaiting = 1;
+
+				// Checked again, the frame might have been published before we said we are waiting.
+				if (pLayout->head.load() == tail)
+				{
+					timespec timeout{ 0, 100 * 1000 * 1000 }; // Checks "isClosed".
+					syscall(SYS_futex, reinterpret_cast<U32*> (&pLayout->doorbell), FUTEX_WAIT, doorbell, &timeout, nullptr, 0);
+				}
+
+				pLayout->isConsumerWaiting = 0;
+				continue;
+			}
+
+			const SlotHeader* pSlot = reinterpret_cast<const SlotHeader*> (pSlots + slotStride * (tail % pLayout->numSlots));
+			const U32 fileId = pSlot->fileId;
+
+			const bool isSent = HandleFrame(*pClient, fileId, random);
+
+			pLayout->tail.store(++tail, std::memory_order_release);
+
+			if (!isSent)
+				break;
+		}
+	}
+
+	// Maps the client's ring, returns nullptr on failure.
+	RingLayout* AttachRing(const ShmAttach& rAttach, size_t& rSlotStride, size_t& rSize)
+	{
+		char name[sizeof(rAttach.name) + 1] = {};
+		memcpy(name, rAttach.name, sizeof(rAttach.name));
+
+		const int fileId = shm_open(name, O_RDWR, 0);
+
+		if (fileId == -1)
+		{
+			printf("Failed for \"shm_open\": %s (Error: %s)\n", name, strerror(errno));
+			return nullptr;
+		}
+
+		rSlotStride = (sizeof(SlotHeader) + rAttach.slotSize + 63) & ~static_cast<size_t> (63);
+		rSize = sizeof(RingLayout) + rSlotStride * rAttach.numSlots;
+
+		void* pMemory = mmap(nullptr, rSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileId, 0);
+
+		close(fileId);
+
+		if (pMemory == MAP_FAILED)
+		{
+			printf("Failed for \"mmap\": %s (Error: %s)\n", name, strerror(errno));
+			return nullptr;
+		}
+
+		RingLayout* pLayout = static_cast<RingLayout*> (pMemory);
+
+		if (pLayout->magic != RingMagic || pLayout->version != RingVersion || pLayout->numSlots != rAttach.numSlots || pLayout->slotSize != rAttach.slotSize)
+		{
+			printf("Invalid shared memory ring: %s\n", name);
+			munmap(pMemory, rSize);
+			return nullptr;
+		}
+
+		return pLayout;
+	}
+
+	// Frames of a single connection are handled one after another, like the real server does.
+	// (Shared memory frames are handled by the separate thread, see "RingProc")
+	void ClientProc(int socketId)
+	{
+		Client client;
+
+		client.socketId = socketId;
+		client.clientId = gClientIdCounter++;
+
+		const U32 clientId = client.clientId;
+
+		std::mt19937 random(clientId);
+
+		std::vector<char> buffer;
+
+		std::thread ringThread;
+		RingLayout* pLayout = nullptr;
+		size_t ringSize = 0;
+
+		try
+		{
+			Hello hello;
+			hello.clientId = clientId;
+			hello.protocolVersion = gSettings.isXMLOnly ? XMLProtocolVersion : BinaryProtocolVersion;
+
+			U16 protocolVersion = XMLProtocolVersion;
+			int64_t alarmId = 0;
+
+			if (!SendAll(socketId, &hello, sizeof(hello)))
+				throw "Failed to send the hello";
+
+			// Handshake.
+			{
+				char prefix[HandshakePrefixSize];
+				Header header;
+
+				if (!ReadAll(socketId, prefix, sizeof(prefix)) || !ReadAll(socketId, &header, sizeof(header)))
+					throw "Failed to read the handshake";
+
+				if (header.size < sizeof(Header) || header.size > MaxMessageSize)
+					throw "Invalid handshake";
+
+				buffer.resize(header.size - sizeof(Header));
+
+				if (!ReadAll(socketId, buffer.data(), buffer.size()))
+					throw "Failed to read the handshake";
+
+				if (buffer.size() >= sizeof(protocolVersion))
+					memcpy(&protocolVersion, buffer.data(), sizeof(protocolVersion));
+
+				// Event the connection was leased to.
+				if (buffer.size() >= sizeof(protocolVersion) + sizeof(alarmId))
+					memcpy(&alarmId, buffer.data() + sizeof(protocolVersion), sizeof(alarmId));
+			}
+
+			client.isBinary = !gSettings.isXMLOnly && protocolVersion >= BinaryProtocolVersion;
+
+			printf("Client %u connected. (Alarm id: %lld, %s results)\n", clientId, static_cast<long long> (alarmId), client.isBinary ? "binary" : "XML");
+
+			for (;;)
+			{
+				Header header;
+
+				if (!ReadAll(socketId, &header, sizeof(header)))
+					break; // Disconnected.
+
+				if (header.size < sizeof(Header) + 8 || header.size > MaxMessageSize)
+					throw "Invalid message size";
+
+				buffer.resize(header.size - sizeof(Header));
+
+				if (!ReadAll(socketId, buffer.data(), buffer.size()))
+					break;
+
+				if (header.type == MessageTypeShmAttach && buffer.size() >= sizeof(ShmAttach) && pLayout == nullptr)
+				{
+					ShmAttach attach;
+					memcpy(&attach, buffer.data(), sizeof(attach));
+
+					size_t slotStride = 0;
+
+					pLayout = AttachRing(attach, slotStride, ringSize);
+
+					if (pLayout != nullptr)
+					{
+						printf("Client %u frames are read from the shared memory. (%u slots, %u bytes each)\n", clientId, attach.numSlots, attach.slotSize);
+
+						ringThread = std::thread(RingProc, &client, pLayout, slotStride);
+					}
+
+					continue;
+				}
+
+				if (header.type != MessageTypeFrame)
+					continue;
+
+				U32 fileId = 0;
+				memcpy(&fileId, buffer.data(), sizeof(fileId));
+
+				if (!HandleFrame(client, fileId, random))
+					break;
+			}
+		}
+		catch (const char* pError)
+		{
+			printf("Client %u: %s!\n", clientId, pError);
+		}
+
+		client.isClosed = true;
+
+		if (ringThread.joinable())
+			ringThread.join();
+
+		if (pLayout != nullptr)
+			munmap(pLayout, ringSize);
+
+		printf("Client %u disconnected.\n", clientId);
+
+		close(socketId);
+	}
+
+	void StatsProc()
+	{
+		uint64_t lastNumFrames = 0;
+
+		for (;;)
+		{
+			std::this_thread::sleep_for(std::chrono::seconds(5));
+
+			const uint64_t numFrames = gNumFrames;
+
+			printf("Frames: %llu (%.1f/s), detections: %llu\n", static_cast<unsigned long long> (numFrames),
+				static_cast<double> (numFrames - lastNumFrames) / 5.0, static_cast<unsigned long long> (gNumDetections.load()));
+
+			lastNumFrames = numFrames;
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int option;
+
+	while ((option = getopt(argc, argv, "p:d:j:r:o:s:xh")) != -1)
+	{
+		switch (option)
+		{
+		case 'p': gSettings.port = static_cast<U16> (atoi(optarg)); break;
+		case 'd': gSettings.delayMs = static_cast<U32> (atoi(optarg)); break;
+		case 'j': gSettings.jitterMs = static_cast<U32> (atoi(optarg)); break;
+		case 'r': gSettings.detectionRate = atof(optarg); break;
+		case 'o': gSettings.numObjects = static_cast<U32> (atoi(optarg)); break;
+		case 's': gSettings.resultSize = static_cast<U32> (atoi(optarg)); break;
+		case 'x': gSettings.isXMLOnly = true; break;
+		default:
+			printf("Usage: %s [-p port] [-d delayMs] [-j jitterMs] [-r detectionRate] [-o objects] [-s resultSize] [-x]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	const int serverId = socket(AF_INET, SOCK_STREAM, 0);
+
+	if (serverId == -1)
+	{
+		printf("Failed for \"socket\"! (Error: %s)\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	const int isOn = 1;
+	setsockopt(serverId, SOL_SOCKET, SO_REUSEADDR, &isOn, sizeof(isOn));
+
+	sockaddr_in addr{};
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(gSettings.port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if (bind(serverId, reinterpret_cast<sockaddr*> (&addr), sizeof(addr)) == -1 || listen(serverId, 64) == -1)
+	{
+		printf("Failed to listen on port %u! (Error: %s)\n", gSettings.port, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	printf("Mock analytics server on port %u (delay: %u ms, jitter: %u ms, detection rate: %.2f, objects: %u, result size: %u)\n",
+		gSettings.port, gSettings.delayMs, gSettings.jitterMs, gSettings.detectionRate, gSettings.numObjects, gSettings.resultSize);
+
+	std::thread(StatsProc).detach();
+
+	for (;;)
+	{
+		const int socketId = accept(serverId, nullptr, nullptr);
+
+		if (socketId == -1)
+		{
+			if (errno == EINTR)
+				continue;
+
+			printf("Failed for \"accept\"! (Error: %s)\n", strerror(errno));
+			break;
+		}
+
+		setsockopt(socketId, IPPROTO_TCP, TCP_NODELAY, &isOn, sizeof(isOn));
+
+		std::thread(ClientProc, socketId).detach();
+	}
+
+	close(serverId);
+
+	return EXIT_SUCCESS;
+}
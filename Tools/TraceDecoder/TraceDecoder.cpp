@@ -0,0 +1,318 @@
+// Converts the flight recorder dump (SIGUSR1 or the API "/trace", see "FlightRecorder") to the Chrome trace JSON.
+// Open the output in "chrome://tracing" or "ui.perfetto.dev".
+//
+// - STOR is shown as the instant event of the FTP (main) thread.
+// - Footage transfers and the database queries are the slices of the thread they ran on.
+// - Analytics frames (send until the result) and the CGI requests (request until the response) are the async slices,
+//   they start and end on the different threads.
+//
+// Usage: TraceDecoder input.bin [output.json] (Standard output, if the output is not given)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+	typedef uint16_t	U16;
+	typedef uint32_t	U32;
+	typedef uint64_t	U64;
+
+	// Same as "FlightRecorder".
+	enum class Type : U16
+	{
+		StorReceived,
+		TransferStart,
+		TransferEnd,
+		DBQueryStart,
+		DBQueryEnd,
+		AnalyticsSend,
+		AnalyticsResult,
+		CGIRequest,
+		CGIResponse
+	};
+
+#pragma pack(push, 1)
+	struct FileHeader
+	{
+		char	magic[4];
+		U32		version;
+		U32		numThreads;
+		U64		dumpTimeNs;
+	};
+
+	struct ThreadHeader
+	{
+		U32		threadIndex;
+		U32		numRecords;
+		char	name[16];
+	};
+
+	struct Record
+	{
+		U64		timeNs;
+		U64		id0;
+		U64		id1;
+		U32		value;
+		U16		type;
+		U16		reserved;
+	};
+#pragma pack(pop)
+
+	struct Thread
+	{
+		U32		index = 0;
+		std::string name;
+		std::vector<Record> records;
+	};
+
+	bool ReadDump(FILE* pFile, std::vector<Thread>& rThreads)
+	{
+		FileHeader fileHeader;
+
+		if (fread(&fileHeader, sizeof(fileHeader), 1, pFile) != 1 || memcmp(fileHeader.magic, "VQFR", 4) != 0)
+		{
+			fprintf(stderr, "Not a flight recorder dump!\n");
+			return false;
+		}
+
+		if (fileHeader.version != 1)
+		{
+			fprintf(stderr, "Unsupported dump version: %u\n", fileHeader.version);
+			return false;
+		}
+
+		rThreads.resize(fileHeader.numThreads);
+
+		for (auto& rThread : rThreads)
+		{
+			ThreadHeader threadHeader;
+
+			if (fread(&threadHeader, sizeof(threadHeader), 1, pFile) != 1)
+			{
+				fprintf(stderr, "Dump is truncated!\n");
+				return false;
+			}
+
+			rThread.index = threadHeader.threadIndex;
+			rThread.name.assign(threadHeader.name, strnlen(threadHeader.name, sizeof(threadHeader.name)));
+			rThread.records.resize(threadHeader.numRecords);
+
+			if (threadHeader.numRecords != 0 && fread(rThread.records.data(), sizeof(Record), threadHeader.numRecords, pFile) != threadHeader.numRecords)
+			{
+				fprintf(stderr, "Dump is truncated!\n");
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	class Writer
+	{
+	public:
+		Writer(FILE* pFile, U64 baseTimeNs)
+			: mpFile(pFile)
+			, mBaseTimeNs(baseTimeNs)
+		{
+			fprintf(mpFile, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+		}
+
+		~Writer()
+		{
+			fprintf(mpFile, "\n]}\n");
+		}
+
+		// "args" is the JSON object's content, without the braces.
+		void Add(const char* pName, const char* pPhase, U32 tid, U64 timeNs, const std::string& rArgs, const char* pExtra = "")
+		{
+			const U64 ns = timeNs - mBaseTimeNs;
+
+			fprintf(mpFile, "%s\n{\"name\":\"%s\",\"ph\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%" PRIu64 ".%03u,\"args\":{%s}%s}",
+				mIsFirst ? "" : ",", pName, pPhase, tid, ns / 1000, static_cast<U32> (ns % 1000), rArgs.c_str(), pExtra);
+
+			mIsFirst = false;
+		}
+
+		void AddComplete(const char* pName, U32 tid, U64 startNs, U64 endNs, const std::string& rArgs)
+		{
+			char extra[64];
+			snprintf(extra, sizeof(extra), ",\"dur\":%" PRIu64 ".%03u", (endNs - startNs) / 1000, static_cast<U32> ((endNs - startNs) % 1000));
+
+			Add(pName, "X", tid, startNs, rArgs, extra);
+		}
+
+		void AddAsync(const char* pName, const char* pPhase, U32 tid, U64 timeNs, const std::string& rId, const std::string& rArgs)
+		{
+			const std::string extra = ",\"cat\":\"" + std::string(pName) + "\",\"id\":\"" + rId + '"';
+
+			Add(pName, pPhase, tid, timeNs, rArgs, extra.c_str());
+		}
+
+		void AddThreadName(U32 tid, const std::string& rName)
+		{
+			fprintf(mpFile, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", mIsFirst ? "" : ",", tid, rName.c_str());
+
+			mIsFirst = false;
+		}
+
+	private:
+		FILE*	mpFile;
+		U64		mBaseTimeNs;
+		bool	mIsFirst = true;
+	};
+
+	std::string MakeArgs(const char* pFormat, ...) __attribute__((format(printf, 1, 2)));
+
+	std::string MakeArgs(const char* pFormat, ...)
+	{
+		char buffer[256];
+
+		va_list args;
+		va_start(args, pFormat);
+		vsnprintf(buffer, sizeof(buffer), pFormat, args);
+		va_end(args);
+
+		return buffer;
+	}
+
+	void WriteThread(Writer& rWriter, const Thread& rThread)
+	{
+		const U32 tid = rThread.index;
+
+		rWriter.AddThreadName(tid, rThread.name.empty() ? "Thread " + std::to_string(tid) : rThread.name);
+
+		// Start of the slice that is still open. (Transfers and the queries don't nest)
+		const Record* pTransfer = nullptr;
+		const Record* pQuery = nullptr;
+
+		for (const auto& rRecord : rThread.records)
+		{
+			switch (static_cast<Type> (rRecord.type))
+			{
+				case Type::StorReceived:
+					rWriter.Add("STOR", "i", tid, rRecord.timeNs, MakeArgs("\"eventId\":%" PRIu64 ",\"footageIndex\":%" PRIu64, rRecord.id0, rRecord.id1), ",\"s\":\"t\"");
+					break;
+
+				case Type::TransferStart:
+					pTransfer = &rRecord;
+					break;
+
+				case Type::TransferEnd:
+					// NOTE: Start might be overwritten already, the end alone is dropped.
+					if (pTransfer)
+						rWriter.AddComplete("Transfer", tid, pTransfer->timeNs, rRecord.timeNs, MakeArgs("\"eventId\":%" PRIu64 ",\"footageIndex\":%" PRIu64 ",\"bytes\":%u", rRecord.id0, rRecord.id1, rRecord.value));
+
+					pTransfer = nullptr;
+					break;
+
+				case Type::DBQueryStart:
+					pQuery = &rRecord;
+					break;
+
+				case Type::DBQueryEnd:
+					if (pQuery)
+						rWriter.AddComplete("DB query", tid, pQuery->timeNs, rRecord.timeNs, MakeArgs("\"length\":%u,\"rows\":%u,\"failed\":%s", pQuery->value, rRecord.value, rRecord.id0 ? "true" : "false"));
+
+					pQuery = nullptr;
+					break;
+
+				case Type::AnalyticsSend:
+					rWriter.AddAsync("Analytics", "b", tid, rRecord.timeNs, "frame" + std::to_string(rRecord.id0), MakeArgs("\"eventFootageId\":%" PRIu64 ",\"bytes\":%u", rRecord.id0, rRecord.value));
+					break;
+
+				case Type::AnalyticsResult:
+					rWriter.AddAsync("Analytics", "e", tid, rRecord.timeNs, "frame" + std::to_string(rRecord.id0), MakeArgs("\"eventId\":%" PRIu64 ",\"latencyMs\":%u", rRecord.id1, rRecord.value));
+					break;
+
+				case Type::CGIRequest:
+					rWriter.AddAsync("CGI", "b", tid, rRecord.timeNs, "connection" + std::to_string(rRecord.id1), MakeArgs("\"eventId\":%" PRId64 ",\"attempt\":%u", static_cast<int64_t> (rRecord.id0), rRecord.value));
+					break;
+
+				case Type::CGIResponse:
+					rWriter.AddAsync("CGI", "e", tid, rRecord.timeNs, "connection" + std::to_string(rRecord.id1), MakeArgs("\"status\":%u", rRecord.value));
+					break;
+
+				default:
+					break;
+			}
+		}
+
+		// Still running when dumped.
+		if (pTransfer)
+			rWriter.Add("Transfer", "B", tid, pTransfer->timeNs, MakeArgs("\"eventId\":%" PRIu64 ",\"footageIndex\":%" PRIu64, pTransfer->id0, pTransfer->id1));
+
+		if (pQuery)
+			rWriter.Add("DB query", "B", tid, pQuery->timeNs, MakeArgs("\"length\":%u", pQuery->value));
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s input.bin [output.json]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	FILE* pInput = fopen(argv[1], "rb");
+
+	if (!pInput)
+	{
+		fprintf(stderr, "Failed to open: \"%s\"\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	std::vector<Thread> threads;
+
+	const bool isRead = ReadDump(pInput, threads);
+
+	fclose(pInput);
+
+	if (!isRead)
+		return EXIT_FAILURE;
+
+	FILE* pOutput = (argc > 2) ? fopen(argv[2], "wb") : stdout;
+
+	if (!pOutput)
+	{
+		fprintf(stderr, "Failed to open: \"%s\"\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+
+	// Timestamps start from the oldest record.
+	U64 baseTimeNs = UINT64_MAX;
+	size_t numRecords = 0;
+
+	for (const auto& rThread : threads)
+	{
+		if (!rThread.records.empty())
+			baseTimeNs = std::min(baseTimeNs, rThread.records.front().timeNs);
+
+		numRecords += rThread.records.size();
+	}
+
+	if (baseTimeNs == UINT64_MAX)
+		baseTimeNs = 0;
+
+	{
+		Writer writer(pOutput, baseTimeNs);
+
+		for (const auto& rThread : threads)
+			WriteThread(writer, rThread);
+	}
+
+	if (pOutput != stdout)
+		fclose(pOutput);
+
+	fprintf(stderr, "%zu threads, %zu records.\n", threads.size(), numRecords);
+
+	return EXIT_SUCCESS;
+}
@@ -84,6 +84,8 @@ constexpr auto InvalidEventSessionId = U32_MAX;
 
 using AnalyticsSessionId = U32;
 
+constexpr auto InvalidAnalyticsSessionId = U32_MAX;
+
 using ClientId = U32; // TODO: Rename to FTPClientId ?
 
 using TimePoint = std::chrono::time_point<std::chrono::steady_clock>; // 8 bytes?
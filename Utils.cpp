@@ -9,6 +9,7 @@
 #endif
 
 #include <iomanip> // std::put_time, std::setw
+#include <string.h>	// memcpy
 
 #include "Utils.hpp"
 #include "Exception.hpp"
@@ -194,6 +195,110 @@ namespace Utils
 		return pText;
 	}
 
+	// XXH64 (https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md)
+	static constexpr U64 Prime64_1 = 0x9E3779B185EBCA87ULL;
+	static constexpr U64 Prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+	static constexpr U64 Prime64_3 = 0x165667B19E3779F9ULL;
+	static constexpr U64 Prime64_4 = 0x85EBCA77C2B2AE63ULL;
+	static constexpr U64 Prime64_5 = 0x27D4EB2F165667C5ULL;
+
+	static inline U64 RotateLeft(U64 value, int bits)
+	{
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	// NOTE: Unaligned little endian reads.
+	static inline U64 Read64(const U8* p)
+	{
+		U64 value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	static inline U32 Read32(const U8* p)
+	{
+		U32 value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	static inline U64 HashRound(U64 accumulator, U64 input)
+	{
+		accumulator += input * Prime64_2;
+		accumulator = RotateLeft(accumulator, 31);
+		return accumulator * Prime64_1;
+	}
+
+	static inline U64 HashMerge(U64 accumulator, U64 value)
+	{
+		accumulator ^= HashRound(0, value);
+		return accumulator * Prime64_1 + Prime64_4;
+	}
+
+	U64 Utils::Hash64(const void* pData, size_t size, U64 seed /* = 0 */)
+	{
+		const U8* p = static_cast<const U8*> (pData);
+		const U8* const pEnd = p + size;
+
+		U64 hash;
+
+		if (size >= 32)
+		{
+			U64 v1 = seed + Prime64_1 + Prime64_2;
+			U64 v2 = seed + Prime64_2;
+			U64 v3 = seed;
+			U64 v4 = seed - Prime64_1;
+
+			// Four independent lanes, 32 bytes per iteration.
+			for (const U8* const pLimit = pEnd - 32; p <= pLimit; p += 32)
+			{
+				v1 = HashRound(v1, Read64(p));
+				v2 = HashRound(v2, Read64(p + 8));
+				v3 = HashRound(v3, Read64(p + 16));
+				v4 = HashRound(v4, Read64(p + 24));
+			}
+
+			hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+
+			hash = HashMerge(hash, v1);
+			hash = HashMerge(hash, v2);
+			hash = HashMerge(hash, v3);
+			hash = HashMerge(hash, v4);
+		}
+		else
+			hash = seed + Prime64_5;
+
+		hash += static_cast<U64> (size);
+
+		for (; p + 8 <= pEnd; p += 8)
+		{
+			hash ^= HashRound(0, Read64(p));
+			hash = RotateLeft(hash, 27) * Prime64_1 + Prime64_4;
+		}
+
+		if (p + 4 <= pEnd)
+		{
+			hash ^= static_cast<U64> (Read32(p)) * Prime64_1;
+			hash = RotateLeft(hash, 23) * Prime64_2 + Prime64_3;
+			p += 4;
+		}
+
+		for (; p < pEnd; ++p)
+		{
+			hash ^= (*p) * Prime64_5;
+			hash = RotateLeft(hash, 11) * Prime64_1;
+		}
+
+		// Avalanche.
+		hash ^= hash >> 33;
+		hash *= Prime64_2;
+		hash ^= hash >> 29;
+		hash *= Prime64_3;
+		hash ^= hash >> 32;
+
+		return hash;
+	}
+
 	/*
 	//Gets the JPEG size from the array of data passed to the function, file reference: http://www.obrador.com/essentialjpeg/headerinfo.htm
 	static char get_jpeg_size(unsigned char* data, unsigned int data_size, unsigned short *width, unsigned short *height)
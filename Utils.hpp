@@ -17,6 +17,9 @@ namespace Utils
 
 	char* StripText(char* pBuffer, size_t length, size_t offset);
 
+	// Fast non-cryptographic hash of the content. (XXH64)
+	U64 Hash64(const void* pData, size_t size, U64 seed = 0);
+
 	// Converts any type of value (integer, char, etc) to a bitmask string.
 	// Sample:
 	// uint8_t		   value = 1 << 1;